@@ -0,0 +1,593 @@
+#include "AudioDSP.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+// MSVC accepts any intrinsic in any function, GCC and Clang need the target enabled per function
+#if defined(__GNUC__)
+    #define DSP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define DSP_TARGET_AVX2
+#endif
+
+namespace AudioDSP {
+    namespace {
+        // Fixed combination order of the eight accumulator lanes, shared by every implementation
+        float CombineLanes(const float* lanes) {
+            float t0 = lanes[0] + lanes[4];
+            float t1 = lanes[1] + lanes[5];
+            float t2 = lanes[2] + lanes[6];
+            float t3 = lanes[3] + lanes[7];
+            return (t0 + t2) + (t1 + t3);
+        }
+
+        // Same semantics as maxps: returns b when either value is NaN
+        float MaxOf(float a, float b) { return a > b ? a : b; }
+
+        float CombineMaxLanes(const float* lanes) {
+            float t0 = MaxOf(lanes[0], lanes[4]);
+            float t1 = MaxOf(lanes[1], lanes[5]);
+            float t2 = MaxOf(lanes[2], lanes[6]);
+            float t3 = MaxOf(lanes[3], lanes[7]);
+            return MaxOf(MaxOf(t0, t2), MaxOf(t1, t3));
+        }
+
+        float ClampUnit(float value) {
+            // Same NaN behaviour as maxps/minps: a NaN input becomes -1
+            value = value > -1.0f ? value : -1.0f;
+            return value < 1.0f ? value : 1.0f;
+        }
+
+        void DownmixGeneric(const float* input, std::size_t frames, std::uint32_t channels, float* output) {
+            float scale = 1.0f / static_cast<float>(channels);
+            for (std::size_t frame = 0; frame < frames; ++frame) {
+                float sum = 0.0f;
+                for (std::uint32_t channel = 0; channel < channels; ++channel) {
+                    sum += input[frame * channels + channel];
+                }
+                output[frame] = sum * scale;
+            }
+        }
+    }
+
+    namespace Scalar {
+        void DownmixToMono(const float* input, std::size_t frames, std::uint32_t channels, float* output) {
+            if (channels == 1) {
+                std::memcpy(output, input, frames * sizeof(float));
+            } else {
+                DownmixGeneric(input, frames, channels, output);
+            }
+        }
+
+        float DotProduct(const float* a, const float* b, std::size_t count) {
+            float lanes[8] = {};
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                for (std::size_t lane = 0; lane < 8; ++lane) {
+                    lanes[lane] += a[i + lane] * b[i + lane];
+                }
+            }
+
+            float sum = CombineLanes(lanes);
+            for (; i < count; ++i) {
+                sum += a[i] * b[i];
+            }
+            return sum;
+        }
+
+        float MeanSquare(const float* samples, std::size_t count) {
+            return count > 0 ? DotProduct(samples, samples, count) / static_cast<float>(count) : 0.0f;
+        }
+
+        float Peak(const float* samples, std::size_t count) {
+            float lanes[8] = {};
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                for (std::size_t lane = 0; lane < 8; ++lane) {
+                    lanes[lane] = MaxOf(std::fabs(samples[i + lane]), lanes[lane]);
+                }
+            }
+
+            float peak = CombineMaxLanes(lanes);
+            for (; i < count; ++i) {
+                peak = MaxOf(std::fabs(samples[i]), peak);
+            }
+            return peak;
+        }
+
+        std::size_t CountZeroCrossings(const float* samples, std::size_t count) {
+            std::size_t crossings = 0;
+            for (std::size_t i = 1; i < count; ++i) {
+                crossings += std::signbit(samples[i]) != std::signbit(samples[i - 1]) ? 1 : 0;
+            }
+            return crossings;
+        }
+
+        void ApplyGain(float* samples, std::size_t count, float gain) {
+            for (std::size_t i = 0; i < count; ++i) {
+                samples[i] *= gain;
+            }
+        }
+
+        void FloatToInt16(const float* input, std::int16_t* output, std::size_t count) {
+            for (std::size_t i = 0; i < count; ++i) {
+                output[i] = static_cast<std::int16_t>(std::nearbyint(ClampUnit(input[i]) * 32767.0f));
+            }
+        }
+
+        void Int16ToFloat(const std::int16_t* input, float* output, std::size_t count) {
+            for (std::size_t i = 0; i < count; ++i) {
+                output[i] = static_cast<float>(input[i]) * (1.0f / 32768.0f);
+            }
+        }
+
+        void DownmixStereo(const float* input, std::size_t frames, float* output) {
+            DownmixGeneric(input, frames, 2, output);
+        }
+    }
+
+    namespace {
+        namespace Sse2 {
+            void DownmixStereo(const float* input, std::size_t frames, float* output) {
+                const __m128 half = _mm_set1_ps(0.5f);
+                std::size_t frame = 0;
+                for (; frame + 4 <= frames; frame += 4) {
+                    __m128 a = _mm_loadu_ps(input + frame * 2);
+                    __m128 b = _mm_loadu_ps(input + frame * 2 + 4);
+                    __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+                    __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+                    _mm_storeu_ps(output + frame, _mm_mul_ps(_mm_add_ps(left, right), half));
+                }
+                DownmixGeneric(input + frame * 2, frames - frame, 2, output + frame);
+            }
+
+            float DotProduct(const float* a, const float* b, std::size_t count) {
+                __m128 low = _mm_setzero_ps();
+                __m128 high = _mm_setzero_ps();
+                std::size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                    high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+                }
+
+                alignas(16) float lanes[8];
+                _mm_store_ps(lanes, low);
+                _mm_store_ps(lanes + 4, high);
+
+                float sum = CombineLanes(lanes);
+                for (; i < count; ++i) {
+                    sum += a[i] * b[i];
+                }
+                return sum;
+            }
+
+            float Peak(const float* samples, std::size_t count) {
+                const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+                __m128 low = _mm_setzero_ps();
+                __m128 high = _mm_setzero_ps();
+                std::size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    low = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(samples + i), absMask), low);
+                    high = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(samples + i + 4), absMask), high);
+                }
+
+                alignas(16) float lanes[8];
+                _mm_store_ps(lanes, low);
+                _mm_store_ps(lanes + 4, high);
+
+                float peak = CombineMaxLanes(lanes);
+                for (; i < count; ++i) {
+                    peak = MaxOf(std::fabs(samples[i]), peak);
+                }
+                return peak;
+            }
+
+            std::size_t CountZeroCrossings(const float* samples, std::size_t count) {
+                std::size_t crossings = 0;
+                std::size_t i = 1;
+                for (; i + 4 <= count; i += 4) {
+                    int current = _mm_movemask_ps(_mm_loadu_ps(samples + i));
+                    int previous = _mm_movemask_ps(_mm_loadu_ps(samples + i - 1));
+                    crossings += std::popcount(static_cast<unsigned>(current ^ previous));
+                }
+                return crossings + Scalar::CountZeroCrossings(samples + i - 1, count > i ? count - i + 1 : 0);
+            }
+
+            void ApplyGain(float* samples, std::size_t count, float gain) {
+                const __m128 factor = _mm_set1_ps(gain);
+                std::size_t i = 0;
+                for (; i + 4 <= count; i += 4) {
+                    _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), factor));
+                }
+                Scalar::ApplyGain(samples + i, count - i, gain);
+            }
+
+            void FloatToInt16(const float* input, std::int16_t* output, std::size_t count) {
+                const __m128 lower = _mm_set1_ps(-1.0f);
+                const __m128 upper = _mm_set1_ps(1.0f);
+                const __m128 scale = _mm_set1_ps(32767.0f);
+                std::size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i), lower), upper), scale);
+                    __m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i + 4), lower), upper), scale);
+                    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+                }
+                Scalar::FloatToInt16(input + i, output + i, count - i);
+            }
+
+            void Int16ToFloat(const std::int16_t* input, float* output, std::size_t count) {
+                const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+                std::size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+                    // Sign-extend by placing each sample in the upper half of a 32-bit lane and shifting back down
+                    __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                    __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+                    _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+                    _mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+                }
+                Scalar::Int16ToFloat(input + i, output + i, count - i);
+            }
+        }
+
+        namespace Avx2 {
+            DSP_TARGET_AVX2 void DownmixStereo(const float* input, std::size_t frames, float* output) {
+                const __m256 half = _mm256_set1_ps(0.5f);
+                std::size_t frame = 0;
+                for (; frame + 8 <= frames; frame += 8) {
+                    __m256 a = _mm256_loadu_ps(input + frame * 2);
+                    __m256 b = _mm256_loadu_ps(input + frame * 2 + 8);
+                    // Shuffles work per 128-bit half, so the results come out as 0 1 4 5 | 2 3 6 7
+                    __m256 left = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+                    __m256 right = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+                    __m256 mixed = _mm256_mul_ps(_mm256_add_ps(left, right), half);
+                    mixed = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(mixed), _MM_SHUFFLE(3, 1, 2, 0)));
+                    _mm256_storeu_ps(output + frame, mixed);
+                }
+                _mm256_zeroupper();
+                Sse2::DownmixStereo(input + frame * 2, frames - frame, output + frame);
+            }
+
+            DSP_TARGET_AVX2 float DotProduct(const float* a, const float* b, std::size_t count) {
+                __m256 sum8 = _mm256_setzero_ps();
+                std::size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    sum8 = _mm256_add_ps(sum8, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+                }
+
+                alignas(32) float lanes[8];
+                _mm256_store_ps(lanes, sum8);
+                _mm256_zeroupper();
+
+                float sum = CombineLanes(lanes);
+                for (; i < count; ++i) {
+                    sum += a[i] * b[i];
+                }
+                return sum;
+            }
+
+            DSP_TARGET_AVX2 float Peak(const float* samples, std::size_t count) {
+                const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+                __m256 peak8 = _mm256_setzero_ps();
+                std::size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    peak8 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(samples + i), absMask), peak8);
+                }
+
+                alignas(32) float lanes[8];
+                _mm256_store_ps(lanes, peak8);
+                _mm256_zeroupper();
+
+                float peak = CombineMaxLanes(lanes);
+                for (; i < count; ++i) {
+                    peak = MaxOf(std::fabs(samples[i]), peak);
+                }
+                return peak;
+            }
+
+            DSP_TARGET_AVX2 std::size_t CountZeroCrossings(const float* samples, std::size_t count) {
+                std::size_t crossings = 0;
+                std::size_t i = 1;
+                for (; i + 8 <= count; i += 8) {
+                    int current = _mm256_movemask_ps(_mm256_loadu_ps(samples + i));
+                    int previous = _mm256_movemask_ps(_mm256_loadu_ps(samples + i - 1));
+                    crossings += std::popcount(static_cast<unsigned>(current ^ previous));
+                }
+                _mm256_zeroupper();
+                return crossings + Scalar::CountZeroCrossings(samples + i - 1, count > i ? count - i + 1 : 0);
+            }
+
+            DSP_TARGET_AVX2 void ApplyGain(float* samples, std::size_t count, float gain) {
+                const __m256 factor = _mm256_set1_ps(gain);
+                std::size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    _mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), factor));
+                }
+                _mm256_zeroupper();
+                Scalar::ApplyGain(samples + i, count - i, gain);
+            }
+
+            DSP_TARGET_AVX2 void FloatToInt16(const float* input, std::int16_t* output, std::size_t count) {
+                const __m256 lower = _mm256_set1_ps(-1.0f);
+                const __m256 upper = _mm256_set1_ps(1.0f);
+                const __m256 scale = _mm256_set1_ps(32767.0f);
+                std::size_t i = 0;
+                for (; i + 16 <= count; i += 16) {
+                    __m256 a = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(input + i), lower), upper), scale);
+                    __m256 b = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(input + i + 8), lower), upper), scale);
+                    // Packing works per 128-bit half as well: a0-3 b0-3 | a4-7 b4-7
+                    __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+                    packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), packed);
+                }
+                _mm256_zeroupper();
+                Sse2::FloatToInt16(input + i, output + i, count - i);
+            }
+
+            DSP_TARGET_AVX2 void Int16ToFloat(const std::int16_t* input, float* output, std::size_t count) {
+                const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+                std::size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)));
+                    _mm256_storeu_ps(output + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+                }
+                _mm256_zeroupper();
+                Scalar::Int16ToFloat(input + i, output + i, count - i);
+            }
+        }
+
+        constexpr Kernels kScalarKernels = {Scalar::DownmixStereo,      Scalar::DotProduct, Scalar::Peak,
+                                            Scalar::CountZeroCrossings, Scalar::ApplyGain,  Scalar::FloatToInt16,
+                                            Scalar::Int16ToFloat};
+        constexpr Kernels kSse2Kernels = {Sse2::DownmixStereo,      Sse2::DotProduct, Sse2::Peak,
+                                          Sse2::CountZeroCrossings, Sse2::ApplyGain,  Sse2::FloatToInt16,
+                                          Sse2::Int16ToFloat};
+        constexpr Kernels kAvx2Kernels = {Avx2::DownmixStereo,      Avx2::DotProduct, Avx2::Peak,
+                                          Avx2::CountZeroCrossings, Avx2::ApplyGain,  Avx2::FloatToInt16,
+                                          Avx2::Int16ToFloat};
+
+        std::atomic<Level>& CurrentLevel() {
+            static std::atomic<Level> level{DetectLevel()};
+            return level;
+        }
+
+        const Kernels& Current() { return GetKernels(CurrentLevel().load(std::memory_order_relaxed)); }
+
+        // Deterministic test signal that also exceeds [-1, 1] to exercise clamping
+        std::vector<float> MakeTestSignal(std::size_t count) {
+            std::vector<float> signal(count);
+            std::uint32_t seed = 0x4D414E54;
+            for (float& sample : signal) {
+                seed = seed * 1664525u + 1013904223u;
+                sample = (static_cast<float>(seed >> 8) / 16777216.0f) * 3.0f - 1.5f;
+            }
+            return signal;
+        }
+
+        bool Matches(const Kernels& kernels) {
+            constexpr std::size_t kSizes[] = {0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 64, 333, 1024};
+
+            std::vector<float> signal = MakeTestSignal(2048 + 3);
+            std::vector<float> other = MakeTestSignal(2048 + 3 + 17);
+            other.erase(other.begin(), other.begin() + 17);
+
+            for (std::size_t size : kSizes) {
+                // Odd offsets make sure unaligned input is handled the same way
+                const float* a = signal.data() + 3;
+                const float* b = other.data() + 1;
+
+                float expectedDot = Scalar::DotProduct(a, b, size);
+                float actualDot = kernels.dotProduct(a, b, size);
+                float expectedPeak = Scalar::Peak(a, size);
+                float actualPeak = kernels.peak(a, size);
+                if (std::memcmp(&expectedDot, &actualDot, sizeof(float)) != 0 ||
+                    std::memcmp(&expectedPeak, &actualPeak, sizeof(float)) != 0 ||
+                    Scalar::CountZeroCrossings(a, size) != kernels.zeroCrossings(a, size)) {
+                    return false;
+                }
+
+                std::vector<float> expected(a, a + size);
+                std::vector<float> actual(a, a + size);
+                Scalar::ApplyGain(expected.data(), size, 0.7f);
+                kernels.applyGain(actual.data(), size, 0.7f);
+                if (std::memcmp(expected.data(), actual.data(), size * sizeof(float)) != 0) {
+                    return false;
+                }
+
+                Scalar::DownmixStereo(a, size / 2, expected.data());
+                kernels.downmixStereo(a, size / 2, actual.data());
+                if (std::memcmp(expected.data(), actual.data(), (size / 2) * sizeof(float)) != 0) {
+                    return false;
+                }
+
+                std::vector<std::int16_t> expectedPcm(size);
+                std::vector<std::int16_t> actualPcm(size);
+                Scalar::FloatToInt16(a, expectedPcm.data(), size);
+                kernels.floatToInt16(a, actualPcm.data(), size);
+                if (expectedPcm != actualPcm) {
+                    return false;
+                }
+
+                Scalar::Int16ToFloat(expectedPcm.data(), expected.data(), size);
+                kernels.int16ToFloat(expectedPcm.data(), actual.data(), size);
+                if (std::memcmp(expected.data(), actual.data(), size * sizeof(float)) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    Level DetectLevel() {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return Level::kSSE2;
+        }
+
+        __cpuidex(info, 1, 0);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        // The OS must save the YMM registers on context switches
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+            return Level::kSSE2;
+        }
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0 ? Level::kAVX2 : Level::kSSE2;
+#else
+        return __builtin_cpu_supports("avx2") ? Level::kAVX2 : Level::kSSE2;
+#endif
+    }
+
+    Level GetLevel() { return CurrentLevel().load(std::memory_order_relaxed); }
+
+    void SetLevel(Level level) { CurrentLevel().store(std::min(level, DetectLevel()), std::memory_order_relaxed); }
+
+    const char* GetLevelName(Level level) {
+        switch (level) {
+            case Level::kAVX2:
+                return "AVX2";
+            case Level::kSSE2:
+                return "SSE2";
+            default:
+                return "scalar";
+        }
+    }
+
+    const Kernels& GetKernels(Level level) {
+        switch (level) {
+            case Level::kAVX2:
+                return kAvx2Kernels;
+            case Level::kSSE2:
+                return kSse2Kernels;
+            default:
+                return kScalarKernels;
+        }
+    }
+
+    bool VerifyKernels() {
+        Level level = GetLevel();
+        bool matched = true;
+        while (level != Level::kScalar && !Matches(GetKernels(level))) {
+            level = static_cast<Level>(static_cast<int>(level) - 1);
+            matched = false;
+        }
+        CurrentLevel().store(level, std::memory_order_relaxed);
+        return matched;
+    }
+
+    void DownmixToMono(const float* input, std::size_t frames, std::uint32_t channels, float* output) {
+        if (channels == 2) {
+            Current().downmixStereo(input, frames, output);
+        } else {
+            Scalar::DownmixToMono(input, frames, channels, output);
+        }
+    }
+
+    float DotProduct(const float* a, const float* b, std::size_t count) { return Current().dotProduct(a, b, count); }
+
+    float MeanSquare(const float* samples, std::size_t count) {
+        return count > 0 ? DotProduct(samples, samples, count) / static_cast<float>(count) : 0.0f;
+    }
+
+    float Peak(const float* samples, std::size_t count) { return Current().peak(samples, count); }
+
+    void PeakEnvelope(const float* samples, std::size_t count, std::size_t blockSize, float* output) {
+        const Kernels& kernels = Current();
+        for (std::size_t offset = 0; offset < count; offset += blockSize) {
+            *output++ = kernels.peak(samples + offset, std::min(blockSize, count - offset));
+        }
+    }
+
+    std::size_t CountZeroCrossings(const float* samples, std::size_t count) {
+        return Current().zeroCrossings(samples, count);
+    }
+
+    void ApplyGain(float* samples, std::size_t count, float gain) { Current().applyGain(samples, count, gain); }
+
+    float Normalize(float* samples, std::size_t count, float targetPeak, float maxGain) {
+        float peak = Peak(samples, count);
+        if (!(peak > 0.0f)) {
+            return 1.0f;  // Silence, nothing to normalize
+        }
+
+        float gain = std::min(targetPeak / peak, maxGain);
+        ApplyGain(samples, count, gain);
+        return gain;
+    }
+
+    void FloatToInt16(const float* input, std::int16_t* output, std::size_t count) {
+        Current().floatToInt16(input, output, count);
+    }
+
+    void Int16ToFloat(const std::int16_t* input, float* output, std::size_t count) {
+        Current().int16ToFloat(input, output, count);
+    }
+
+    void Resampler::Configure(std::uint32_t inputRate, std::uint32_t outputRate) {
+        _step = static_cast<double>(inputRate) / static_cast<double>(outputRate);
+
+        // Cut off a little below the Nyquist frequency of the lower of the two rates
+        double cutoff = 0.45 * std::min(inputRate, outputRate) / static_cast<double>(inputRate);
+        double center = (kTaps - 1) / 2.0;
+
+        _kernel.assign(kTaps, 0.0f);
+        double sum = 0.0;
+        for (std::size_t n = 0; n < kTaps; ++n) {
+            double x = static_cast<double>(n) - center;
+            double sinc = x == 0.0 ? 2.0 * cutoff
+                                   : std::sin(2.0 * std::numbers::pi * cutoff * x) / (std::numbers::pi * x);
+            double phase = 2.0 * std::numbers::pi * static_cast<double>(n) / (kTaps - 1);
+            double blackman = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+            _kernel[n] = static_cast<float>(sinc * blackman);
+            sum += sinc * blackman;
+        }
+        for (float& tap : _kernel) {
+            tap = static_cast<float>(tap / sum);
+        }
+
+        Reset();
+    }
+
+    void Resampler::Reset() {
+        _history.assign(kTaps - 1, 0.0f);
+        _position = static_cast<double>(kTaps - 1);
+    }
+
+    float Resampler::Filtered(std::size_t index) const {
+        // The kernel is symmetric, so it doesn't need to be reversed for the convolution
+        return DotProduct(_history.data() + index - (kTaps - 1), _kernel.data(), kTaps);
+    }
+
+    void Resampler::Process(const float* input, std::size_t count, std::vector<float>& output) {
+        _history.insert(_history.end(), input, input + count);
+
+        while (_position + 1.0 < static_cast<double>(_history.size())) {
+            std::size_t index = static_cast<std::size_t>(_position);
+            float fraction = static_cast<float>(_position - static_cast<double>(index));
+            float current = Filtered(index);
+            float next = Filtered(index + 1);
+            output.push_back(current + (next - current) * fraction);
+            _position += _step;
+        }
+
+        // Drop the input that is no longer needed, keeping the filter's look-back window
+        std::size_t consumed = std::min(static_cast<std::size_t>(_position), _history.size()) - (kTaps - 1);
+        if (consumed > 0) {
+            _history.erase(_history.begin(), _history.begin() + static_cast<std::ptrdiff_t>(consumed));
+            _position -= static_cast<double>(consumed);
+        }
+    }
+}
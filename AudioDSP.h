@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* Audio processing kernels for the voice pipeline
+*
+* Every kernel has a plain C++ version in AudioDSP::Scalar that defines the exact result, plus SSE2 and
+* AVX2 versions. Reductions are accumulated in eight interleaved lanes and combined in a fixed order,
+* so all versions produce bit-identical output. The top-level functions call the best version the CPU
+* supports; VerifyKernels() checks that against the scalar versions once at startup.
+**/
+namespace AudioDSP {
+    enum class Level {
+        kScalar,
+        kSSE2,
+        kAVX2
+    };
+
+    // Highest level supported by this CPU and operating system
+    Level DetectLevel();
+    // Level used by the top-level functions. Defaults to DetectLevel(), can be lowered for troubleshooting.
+    Level GetLevel();
+    void SetLevel(Level level);
+    const char* GetLevelName(Level level);
+
+    // Run every kernel of the current level against the scalar versions on a fixed test signal and step
+    // down a level until the results match bit for bit. Returns false if it had to step down.
+    bool VerifyKernels();
+
+    // Average all channels of interleaved float samples into one mono channel
+    void DownmixToMono(const float* input, std::size_t frames, std::uint32_t channels, float* output);
+
+    float DotProduct(const float* a, const float* b, std::size_t count);
+    float MeanSquare(const float* samples, std::size_t count);
+
+    // Largest absolute sample value
+    float Peak(const float* samples, std::size_t count);
+    // Peak of every block of blockSize samples (the last block may be shorter), for lip-sync amplitude
+    void PeakEnvelope(const float* samples, std::size_t count, std::size_t blockSize, float* output);
+    // Number of neighbouring samples with different sign bits, a cheap measure of how noisy a block is
+    std::size_t CountZeroCrossings(const float* samples, std::size_t count);
+
+    void ApplyGain(float* samples, std::size_t count, float gain);
+    // Scale samples so their peak reaches targetPeak, amplifying by at most maxGain. Returns the gain used.
+    float Normalize(float* samples, std::size_t count, float targetPeak, float maxGain);
+
+    // Clamp to [-1, 1] and scale to 16-bit, rounding to nearest even
+    void FloatToInt16(const float* input, std::int16_t* output, std::size_t count);
+    void Int16ToFloat(const std::int16_t* input, float* output, std::size_t count);
+
+    // One set of kernels for a single instruction set level
+    struct Kernels {
+        void (*downmixStereo)(const float* input, std::size_t frames, float* output);
+        float (*dotProduct)(const float* a, const float* b, std::size_t count);
+        float (*peak)(const float* samples, std::size_t count);
+        std::size_t (*zeroCrossings)(const float* samples, std::size_t count);
+        void (*applyGain)(float* samples, std::size_t count, float gain);
+        void (*floatToInt16)(const float* input, std::int16_t* output, std::size_t count);
+        void (*int16ToFloat)(const std::int16_t* input, float* output, std::size_t count);
+    };
+
+    const Kernels& GetKernels(Level level);
+
+    namespace Scalar {
+        void DownmixToMono(const float* input, std::size_t frames, std::uint32_t channels, float* output);
+        float DotProduct(const float* a, const float* b, std::size_t count);
+        float MeanSquare(const float* samples, std::size_t count);
+        float Peak(const float* samples, std::size_t count);
+        std::size_t CountZeroCrossings(const float* samples, std::size_t count);
+        void ApplyGain(float* samples, std::size_t count, float gain);
+        void FloatToInt16(const float* input, std::int16_t* output, std::size_t count);
+        void Int16ToFloat(const std::int16_t* input, float* output, std::size_t count);
+    }
+
+    /**
+    * Streaming sample rate converter
+    *
+    * A windowed-sinc low-pass filter removes everything above the output band, then the filtered
+    * signal is linearly interpolated at the output rate. Good enough for speech recognition input.
+    **/
+    class Resampler {
+    public:
+        void Configure(std::uint32_t inputRate, std::uint32_t outputRate);
+        void Reset();
+
+        // Resample the next block of mono input and append the result to output
+        void Process(const float* input, std::size_t count, std::vector<float>& output);
+
+    private:
+        float Filtered(std::size_t index) const;
+
+        static constexpr std::size_t kTaps = 48;
+
+        std::vector<float> _kernel;
+        std::vector<float> _history;
+        double _step = 1.0;
+        double _position = 0.0;
+    };
+}
@@ -0,0 +1,204 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <numeric>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <atomic>
+    #include <iomanip>
+    #include <sstream>
+    #include <thread>
+
+    #include "AudioDSP.h"
+    #include "Channel.h"
+    #include "Launcher.h"
+    #include "MainThread.h"
+    #include "Metrics.h"
+    #include "Settings.h"
+    #include "Status.h"
+#endif
+
+namespace Benchmark {
+    Summary Summarize(std::vector<double> samples) {
+        Summary summary;
+        if (samples.empty()) {
+            return summary;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) {
+            double rank = p * static_cast<double>(samples.size() - 1);
+            auto lower = static_cast<std::size_t>(rank);
+            std::size_t upper = std::min(lower + 1, samples.size() - 1);
+            return samples[lower] + (samples[upper] - samples[lower]) * (rank - static_cast<double>(lower));
+        };
+        summary.count = samples.size();
+        summary.min = samples.front();
+        summary.p50 = percentile(0.5);
+        summary.p90 = percentile(0.9);
+        summary.p99 = percentile(0.99);
+        summary.max = samples.back();
+        summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size());
+        return summary;
+    }
+
+    std::optional<Result> Session::RunOnce(const Script& script, bool warmup, std::chrono::milliseconds timeout,
+                                           double& roundTripMs) {
+        std::unique_lock guard(_lock);
+        std::uint32_t runId = _nextRunId++;
+        _waitingFor = runId;
+        _result.reset();
+
+        Json::Writer json;
+        json.BeginObject()
+            .Field("type", "benchmark_run")
+            .Field("run_id", runId)
+            .Field("warmup", warmup)
+            .Field("audio", script.audio)
+            .Field("prompt", script.prompt)
+            .Field("voice", script.voice)
+            .EndObject();
+        std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+        _send(json.Take());
+
+        bool received = _answered.wait_for(guard, timeout, [&] { return _result.has_value(); });
+        roundTripMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count();
+        _waitingFor = 0;
+        if (!received) {
+            return std::nullopt;
+        }
+        return std::move(_result);
+    }
+
+    void Session::OnResult(const Json::Value& message) {
+        Result result;
+        result.error = message["error"].GetString();
+        for (std::size_t i = 0; i < kStageCount; ++i) {
+            result.stageMs[i] = message[std::string(kColumns[i]) + "_ms"].GetDouble();
+        }
+
+        std::lock_guard guard(_lock);
+        if (static_cast<std::uint32_t>(message["run_id"].GetUInt()) != _waitingFor) {
+            return;  // Answer to a run that already timed out
+        }
+        _result = std::move(result);
+        _answered.notify_one();
+    }
+
+    void Samples::Add(const Result& result, double roundTripMs) {
+        for (std::size_t i = 0; i < kStageCount; ++i) {
+            _columns[i].push_back(result.stageMs[i]);
+        }
+        // The first-token and first-audio times are contained in the full LLM and TTS times
+        double stagesMs = result.stageMs[0] + result.stageMs[2] + result.stageMs[4];
+        _columns[kOverhead].push_back(std::max(roundTripMs - stagesMs, 0.0));
+        _columns[kRoundTrip].push_back(roundTripMs);
+    }
+
+#ifdef _WIN32
+    namespace {
+        constexpr const wchar_t* kDefaultPrompt =
+            L"Greetings, traveler. What news do you bring from Whiterun, and is it true that a dragon was seen "
+            L"near the Western Watchtower?";
+
+        struct State {
+            std::atomic<bool> running{false};
+            Session session{[](std::string message) { Channel::Send(std::move(message)); }};
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        void Report(const Samples& samples) {
+            Status::Snapshot status = Status::Get();
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(1) << "Mantella benchmark: " << samples.Get(kRoundTrip).size()
+               << " runs, " << std::thread::hardware_concurrency() << " hardware threads, "
+               << AudioDSP::GetLevelName(AudioDSP::GetLevel()) << ", Mantella " << Status::GetStateName(status.state)
+               << " (launch took " << status.launchMs << " ms)";
+            PrintToConsole(ss.str());
+
+            for (std::size_t column = 0; column < kColumns.size(); ++column) {
+                for (double ms : samples.Get(column)) {
+                    Metrics::RecordLatency(std::string("benchmark.") + kColumns[column], ms);
+                }
+                Summary summary = Summarize(samples.Get(column));
+                ss.str({});
+                ss << "  " << std::left << std::setw(16) << kColumns[column] << std::right << " p50 " << std::setw(8)
+                   << summary.p50 << "  p90 " << std::setw(8) << summary.p90 << "  p99 " << std::setw(8) << summary.p99
+                   << "  min " << std::setw(8) << summary.min << "  max " << std::setw(8) << summary.max << " ms";
+                PrintToConsole(ss.str());
+            }
+
+            // Lets an MCM page show the headline number
+            double median = Summarize(samples.Get(kRoundTrip)).p50;
+            MainThread::SendModEvent("Mantella_BenchmarkDone", {}, static_cast<float>(median));
+        }
+
+        void Run(int runs, int warmupRuns) {
+            State& state = GetState();
+            Script script;
+            script.audio = WideStringToString(Settings::GetString(L"Benchmark", L"sAudioFile", L"").c_str());
+            script.prompt = WideStringToString(Settings::GetString(L"Benchmark", L"sPrompt", kDefaultPrompt).c_str());
+            script.voice = WideStringToString(Settings::GetString(L"Benchmark", L"sVoice", L"MaleNord").c_str());
+            std::chrono::seconds timeout(std::max(Settings::GetInt(L"Benchmark", L"iTimeoutSeconds", 120), 1));
+
+            Samples samples;
+            for (int run = 0; run < warmupRuns + runs; ++run) {
+                bool warmup = run < warmupRuns;
+                double roundTripMs = 0.0;
+                std::optional<Result> result = state.session.RunOnce(script, warmup, timeout, roundTripMs);
+                if (!result || !result->error.empty()) {
+                    std::stringstream ss;
+                    ss << "Mantella benchmark stopped at run " << run + 1 << ": "
+                       << (result ? result->error : "no answer within " + std::to_string(timeout.count()) + " s");
+                    PrintToConsole(ss.str());
+                    state.running = false;
+                    return;
+                }
+                if (!warmup) {
+                    samples.Add(*result, roundTripMs);
+                }
+            }
+
+            Report(samples);
+            state.running = false;
+        }
+
+        bool RunMantellaBenchmarkPapyrus(RE::StaticFunctionTag*, std::int32_t runs, std::int32_t warmupRuns) {
+            return Start(runs, warmupRuns);
+        }
+    }
+
+    void Install() {
+        Channel::RegisterHandler("benchmark_result", [](Json::Value message) { GetState().session.OnResult(message); });
+    }
+
+    bool Start(int runs, int warmupRuns) {
+        if (!Channel::IsConnected()) {
+            PrintToConsole("Mantella is not connected, start a benchmark once it is running.");
+            return false;
+        }
+        State& state = GetState();
+        if (state.running.exchange(true)) {
+            PrintToConsole("A Mantella benchmark is already running.");
+            return false;
+        }
+
+        runs = std::clamp(runs, 1, 1000);
+        warmupRuns = std::clamp(warmupRuns, 0, 100);
+        std::stringstream ss;
+        ss << "Running the Mantella benchmark: " << warmupRuns << " warm-up and " << runs << " measured runs.";
+        PrintToConsole(ss.str());
+        std::thread(Run, runs, warmupRuns).detach();
+        return true;
+    }
+
+    bool Register(RE::BSScript::IVirtualMachine* vm) {
+        vm->RegisterFunction("RunMantellaBenchmark", "MantellaLauncher", RunMantellaBenchmarkPapyrus);
+        return true;
+    }
+#endif
+}
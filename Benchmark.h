@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Json.h"
+
+/**
+* Self-benchmark of the whole conversation loop
+*
+* When a player reports that Mantella is slow, RunMantellaBenchmark() (from the MCM, or from the console
+* with cgf "MantellaLauncher.RunMantellaBenchmark" 10 2) plays a scripted conversation: the same audio
+* clip, prompt and voice every time. Each run asks Mantella over the channel to transcribe the clip,
+* answer the prompt and synthesize the reply, and Mantella reports how long each stage took. The plugin
+* adds the round trip it saw, so what is left after the stages is the channel and Mantella's own glue.
+* After the warm-up runs, the percentiles of every stage are printed to the console together with the
+* launch time, so numbers from different machines can be compared. They are also recorded as
+* "benchmark.<stage>".
+*
+* Session and Samples don't depend on the channel, so the tests run the same loop against a stand-in Mantella.
+**/
+namespace Benchmark {
+    struct Summary {
+        std::size_t count = 0;
+        double min = 0.0;
+        double p50 = 0.0;
+        double p90 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+        double mean = 0.0;
+    };
+
+    // Percentiles interpolated between the nearest ranks, the benchmark has too few samples for histograms
+    Summary Summarize(std::vector<double> samples);
+
+    // Stages as reported by Mantella in benchmark_result, in "<stage>_ms" fields
+    inline constexpr std::size_t kStageCount = 5;
+    // Followed by what the plugin measures itself
+    inline constexpr std::size_t kOverhead = kStageCount;
+    inline constexpr std::size_t kRoundTrip = kStageCount + 1;
+    inline constexpr std::array<const char*, kStageCount + 2> kColumns = {
+        "stt", "llm_first_token", "llm", "tts_first_audio", "tts", "overhead", "round_trip"};
+
+    // The scripted conversation, the same for every run
+    struct Script {
+        std::string audio;  // empty for the clip that comes with Mantella
+        std::string prompt;
+        std::string voice;
+    };
+
+    struct Result {
+        std::string error;
+        std::array<double, kStageCount> stageMs{};
+    };
+
+    // Asks for one run at a time and matches the answer to it by run id
+    class Session {
+    public:
+        using Send = std::function<void(std::string message)>;
+
+        explicit Session(Send send) : _send(std::move(send)) {}
+
+        // Send a benchmark_run and wait for its benchmark_result. Returns nothing on timeout; roundTripMs is
+        // the time from sending until the answer or the timeout.
+        std::optional<Result> RunOnce(const Script& script, bool warmup, std::chrono::milliseconds timeout,
+                                      double& roundTripMs);
+
+        // Handler for benchmark_result, on any thread. Answers to runs that timed out are ignored.
+        void OnResult(const Json::Value& message);
+
+    private:
+        Send _send;
+        std::mutex _lock;
+        std::condition_variable _answered;
+        std::uint32_t _nextRunId = 1;
+        std::uint32_t _waitingFor = 0;
+        std::optional<Result> _result;
+    };
+
+    // The samples of every column over the measured runs
+    class Samples {
+    public:
+        void Add(const Result& result, double roundTripMs);
+
+        const std::vector<double>& Get(std::size_t column) const { return _columns[column]; }
+
+    private:
+        std::array<std::vector<double>, kColumns.size()> _columns;
+    };
+
+#ifdef _WIN32
+    // Listen for Mantella's results. Call once at kDataLoaded.
+    void Install();
+
+    // Start runs measured runs after warmupRuns unmeasured ones on a background thread.
+    // Returns false if Mantella isn't connected or a benchmark is already running.
+    bool Start(int runs, int warmupRuns);
+
+    // Register the natives on the MantellaLauncher script
+    bool Register(RE::BSScript::IVirtualMachine* vm);
+#endif
+}
@@ -0,0 +1,250 @@
+#include "Catalog.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <chrono>
+    #include <filesystem>
+    #include <sstream>
+
+    #include "Channel.h"
+    #include "Json.h"
+    #include "Launcher.h"
+    #include "Metrics.h"
+    #include "Settings.h"
+    #include "WorkerPool.h"
+#endif
+
+namespace Catalog {
+    namespace {
+        template <class T>
+        void SortByFormId(std::vector<T>& records) {
+            std::sort(records.begin(), records.end(), [](const T& a, const T& b) { return a.formId < b.formId; });
+        }
+
+        // Lay out a section for the items of a table or the string pool, size being the file size so far
+        template <class Items>
+        Section Reserve(std::size_t& size, const Items& items) {
+            Section section = {static_cast<std::uint32_t>(size), static_cast<std::uint32_t>(items.size())};
+            size += items.size() * sizeof(*items.data());
+            return section;
+        }
+
+        template <class Items>
+        void Copy(std::vector<std::byte>& file, const Section& section, const Items& items) {
+            if (!items.empty()) {
+                std::memcpy(file.data() + section.offset, items.data(), items.size() * sizeof(*items.data()));
+            }
+        }
+    }
+
+    std::vector<std::byte> Serialize(Tables& tables, std::int64_t builtAt) {
+        SortByFormId(tables.actors);
+        SortByFormId(tables.voiceTypes);
+        SortByFormId(tables.races);
+        SortByFormId(tables.factions);
+        SortByFormId(tables.locations);
+
+        Header header = {};
+        header.magic = Header::kMagic;
+        header.version = Header::kVersion;
+        header.builtAt = builtAt;
+        // Sized once and copied into, rather than grown section by section
+        std::size_t size = sizeof(Header);
+        header.actors = Reserve(size, tables.actors);
+        header.voiceTypes = Reserve(size, tables.voiceTypes);
+        header.races = Reserve(size, tables.races);
+        header.factions = Reserve(size, tables.factions);
+        header.locations = Reserve(size, tables.locations);
+        header.factionRanks = Reserve(size, tables.factionRanks);
+        header.strings = Reserve(size, tables.strings);
+
+        std::vector<std::byte> file(size);
+        std::memcpy(file.data(), &header, sizeof(header));
+        Copy(file, header.actors, tables.actors);
+        Copy(file, header.voiceTypes, tables.voiceTypes);
+        Copy(file, header.races, tables.races);
+        Copy(file, header.factions, tables.factions);
+        Copy(file, header.locations, tables.locations);
+        Copy(file, header.factionRanks, tables.factionRanks);
+        Copy(file, header.strings, tables.strings);
+        return file;
+    }
+
+#ifdef _WIN32
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr std::size_t kChunkSize = 1024;  // actor records per pool job
+
+        // Actors of one chunk, with string and faction rank offsets relative to the chunk
+        struct Part {
+            std::vector<Actor> actors;
+            std::vector<FactionRank> ranks;
+            std::string strings;
+        };
+
+        // Offset of text in the pool, 0 for an empty name since every pool starts with an empty string
+        std::uint32_t AddString(std::string& pool, const char* text) {
+            if (!text || *text == '\0') {
+                return 0;
+            }
+            auto offset = static_cast<std::uint32_t>(pool.size());
+            pool += text;
+            pool += '\0';
+            return offset;
+        }
+
+        RE::FormID GetFormId(const RE::TESForm* form) { return form ? form->GetFormID() : 0; }
+
+        void CollectActors(const RE::BSTArray<RE::TESNPC*>& npcs, std::size_t chunk, Part& part) {
+            part.strings.assign(1, '\0');
+            std::size_t end = std::min(npcs.size(), (chunk + 1) * kChunkSize);
+            for (std::size_t i = chunk * kChunkSize; i < end; ++i) {
+                const RE::TESNPC* npc = npcs[static_cast<std::uint32_t>(i)];
+                if (!npc) {
+                    continue;
+                }
+
+                Actor actor = {};
+                actor.formId = npc->GetFormID();
+                actor.name = AddString(part.strings, npc->GetName());
+                actor.race = GetFormId(npc->race);
+                actor.voiceType = GetFormId(npc->voiceType);
+                actor.firstFactionRank = static_cast<std::uint32_t>(part.ranks.size());
+                for (const RE::FACTION_RANK& rank : npc->factions) {
+                    if (rank.faction) {
+                        part.ranks.push_back({rank.faction->GetFormID(), rank.rank});
+                    }
+                }
+                actor.factionRankCount = static_cast<std::uint16_t>(part.ranks.size() - actor.firstFactionRank);
+                actor.flags = static_cast<std::uint16_t>((npc->IsFemale() ? Actor::kFemale : 0) |
+                                                         (npc->IsUnique() ? Actor::kUnique : 0) |
+                                                         (npc->IsEssential() ? Actor::kEssential : 0));
+                part.actors.push_back(actor);
+            }
+        }
+
+        template <class T, class Function>
+        std::vector<NamedForm> CollectNamed(std::string& strings, Function&& getName) {
+            std::vector<NamedForm> records;
+            for (const T* form : RE::TESDataHandler::GetSingleton()->GetFormArray<T>()) {
+                if (form) {
+                    records.push_back({form->GetFormID(), AddString(strings, getName(form))});
+                }
+            }
+            return records;
+        }
+
+        // Remove the catalogs of earlier sessions. One that Mantella still maps stays until the next time.
+        void RemoveOldCatalogs(const std::filesystem::path& current) {
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(current.parent_path(), error)) {
+                std::wstring name = entry.path().filename().wstring();
+                if (entry.path() != current && name.starts_with(L"catalog") && name.ends_with(L".bin")) {
+                    std::filesystem::remove(entry.path(), error);
+                }
+            }
+        }
+
+        // Stops early, without writing anything, when the job is cancelled
+        void Build(WorkerPool::Job& job, std::wstring path, std::int64_t builtAt) {
+            Clock::time_point start = Clock::now();
+            RE::TESDataHandler* dataHandler = RE::TESDataHandler::GetSingleton();
+
+            // Actor records dominate, so they are collected in parallel chunks
+            const RE::BSTArray<RE::TESNPC*>& npcs = dataHandler->GetFormArray<RE::TESNPC>();
+            std::vector<Part> parts((npcs.size() + kChunkSize - 1) / kChunkSize);
+            bool collected = WorkerPool::ParallelFor(
+                "catalog_actors", parts.size(), [&](std::size_t chunk) { CollectActors(npcs, chunk, parts[chunk]); },
+                &job);
+            if (!collected || !job.Checkpoint()) {
+                return;
+            }
+
+            Tables tables;
+            std::string& strings = tables.strings;
+            tables.voiceTypes = CollectNamed<RE::BGSVoiceType>(
+                strings, [](const RE::BGSVoiceType* form) { return form->GetFormEditorID(); });
+            tables.races =
+                CollectNamed<RE::TESRace>(strings, [](const RE::TESRace* form) { return form->GetName(); });
+            tables.factions =
+                CollectNamed<RE::TESFaction>(strings, [](const RE::TESFaction* form) { return form->GetName(); });
+            for (const RE::BGSLocation* location : dataHandler->GetFormArray<RE::BGSLocation>()) {
+                if (location) {
+                    tables.locations.push_back({location->GetFormID(), AddString(strings, location->GetName()),
+                                                GetFormId(location->parentLoc)});
+                }
+            }
+
+            if (!job.Checkpoint()) {
+                return;
+            }
+
+            // Stitch the chunks together, moving their offsets behind what came before them
+            for (Part& part : parts) {
+                auto stringBase = static_cast<std::uint32_t>(strings.size());
+                auto rankBase = static_cast<std::uint32_t>(tables.factionRanks.size());
+                for (Actor& actor : part.actors) {
+                    actor.name = actor.name != 0 ? actor.name + stringBase : 0;
+                    actor.firstFactionRank += rankBase;
+                }
+                tables.actors.insert(tables.actors.end(), part.actors.begin(), part.actors.end());
+                tables.factionRanks.insert(tables.factionRanks.end(), part.ranks.begin(), part.ranks.end());
+                strings += part.strings;
+            }
+            std::vector<std::byte> file = Serialize(tables, builtAt);
+            if (!job.Checkpoint()) {
+                return;
+            }
+
+            // Written next to the final name and then renamed, so Mantella never maps a partial catalog
+            std::error_code error;
+            std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+            if (!WriteWholeFile(path, file)) {
+                DWORD lastError = GetLastError();
+                std::stringstream ss;
+                ss << "Failed to write the Mantella catalog. Error: " << lastError;
+                PrintToConsole(ss.str());
+                return;
+            }
+            RemoveOldCatalogs(path);
+
+            Metrics::RecordLatency("catalog.build",
+                                   std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            Metrics::SetGauge("catalog.actors", static_cast<std::int64_t>(tables.actors.size()));
+            Metrics::SetGauge("catalog.bytes", static_cast<std::int64_t>(file.size()));
+
+            Json::Writer json(Channel::AcquireBuffer());
+            json.BeginObject()
+                .Field("type", "catalog")
+                .Field("path", WideStringToString(path.c_str()))
+                .Field("version", Header::kVersion)
+                .Field("built_at", builtAt)
+                .Field("actors", static_cast<std::uint32_t>(tables.actors.size()))
+                .EndObject();
+            Channel::Send(json.Take());
+        }
+    }
+
+    void Install() {
+        if (!Settings::GetBool(L"Catalog", L"bEnabled", true)) {
+            return;
+        }
+        std::wstring directory = GetLocalDataDirectory();
+        if (directory.empty()) {
+            return;
+        }
+
+        // Named after its build time and set before Mantella.exe starts, so it inherits it
+        std::int64_t builtAt =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        std::wstring path = directory + L"\\catalog-" + std::to_wstring(builtAt) + L".bin";
+        SetEnvironmentVariable(L"MANTELLA_CATALOG", path.c_str());
+        WorkerPool::Submit("catalog", WorkerPool::Priority::kNormal,
+                           [path = std::move(path), builtAt](WorkerPool::Job& job) { Build(job, path, builtAt); });
+    }
+#endif
+}
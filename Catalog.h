@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+* Catalog of the load order's actors, voice types, races, factions and locations for Mantella
+*
+* Mantella used to resolve NPC names, races, voice types, factions and locations one by one through
+* Papyrus, and heavily modded load orders have tens of thousands of actor records. At kDataLoaded the
+* plugin writes them all to %LOCALAPPDATA%\Mantella\catalog-<build time>.bin, whose path is also passed to
+* Mantella.exe in the MANTELLA_CATALOG environment variable. Every session writes a new file, because
+* Windows can't replace a file that Mantella still maps; older catalogs are deleted once nothing maps
+* them anymore. The file is meant to be memory-mapped:
+* fixed-size records sorted by FormID can be binary-searched in place, and names are offsets into a
+* pool of null-terminated UTF-8 strings, so nothing has to be parsed. Everything is little-endian.
+* Building it is recorded as "catalog.build".
+**/
+namespace Catalog {
+    // Where a table starts in the file and how many records it holds. For strings, the count is in bytes.
+    struct Section {
+        std::uint32_t offset;
+        std::uint32_t count;
+    };
+
+    struct Header {
+        static constexpr std::uint32_t kMagic = 0x5441434D;  // "MCAT"
+        static constexpr std::uint32_t kVersion = 1;
+
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::int64_t builtAt;  // Unix time in milliseconds
+        Section actors;        // Actor
+        Section voiceTypes;    // NamedForm with the editor ID
+        Section races;         // NamedForm
+        Section factions;      // NamedForm
+        Section locations;     // Location
+        Section factionRanks;  // FactionRank, referenced by Actor
+        Section strings;       // starts with an empty string, so offset 0 means no name
+    };
+
+    struct Actor {
+        enum Flags : std::uint16_t {
+            kFemale = 1 << 0,
+            kUnique = 1 << 1,
+            kEssential = 1 << 2
+        };
+
+        std::uint32_t formId;  // of the TESNPC base record
+        std::uint32_t name;
+        std::uint32_t race;       // FormID, 0 if none
+        std::uint32_t voiceType;  // FormID, 0 if none
+        std::uint32_t firstFactionRank;
+        std::uint16_t factionRankCount;
+        std::uint16_t flags;
+    };
+
+    struct NamedForm {
+        std::uint32_t formId;
+        std::uint32_t name;
+    };
+
+    struct Location {
+        std::uint32_t formId;
+        std::uint32_t name;
+        std::uint32_t parent;  // FormID, 0 if none
+    };
+
+    struct FactionRank {
+        std::uint32_t faction;
+        std::int32_t rank;
+    };
+
+    static_assert(sizeof(Header) == 72 && sizeof(Actor) == 24 && sizeof(NamedForm) == 8 && sizeof(Location) == 12 &&
+                  sizeof(FactionRank) == 8);
+
+    // Binary search of a table sorted by FormID, works on any of the record types above
+    template <class T>
+    const T* Find(std::span<const T> table, std::uint32_t formId) {
+        auto it = std::lower_bound(table.begin(), table.end(), formId,
+                                   [](const T& record, std::uint32_t id) { return record.formId < id; });
+        return it != table.end() && it->formId == formId ? &*it : nullptr;
+    }
+
+    // The tables of a catalog, in any order. Names are offsets into strings, which starts with an empty string.
+    struct Tables {
+        std::vector<Actor> actors;
+        std::vector<NamedForm> voiceTypes;
+        std::vector<NamedForm> races;
+        std::vector<NamedForm> factions;
+        std::vector<Location> locations;
+        std::vector<FactionRank> factionRanks;
+        std::string strings = std::string(1, '\0');
+    };
+
+    // Sort the tables by FormID and lay them out as the catalog file
+    std::vector<std::byte> Serialize(Tables& tables, std::int64_t builtAt);
+
+#ifdef _WIN32
+    // Build the catalog on the worker pool and write it. Call once at kDataLoaded.
+    void Install();
+#endif
+}
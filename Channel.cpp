@@ -0,0 +1,332 @@
+#include "Channel.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <atomic>
+    #include <chrono>
+    #include <deque>
+    #include <sstream>
+    #include <thread>
+    #include <vector>
+
+    #include "Launcher.h"
+    #include "Metrics.h"
+    #include "Recorder.h"
+#endif
+
+namespace Channel {
+    void Handlers::Register(std::string_view type, Handler handler) {
+        std::lock_guard guard(_lock);
+        _handlers.insert_or_assign(std::string(type), std::move(handler));
+    }
+
+    bool Handlers::Dispatch(std::string_view text) const {
+        Json::Value message = Json::Parse(text);
+        Handler handler;
+        {
+            // Called outside the lock, so a handler may register others
+            std::lock_guard guard(_lock);
+            auto it = _handlers.find(message["type"].GetRawString());
+            if (it == _handlers.end()) {
+                return false;
+            }
+            handler = it->second;
+        }
+        handler(message);
+        return true;
+    }
+
+#ifdef _WIN32
+    namespace {
+        constexpr const wchar_t* kPipeName = L"\\\\.\\pipe\\MantellaLauncher";
+        constexpr DWORD kBufferSize = 64 * 1024;
+        constexpr std::size_t kMaxQueuedMessages = 1024;
+        constexpr std::size_t kMaxPooledBuffers = 32;
+
+        // A message from Inject, waiting for the channel thread
+        struct Injected {
+            std::string message;
+            std::promise<double> dispatched;
+        };
+
+        struct State {
+            std::mutex lock;
+            std::deque<std::string> highQueue;
+            std::deque<std::string> lowQueue;
+            std::vector<std::string> bufferPool;
+            Handlers handlers;
+            std::deque<Injected> injectQueue;
+            HANDLE sendEvent = NULL;
+            HANDLE injectEvent = NULL;
+            std::atomic<bool> connected{false};
+            std::atomic<std::uint32_t> connectionId{0};
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        bool IssueRead(HANDLE pipe, OVERLAPPED& overlapped, std::vector<char>& buffer) {
+            ResetEvent(overlapped.hEvent);
+            if (!ReadFile(pipe, buffer.data(), static_cast<DWORD>(buffer.size()), NULL, &overlapped)) {
+                return GetLastError() == ERROR_IO_PENDING;
+            }
+            return true;  // Completed synchronously, the event is signaled anyway
+        }
+
+        bool WriteMessage(HANDLE pipe, OVERLAPPED& overlapped, const std::string& message) {
+            ResetEvent(overlapped.hEvent);
+            if (!WriteFile(pipe, message.data(), static_cast<DWORD>(message.size()), NULL, &overlapped) &&
+                GetLastError() != ERROR_IO_PENDING) {
+                return false;
+            }
+            DWORD written = 0;
+            return GetOverlappedResult(pipe, &overlapped, &written, TRUE) && written == message.size();
+        }
+
+        void Dispatch(std::string_view text) {
+            Recorder::RecordMessage(Recorder::kReceived, text);
+            Metrics::Increment("channel.received");
+            if (!GetState().handlers.Dispatch(text)) {
+                Metrics::Increment("channel.unhandled");
+            }
+        }
+
+        // Dispatch what Inject queued, timing each handler for the caller
+        void DispatchInjected() {
+            State& state = GetState();
+            for (;;) {
+                Injected injected;
+                {
+                    std::lock_guard guard(state.lock);
+                    if (state.injectQueue.empty()) {
+                        return;
+                    }
+                    injected = std::move(state.injectQueue.front());
+                    state.injectQueue.pop_front();
+                }
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                Dispatch(injected.message);
+                injected.dispatched.set_value(
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+        }
+
+        bool WaitForClient(HANDLE pipe, OVERLAPPED& overlapped) {
+            ResetEvent(overlapped.hEvent);
+            if (ConnectNamedPipe(pipe, &overlapped)) {
+                return true;
+            }
+
+            DWORD error = GetLastError();
+            if (error == ERROR_PIPE_CONNECTED) {
+                return true;
+            }
+            if (error != ERROR_IO_PENDING) {
+                return false;
+            }
+
+            // Injected messages are handled while nobody is connected, that is when recordings are replayed
+            DWORD unused = 0;
+            for (;;) {
+                HANDLE handles[] = {overlapped.hEvent, GetState().injectEvent};
+                DWORD signaled = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+                if (signaled == WAIT_OBJECT_0) {
+                    return GetOverlappedResult(pipe, &overlapped, &unused, FALSE) != FALSE;
+                }
+                if (signaled != WAIT_OBJECT_0 + 1) {
+                    CancelIo(pipe);
+                    GetOverlappedResult(pipe, &overlapped, &unused, TRUE);
+                    return false;
+                }
+                DispatchInjected();
+            }
+        }
+
+        // Send everything that is queued, high priority first
+        bool FlushQueues(HANDLE pipe, OVERLAPPED& overlapped) {
+            State& state = GetState();
+            for (;;) {
+                std::string message;
+                {
+                    std::lock_guard guard(state.lock);
+                    std::deque<std::string>& queue = !state.highQueue.empty() ? state.highQueue : state.lowQueue;
+                    if (queue.empty()) {
+                        return true;
+                    }
+                    message = std::move(queue.front());
+                    queue.pop_front();
+                }
+
+                if (!WriteMessage(pipe, overlapped, message)) {
+                    return false;
+                }
+                Metrics::Increment("channel.sent");
+                Recorder::RecordMessage(Recorder::kSent, message);
+
+                // Keep the buffer for the next message
+                message.clear();
+                std::lock_guard guard(state.lock);
+                if (state.bufferPool.size() < kMaxPooledBuffers) {
+                    state.bufferPool.push_back(std::move(message));
+                }
+            }
+        }
+
+        // Exchange messages with a connected client until it goes away
+        void Serve(HANDLE pipe) {
+            State& state = GetState();
+
+            OVERLAPPED readOverlapped = {0};
+            OVERLAPPED writeOverlapped = {0};
+            readOverlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+            writeOverlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+            std::vector<char> buffer(kBufferSize);
+            std::string inbox;
+
+            state.connected = true;
+            ++state.connectionId;
+            PrintToConsole("Mantella connected to the launcher channel.");
+
+            bool alive = IssueRead(pipe, readOverlapped, buffer) && FlushQueues(pipe, writeOverlapped);
+            while (alive) {
+                HANDLE handles[] = {readOverlapped.hEvent, state.sendEvent, state.injectEvent};
+                DWORD signaled = WaitForMultipleObjects(3, handles, FALSE, INFINITE);
+
+                if (signaled == WAIT_OBJECT_0) {
+                    DWORD bytesRead = 0;
+                    if (!GetOverlappedResult(pipe, &readOverlapped, &bytesRead, FALSE)) {
+                        break;  // Client disconnected
+                    }
+                    inbox.append(buffer.data(), bytesRead);
+
+                    std::size_t start = 0;
+                    std::size_t end;
+                    while ((end = inbox.find('\n', start)) != std::string::npos) {
+                        if (end > start) {
+                            Dispatch(std::string_view(inbox).substr(start, end - start));
+                        }
+                        start = end + 1;
+                    }
+                    inbox.erase(0, start);
+
+                    alive = IssueRead(pipe, readOverlapped, buffer);
+                } else if (signaled == WAIT_OBJECT_0 + 1) {
+                    alive = FlushQueues(pipe, writeOverlapped);
+                } else if (signaled == WAIT_OBJECT_0 + 2) {
+                    DispatchInjected();
+                } else {
+                    alive = false;
+                }
+            }
+
+            state.connected = false;
+            CancelIo(pipe);
+            DWORD unused = 0;
+            GetOverlappedResult(pipe, &readOverlapped, &unused, TRUE);
+            CloseHandle(readOverlapped.hEvent);
+            CloseHandle(writeOverlapped.hEvent);
+
+            {
+                std::lock_guard guard(state.lock);
+                state.highQueue.clear();
+                state.lowQueue.clear();
+            }
+            PrintToConsole("Mantella disconnected from the launcher channel.");
+        }
+
+        void Run() {
+            OVERLAPPED connectOverlapped = {0};
+            connectOverlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+            for (;;) {
+                HANDLE pipe = CreateNamedPipe(kPipeName, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                                              PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                              1, kBufferSize, kBufferSize, 0, NULL);
+                if (pipe == INVALID_HANDLE_VALUE) {
+                    std::stringstream ss;
+                    ss << "Failed to create the Mantella launcher channel. CreateNamedPipe error: " << GetLastError();
+                    PrintToConsole(ss.str());
+                    return;
+                }
+
+                if (WaitForClient(pipe, connectOverlapped)) {
+                    Serve(pipe);
+                }
+
+                DisconnectNamedPipe(pipe);
+                CloseHandle(pipe);
+            }
+        }
+    }
+
+    void Start() {
+        State& state = GetState();
+        if (state.sendEvent != NULL) {
+            return;  // Already running
+        }
+        state.sendEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        state.injectEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        std::thread(Run).detach();
+    }
+
+    bool IsConnected() { return GetState().connected; }
+
+    std::uint32_t GetConnectionId() { return GetState().connectionId; }
+
+    std::string AcquireBuffer() {
+        State& state = GetState();
+        std::lock_guard guard(state.lock);
+        if (state.bufferPool.empty()) {
+            std::string buffer;
+            buffer.reserve(512);
+            return buffer;
+        }
+        std::string buffer = std::move(state.bufferPool.back());
+        state.bufferPool.pop_back();
+        return buffer;
+    }
+
+    void Send(std::string message, Priority priority) {
+        State& state = GetState();
+        if (!state.connected) {
+            Metrics::Increment("channel.dropped");
+            return;
+        }
+
+        if (message.empty() || message.back() != '\n') {
+            message.push_back('\n');
+        }
+
+        {
+            std::lock_guard guard(state.lock);
+            std::deque<std::string>& queue = priority == Priority::kHigh ? state.highQueue : state.lowQueue;
+            if (queue.size() >= kMaxQueuedMessages) {
+                queue.pop_front();
+                Metrics::Increment("channel.dropped");
+            }
+            queue.push_back(std::move(message));
+        }
+        SetEvent(state.sendEvent);
+    }
+
+    void RegisterHandler(std::string_view type, Handler handler) {
+        GetState().handlers.Register(type, std::move(handler));
+    }
+
+    std::future<double> Inject(std::string message) {
+        State& state = GetState();
+        Injected injected;
+        injected.message = std::move(message);
+        std::future<double> dispatched = injected.dispatched.get_future();
+        {
+            std::lock_guard guard(state.lock);
+            state.injectQueue.push_back(std::move(injected));
+        }
+        SetEvent(state.injectEvent);
+        return dispatched;
+    }
+#endif
+}
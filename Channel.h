@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "Json.h"
+
+/**
+* Local message channel between the plugin and Mantella.exe
+*
+* The plugin hosts the named pipe \\.\pipe\MantellaLauncher and Mantella connects to it as a client.
+* Messages are single-line JSON objects terminated by '\n', each carrying a "type" field.
+* Everything runs on one background thread, so handlers must return quickly.
+**/
+namespace Channel {
+    enum class Priority {
+        kHigh,  // sent as soon as possible
+        kLow    // only sent while no high-priority messages are waiting
+    };
+
+    using Handler = std::function<void(Json::Value message)>;
+
+    // The handlers by message type, apart from the pipe so the tests dispatch with it too
+    class Handlers {
+    public:
+        void Register(std::string_view type, Handler handler);
+        // Parse a message and call the handler of its type. Returns false if no handler takes it.
+        bool Dispatch(std::string_view text) const;
+
+    private:
+        mutable std::mutex _lock;
+        std::map<std::string, Handler, std::less<>> _handlers;
+    };
+
+#ifdef _WIN32
+    void Start();
+
+    bool IsConnected();
+    // Incremented every time Mantella (re)connects, so callers can reset per-connection state
+    std::uint32_t GetConnectionId();
+
+    // An empty string with spare capacity from the channel's pool of sent messages. Building a message
+    // in it with Json::Writer and passing it to Send avoids allocating for every message.
+    std::string AcquireBuffer();
+
+    // Queue a message for Mantella. Messages are dropped while nobody is connected.
+    void Send(std::string message, Priority priority = Priority::kHigh);
+
+    // Register a handler for incoming messages of the given type. Handlers run on the channel thread
+    // and the message only stays valid until the handler returns.
+    void RegisterHandler(std::string_view type, Handler handler);
+
+    // Hand a message to its handler on the channel thread as if Mantella had sent it. Used to replay recordings.
+    // The result is ready once the handler returned and holds the time the dispatch took in milliseconds.
+    std::future<double> Inject(std::string message);
+#endif
+}
@@ -0,0 +1,129 @@
+#include "Commands.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+#include "Channel.h"
+#include "Json.h"
+#include "Launcher.h"
+#include "MainThread.h"
+#include "Metrics.h"
+#include "Remote.h"
+#include "Status.h"
+#include "Timers.h"
+
+namespace Commands {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        // Arguments start at index 1, index 0 is the command's name
+        using Command = std::string (*)(const Json::Value& command);
+
+        std::string FromBool(bool value) { return value ? "true" : ""; }
+
+        std::chrono::milliseconds ToMilliseconds(const Json::Value& seconds) {
+            return std::chrono::milliseconds(static_cast<std::int64_t>(std::max(seconds.GetDouble(), 0.0) * 1000.0));
+        }
+
+        float ToFloat(const Json::Value& value) { return static_cast<float>(value.GetDouble()); }
+
+        std::string GetMantellaState(const Json::Value&) { return Status::GetStateName(Status::Get().state); }
+
+        std::string GetMantellaPid(const Json::Value&) { return std::to_string(Status::Get().pid); }
+
+        std::string GetMantellaLastError(const Json::Value&) { return Status::Get().lastError; }
+
+        std::string GetMantellaEndpoint(const Json::Value&) { return Remote::GetEndpoint(); }
+
+        std::string IsMantellaConnected(const Json::Value&) { return FromBool(Channel::IsConnected()); }
+
+        // ["Send", {message}]: a message object for Mantella, passed on as it is
+        std::string Send(const Json::Value& command) {
+            Json::Value message = command[1];
+            if (message.GetType() != Json::Value::Type::kObject || !Channel::IsConnected()) {
+                return FromBool(false);
+            }
+            Channel::Send(std::string(message.GetText()));
+            return FromBool(true);
+        }
+
+        // ["SendModEvent", eventName, strArg, numArg]
+        std::string SendModEvent(const Json::Value& command) {
+            MainThread::SendModEvent(command[1].GetString(), command[2].GetString(), ToFloat(command[3]));
+            return {};
+        }
+
+        // ["StartTimer", eventName, delaySeconds, intervalSeconds, strArg, numArg]
+        std::string StartTimer(const Json::Value& command) {
+            return std::to_string(Timers::Start(command[1].GetString(), ToMilliseconds(command[2]),
+                                                ToMilliseconds(command[3]), command[4].GetString(),
+                                                ToFloat(command[5])));
+        }
+
+        // ["CancelTimer", timerId]
+        std::string CancelTimer(const Json::Value& command) {
+            Timers::Cancel(static_cast<std::uint32_t>(command[1].GetUInt()));
+            return {};
+        }
+
+        // ["Debounce", eventName, quietSeconds, strArg, numArg]
+        std::string Debounce(const Json::Value& command) {
+            Timers::Debounce(command[1].GetString(), ToMilliseconds(command[2]), command[3].GetString(),
+                             ToFloat(command[4]));
+            return {};
+        }
+
+        struct Entry {
+            std::string_view name;
+            Command command;
+        };
+
+        constexpr std::array<Entry, 10> kCommands = {{{"GetMantellaState", GetMantellaState},
+                                                      {"GetMantellaPid", GetMantellaPid},
+                                                      {"GetMantellaLastError", GetMantellaLastError},
+                                                      {"GetMantellaEndpoint", GetMantellaEndpoint},
+                                                      {"IsMantellaConnected", IsMantellaConnected},
+                                                      {"Send", Send},
+                                                      {"SendModEvent", SendModEvent},
+                                                      {"StartTimer", StartTimer},
+                                                      {"CancelTimer", CancelTimer},
+                                                      {"Debounce", Debounce}}};
+
+        std::vector<RE::BSFixedString> RunMantellaCommandsPapyrus(RE::StaticFunctionTag*,
+                                                                  RE::BSFixedString commands) {
+            std::vector<RE::BSFixedString> results;
+            for (const std::string& result : Run({commands.data(), commands.size()})) {
+                results.emplace_back(result.c_str());
+            }
+            return results;
+        }
+    }
+
+    std::vector<std::string> Run(std::string_view commands) {
+        Clock::time_point start = Clock::now();
+        std::vector<std::string> results;
+        Json::Parse(commands).ForEachElement([&](Json::Value command) {
+            std::string_view name = command[std::size_t{0}].GetRawString();
+            auto it = std::find_if(kCommands.begin(), kCommands.end(),
+                                   [&](const Entry& entry) { return entry.name == name; });
+            if (it == kCommands.end()) {
+                Metrics::Increment("commands.unknown");
+                PrintToConsole("Unknown Mantella command: " + std::string(name));
+                results.emplace_back();
+                return;
+            }
+            results.push_back(it->command(command));
+        });
+
+        Metrics::Increment("commands.executed", results.size());
+        Metrics::RecordLatency("commands.batch",
+                               std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        return results;
+    }
+
+    bool Register(RE::BSScript::IVirtualMachine* vm) {
+        vm->RegisterFunction("RunMantellaCommands", "MantellaLauncher", RunMantellaCommandsPapyrus);
+        return true;
+    }
+}
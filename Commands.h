@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+* Batches of Mantella operations in one native call
+*
+* Every call from Papyrus into a native goes through the VM's scheduling, and Mantella's per-turn logic
+* makes many small ones: query the launcher state, send context, start a timer. RunMantellaCommands()
+* takes them all as one JSON array of commands, each an array of the operation's name and its
+* arguments, e.g. [["GetMantellaState"],["StartTimer","Mantella_Tick",1.5]]. The operations run in order
+* and their results come back as one string per command. Time per batch is recorded as "commands.batch".
+**/
+namespace Commands {
+    // Run every command of the JSON array and return a result per command. Booleans are "true" or "",
+    // so "as bool" works in Papyrus; failed commands return "".
+    std::vector<std::string> Run(std::string_view commands);
+
+    // Register the natives on the MantellaLauncher script
+    bool Register(RE::BSScript::IVirtualMachine* vm);
+}
@@ -0,0 +1,73 @@
+#include "Fuz.h"
+
+#include <cstring>
+
+namespace Fuz {
+    namespace {
+        void AppendBytes(std::vector<std::byte>& out, const void* data, std::size_t size) {
+            const auto* bytes = static_cast<const std::byte*>(data);
+            out.insert(out.end(), bytes, bytes + size);
+        }
+
+        void AppendU32(std::vector<std::byte>& out, std::uint32_t value) { AppendBytes(out, &value, sizeof(value)); }
+
+        void AppendU16(std::vector<std::byte>& out, std::uint16_t value) { AppendBytes(out, &value, sizeof(value)); }
+    }
+
+    void AppendWavHeader(std::vector<std::byte>& out, std::uint32_t sampleRate, std::uint16_t channels,
+                         std::uint32_t dataSize) {
+        std::uint16_t blockAlign = static_cast<std::uint16_t>(channels * 2);
+
+        AppendBytes(out, "RIFF", 4);
+        AppendU32(out, static_cast<std::uint32_t>(kWavHeaderSize - 8) + dataSize);
+        AppendBytes(out, "WAVE", 4);
+
+        AppendBytes(out, "fmt ", 4);
+        AppendU32(out, 16);
+        AppendU16(out, 1);  // PCM
+        AppendU16(out, channels);
+        AppendU32(out, sampleRate);
+        AppendU32(out, sampleRate * blockAlign);
+        AppendU16(out, blockAlign);
+        AppendU16(out, 16);
+
+        AppendBytes(out, "data", 4);
+        AppendU32(out, dataSize);
+    }
+
+    void Build(std::span<const std::byte> lip, std::span<const std::byte> audio, std::vector<std::byte>& out) {
+        FuzHeader header = {FuzHeader::kMagic, FuzHeader::kVersion, static_cast<std::uint32_t>(lip.size())};
+
+        out.reserve(out.size() + sizeof(header) + lip.size() + audio.size());
+        AppendBytes(out, &header, sizeof(header));
+        out.insert(out.end(), lip.begin(), lip.end());
+        out.insert(out.end(), audio.begin(), audio.end());
+    }
+
+    void BuildFromPcm(std::span<const std::byte> lip, std::uint32_t sampleRate, std::uint16_t channels,
+                      std::span<const std::byte> pcm, std::vector<std::byte>& out) {
+        FuzHeader header = {FuzHeader::kMagic, FuzHeader::kVersion, static_cast<std::uint32_t>(lip.size())};
+
+        out.reserve(out.size() + sizeof(header) + lip.size() + kWavHeaderSize + pcm.size());
+        AppendBytes(out, &header, sizeof(header));
+        out.insert(out.end(), lip.begin(), lip.end());
+        AppendWavHeader(out, sampleRate, channels, static_cast<std::uint32_t>(pcm.size()));
+        out.insert(out.end(), pcm.begin(), pcm.end());
+    }
+
+    bool Split(std::span<const std::byte> fuz, std::span<const std::byte>& lip, std::span<const std::byte>& audio) {
+        FuzHeader header;
+        if (fuz.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, fuz.data(), sizeof(header));
+        if (header.magic != FuzHeader::kMagic || header.version != FuzHeader::kVersion ||
+            header.lipSize > fuz.size() - sizeof(header)) {
+            return false;
+        }
+
+        lip = fuz.subspan(sizeof(header), header.lipSize);
+        audio = fuz.subspan(sizeof(header) + header.lipSize);
+        return true;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+* In-memory muxing of the game's voice file containers
+*
+* A .fuz file is a 12-byte FuzHeader, the .lip data, then the audio file. Lines are assembled in
+* memory from the buffers Mantella streams and written with a single write, instead of packing them
+* with external tools through intermediate files. Streamed lines that are only played are never
+* written at all.
+**/
+namespace Fuz {
+    struct FuzHeader {
+        static constexpr std::uint32_t kMagic = 0x455A5546;  // "FUZE"
+        static constexpr std::uint32_t kVersion = 1;
+
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t lipSize;
+    };
+
+    constexpr std::size_t kWavHeaderSize = 44;
+
+    // Append a canonical 44-byte header for a 16-bit PCM .wav file holding dataSize bytes
+    void AppendWavHeader(std::vector<std::byte>& out, std::uint32_t sampleRate, std::uint16_t channels,
+                         std::uint32_t dataSize);
+
+    // Append a complete .fuz file with the given .lip data and audio file to out
+    void Build(std::span<const std::byte> lip, std::span<const std::byte> audio, std::vector<std::byte>& out);
+
+    // Append a complete .fuz file with the given .lip data and a .wav file of 16-bit PCM to out, growing out once
+    void BuildFromPcm(std::span<const std::byte> lip, std::uint32_t sampleRate, std::uint16_t channels,
+                      std::span<const std::byte> pcm, std::vector<std::byte>& out);
+
+    // Find the .lip data and audio file inside a .fuz file. Returns false if it is malformed.
+    bool Split(std::span<const std::byte> fuz, std::span<const std::byte>& lip, std::span<const std::byte>& audio);
+}
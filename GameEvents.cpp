@@ -0,0 +1,291 @@
+#include "GameEvents.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "Json.h"
+
+#ifdef _WIN32
+    #include <chrono>
+
+    #include "Channel.h"
+    #include "Metrics.h"
+    #include "Settings.h"
+#endif
+
+namespace GameEvents {
+    namespace {
+        struct Summary {
+            Record record;
+            std::uint32_t count;
+        };
+
+        bool IsSame(const Form& a, const Form& b) { return a.id == b.id; }
+
+        const char* GetKindName(Kind kind) {
+            switch (kind) {
+                case Kind::kHit:
+                    return "hit";
+                case Kind::kSpellCast:
+                    return "spell_cast";
+                case Kind::kItemAdded:
+                    return "item_added";
+                case Kind::kItemRemoved:
+                    return "item_removed";
+                default:
+                    return "location_change";
+            }
+        }
+
+        void WriteForm(Json::Writer& json, std::string_view key, const Form& form) {
+            if (form.id == 0) {
+                return;
+            }
+            json.Key(key).BeginObject().Field("id", form.id);
+            if (form.name[0] != '\0') {
+                json.Field("name", std::string_view(form.name.data(), strnlen(form.name.data(), form.name.size())));
+            }
+            json.EndObject();
+        }
+    }
+
+    void Form::Set(std::uint32_t formId, const char* formName) {
+        id = formId;
+        name = {};
+        if (formName) {
+            // Leaves the last byte zero, a cut-off name may end in part of a UTF-8 sequence
+            std::strncpy(name.data(), formName, name.size() - 1);
+        }
+    }
+
+    RecordQueue::RecordQueue() {
+        for (std::size_t i = 0; i < kQueueCapacity; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool RecordQueue::Push(const Record& record) {
+        std::size_t position = _tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &_cells[position & (kQueueCapacity - 1)];
+            std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+            if (difference == 0) {
+                if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;  // Full
+            } else {
+                position = _tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->record = record;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool RecordQueue::Pop(Record& record) {
+        Cell& cell = _cells[_head & (kQueueCapacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != _head + 1) {
+            return false;
+        }
+        record = cell.record;
+        cell.sequence.store(_head + kQueueCapacity, std::memory_order_release);
+        ++_head;
+        return true;
+    }
+
+    std::size_t WriteSummary(RecordQueue& queue, std::uint32_t dropped, Json::Writer& json) {
+        std::vector<Summary> summaries;
+        Record record;
+        while (queue.Pop(record)) {
+            auto it = std::find_if(summaries.begin(), summaries.end(), [&](const Summary& summary) {
+                return summary.record.kind == record.kind && IsSame(summary.record.source, record.source) &&
+                       IsSame(summary.record.target, record.target) && IsSame(summary.record.object, record.object);
+            });
+            if (it == summaries.end()) {
+                summaries.push_back({record, 1});
+            } else {
+                it->record.amount += record.amount;
+                ++it->count;
+            }
+        }
+
+        json.BeginObject().Field("type", "events").Key("events").BeginArray();
+        for (const Summary& summary : summaries) {
+            json.BeginObject().Field("kind", GetKindName(summary.record.kind)).Field("count", summary.count);
+            WriteForm(json, "source", summary.record.source);
+            WriteForm(json, "target", summary.record.target);
+            WriteForm(json, "object", summary.record.object);
+            if (summary.record.kind == Kind::kItemAdded || summary.record.kind == Kind::kItemRemoved) {
+                json.Field("amount", summary.record.amount);
+            }
+            json.EndObject();
+        }
+        json.EndArray().Field("dropped", dropped).EndObject();
+        return summaries.size();
+    }
+
+#ifdef _WIN32
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr std::size_t kMaxTrackedActors = 16;
+
+        struct State {
+            RecordQueue queue;
+            std::array<std::atomic<RE::FormID>, kMaxTrackedActors> tracked{};
+            // Published with the summary, so the sinks don't take the metrics lock for every event
+            std::atomic<std::uint32_t> recorded{0};
+            std::atomic<std::uint32_t> dropped{0};
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        bool IsRelevant(RE::FormID formId) {
+            if (formId == 0) {
+                return false;
+            }
+            if (formId == 0x14) {
+                return true;  // The player
+            }
+            for (const auto& tracked : GetState().tracked) {
+                if (tracked.load(std::memory_order_relaxed) == formId) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        RE::FormID GetFormId(const RE::TESForm* form) { return form ? form->GetFormID() : 0; }
+
+        // Runs on the thread that sent the event, which owns the forms, so their names are copied here
+        void Enqueue(Kind kind, const RE::TESForm* source, const RE::TESForm* target, const RE::TESForm* object,
+                     std::int32_t amount = 1) {
+            Record record = {kind, amount, {}, {}, {}};
+            record.source.Set(GetFormId(source), source ? source->GetName() : nullptr);
+            record.target.Set(GetFormId(target), target ? target->GetName() : nullptr);
+            record.object.Set(GetFormId(object), object ? object->GetName() : nullptr);
+
+            State& state = GetState();
+            if (state.queue.Push(record)) {
+                state.recorded.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                state.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Collapse everything recorded since the last turn into one message
+        void OnTurn(Json::Value) {
+            Clock::time_point start = Clock::now();
+            State& state = GetState();
+            std::uint32_t dropped = state.dropped.exchange(0);
+
+            Json::Writer json(Channel::AcquireBuffer());
+            WriteSummary(state.queue, dropped, json);
+            Channel::Send(json.Take());
+
+            Metrics::Increment("events.recorded", state.recorded.exchange(0));
+            Metrics::Increment("events.dropped", dropped);
+            Metrics::Increment("events.summaries");
+            Metrics::RecordLatency("events.summary",
+                                   std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+
+        // Mantella tells which actors take part in the conversation
+        void OnEventActors(Json::Value message) {
+            State& state = GetState();
+            std::size_t count = 0;
+            message["ref_ids"].ForEachElement([&](Json::Value refId) {
+                if (count < kMaxTrackedActors) {
+                    state.tracked[count++].store(static_cast<RE::FormID>(refId.GetUInt()), std::memory_order_relaxed);
+                }
+            });
+            for (; count < kMaxTrackedActors; ++count) {
+                state.tracked[count].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        class EventSink : public RE::BSTEventSink<RE::TESHitEvent>,
+                          public RE::BSTEventSink<RE::TESSpellCastEvent>,
+                          public RE::BSTEventSink<RE::TESContainerChangedEvent>,
+                          public RE::BSTEventSink<RE::TESActorLocationChangeEvent> {
+        public:
+            static EventSink* GetSingleton() {
+                static EventSink singleton;
+                return &singleton;
+            }
+
+            RE::BSEventNotifyControl ProcessEvent(const RE::TESHitEvent* event,
+                                                  RE::BSTEventSource<RE::TESHitEvent>*) override {
+                if (event) {
+                    const RE::TESObjectREFR* cause = event->cause.get();
+                    const RE::TESObjectREFR* target = event->target.get();
+                    if (IsRelevant(GetFormId(cause)) || IsRelevant(GetFormId(target))) {
+                        Enqueue(Kind::kHit, cause, target, RE::TESForm::LookupByID(event->source));
+                    }
+                }
+                return RE::BSEventNotifyControl::kContinue;
+            }
+
+            RE::BSEventNotifyControl ProcessEvent(const RE::TESSpellCastEvent* event,
+                                                  RE::BSTEventSource<RE::TESSpellCastEvent>*) override {
+                if (event) {
+                    const RE::TESObjectREFR* caster = event->object.get();
+                    if (IsRelevant(GetFormId(caster))) {
+                        Enqueue(Kind::kSpellCast, caster, nullptr, RE::TESForm::LookupByID(event->spell));
+                    }
+                }
+                return RE::BSEventNotifyControl::kContinue;
+            }
+
+            RE::BSEventNotifyControl ProcessEvent(const RE::TESContainerChangedEvent* event,
+                                                  RE::BSTEventSource<RE::TESContainerChangedEvent>*) override {
+                if (event) {
+                    bool added = IsRelevant(event->newContainer);
+                    if (added || IsRelevant(event->oldContainer)) {
+                        Enqueue(added ? Kind::kItemAdded : Kind::kItemRemoved,
+                                RE::TESForm::LookupByID(event->oldContainer),
+                                RE::TESForm::LookupByID(event->newContainer), RE::TESForm::LookupByID(event->baseObj),
+                                event->itemCount);
+                    }
+                }
+                return RE::BSEventNotifyControl::kContinue;
+            }
+
+            RE::BSEventNotifyControl ProcessEvent(const RE::TESActorLocationChangeEvent* event,
+                                                  RE::BSTEventSource<RE::TESActorLocationChangeEvent>*) override {
+                if (event) {
+                    const RE::TESObjectREFR* actor = event->actor.get();
+                    if (IsRelevant(GetFormId(actor))) {
+                        Enqueue(Kind::kLocationChange, actor, event->newLoc, event->oldLoc);
+                    }
+                }
+                return RE::BSEventNotifyControl::kContinue;
+            }
+        };
+    }
+
+    void Install() {
+        if (!Settings::GetBool(L"Events", L"bEnabled", true)) {
+            return;
+        }
+
+        RE::ScriptEventSourceHolder* events = RE::ScriptEventSourceHolder::GetSingleton();
+        events->AddEventSink<RE::TESHitEvent>(EventSink::GetSingleton());
+        events->AddEventSink<RE::TESSpellCastEvent>(EventSink::GetSingleton());
+        events->AddEventSink<RE::TESContainerChangedEvent>(EventSink::GetSingleton());
+        events->AddEventSink<RE::TESActorLocationChangeEvent>(EventSink::GetSingleton());
+
+        Channel::RegisterHandler("turn", OnTurn);
+        Channel::RegisterHandler("event_actors", OnEventActors);
+    }
+#endif
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Json {
+    class Writer;
+}
+
+/**
+* In-game events for Mantella's conversation context
+*
+* C++ event sinks replace the Papyrus event handlers that recorded hits, spells, item transfers and
+* location changes. A sink copies the form IDs and names of an event into a compact record on a lock-free
+* queue, so the main thread doesn't build strings or wait for the script VM, and the channel thread never
+* touches game forms. The records are merged on the channel thread when Mantella asks for them at the
+* start of a turn ("turn"). They are sent back as one "events" message, in which repeated events are
+* collapsed into a count.
+*
+* Only events that involve the player or one of the actors Mantella is tracking ("event_actors") are
+* recorded.
+**/
+namespace GameEvents {
+    constexpr std::size_t kQueueCapacity = 1024;  // power of two
+
+    enum class Kind : std::uint8_t {
+        kHit,
+        kSpellCast,
+        kItemAdded,
+        kItemRemoved,
+        kLocationChange
+    };
+
+    // A form as it was when the event happened. Longer names are cut off.
+    struct Form {
+        std::uint32_t id = 0;
+        std::array<char, 44> name = {};
+
+        void Set(std::uint32_t formId, const char* formName);
+    };
+
+    struct Record {
+        Kind kind;
+        std::int32_t amount;
+        Form source;  // attacker, caster, container the item left or actor that moved
+        Form target;  // victim, container the item entered or new location
+        Form object;  // weapon or spell, item, old location
+    };
+
+    /**
+    * Bounded multi-producer queue
+    *
+    * Every cell carries a sequence number that tells producers and the consumer whose turn it is,
+    * so pushing is a single compare-exchange and events may come from any thread.
+    **/
+    class RecordQueue {
+    public:
+        RecordQueue();
+
+        // Returns false if the queue is full
+        bool Push(const Record& record);
+        // Only one thread may pop
+        bool Pop(Record& record);
+
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            Record record;
+        };
+
+        std::array<Cell, kQueueCapacity> _cells;
+        alignas(64) std::atomic<std::size_t> _tail{0};
+        alignas(64) std::size_t _head = 0;
+    };
+
+    // Pop everything from queue and write it as the "events" message, repeats merged. Returns the number
+    // of merged events written.
+    std::size_t WriteSummary(RecordQueue& queue, std::uint32_t dropped, Json::Writer& json);
+
+#ifdef _WIN32
+    // Register the event sinks and channel handlers. Call once at kDataLoaded.
+    void Install();
+#endif
+}
@@ -0,0 +1,558 @@
+#include "Json.h"
+
+#include <emmintrin.h>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <utility>
+
+namespace Json {
+    namespace {
+        constexpr std::size_t npos = std::string_view::npos;
+
+        bool IsWhitespace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+        std::size_t SkipWhitespace(std::string_view text, std::size_t position) {
+            while (position < text.size() && IsWhitespace(text[position])) {
+                ++position;
+            }
+            return position;
+        }
+
+        // Offset of the first '"' or '\' at or after position, or npos
+        std::size_t FindQuoteOrBackslash(std::string_view text, std::size_t position) {
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            for (; position + 16 <= text.size(); position += 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + position));
+                unsigned mask = static_cast<unsigned>(
+                    _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash))));
+                if (mask != 0) {
+                    return position + std::countr_zero(mask);
+                }
+            }
+            for (; position < text.size(); ++position) {
+                if (text[position] == '"' || text[position] == '\\') {
+                    return position;
+                }
+            }
+            return npos;
+        }
+
+        // Offset of the first '"', '{', '}', '[' or ']' at or after position, or npos
+        std::size_t FindStructural(std::string_view text, std::size_t position) {
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i openBrace = _mm_set1_epi8('{');
+            const __m128i closeBrace = _mm_set1_epi8('}');
+            const __m128i lowerCase = _mm_set1_epi8(0x20);
+            for (; position + 16 <= text.size(); position += 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + position));
+                // Setting bit 5 turns '[' into '{' and ']' into '}'
+                __m128i folded = _mm_or_si128(chunk, lowerCase);
+                __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                               _mm_or_si128(_mm_cmpeq_epi8(folded, openBrace),
+                                                            _mm_cmpeq_epi8(folded, closeBrace)));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+                if (mask != 0) {
+                    return position + std::countr_zero(mask);
+                }
+            }
+            for (; position < text.size(); ++position) {
+                char c = text[position];
+                if (c == '"' || c == '{' || c == '}' || c == '[' || c == ']') {
+                    return position;
+                }
+            }
+            return npos;
+        }
+
+        // position is at the opening quote, returns the offset just past the closing quote
+        std::size_t SkipString(std::string_view text, std::size_t position) {
+            ++position;
+            for (;;) {
+                position = FindQuoteOrBackslash(text, position);
+                if (position == npos) {
+                    return npos;
+                }
+                if (text[position] == '"') {
+                    return position + 1;
+                }
+                position += 2;  // Skip the escaped character
+            }
+        }
+
+        // position is at the opening bracket, returns the offset just past the matching closing bracket
+        std::size_t SkipContainer(std::string_view text, std::size_t position) {
+            int depth = 0;
+            for (;;) {
+                position = FindStructural(text, position);
+                if (position == npos) {
+                    return npos;
+                }
+
+                char c = text[position];
+                if (c == '"') {
+                    position = SkipString(text, position);
+                    if (position == npos) {
+                        return npos;
+                    }
+                    continue;
+                }
+
+                depth += (c == '{' || c == '[') ? 1 : -1;
+                ++position;
+                if (depth == 0) {
+                    return position;
+                }
+            }
+        }
+
+        std::size_t SkipValue(std::string_view text, std::size_t position) {
+            if (position >= text.size()) {
+                return npos;
+            }
+
+            char c = text[position];
+            if (c == '"') {
+                return SkipString(text, position);
+            }
+            if (c == '{' || c == '[') {
+                return SkipContainer(text, position);
+            }
+            if (c == '}' || c == ']' || c == ',' || c == ':') {
+                return npos;
+            }
+
+            // Number, true, false or null
+            std::size_t end = position;
+            while (end < text.size() && text[end] != ',' && text[end] != '}' && text[end] != ']' &&
+                   !IsWhitespace(text[end])) {
+                ++end;
+            }
+            return end;
+        }
+
+        void AppendUtf8(std::string& out, std::uint32_t codePoint) {
+            if (codePoint < 0x80) {
+                out += static_cast<char>(codePoint);
+            } else if (codePoint < 0x800) {
+                out += static_cast<char>(0xC0 | (codePoint >> 6));
+                out += static_cast<char>(0x80 | (codePoint & 0x3F));
+            } else if (codePoint < 0x10000) {
+                out += static_cast<char>(0xE0 | (codePoint >> 12));
+                out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (codePoint & 0x3F));
+            } else {
+                out += static_cast<char>(0xF0 | (codePoint >> 18));
+                out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (codePoint & 0x3F));
+            }
+        }
+
+        bool ParseHex4(std::string_view raw, std::size_t position, std::uint32_t& value) {
+            if (position + 4 > raw.size()) {
+                return false;
+            }
+            auto result = std::from_chars(raw.data() + position, raw.data() + position + 4, value, 16);
+            return result.ec == std::errc() && result.ptr == raw.data() + position + 4;
+        }
+    }
+
+    Writer::Writer(std::string buffer) : _buffer(std::move(buffer)) { _buffer.clear(); }
+
+    void Writer::BeforeValue() {
+        if (_afterKey) {
+            _afterKey = false;
+            return;
+        }
+        if (_depth == 0) {
+            return;
+        }
+
+        std::uint64_t bit = std::uint64_t{1} << ((_depth - 1) & 63);
+        if (_hasElements & bit) {
+            _buffer += ',';
+        }
+        _hasElements |= bit;
+    }
+
+    Writer& Writer::BeginObject() {
+        BeforeValue();
+        _buffer += '{';
+        _hasElements &= ~(std::uint64_t{1} << (_depth & 63));
+        ++_depth;
+        return *this;
+    }
+
+    Writer& Writer::EndObject() {
+        --_depth;
+        _buffer += '}';
+        return *this;
+    }
+
+    Writer& Writer::BeginArray() {
+        BeforeValue();
+        _buffer += '[';
+        _hasElements &= ~(std::uint64_t{1} << (_depth & 63));
+        ++_depth;
+        return *this;
+    }
+
+    Writer& Writer::EndArray() {
+        --_depth;
+        _buffer += ']';
+        return *this;
+    }
+
+    Writer& Writer::Key(std::string_view key) {
+        BeforeValue();
+        _buffer += '"';
+        AppendEscaped(_buffer, key);
+        _buffer += "\":";
+        _afterKey = true;
+        return *this;
+    }
+
+    Writer& Writer::String(std::string_view value) {
+        BeforeValue();
+        _buffer += '"';
+        AppendEscaped(_buffer, value);
+        _buffer += '"';
+        return *this;
+    }
+
+    Writer& Writer::Int(std::int64_t value) {
+        BeforeValue();
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        _buffer.append(digits, result.ptr);
+        return *this;
+    }
+
+    Writer& Writer::UInt(std::uint64_t value) {
+        BeforeValue();
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        _buffer.append(digits, result.ptr);
+        return *this;
+    }
+
+    Writer& Writer::Double(double value) {
+        if (!std::isfinite(value)) {
+            return Null();  // JSON has no NaN or infinity
+        }
+        BeforeValue();
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        _buffer.append(digits, result.ptr);
+        return *this;
+    }
+
+    Writer& Writer::Bool(bool value) {
+        BeforeValue();
+        _buffer += value ? "true" : "false";
+        return *this;
+    }
+
+    Writer& Writer::Null() {
+        BeforeValue();
+        _buffer += "null";
+        return *this;
+    }
+
+    Writer& Writer::Raw(std::string_view json) {
+        BeforeValue();
+        _buffer += json;
+        return *this;
+    }
+
+    std::string Writer::Take() {
+        std::string result = std::move(_buffer);
+        _buffer = std::string();
+        _hasElements = 0;
+        _depth = 0;
+        _afterKey = false;
+        return result;
+    }
+
+    void Writer::Reset() {
+        _buffer.clear();
+        _hasElements = 0;
+        _depth = 0;
+        _afterKey = false;
+    }
+
+    void AppendEscaped(std::string& out, std::string_view text) {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i lastControl = _mm_set1_epi8(0x1F);
+
+        std::size_t position = 0;
+        while (position < text.size()) {
+            // Copy the longest run that needs no escaping
+            std::size_t runEnd = position;
+            for (; runEnd + 16 <= text.size(); runEnd += 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + runEnd));
+                // Unsigned c <= 0x1F is the same as max(c, 0x1F) == 0x1F
+                __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, lastControl), lastControl);
+                __m128i special =
+                    _mm_or_si128(control, _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+                if (mask != 0) {
+                    runEnd += std::countr_zero(mask);
+                    break;
+                }
+            }
+            if (runEnd + 16 > text.size()) {
+                while (runEnd < text.size()) {
+                    unsigned char c = static_cast<unsigned char>(text[runEnd]);
+                    if (c == '"' || c == '\\' || c < 0x20) {
+                        break;
+                    }
+                    ++runEnd;
+                }
+            }
+
+            out.append(text.data() + position, runEnd - position);
+            if (runEnd >= text.size()) {
+                return;
+            }
+
+            unsigned char c = static_cast<unsigned char>(text[runEnd]);
+            switch (c) {
+                case '"':
+                    out += "\\\"";
+                    break;
+                case '\\':
+                    out += "\\\\";
+                    break;
+                case '\n':
+                    out += "\\n";
+                    break;
+                case '\r':
+                    out += "\\r";
+                    break;
+                case '\t':
+                    out += "\\t";
+                    break;
+                default: {
+                    constexpr char kHex[] = "0123456789abcdef";
+                    out += "\\u00";
+                    out += kHex[c >> 4];
+                    out += kHex[c & 0xF];
+                }
+            }
+            position = runEnd + 1;
+        }
+    }
+
+    void Unescape(std::string_view raw, std::string& out) {
+        std::size_t position = 0;
+        while (position < raw.size()) {
+            std::size_t escape = raw.find('\\', position);
+            out.append(raw.data() + position, (escape == npos ? raw.size() : escape) - position);
+            if (escape == npos || escape + 1 >= raw.size()) {
+                return;
+            }
+
+            char c = raw[escape + 1];
+            position = escape + 2;
+            switch (c) {
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'u': {
+                    std::uint32_t codePoint;
+                    if (!ParseHex4(raw, position, codePoint)) {
+                        return;
+                    }
+                    position += 4;
+
+                    // Combine a UTF-16 surrogate pair
+                    std::uint32_t low;
+                    if (codePoint >= 0xD800 && codePoint < 0xDC00 && position + 1 < raw.size() &&
+                        raw[position] == '\\' && raw[position + 1] == 'u' && ParseHex4(raw, position + 2, low) &&
+                        low >= 0xDC00 && low < 0xE000) {
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                        position += 6;
+                    }
+                    AppendUtf8(out, codePoint);
+                    break;
+                }
+                default:
+                    out += c;  // \" \\ and \/
+            }
+        }
+    }
+
+    Value::Type Value::GetType() const {
+        if (_text.empty()) {
+            return Type::kInvalid;
+        }
+        switch (_text.front()) {
+            case '{':
+                return Type::kObject;
+            case '[':
+                return Type::kArray;
+            case '"':
+                return Type::kString;
+            case 't':
+            case 'f':
+                return Type::kBool;
+            case 'n':
+                return Type::kNull;
+            default:
+                return Type::kNumber;
+        }
+    }
+
+    std::string_view Value::GetRawString() const {
+        if (GetType() != Type::kString || _text.size() < 2) {
+            return {};
+        }
+        return _text.substr(1, _text.size() - 2);
+    }
+
+    std::string Value::GetString() const {
+        std::string result;
+        Unescape(GetRawString(), result);
+        return result;
+    }
+
+    std::int64_t Value::GetInt(std::int64_t defaultValue) const {
+        std::int64_t value;
+        auto result = std::from_chars(_text.data(), _text.data() + _text.size(), value);
+        return result.ec == std::errc() ? value : defaultValue;
+    }
+
+    std::uint64_t Value::GetUInt(std::uint64_t defaultValue) const {
+        std::uint64_t value;
+        auto result = std::from_chars(_text.data(), _text.data() + _text.size(), value);
+        return result.ec == std::errc() ? value : defaultValue;
+    }
+
+    double Value::GetDouble(double defaultValue) const {
+        double value;
+        auto result = std::from_chars(_text.data(), _text.data() + _text.size(), value);
+        return result.ec == std::errc() ? value : defaultValue;
+    }
+
+    bool Value::GetBool(bool defaultValue) const {
+        if (_text == "true") {
+            return true;
+        }
+        if (_text == "false") {
+            return false;
+        }
+        return defaultValue;
+    }
+
+    Value Value::operator[](std::string_view key) const {
+        if (GetType() != Type::kObject) {
+            return Value();
+        }
+
+        std::size_t position = 1;
+        std::string_view fieldKey;
+        Value value;
+        while (NextField(position, fieldKey, value)) {
+            if (fieldKey == key) {
+                return value;
+            }
+        }
+        return Value();
+    }
+
+    Value Value::operator[](std::size_t index) const {
+        if (GetType() != Type::kArray) {
+            return Value();
+        }
+
+        std::size_t position = 1;
+        Value element;
+        while (NextElement(position, element)) {
+            if (index-- == 0) {
+                return element;
+            }
+        }
+        return Value();
+    }
+
+    bool Value::NextElement(std::size_t& position, Value& element) const {
+        if (GetType() != Type::kArray) {
+            return false;
+        }
+
+        position = SkipWhitespace(_text, position);
+        if (position < _text.size() && _text[position] == ',') {
+            position = SkipWhitespace(_text, position + 1);
+        }
+        if (position >= _text.size() || _text[position] == ']') {
+            return false;
+        }
+
+        std::size_t end = SkipValue(_text, position);
+        if (end == npos) {
+            return false;
+        }
+        element = Value(_text.substr(position, end - position));
+        position = end;
+        return true;
+    }
+
+    bool Value::NextField(std::size_t& position, std::string_view& key, Value& value) const {
+        if (GetType() != Type::kObject) {
+            return false;
+        }
+
+        position = SkipWhitespace(_text, position);
+        if (position < _text.size() && _text[position] == ',') {
+            position = SkipWhitespace(_text, position + 1);
+        }
+        if (position >= _text.size() || _text[position] != '"') {
+            return false;
+        }
+
+        std::size_t keyEnd = SkipString(_text, position);
+        if (keyEnd == npos) {
+            return false;
+        }
+        key = _text.substr(position + 1, keyEnd - position - 2);
+
+        position = SkipWhitespace(_text, keyEnd);
+        if (position >= _text.size() || _text[position] != ':') {
+            return false;
+        }
+        position = SkipWhitespace(_text, position + 1);
+
+        std::size_t end = SkipValue(_text, position);
+        if (end == npos) {
+            return false;
+        }
+        value = Value(_text.substr(position, end - position));
+        position = end;
+        return true;
+    }
+
+    Value Parse(std::string_view text) {
+        std::size_t start = SkipWhitespace(text, 0);
+        std::size_t end = SkipValue(text, start);
+        if (end == npos) {
+            return Value();
+        }
+        return Value(text.substr(start, end - start));
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+* JSON for the messages exchanged with Mantella
+*
+* Json::Writer appends straight into a reusable std::string, so once its buffer has grown to the usual
+* message size, building a message doesn't allocate. Json::Value is an on-demand reader: it never
+* builds a tree or copies anything, it only looks at the part of the input that is asked for and returns
+* string_views into the input. Scanning over strings and nested values uses SSE2 to skip 16 bytes at a time.
+**/
+namespace Json {
+    class Writer {
+    public:
+        Writer() = default;
+        // Write into an existing buffer, keeping its capacity
+        explicit Writer(std::string buffer);
+
+        Writer& BeginObject();
+        Writer& EndObject();
+        Writer& BeginArray();
+        Writer& EndArray();
+        Writer& Key(std::string_view key);
+
+        Writer& String(std::string_view value);
+        Writer& Int(std::int64_t value);
+        Writer& UInt(std::uint64_t value);
+        Writer& Double(double value);
+        Writer& Bool(bool value);
+        Writer& Null();
+        // Insert already serialized JSON as a value
+        Writer& Raw(std::string_view json);
+
+        Writer& Field(std::string_view key, std::string_view value) { return Key(key).String(value); }
+        Writer& Field(std::string_view key, const char* value) { return Key(key).String(value); }
+        Writer& Field(std::string_view key, bool value) { return Key(key).Bool(value); }
+        Writer& Field(std::string_view key, double value) { return Key(key).Double(value); }
+        Writer& Field(std::string_view key, float value) { return Key(key).Double(value); }
+        Writer& Field(std::string_view key, std::int32_t value) { return Key(key).Int(value); }
+        Writer& Field(std::string_view key, std::int64_t value) { return Key(key).Int(value); }
+        Writer& Field(std::string_view key, std::uint32_t value) { return Key(key).UInt(value); }
+        Writer& Field(std::string_view key, std::uint64_t value) { return Key(key).UInt(value); }
+
+        const std::string& GetBuffer() const { return _buffer; }
+        // Hand over the finished text, leaving the writer empty
+        std::string Take();
+        // Start a new document, keeping the buffer's capacity
+        void Reset();
+
+    private:
+        void BeforeValue();
+
+        std::string _buffer;
+        std::uint64_t _hasElements = 0;  // one bit per nesting level
+        std::uint32_t _depth = 0;
+        bool _afterKey = false;
+    };
+
+    // Append text to out as the contents of a JSON string, without the surrounding quotes
+    void AppendEscaped(std::string& out, std::string_view text);
+    // Decode the escapes of raw string contents as returned by Value::GetRawString
+    void Unescape(std::string_view raw, std::string& out);
+
+    class Value {
+    public:
+        enum class Type {
+            kInvalid,
+            kNull,
+            kBool,
+            kNumber,
+            kString,
+            kArray,
+            kObject
+        };
+
+        Value() = default;
+
+        Type GetType() const;
+        bool IsValid() const { return !_text.empty(); }
+        // The exact JSON text of this value
+        std::string_view GetText() const { return _text; }
+
+        // String contents without the quotes. Escape sequences are left as they are, see Unescape.
+        std::string_view GetRawString() const;
+        std::string GetString() const;
+        std::int64_t GetInt(std::int64_t defaultValue = 0) const;
+        std::uint64_t GetUInt(std::uint64_t defaultValue = 0) const;
+        double GetDouble(double defaultValue = 0.0) const;
+        bool GetBool(bool defaultValue = false) const;
+
+        // Field of an object, or an invalid value if there is none
+        Value operator[](std::string_view key) const;
+        // Element of an array, or an invalid value if there is none
+        Value operator[](std::size_t index) const;
+
+        // Call function(Value) for every element of an array
+        template <class Function>
+        void ForEachElement(Function&& function) const {
+            std::size_t position = 1;
+            Value element;
+            while (NextElement(position, element)) {
+                function(element);
+            }
+        }
+
+        // Call function(std::string_view key, Value) for every field of an object. Keys are raw.
+        template <class Function>
+        void ForEachField(Function&& function) const {
+            std::size_t position = 1;
+            std::string_view key;
+            Value value;
+            while (NextField(position, key, value)) {
+                function(key, value);
+            }
+        }
+
+    private:
+        friend Value Parse(std::string_view text);
+        explicit Value(std::string_view text) : _text(text) {}
+
+        bool NextElement(std::size_t& position, Value& element) const;
+        bool NextField(std::size_t& position, std::string_view& key, Value& value) const;
+
+        std::string_view _text;
+    };
+
+    // View the single JSON value in text. Returns an invalid value if it is malformed.
+    Value Parse(std::string_view text);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <windows.h>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+// Helpers implemented in plugin.cpp that the other parts of the plugin share.
+
+std::wstring GetCurrentModuleDirectory();
+std::wstring GetTopLevelDirectory();
+// %LOCALAPPDATA%\Mantella, for data that must not be synced to the cloud. Empty if it can't be found.
+std::wstring GetLocalDataDirectory();
+std::string WideStringToString(const wchar_t* wideString);
+std::wstring StringToWideString(const std::string& string);
+std::vector<HANDLE> LocateExistingMantellaProcesses();
+bool LaunchMantellaExe();
+
+/**
+* Write data to path with one WriteFile call
+*
+* The data goes to a temporary file next to path first, which then replaces path, so the game and
+* Mantella never see a partly written file. Replacing fails while another process maps path.
+**/
+bool WriteWholeFile(const std::wstring& path, std::span<const std::byte> data);
+
+// Print a message to the in-game console. Safe to call from any thread:
+// the message is queued for the main thread, see MainThread.
+void PrintToConsole(std::string message);
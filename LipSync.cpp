@@ -0,0 +1,387 @@
+#include "LipSync.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+
+#include "AudioDSP.h"
+#include "Metrics.h"
+
+#ifdef _WIN32
+    #include <atomic>
+    #include <condition_variable>
+    #include <map>
+    #include <thread>
+
+    #include "Settings.h"
+#endif
+
+namespace LipSync {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr float kSilenceRms = 0.01f;        // about -40 dBFS
+        constexpr float kVoicedFraction = 0.1f;     // of the loudest frame so far
+        constexpr float kNoisyCrossingRate = 0.3f;  // fricatives cross zero far more often than vowels
+        constexpr float kUnitsPerSecond = 14.0f;    // typical speaking rate, in TextToPhonemes' units
+        constexpr float kSmoothing = 0.5f;          // how far each frame moves towards its target
+
+        struct Rule {
+            std::string_view letters;
+            Phoneme phoneme;
+        };
+
+        // Longest spellings first, the first match wins
+        constexpr Rule kRules[] = {
+            {"tch", kChJSh}, {"th", kTh},     {"sh", kChJSh},  {"ch", kChJSh},  {"ph", kFV},     {"wh", kW},
+            {"ck", kK},      {"ng", kN},      {"qu", kK},      {"oo", kOohQ},   {"ee", kEee},    {"ea", kEee},
+            {"ie", kEee},    {"ou", kOh},     {"ow", kOh},     {"oa", kOh},     {"oi", kOh},     {"oy", kOh},
+            {"ai", kEh},     {"ay", kEh},     {"au", kBigAah}, {"aw", kBigAah}, {"er", kR},      {"ir", kR},
+            {"ur", kR},      {"a", kAah},     {"e", kEh},      {"i", kI},       {"o", kOh},      {"u", kOohQ},
+            {"y", kI},       {"b", kBMP},     {"m", kBMP},     {"p", kBMP},     {"f", kFV},      {"v", kFV},
+            {"d", kDST},     {"s", kDST},     {"t", kDST},     {"z", kDST},     {"x", kDST},     {"c", kK},
+            {"g", kK},       {"k", kK},       {"q", kK},       {"j", kChJSh},   {"l", kN},       {"n", kN},
+            {"r", kR},       {"w", kW},
+        };
+
+        bool IsVowel(Phoneme phoneme) {
+            switch (phoneme) {
+                case kAah:
+                case kBigAah:
+                case kEee:
+                case kEh:
+                case kI:
+                case kOh:
+                case kOohQ:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        struct Features {
+            float rms;
+            float crossingRate;
+        };
+
+        Features Measure(const float* samples, std::size_t count) {
+            Features features;
+            features.rms = std::sqrt(AudioDSP::MeanSquare(samples, count));
+            features.crossingRate =
+                count > 1 ? static_cast<float>(AudioDSP::CountZeroCrossings(samples, count)) / (count - 1) : 0.0f;
+            return features;
+        }
+
+        bool IsVoiced(const Features& features, float loudest) {
+            return features.rms > std::max(kSilenceRms, loudest * kVoicedFraction);
+        }
+
+        // Mouth opening from loudness, 0 at -40 dBFS and fully open at -10 dBFS
+        float Opening(float rms) {
+            float db = 20.0f * std::log10(std::max(rms, 1e-6f));
+            return std::clamp((db + 40.0f) / 30.0f, 0.0f, 1.0f);
+        }
+
+        // Phoneme at cursor, then move the cursor on by step
+        const Segment* Advance(const std::vector<Segment>& phonemes, std::size_t& index, float& cursor, float step) {
+            if (phonemes.empty()) {
+                return nullptr;
+            }
+            while (index + 1 < phonemes.size() && phonemes[index].end <= cursor) {
+                ++index;
+            }
+            cursor += step;
+            return &phonemes[index];
+        }
+
+        Frame Shape(const Features& features, bool voiced, const Segment* segment, const Frame& previous) {
+            Frame target = {};
+            if (voiced) {
+                float opening = Opening(features.rms);
+                if (segment) {
+                    // Consonants are shaped by the lips and tongue, so they barely depend on loudness
+                    target[segment->phoneme] = IsVowel(segment->phoneme) ? opening : 0.4f + 0.6f * opening;
+                } else if (features.crossingRate > kNoisyCrossingRate) {
+                    target[kDST] = opening;
+                } else {
+                    target[kAah] = opening;
+                    target[kEh] = 0.5f * opening;
+                }
+            }
+
+            Frame frame;
+            for (std::size_t i = 0; i < kPhonemeCount; ++i) {
+                frame[i] = previous[i] + (target[i] - previous[i]) * kSmoothing;
+            }
+            return frame;
+        }
+
+        void ToMono(const std::int16_t* samples, std::size_t frames, std::uint16_t channels,
+                    std::vector<float>& converted, std::vector<float>& mono) {
+            converted.resize(frames * channels);
+            mono.resize(frames);
+            AudioDSP::Int16ToFloat(samples, converted.data(), converted.size());
+            AudioDSP::DownmixToMono(converted.data(), frames, channels, mono.data());
+        }
+    }
+
+#ifdef _WIN32
+    namespace {
+        constexpr auto kUpdateInterval = std::chrono::milliseconds(16);
+
+        struct Playing {
+            std::shared_ptr<Animation> animation;
+            Clock::time_point start;
+        };
+
+        struct State {
+            bool enabled = false;
+
+            std::mutex lock;
+            std::condition_variable wake;
+            std::map<std::uint32_t, Playing> playing;
+            std::vector<std::uint32_t> stopped;
+            std::atomic<bool> taskQueued{false};
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        void SetPhonemes(std::uint32_t refId, const Frame& weights) {
+            auto* actor = RE::TESForm::LookupByID<RE::Actor>(refId);
+            RE::BSFaceGenAnimationData* faceGen = actor ? actor->GetFaceGenAnimationData() : nullptr;
+            if (!faceGen) {
+                return;
+            }
+
+            RE::BSSpinLockGuard guard(faceGen->lock);
+            RE::BSFaceGenKeyframeMultiple& keyframe = faceGen->phenomeKeyFrame;
+            for (std::uint32_t i = 0; i < keyframe.count && i < kPhonemeCount; ++i) {
+                keyframe.values[i] = weights[i];
+            }
+            keyframe.isUpdated = false;
+        }
+
+        // Frame at a fractional position, holding the last frame while more audio is on its way
+        bool Sample(Animation& animation, float position, Frame& frame) {
+            std::lock_guard guard(animation.lock);
+            if (animation.frames.empty()) {
+                return false;
+            }
+
+            std::size_t index = static_cast<std::size_t>(position);
+            if (index + 1 >= animation.frames.size()) {
+                frame = animation.frames.back();
+                return true;
+            }
+
+            float blend = position - static_cast<float>(index);
+            const Frame& from = animation.frames[index];
+            const Frame& to = animation.frames[index + 1];
+            for (std::size_t i = 0; i < kPhonemeCount; ++i) {
+                frame[i] = from[i] + (to[i] - from[i]) * blend;
+            }
+            return true;
+        }
+
+        // Runs on the main thread
+        void ApplyFrames() {
+            State& state = GetState();
+            state.taskQueued = false;
+
+            std::vector<std::pair<std::uint32_t, Frame>> updates;
+            {
+                std::lock_guard guard(state.lock);
+                Clock::time_point now = Clock::now();
+                for (auto& [refId, playing] : state.playing) {
+                    float seconds = std::chrono::duration<float>(now - playing.start).count();
+                    Frame frame;
+                    if (seconds >= 0.0f && Sample(*playing.animation, seconds * kFramesPerSecond, frame)) {
+                        updates.emplace_back(refId, frame);
+                    }
+                }
+                for (std::uint32_t refId : state.stopped) {
+                    updates.emplace_back(refId, Frame{});
+                }
+                state.stopped.clear();
+            }
+
+            for (const auto& [refId, frame] : updates) {
+                SetPhonemes(refId, frame);
+            }
+        }
+
+        // Ask the main thread for an update every frame or so while anything is animated
+        void UpdateLoop() {
+            State& state = GetState();
+            for (;;) {
+                {
+                    std::unique_lock guard(state.lock);
+                    state.wake.wait(guard, [&]() { return !state.playing.empty() || !state.stopped.empty(); });
+                }
+                if (!state.taskQueued.exchange(true)) {
+                    SKSE::GetTaskInterface()->AddTask(ApplyFrames);
+                }
+                std::this_thread::sleep_for(kUpdateInterval);
+            }
+        }
+    }
+#endif
+
+    std::vector<Segment> TextToPhonemes(std::string_view text) {
+        std::string lower;
+        lower.reserve(text.size());
+        for (char c : text) {
+            lower.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+        }
+
+        std::vector<Segment> phonemes;
+        float time = 0.0f;
+        std::string_view rest = lower;
+        while (!rest.empty()) {
+            const Rule* match = nullptr;
+            for (const Rule& rule : kRules) {
+                if (rest.starts_with(rule.letters)) {
+                    match = &rule;
+                    break;
+                }
+            }
+            if (!match) {
+                rest.remove_prefix(1);  // Silent letters, digits, punctuation and spaces
+                continue;
+            }
+
+            // Doubled letters are one sound
+            if (phonemes.empty() || phonemes.back().phoneme != match->phoneme || match->letters.size() > 1) {
+                float duration = IsVowel(match->phoneme) ? 2.0f : 1.0f;
+                phonemes.push_back({match->phoneme, time, time + duration});
+                time += duration;
+            }
+            rest.remove_prefix(match->letters.size());
+        }
+        return phonemes;
+    }
+
+    void Analyzer::Begin(std::uint32_t sampleRate, std::uint16_t channels) {
+        _phonemes.clear();
+        _phonemeIndex = 0;
+        _cursor = 0.0f;
+        _unitsPerVoicedFrame = kUnitsPerSecond / kFramesPerSecond;
+        _channels = std::max<std::uint16_t>(channels, 1);
+        _frameSamples = static_cast<std::size_t>(static_cast<float>(sampleRate) / kFramesPerSecond);
+        _loudest = 0.0f;
+        _pending.clear();
+        _previous = {};
+        _animation = std::make_shared<Animation>();
+    }
+
+    void Analyzer::SetText(std::string_view text) { _phonemes = TextToPhonemes(text); }
+
+    void Analyzer::Feed(const std::int16_t* samples, std::size_t frames) {
+        if (_frameSamples == 0) {
+            return;
+        }
+
+        Clock::time_point start = Clock::now();
+        ToMono(samples, frames, _channels, _converted, _mono);
+        _pending.insert(_pending.end(), _mono.begin(), _mono.end());
+
+        std::vector<Frame> finished;
+        std::size_t offset = 0;
+        for (; offset + _frameSamples <= _pending.size(); offset += _frameSamples) {
+            Features features = Measure(_pending.data() + offset, _frameSamples);
+            _loudest = std::max(_loudest, features.rms);
+            bool voiced = IsVoiced(features, _loudest);
+            const Segment* segment =
+                voiced ? Advance(_phonemes, _phonemeIndex, _cursor, _unitsPerVoicedFrame) : nullptr;
+            _previous = Shape(features, voiced, segment, _previous);
+            finished.push_back(_previous);
+        }
+        _pending.erase(_pending.begin(), _pending.begin() + offset);
+
+        if (!finished.empty()) {
+            std::lock_guard guard(_animation->lock);
+            _animation->frames.insert(_animation->frames.end(), finished.begin(), finished.end());
+        }
+        Metrics::RecordLatency("lipsync.analyze",
+                               std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    std::vector<Frame> Generate(std::string_view text, const std::int16_t* samples, std::size_t frames,
+                                std::uint32_t sampleRate, std::uint16_t channels) {
+        std::vector<float> converted;
+        std::vector<float> mono;
+        ToMono(samples, frames, std::max<std::uint16_t>(channels, 1), converted, mono);
+
+        std::size_t frameSamples = static_cast<std::size_t>(static_cast<float>(sampleRate) / kFramesPerSecond);
+        if (frameSamples == 0) {
+            return {};
+        }
+
+        std::vector<Features> features;
+        float loudest = 0.0f;
+        for (std::size_t offset = 0; offset + frameSamples <= mono.size(); offset += frameSamples) {
+            features.push_back(Measure(mono.data() + offset, frameSamples));
+            loudest = std::max(loudest, features.back().rms);
+        }
+
+        std::size_t voicedFrames = std::count_if(features.begin(), features.end(),
+                                                 [&](const Features& frame) { return IsVoiced(frame, loudest); });
+
+        std::vector<Segment> phonemes = TextToPhonemes(text);
+        float step = phonemes.empty() || voicedFrames == 0 ? 0.0f : phonemes.back().end / voicedFrames;
+        std::size_t index = 0;
+        float cursor = 0.0f;
+
+        std::vector<Frame> result;
+        result.reserve(features.size());
+        Frame previous = {};
+        for (const Features& frame : features) {
+            bool voiced = IsVoiced(frame, loudest);
+            const Segment* segment = voiced ? Advance(phonemes, index, cursor, step) : nullptr;
+            previous = Shape(frame, voiced, segment, previous);
+            result.push_back(previous);
+        }
+        return result;
+    }
+
+#ifdef _WIN32
+    void Install() {
+        State& state = GetState();
+        state.enabled = Settings::GetBool(L"LipSync", L"bEnabled", true);
+        if (state.enabled) {
+            std::thread(UpdateLoop).detach();
+        }
+    }
+
+    bool IsEnabled() { return GetState().enabled; }
+
+    void Play(std::uint32_t refId, std::shared_ptr<Animation> animation, std::chrono::steady_clock::time_point start) {
+        State& state = GetState();
+        if (!state.enabled || refId == 0 || !animation) {
+            return;
+        }
+        {
+            std::lock_guard guard(state.lock);
+            state.playing.insert_or_assign(refId, Playing{std::move(animation), start});
+            std::erase(state.stopped, refId);
+        }
+        state.wake.notify_one();
+    }
+
+    void Stop(std::uint32_t refId) {
+        State& state = GetState();
+        {
+            std::lock_guard guard(state.lock);
+            if (state.playing.erase(refId) == 0) {
+                return;
+            }
+            state.stopped.push_back(refId);
+        }
+        state.wake.notify_one();
+    }
+#endif
+}
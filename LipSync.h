@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+/**
+* Native lip sync for streamed voice lines
+*
+* Instead of running an external lip generation tool for every line, the phoneme track is estimated
+* while the audio arrives. The text of the line is turned into a sequence of Skyrim's 16 phoneme
+* targets with simple spelling rules. The audio is measured in 1/30 s frames (loudness and zero
+* crossings, using the AudioDSP kernels), and the text phonemes are spread over the voiced frames,
+* with the mouth opening following the loudness.
+*
+* The result is applied directly to the speaker's face animation on the main thread, so no .lip
+* file has to be written.
+**/
+namespace LipSync {
+    // Skyrim's phoneme targets, in the order of BSFaceGenAnimationData's phoneme keyframe
+    enum Phoneme : std::uint8_t {
+        kAah,
+        kBigAah,
+        kBMP,
+        kChJSh,
+        kDST,
+        kEee,
+        kEh,
+        kFV,
+        kI,
+        kK,
+        kN,
+        kOh,
+        kOohQ,
+        kR,
+        kTh,
+        kW,
+        kPhonemeCount
+    };
+
+    constexpr float kFramesPerSecond = 30.0f;
+
+    // Weight of every phoneme target for one frame
+    using Frame = std::array<float, kPhonemeCount>;
+
+    // Frames of one line. Grows while the line is streamed, so access it under the lock.
+    struct Animation {
+        std::mutex lock;
+        std::vector<Frame> frames;
+    };
+
+    // A phoneme of the text and its place on the text's relative time scale
+    struct Segment {
+        Phoneme phoneme;
+        float start;
+        float end;
+    };
+
+    // Spell out text as phonemes, vowels taking twice as long as consonants
+    std::vector<Segment> TextToPhonemes(std::string_view text);
+
+    /**
+    * Incremental lip sync analysis of one line
+    *
+    * Without the whole line the number of voiced frames isn't known yet, so the text is paced at a
+    * typical speaking rate and held on its last phoneme if the audio runs longer.
+    **/
+    class Analyzer {
+    public:
+        void Begin(std::uint32_t sampleRate, std::uint16_t channels);
+        // Optional, before the first Feed. Without text only the mouth opening is animated.
+        void SetText(std::string_view text);
+        // Analyze interleaved 16-bit samples and append the finished frames to the animation
+        void Feed(const std::int16_t* samples, std::size_t frames);
+
+        bool IsActive() const { return _frameSamples > 0; }
+        const std::shared_ptr<Animation>& GetAnimation() const { return _animation; }
+
+    private:
+        std::vector<Segment> _phonemes;
+        std::size_t _phonemeIndex = 0;
+        float _cursor = 0.0f;
+        float _unitsPerVoicedFrame = 0.0f;
+
+        std::uint16_t _channels = 1;
+        std::size_t _frameSamples = 0;
+        float _loudest = 0.0f;
+        std::vector<float> _converted;
+        std::vector<float> _mono;
+        std::vector<float> _pending;
+        Frame _previous = {};
+        std::shared_ptr<Animation> _animation;
+    };
+
+    // Analyze a complete line at once, spreading the text exactly over its voiced frames
+    std::vector<Frame> Generate(std::string_view text, const std::int16_t* samples, std::size_t frames,
+                                std::uint32_t sampleRate, std::uint16_t channels);
+
+#ifdef _WIN32
+    // Read the settings and start the animation thread. Call once at kDataLoaded.
+    void Install();
+    bool IsEnabled();
+
+    // Animate the face of the actor refId, frame 0 being shown at start
+    void Play(std::uint32_t refId, std::shared_ptr<Animation> animation, std::chrono::steady_clock::time_point start);
+    // Stop animating refId and close its mouth
+    void Stop(std::uint32_t refId);
+#endif
+}
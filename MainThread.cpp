@@ -0,0 +1,160 @@
+#include "MainThread.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <atomic>
+    #include <thread>
+
+    #include "Metrics.h"
+    #include "Settings.h"
+#endif
+
+namespace MainThread {
+    bool WorkQueue::Push(std::function<void()> work, std::string key) {
+        std::lock_guard guard(_lock);
+        if (!key.empty() && !_keys.insert(key).second) {
+            return false;
+        }
+        _items.push_back({std::move(work), std::move(key), Clock::now()});
+        return true;
+    }
+
+    WorkQueue::Stats WorkQueue::Drain(Clock::duration budget) {
+        Stats stats;
+        Clock::time_point start = Clock::now();
+        std::size_t available = GetSize();
+        while (stats.ran < available) {
+            Item item;
+            {
+                std::lock_guard guard(_lock);
+                if (_items.empty()) {
+                    break;
+                }
+                item = std::move(_items.front());
+                _items.pop_front();
+                if (!item.key.empty()) {
+                    _keys.erase(item.key);
+                }
+            }
+
+            Clock::time_point now = Clock::now();
+            stats.longestWait = std::max(stats.longestWait, now - item.queuedAt);
+            item.work();
+            ++stats.ran;
+            if (Clock::now() - start >= budget) {
+                break;
+            }
+        }
+        stats.elapsed = Clock::now() - start;
+        stats.remaining = GetSize();
+        return stats;
+    }
+
+    std::size_t WorkQueue::GetSize() const {
+        std::lock_guard guard(_lock);
+        return _items.size();
+    }
+
+#ifdef _WIN32
+    namespace {
+        using Clock = WorkQueue::Clock;
+
+        // SKSE runs every task queued before its task loop empties, including ones queued meanwhile. Slices
+        // are queued at least this far apart so each of them lands in a frame of its own.
+        constexpr auto kMinSliceInterval = std::chrono::milliseconds(8);
+
+        struct State {
+            WorkQueue queue;
+            Clock::duration budget = std::chrono::microseconds(500);
+            HANDLE wakeEvent = NULL;
+            std::atomic<bool> sliceQueued{false};
+            std::atomic<Clock::rep> lastSlice{0};  // when the last slice started, as Clock ticks
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        // Runs on the main thread, once per frame while there is work
+        void RunSlice() {
+            State& state = GetState();
+            state.lastSlice = Clock::now().time_since_epoch().count();
+            WorkQueue::Stats stats = state.queue.Drain(state.budget);
+            state.sliceQueued = false;
+
+            Metrics::RecordLatency("main.work", std::chrono::duration<double, std::milli>(stats.elapsed).count());
+            Metrics::RecordLatency("main.wait", std::chrono::duration<double, std::milli>(stats.longestWait).count());
+            Metrics::SetGauge("main.deferred", static_cast<std::int64_t>(stats.remaining));
+            if (stats.remaining > 0) {
+                Metrics::Increment("main.deferred_frames");
+            }
+            // Checked after clearing sliceQueued, so work posted in between isn't left waiting
+            if (state.queue.GetSize() > 0) {
+                SetEvent(state.wakeEvent);
+            }
+        }
+
+        void PumpLoop() {
+            State& state = GetState();
+            for (;;) {
+                WaitForSingleObject(state.wakeEvent, INFINITE);
+                if (state.sliceQueued || state.queue.GetSize() == 0) {
+                    continue;
+                }
+                Clock::time_point lastSlice{Clock::duration(state.lastSlice.load())};
+                std::this_thread::sleep_until(lastSlice + kMinSliceInterval);
+                state.sliceQueued = true;
+                SKSE::GetTaskInterface()->AddTask(RunSlice);
+            }
+        }
+
+        void Wake(State& state) {
+            if (!state.sliceQueued && state.wakeEvent != NULL) {
+                SetEvent(state.wakeEvent);
+            }
+        }
+    }
+
+    void Install() {
+        State& state = GetState();
+        if (state.wakeEvent != NULL) {
+            return;
+        }
+        int budgetUs = Settings::GetInt(L"MainThread", L"iFrameBudgetUs", 500);
+        state.budget = std::chrono::microseconds(std::max(budgetUs, 50));
+        state.wakeEvent = CreateEvent(NULL, FALSE, TRUE, NULL);  // Signaled, for work posted before Install
+        std::thread(PumpLoop).detach();
+    }
+
+    void Post(std::function<void()> work) {
+        State& state = GetState();
+        state.queue.Push(std::move(work));
+        Wake(state);
+    }
+
+    void SendModEvent(std::string eventName, std::string strArg, float numArg) {
+        State& state = GetState();
+        // Identical events share a key: the name and the string argument, plus the bits of the number
+        std::string key = eventName;
+        key += '\0';
+        key += strArg;
+        key += '\0';
+        key.append(reinterpret_cast<const char*>(&numArg), sizeof(numArg));
+
+        bool queued = state.queue.Push(
+            [eventName = std::move(eventName), strArg = std::move(strArg), numArg]() {
+                SKSE::ModCallbackEvent event{eventName.c_str(), strArg.c_str(), numArg, nullptr};
+                SKSE::GetModCallbackEventSource()->SendEvent(&event);
+            },
+            std::move(key));
+        if (!queued) {
+            Metrics::Increment("main.coalesced");
+            return;
+        }
+        Wake(state);
+    }
+#endif
+}
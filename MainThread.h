@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+/**
+* Work that has to run on the game's main thread, spread over frames
+*
+* Handing every console message and ModEvent to SKSE's task interface on its own runs all of them in the
+* next frame, so a burst (the launch finishing along with dozens of voice file and readiness events) lands
+* in one frame and hitches. Instead, work is queued here and drained once per frame under a budget of
+* [MainThread] iFrameBudgetUs; whatever doesn't fit waits for the next frame. ModEvents that are already
+* waiting with the same name and arguments are only sent once. The time spent per frame is recorded as
+* "main.work", how much had to wait for a later frame as "main.deferred".
+**/
+namespace MainThread {
+    /**
+    * The scheduling policy, separate from SKSE so it can be exercised with any work
+    *
+    * Thread safe. Work is run in the order it was pushed.
+    **/
+    class WorkQueue {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Stats {
+            std::size_t ran = 0;
+            std::size_t remaining = 0;
+            Clock::duration elapsed{};
+            Clock::duration longestWait{};  // from being pushed to running, of the work that ran
+        };
+
+        // Queue work. Work with a key is dropped while other work with the same key still waits, returning false.
+        bool Push(std::function<void()> work, std::string key = {});
+
+        // Run the work that was queued when it was called until budget is spent. At least one item runs, so
+        // the queue keeps moving even when a single item takes longer than the budget.
+        Stats Drain(Clock::duration budget);
+
+        std::size_t GetSize() const;
+
+    private:
+        struct Item {
+            std::function<void()> work;
+            std::string key;
+            Clock::time_point queuedAt;
+        };
+
+        mutable std::mutex _lock;
+        std::deque<Item> _items;
+        std::unordered_set<std::string> _keys;
+    };
+
+    // Start handing the queue to the main thread. Call once, first thing at kDataLoaded.
+    void Install();
+
+    // Run work on the main thread in a later frame. Safe to call from any thread.
+    void Post(std::function<void()> work);
+
+    // Send a ModEvent from the main thread, unless an identical one is still waiting to be sent
+    void SendModEvent(std::string eventName, std::string strArg = {}, float numArg = 0.0f);
+}
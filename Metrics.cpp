@@ -0,0 +1,134 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#ifdef _WIN32
+    #include "Launcher.h"
+#endif
+
+namespace Metrics {
+    namespace {
+        // Bucket i holds samples below 2^i microseconds, the last bucket catches everything else
+        constexpr std::size_t kBucketCount = 28;
+
+        struct Histogram {
+            std::array<std::uint64_t, kBucketCount> buckets{};
+            std::uint64_t count = 0;
+            double sum = 0.0;
+            double min = 0.0;
+            double max = 0.0;
+
+            void Add(double milliseconds) {
+                double micros = std::max(milliseconds * 1000.0, 0.0);
+                std::size_t bucket = 0;
+                while (bucket + 1 < kBucketCount && micros >= static_cast<double>(1ull << bucket)) {
+                    ++bucket;
+                }
+                ++buckets[bucket];
+                min = count == 0 ? milliseconds : std::min(min, milliseconds);
+                max = count == 0 ? milliseconds : std::max(max, milliseconds);
+                sum += milliseconds;
+                ++count;
+            }
+
+            // Upper bound of the bucket that contains the given percentile, clamped to the observed range
+            double Percentile(double fraction) const {
+                std::uint64_t target = static_cast<std::uint64_t>(std::ceil(fraction * static_cast<double>(count)));
+                std::uint64_t seen = 0;
+                for (std::size_t i = 0; i < kBucketCount; ++i) {
+                    seen += buckets[i];
+                    if (seen >= target && seen > 0) {
+                        double upper = static_cast<double>(1ull << i) / 1000.0;
+                        return std::clamp(upper, min, max);
+                    }
+                }
+                return max;
+            }
+        };
+
+        struct Registry {
+            std::mutex lock;
+            std::map<std::string, std::uint64_t, std::less<>> counters;
+            std::map<std::string, std::int64_t, std::less<>> gauges;
+            std::map<std::string, Histogram, std::less<>> histograms;
+        };
+
+        Registry& GetRegistry() {
+            static Registry registry;
+            return registry;
+        }
+
+        template <class Map>
+        auto& FindOrInsert(Map& map, std::string_view name) {
+            auto it = map.find(name);
+            if (it == map.end()) {
+                it = map.emplace(std::string(name), typename Map::mapped_type{}).first;
+            }
+            return it->second;
+        }
+    }
+
+    void Increment(std::string_view name, std::uint64_t amount) {
+        Registry& registry = GetRegistry();
+        std::lock_guard guard(registry.lock);
+        FindOrInsert(registry.counters, name) += amount;
+    }
+
+    void SetGauge(std::string_view name, std::int64_t value) {
+        Registry& registry = GetRegistry();
+        std::lock_guard guard(registry.lock);
+        FindOrInsert(registry.gauges, name) = value;
+    }
+
+    void RecordLatency(std::string_view name, double milliseconds) {
+        Registry& registry = GetRegistry();
+        std::lock_guard guard(registry.lock);
+        FindOrInsert(registry.histograms, name).Add(milliseconds);
+    }
+
+    std::string Format() {
+        Registry& registry = GetRegistry();
+        std::lock_guard guard(registry.lock);
+
+        std::stringstream ss;
+        for (const auto& [name, value] : registry.counters) {
+            ss << name << ": " << value << "\n";
+        }
+        for (const auto& [name, value] : registry.gauges) {
+            ss << name << ": " << value << "\n";
+        }
+        for (const auto& [name, histogram] : registry.histograms) {
+            char line[256];
+            std::snprintf(line, sizeof(line), "%s: n=%llu mean=%.2fms p50=%.2fms p90=%.2fms p99=%.2fms max=%.2fms\n",
+                          name.c_str(), static_cast<unsigned long long>(histogram.count),
+                          histogram.count ? histogram.sum / static_cast<double>(histogram.count) : 0.0,
+                          histogram.Percentile(0.50), histogram.Percentile(0.90), histogram.Percentile(0.99),
+                          histogram.max);
+            ss << line;
+        }
+        return ss.str();
+    }
+
+#ifdef _WIN32
+    void LogToConsole() {
+        std::string text = Format();
+        if (text.empty()) {
+            PrintToConsole("Mantella metrics: nothing recorded yet.");
+            return;
+        }
+
+        std::size_t start = 0;
+        while (start < text.size()) {
+            std::size_t end = text.find('\n', start);
+            PrintToConsole(text.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+#endif
+}
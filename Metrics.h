@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+* Process-wide counters and latency histograms
+*
+* Any part of the plugin can record into a named metric from any thread.
+* Latencies are kept in power-of-two microsecond buckets, which is enough to
+* report percentiles without storing individual samples.
+**/
+namespace Metrics {
+    void Increment(std::string_view name, std::uint64_t amount = 1);
+    void SetGauge(std::string_view name, std::int64_t value);
+    void RecordLatency(std::string_view name, double milliseconds);
+
+    // One line per metric, sorted by name
+    std::string Format();
+#ifdef _WIN32
+    void LogToConsole();
+#endif
+}
@@ -0,0 +1,233 @@
+#include "ModOrganizer.h"
+
+#include <windows.h>
+#include <exdisp.h>
+#include <shldisp.h>
+#include <shlguid.h>
+#include <shobjidl.h>
+#include <comdef.h>
+#include <wrl/client.h>
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Launcher.h"
+#include "Metrics.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace ModOrganizer {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr int kProbeFileCount = 200;
+        constexpr DWORD kProbeFileSize = 4096;
+
+        std::wstring GetEnvironment(const wchar_t* name) {
+            wchar_t value[MAX_PATH];
+            DWORD length = GetEnvironmentVariable(name, value, MAX_PATH);
+            if (length == 0 || length >= MAX_PATH) {
+                return L"";
+            }
+            return value;
+        }
+
+        // Path of the file behind an open handle, without the \\?\ prefix
+        std::wstring GetHandlePath(HANDLE file) {
+            wchar_t path[MAX_PATH];
+            DWORD length = GetFinalPathNameByHandle(file, path, MAX_PATH, FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+            if (length == 0 || length >= MAX_PATH) {
+                return L"";
+            }
+
+            std::wstring result(path, length);
+            if (result.starts_with(L"\\\\?\\UNC\\")) {
+                result = L"\\\\" + result.substr(8);
+            } else if (result.starts_with(L"\\\\?\\")) {
+                result = result.substr(4);
+            }
+            return result;
+        }
+
+        /**
+        * Ask Explorer's desktop window to run a program
+        *
+        * Explorer is not hooked by usvfs, so whatever it starts is outside the virtual file system as well.
+        * Must be called on a thread that initialized a single-threaded COM apartment.
+        **/
+        bool ShellExecuteFromDesktop(const std::wstring& file, const std::wstring& parameters,
+                                     const std::wstring& directory, int show) {
+            ComPtr<IShellWindows> shellWindows;
+            if (FAILED(CoCreateInstance(CLSID_ShellWindows, NULL, CLSCTX_LOCAL_SERVER, IID_PPV_ARGS(&shellWindows)))) {
+                return false;
+            }
+
+            _variant_t desktopLocation(static_cast<long>(CSIDL_DESKTOP));
+            _variant_t empty;
+            long hwnd = 0;
+            ComPtr<IDispatch> desktop;
+            if (shellWindows->FindWindowSW(&desktopLocation, &empty, SWC_DESKTOP, &hwnd, SWFO_NEEDDISPATCH,
+                                           &desktop) != S_OK ||
+                !desktop) {
+                return false;
+            }
+
+            ComPtr<IServiceProvider> provider;
+            ComPtr<IShellBrowser> browser;
+            ComPtr<IShellView> view;
+            ComPtr<IDispatch> background;
+            ComPtr<IShellFolderViewDual> folderView;
+            ComPtr<IDispatch> application;
+            ComPtr<IShellDispatch2> shell;
+            if (FAILED(desktop.As(&provider)) ||
+                FAILED(provider->QueryService(SID_STopLevelBrowser, IID_PPV_ARGS(&browser))) ||
+                FAILED(browser->QueryActiveShellView(&view)) ||
+                FAILED(view->GetItemObject(SVGIO_BACKGROUND, IID_PPV_ARGS(&background))) ||
+                FAILED(background.As(&folderView)) || FAILED(folderView->get_Application(&application)) ||
+                FAILED(application.As(&shell))) {
+                return false;
+            }
+
+            return SUCCEEDED(shell->ShellExecute(_bstr_t(file.c_str()), _variant_t(parameters.c_str()),
+                                                 _variant_t(directory.c_str()), _variant_t(L"open"),
+                                                 _variant_t(static_cast<long>(show))));
+        }
+
+        // Append `set "name=value" && ` for the command line run by cmd.exe
+        void AppendSet(std::wstring& command, const wchar_t* name, const std::wstring& value) {
+            if (!value.empty()) {
+                command += L"set \"";
+                command += name;
+                command += L"=" + value + L"\" && ";
+            }
+        }
+
+        // Average time of one create, write and delete cycle in directory, or a negative value on failure
+        double TimeFileOps(const std::wstring& directory) {
+            std::vector<char> data(kProbeFileSize, 'M');
+            std::wstring prefix = directory + L"\\MantellaLauncher.probe";
+
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < kProbeFileCount; ++i) {
+                std::wstring path = prefix + std::to_wstring(i);
+                HANDLE file = CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                         FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+                if (file == INVALID_HANDLE_VALUE) {
+                    return -1.0;
+                }
+                DWORD written = 0;
+                WriteFile(file, data.data(), kProbeFileSize, &written, NULL);
+                CloseHandle(file);
+            }
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / kProbeFileCount;
+        }
+    }
+
+    bool IsVirtualized() { return GetModuleHandle(L"usvfs_x64.dll") != NULL; }
+
+    std::wstring ResolveRealPath(const std::wstring& path) {
+        // usvfs redirects the open to the real file, so the handle knows where it actually lives
+        HANDLE file = CreateFile(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                 OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return L"";
+        }
+        std::wstring result = GetHandlePath(file);
+        CloseHandle(file);
+        return result;
+    }
+
+    std::wstring ResolveOverwriteFolder() {
+        if (!IsVirtualized()) {
+            return L"";
+        }
+
+        // A new file in the virtual Data folder is created in the overwrite folder
+        std::wstring probe = GetTopLevelDirectory() + L"\\Data\\MantellaLauncher.overwrite.probe";
+        HANDLE file = CreateFile(probe.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW,
+                                 FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return L"";
+        }
+        std::wstring result = GetHandlePath(file);
+        CloseHandle(file);
+        return std::filesystem::path(result).parent_path().wstring();
+    }
+
+    bool LaunchOutsideVfs(const std::wstring& exePath, const std::wstring& parameters) {
+        // Explorer only sees the real disk, so every path handed over must be a real one
+        std::wstring realExe = ResolveRealPath(exePath);
+        if (realExe.empty()) {
+            return false;
+        }
+        std::filesystem::path workingDir = std::filesystem::path(realExe).parent_path().parent_path();
+        std::wstring overwriteDir = ResolveOverwriteFolder();
+        std::wstring voiceDir = ResolveRealPath(GetTopLevelDirectory() + L"\\Data\\Sound\\Voice\\Mantella.esp");
+
+        PrintToConsole("Mantella.exe resolved to " + WideStringToString(realExe.c_str()));
+        if (!overwriteDir.empty()) {
+            PrintToConsole("MO2 overwrite folder: " + WideStringToString(overwriteDir.c_str()));
+        }
+        if (!voiceDir.empty()) {
+            PrintToConsole("Mantella voice folder: " + WideStringToString(voiceDir.c_str()));
+        }
+
+        // The child gets Explorer's environment, so cmd.exe sets ours again before starting Mantella
+        std::wstring command = L"/d /s /c \"";
+        AppendSet(command, L"TEMP", GetEnvironment(L"TEMP"));
+        AppendSet(command, L"TMP", GetEnvironment(L"TMP"));
+        AppendSet(command, L"MANTELLA_GAME_DIR", GetTopLevelDirectory());
+        AppendSet(command, L"MANTELLA_OVERWRITE_DIR", overwriteDir);
+        AppendSet(command, L"MANTELLA_VOICE_DIR", voiceDir);
+        AppendSet(command, L"MANTELLA_CATALOG", GetEnvironment(L"MANTELLA_CATALOG"));
+        command += L"start \"Mantella\" /min /d \"" + workingDir.wstring() + L"\" \"" + realExe + L"\" " + parameters +
+                   L"\"";
+
+        wchar_t systemDir[MAX_PATH];
+        if (GetSystemDirectory(systemDir, MAX_PATH) == 0) {
+            return false;
+        }
+        std::wstring cmd = std::wstring(systemDir) + L"\\cmd.exe";
+
+        // Use a fresh thread so the COM apartment doesn't depend on the caller's
+        bool launched = false;
+        std::thread([&]() {
+            if (SUCCEEDED(CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE))) {
+                launched = ShellExecuteFromDesktop(cmd, command, workingDir.wstring(), SW_HIDE);
+                CoUninitialize();
+            }
+        }).join();
+
+        Metrics::Increment(launched ? "vfs.launch.outside" : "vfs.launch.failed");
+        return launched;
+    }
+
+    void MeasureFileThroughput() {
+        std::wstring virtualDir = GetCurrentModuleDirectory();
+        std::wstring realDir = ResolveRealPath(virtualDir);
+        if (realDir.empty()) {
+            return;
+        }
+
+        double virtualMs = TimeFileOps(virtualDir);
+        double realMs = TimeFileOps(realDir);
+        if (virtualMs < 0.0 || realMs < 0.0) {
+            std::stringstream ss;
+            ss << "File throughput probe failed. Error: " << GetLastError();
+            PrintToConsole(ss.str());
+            return;
+        }
+
+        Metrics::RecordLatency("vfs.file_op.virtual", virtualMs);
+        Metrics::RecordLatency("vfs.file_op.real", realMs);
+
+        std::stringstream ss;
+        ss.precision(3);
+        ss << "File create/write/delete: " << virtualMs << " ms through MO2's virtual Data folder, " << realMs
+           << " ms on the real folder.";
+        PrintToConsole(ss.str());
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+/**
+* Launching Mantella.exe outside Mod Organizer 2's virtual file system
+*
+* When Skyrim is started from MO2, usvfs hooks the game process and injects itself into every child
+* process it creates, so all of Mantella's Python imports, model loads and temp files would go through
+* the virtual file system. To avoid that, Mantella.exe is started by Explorer (the desktop shell) instead
+* of by the game. That process no longer sees the virtual Data folder, so the real paths it needs are
+* resolved through usvfs beforehand.
+**/
+namespace ModOrganizer {
+    // True when usvfs is loaded into the game process
+    bool IsVirtualized();
+
+    // Real on-disk location of a file or folder in the virtual file system, or an empty string if it doesn't exist
+    std::wstring ResolveRealPath(const std::wstring& path);
+
+    // MO2's overwrite folder, where new files created in the virtual Data folder end up
+    std::wstring ResolveOverwriteFolder();
+
+    /**
+    * Start exePath with parameters through Explorer, with the current TEMP/TMP and the resolved paths
+    * passed on as environment variables. Returns false if the launch could not be requested.
+    **/
+    bool LaunchOutsideVfs(const std::wstring& exePath, const std::wstring& parameters);
+
+    // Time small file create/write/delete cycles through a virtual path and its real path and record both
+    void MeasureFileThroughput();
+}
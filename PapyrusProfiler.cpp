@@ -0,0 +1,192 @@
+#include "PapyrusProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Launcher.h"
+#include "Metrics.h"
+#include "Settings.h"
+#include "Trace.h"
+
+namespace PapyrusProfiler {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        struct Observation {
+            const RE::BSScript::IFunction* function = nullptr;
+            std::string name;  // "papyrus.<Script>.<Function>"
+            Clock::time_point firstSeen;
+            Clock::time_point lastSeen;
+            Clock::duration latentWait{0};
+            std::uint32_t instructionPointer = 0;
+            std::uint64_t tick = 0;  // of the last sample the frame was in
+        };
+
+        struct State {
+            std::vector<std::string> patterns;  // lower case, a trailing '*' matches any suffix
+            std::chrono::milliseconds interval{10};
+
+            std::unordered_map<const RE::BSScript::IFunction*, bool> profiled;  // IsProfiled per function
+            std::unordered_map<const RE::BSScript::StackFrame*, Observation> frames;
+            std::uint64_t tick = 0;
+            Clock::time_point lastSample;
+            std::atomic<bool> taskQueued{false};
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        std::string ToLower(std::string_view text) {
+            std::string lower(text);
+            std::transform(lower.begin(), lower.end(), lower.begin(),
+                           [](char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; });
+            return lower;
+        }
+
+        bool IsProfiled(State& state, const RE::BSScript::IFunction* function) {
+            auto [it, inserted] = state.profiled.try_emplace(function, false);
+            if (inserted) {
+                std::string lower = ToLower(function->GetObjectTypeName().c_str());
+                it->second = std::any_of(state.patterns.begin(), state.patterns.end(), [&](const std::string& pattern) {
+                    return pattern.ends_with('*') ? lower.starts_with(pattern.substr(0, pattern.size() - 1))
+                                                  : lower == pattern;
+                });
+            }
+            return it->second;
+        }
+
+        double ToMs(Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); }
+
+        void Finish(const Observation& observation, Clock::duration interval) {
+            // The call started and ended somewhere within half an interval of its first and last sighting
+            Metrics::RecordLatency(observation.name + ".inclusive",
+                                   ToMs(observation.lastSeen - observation.firstSeen + interval));
+            if (observation.latentWait.count() > 0) {
+                Metrics::RecordLatency(observation.name + ".latent_wait", ToMs(observation.latentWait));
+            }
+            if (Trace::IsRecording()) {
+                Trace::AddSpan(Trace::Stage::kPapyrus, observation.name.substr(sizeof("papyrus.") - 1),
+                               observation.firstSeen - interval / 2, observation.lastSeen + interval / 2,
+                               observation.latentWait);
+            }
+        }
+
+        // A frame's memory is reused for later calls. It holds another call when it runs a different function,
+        // was missing from the previous sample, or its instruction pointer moved backwards because the same
+        // function was called again. A loop that jumps back between two samples looks the same and is counted
+        // as a new call; loops that wait on a latent function sit on the same instruction and are not affected.
+        bool IsNewCall(const Observation& observation, const RE::BSScript::StackFrame& frame,
+                       const RE::BSScript::IFunction* function, std::uint64_t tick) {
+            return observation.function != function || observation.tick + 1 != tick ||
+                   frame.instructionPointer < observation.instructionPointer;
+        }
+
+        void Observe(State& state, const RE::BSScript::Stack& stack, Clock::time_point now, Clock::duration elapsed) {
+            for (const RE::BSScript::StackFrame* frame = stack.top; frame; frame = frame->previousFrame) {
+                const RE::BSScript::IFunction* function = frame->owningFunction.get();
+                if (!function || !IsProfiled(state, function)) {
+                    continue;
+                }
+
+                auto [it, inserted] = state.frames.try_emplace(frame);
+                Observation& observation = it->second;
+                if (!inserted && IsNewCall(observation, *frame, function, state.tick)) {
+                    Finish(observation, elapsed);
+                    inserted = true;
+                }
+                if (inserted) {
+                    observation = Observation();
+                    observation.function = function;
+                    observation.name = std::string("papyrus.") + function->GetObjectTypeName().c_str() + "." +
+                                       function->GetName().c_str();
+                    observation.firstSeen = now;
+                    Metrics::Increment(observation.name + ".calls");
+                }
+
+                if (frame == stack.top && stack.state == RE::BSScript::Stack::State::kWaitingOnLatentFunction) {
+                    observation.latentWait += elapsed;
+                }
+                observation.lastSeen = now;
+                observation.instructionPointer = frame->instructionPointer;
+                observation.tick = state.tick;
+            }
+        }
+
+        // Runs on the main thread, where the VM is not in the middle of a script update
+        void Sample() {
+            State& state = GetState();
+            state.taskQueued = false;
+
+            auto* vm = RE::BSScript::Internal::VirtualMachine::GetSingleton();
+            if (!vm) {
+                return;
+            }
+
+            Clock::time_point now = Clock::now();
+            Clock::duration elapsed = state.tick > 0 ? now - state.lastSample : Clock::duration::zero();
+            state.lastSample = now;
+            ++state.tick;
+
+            {
+                RE::BSSpinLockGuard guard(vm->runningStacksLock);
+                for (const auto& [stackId, stack] : vm->allRunningStacks) {
+                    if (stack) {
+                        Observe(state, *stack, now, elapsed);
+                    }
+                }
+            }
+
+            for (auto it = state.frames.begin(); it != state.frames.end();) {
+                if (it->second.tick != state.tick) {
+                    Finish(it->second, elapsed);
+                    it = state.frames.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        void SampleLoop() {
+            State& state = GetState();
+            for (;;) {
+                if (!state.taskQueued.exchange(true)) {
+                    SKSE::GetTaskInterface()->AddTask(Sample);
+                }
+                std::this_thread::sleep_for(state.interval);
+            }
+        }
+    }
+
+    void Install() {
+        if (!Settings::GetBool(L"Profiler", L"bEnabled", false)) {
+            return;
+        }
+
+        State& state = GetState();
+        state.interval =
+            std::chrono::milliseconds(std::max(Settings::GetInt(L"Profiler", L"iSampleIntervalMs", 10), 1));
+
+        std::wstring setting = Settings::GetString(L"Profiler", L"sScripts", L"Mantella*");
+        std::string scripts = ToLower(WideStringToString(setting.c_str()));
+        std::size_t start = 0;
+        while (start <= scripts.size()) {
+            std::size_t end = std::min(scripts.find(',', start), scripts.size());
+            std::string pattern = scripts.substr(start, end - start);
+            std::erase(pattern, ' ');
+            if (!pattern.empty()) {
+                state.patterns.push_back(std::move(pattern));
+            }
+            start = end + 1;
+        }
+
+        std::thread(SampleLoop).detach();
+        PrintToConsole("Papyrus profiler enabled, use LogMantellaMetrics to see the results.");
+    }
+}
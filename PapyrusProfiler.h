@@ -0,0 +1,20 @@
+#pragma once
+
+/**
+* Opt-in profiler for Mantella's Papyrus scripts
+*
+* While enabled, the VM's running stacks are sampled on the main thread between script updates. Every
+* frame of a function in one of the [Profiler] sScripts scripts is followed from the first sample it
+* appears in until it is gone. That gives per-function call counts, inclusive time and the time spent
+* waiting on latent functions such as Utility.Wait, recorded as Metrics histograms named
+* "papyrus.<Script>.<Function>.*". Calls that start and end between two samples are not seen, so the
+* numbers describe the calls that matter for latency rather than every call. While a conversation is
+* traced, every call is also added to the trace, whose file then carries the same numbers per function
+* for that conversation.
+*
+* When disabled nothing is registered, so it costs nothing.
+**/
+namespace PapyrusProfiler {
+    // Start sampling if [Profiler] bEnabled is set. Call once at kDataLoaded.
+    void Install();
+}
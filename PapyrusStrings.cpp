@@ -0,0 +1,168 @@
+#include "PapyrusStrings.h"
+
+#include <emmintrin.h>
+#include <bit>
+#include <cstring>
+
+#ifdef _WIN32
+    #include <string>
+    #include <vector>
+
+    #include "Json.h"
+#endif
+
+namespace PapyrusStrings {
+    std::size_t Find(std::string_view text, std::string_view needle, std::size_t from) {
+        if (needle.empty()) {
+            return from <= text.size() ? from : std::string_view::npos;
+        }
+        if (needle.size() > text.size() || from > text.size() - needle.size()) {
+            return std::string_view::npos;
+        }
+
+        // Candidates must match the first and the last byte of the needle; only those are compared in full
+        const char* data = text.data();
+        std::size_t lastStart = text.size() - needle.size();
+        const __m128i first = _mm_set1_epi8(needle.front());
+        const __m128i last = _mm_set1_epi8(needle.back());
+
+        std::size_t i = from;
+        for (; i + 15 <= lastStart; i += 16) {
+            __m128i starts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i ends = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + needle.size() - 1));
+            auto mask = static_cast<unsigned>(
+                _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(starts, first), _mm_cmpeq_epi8(ends, last))));
+            while (mask != 0) {
+                std::size_t candidate = i + std::countr_zero(mask);
+                if (std::memcmp(data + candidate, needle.data(), needle.size()) == 0) {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
+        }
+
+        for (; i <= lastStart; ++i) {
+            if (data[i] == needle.front() && std::memcmp(data + i, needle.data(), needle.size()) == 0) {
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+#ifdef _WIN32
+    namespace {
+        // Reused by every call on the same thread, so building a result only allocates while it grows
+        std::string& GetBuffer() {
+            thread_local std::string buffer;
+            buffer.clear();
+            return buffer;
+        }
+
+        std::string_view View(const RE::BSFixedString& string) { return {string.data(), string.size()}; }
+
+        std::vector<RE::BSFixedString> SplitString(RE::StaticFunctionTag*, RE::BSFixedString text,
+                                                   RE::BSFixedString delimiter) {
+            std::vector<RE::BSFixedString> parts;
+            std::string_view rest = View(text);
+            std::string_view separator = View(delimiter);
+            if (separator.empty()) {
+                parts.emplace_back(text);
+                return parts;
+            }
+
+            std::string& part = GetBuffer();
+            for (;;) {
+                std::size_t end = Find(rest, separator);
+                part.assign(rest.substr(0, end));
+                parts.emplace_back(part.c_str());
+                if (end == std::string_view::npos) {
+                    return parts;
+                }
+                rest.remove_prefix(end + separator.size());
+            }
+        }
+
+        RE::BSFixedString JoinStrings(RE::StaticFunctionTag*, std::vector<RE::BSFixedString> parts,
+                                      RE::BSFixedString separator) {
+            std::string& joined = GetBuffer();
+            for (std::size_t i = 0; i < parts.size(); ++i) {
+                if (i > 0) {
+                    joined += View(separator);
+                }
+                joined += View(parts[i]);
+            }
+            return joined.c_str();
+        }
+
+        RE::BSFixedString ReplaceString(RE::StaticFunctionTag*, RE::BSFixedString text, RE::BSFixedString search,
+                                        RE::BSFixedString replacement) {
+            std::string_view source = View(text);
+            std::string_view pattern = View(search);
+            std::size_t match = pattern.empty() ? std::string_view::npos : Find(source, pattern);
+            if (match == std::string_view::npos) {
+                return text;
+            }
+
+            std::string& result = GetBuffer();
+            std::size_t position = 0;
+            for (; match != std::string_view::npos; match = Find(source, pattern, position)) {
+                result.append(source.substr(position, match - position));
+                result += View(replacement);
+                position = match + pattern.size();
+            }
+            result.append(source.substr(position));
+            return result.c_str();
+        }
+
+        // The game's string cache ignores case, so equal Papyrus strings share one entry
+        std::int32_t FindStringInArray(RE::StaticFunctionTag*, std::vector<RE::BSFixedString> list,
+                                       RE::BSFixedString value) {
+            for (std::size_t i = 0; i < list.size(); ++i) {
+                if (list[i].data() == value.data()) {
+                    return static_cast<std::int32_t>(i);
+                }
+            }
+            return -1;
+        }
+
+        // Field of a JSON object by key, "a.b" looks into nested objects. Strings are returned unescaped,
+        // anything else as its JSON text, and a missing field as "".
+        RE::BSFixedString GetJsonField(RE::StaticFunctionTag*, RE::BSFixedString json, RE::BSFixedString key) {
+            Json::Value value = Json::Parse(View(json));
+            std::string_view path = View(key);
+            for (;;) {
+                std::size_t dot = path.find('.');
+                value = value[path.substr(0, dot)];
+                if (dot == std::string_view::npos) {
+                    break;
+                }
+                path.remove_prefix(dot + 1);
+            }
+
+            std::string& text = GetBuffer();
+            if (value.GetType() == Json::Value::Type::kString) {
+                Json::Unescape(value.GetRawString(), text);
+            } else {
+                text.assign(value.GetText());
+            }
+            return text.c_str();
+        }
+
+        RE::BSFixedString EscapeJsonString(RE::StaticFunctionTag*, RE::BSFixedString text) {
+            std::string& escaped = GetBuffer();
+            Json::AppendEscaped(escaped, View(text));
+            return escaped.c_str();
+        }
+    }
+
+    bool Register(RE::BSScript::IVirtualMachine* vm) {
+        vm->RegisterFunction("SplitString", "MantellaLauncher", SplitString);
+        vm->RegisterFunction("JoinStrings", "MantellaLauncher", JoinStrings);
+        vm->RegisterFunction("ReplaceString", "MantellaLauncher", ReplaceString);
+        vm->RegisterFunction("FindStringInArray", "MantellaLauncher", FindStringInArray);
+        vm->RegisterFunction("GetJsonField", "MantellaLauncher", GetJsonField);
+        vm->RegisterFunction("EscapeJsonString", "MantellaLauncher", EscapeJsonString);
+        return true;
+    }
+#endif
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/**
+* String natives for Mantella's scripts
+*
+* Splitting responses, escaping text and picking fields out of JSON in Papyrus costs a VM
+* instruction per character on the budget every mod shares. These natives do the same work in
+* C++. Substring search compares 16 bytes at a time with SSE2, and results are built in
+* per-thread buffers that keep their capacity, so common calls don't allocate apart from the
+* game's own string cache.
+**/
+namespace PapyrusStrings {
+    // Position of the first occurrence of needle in text at or after from, or std::string_view::npos
+    std::size_t Find(std::string_view text, std::string_view needle, std::size_t from = 0);
+
+#ifdef _WIN32
+    // Register the natives on the MantellaLauncher script
+    bool Register(RE::BSScript::IVirtualMachine* vm);
+#endif
+}
@@ -0,0 +1,221 @@
+#include "Prefetch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Channel.h"
+#include "Json.h"
+#include "Metrics.h"
+#include "Settings.h"
+
+namespace Prefetch {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        struct Candidate {
+            RE::FormID refId = 0;
+            RE::FormID voiceTypeId = 0;
+            std::string name;
+        };
+
+        struct State {
+            bool enabled = true;
+            float radius = 3000.0f;
+            Clock::duration minInterval = std::chrono::seconds(5);
+            std::size_t maxBatchSize = 32;
+
+            std::mutex lock;
+            std::condition_variable wakeUp;
+            std::map<RE::FormID, Candidate> pending;  // keyed by base form ID
+            std::unordered_set<RE::FormID> hinted;
+            std::uint32_t connectionId = 0;
+            Clock::time_point lastFlush;
+
+            std::unordered_map<RE::FormID, Clock::time_point> conversationStarts;
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        // Forget what was hinted when Mantella restarts, its caches are cold again
+        void SyncConnection(State& state) {
+            std::uint32_t connectionId = Channel::GetConnectionId();
+            if (connectionId != state.connectionId) {
+                state.connectionId = connectionId;
+                state.hinted.clear();
+            }
+        }
+
+        // Build one prefetch message from up to maxBatchSize pending NPCs. Expects the lock to be held.
+        std::string TakeBatch(State& state) {
+            Json::Writer json(Channel::AcquireBuffer());
+            json.BeginObject().Field("type", "prefetch").Key("actors").BeginArray();
+
+            std::size_t count = 0;
+            for (auto it = state.pending.begin(); it != state.pending.end() && count < state.maxBatchSize;) {
+                json.BeginObject()
+                    .Field("ref_id", it->second.refId)
+                    .Field("base_id", it->first)
+                    .Field("voice_type", it->second.voiceTypeId)
+                    .Field("name", it->second.name)
+                    .EndObject();
+                state.hinted.insert(it->first);
+                it = state.pending.erase(it);
+                ++count;
+            }
+            json.EndArray().EndObject();
+
+            Metrics::Increment("prefetch.batches");
+            Metrics::Increment("prefetch.actors", count);
+            return json.Take();
+        }
+
+        void FlushLoop() {
+            State& state = GetState();
+            std::unique_lock guard(state.lock);
+            for (;;) {
+                state.wakeUp.wait(guard, [&] { return !state.pending.empty(); });
+
+                if (!Channel::IsConnected()) {
+                    state.wakeUp.wait_for(guard, std::chrono::seconds(1));
+                    continue;
+                }
+
+                Clock::time_point next = state.lastFlush + state.minInterval;
+                if (Clock::now() < next) {
+                    state.wakeUp.wait_until(guard, next);
+                    continue;
+                }
+
+                SyncConnection(state);
+                std::erase_if(state.pending, [&](const auto& entry) { return state.hinted.contains(entry.first); });
+                if (state.pending.empty()) {
+                    continue;
+                }
+
+                std::string message = TakeBatch(state);
+                state.lastFlush = Clock::now();
+
+                guard.unlock();
+                Channel::Send(std::move(message), Channel::Priority::kLow);
+                guard.lock();
+            }
+        }
+
+        void OnConversationStart(Json::Value message) {
+            auto baseId = static_cast<RE::FormID>(message["base_id"].GetUInt());
+            State& state = GetState();
+            std::lock_guard guard(state.lock);
+            state.conversationStarts[baseId] = Clock::now();
+        }
+
+        void OnLine(Json::Value message) {
+            auto baseId = static_cast<RE::FormID>(message["base_id"].GetUInt());
+            State& state = GetState();
+            std::lock_guard guard(state.lock);
+
+            auto it = state.conversationStarts.find(baseId);
+            if (it == state.conversationStarts.end()) {
+                return;  // Not the first line of this conversation
+            }
+
+            double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - it->second).count();
+            state.conversationStarts.erase(it);
+
+            bool wasHinted = state.connectionId == Channel::GetConnectionId() && state.hinted.contains(baseId);
+            Metrics::RecordLatency(wasHinted ? "prefetch.first_line.hinted" : "prefetch.first_line.unhinted", elapsed);
+        }
+
+        class CellLoadSink : public RE::BSTEventSink<RE::TESCellFullyLoadedEvent> {
+        public:
+            static CellLoadSink* GetSingleton() {
+                static CellLoadSink singleton;
+                return &singleton;
+            }
+
+            RE::BSEventNotifyControl ProcessEvent(const RE::TESCellFullyLoadedEvent* event,
+                                                  RE::BSTEventSource<RE::TESCellFullyLoadedEvent>*) override {
+                if (event && event->cell) {
+                    CollectNearbyActors();
+                }
+                return RE::BSEventNotifyControl::kContinue;
+            }
+        };
+    }
+
+    void Install() {
+        State& state = GetState();
+        state.enabled = Settings::GetBool(L"Prefetch", L"bEnabled", true);
+        state.radius = Settings::GetFloat(L"Prefetch", L"fRadius", 3000.0f);
+        state.minInterval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<float>(Settings::GetFloat(L"Prefetch", L"fMinIntervalSeconds", 5.0f)));
+        state.maxBatchSize = static_cast<std::size_t>(std::max(Settings::GetInt(L"Prefetch", L"iMaxBatchSize", 32), 1));
+
+        // Latency is recorded even when hints are disabled, to provide the baseline
+        Channel::RegisterHandler("conversation_start", OnConversationStart);
+        Channel::RegisterHandler("line", OnLine);
+
+        if (!state.enabled) {
+            return;
+        }
+
+        RE::ScriptEventSourceHolder::GetSingleton()->AddEventSink<RE::TESCellFullyLoadedEvent>(
+            CellLoadSink::GetSingleton());
+        std::thread(FlushLoop).detach();
+    }
+
+    void CollectNearbyActors() {
+        State& state = GetState();
+        if (!state.enabled) {
+            return;
+        }
+
+        RE::PlayerCharacter* player = RE::PlayerCharacter::GetSingleton();
+        RE::ProcessLists* processLists = RE::ProcessLists::GetSingleton();
+        if (!player || !processLists) {
+            return;
+        }
+
+        RE::NiPoint3 playerPosition = player->GetPosition();
+        std::lock_guard guard(state.lock);
+        SyncConnection(state);
+
+        std::size_t added = 0;
+        for (RE::ActorHandle& handle : processLists->highActorHandles) {
+            RE::NiPointer<RE::Actor> actor = handle.get();
+            if (!actor || actor.get() == player || actor->IsDead() || !actor->Is3DLoaded()) {
+                continue;
+            }
+
+            RE::TESNPC* base = actor->GetActorBase();
+            if (!base || !base->voiceType) {
+                continue;  // Mantella can't voice NPCs without a voice type
+            }
+            if (actor->GetPosition().GetDistance(playerPosition) > state.radius) {
+                continue;
+            }
+
+            RE::FormID baseId = base->GetFormID();
+            if (state.hinted.contains(baseId) || state.pending.contains(baseId)) {
+                continue;
+            }
+
+            state.pending.emplace(baseId, Candidate{actor->GetFormID(), base->voiceType->GetFormID(),
+                                                    actor->GetDisplayFullName()});
+            ++added;
+        }
+
+        if (added > 0) {
+            state.wakeUp.notify_one();
+        }
+    }
+}
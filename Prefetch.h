@@ -0,0 +1,20 @@
+#pragma once
+
+/**
+* Prefetch hints for Mantella
+*
+* Mantella loads character bios, voice models and memory summaries lazily when a conversation starts.
+* Whenever the player's surroundings change (a cell finishes loading or a save is loaded) the plugin
+* collects the conversable NPCs near the player and sends them to Mantella as a low-priority,
+* batched "prefetch" message, so that work can happen before the player starts talking.
+*
+* Hints are rate-limited and every NPC is only hinted once per Mantella connection.
+* First-line latency is recorded separately for hinted and unhinted NPCs to measure the effect.
+**/
+namespace Prefetch {
+    // Register the cell load sink and the channel handlers. Call once at kDataLoaded.
+    void Install();
+
+    // Collect nearby conversable NPCs and queue them for the next hint. Must run on the main thread.
+    void CollectNearbyActors();
+}
@@ -0,0 +1,366 @@
+#include "Recorder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "Metrics.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <atomic>
+    #include <filesystem>
+    #include <fstream>
+    #include <future>
+    #include <map>
+    #include <memory>
+    #include <mutex>
+    #include <sstream>
+    #include <vector>
+
+    #include "Benchmark.h"
+    #include "Channel.h"
+    #include "Launcher.h"
+    #include "Settings.h"
+    #include "SharedRing.h"
+#endif
+
+namespace Recorder {
+    namespace {
+        constexpr std::size_t AlignEvent(std::size_t size) { return (size + 7) & ~std::size_t{7}; }
+    }
+
+    bool Reader::Open(std::span<const std::byte> file) {
+        if (file.size() < sizeof(FileHeader)) {
+            return false;
+        }
+        std::memcpy(&_header, file.data(), sizeof(_header));
+        if (_header.magic != FileHeader::kMagic || _header.version != FileHeader::kVersion) {
+            return false;
+        }
+        _file = file;
+        _position = sizeof(FileHeader);
+        return true;
+    }
+
+    bool Reader::Next(EventHeader& header, std::span<const std::byte>& payload) {
+        if (_file.size() - _position < sizeof(EventHeader)) {
+            return false;
+        }
+        std::memcpy(&header, _file.data() + _position, sizeof(header));
+        std::size_t start = _position + sizeof(EventHeader);
+        if (_file.size() - start < header.size) {
+            return false;
+        }
+        payload = _file.subspan(start, header.size);
+        _position = std::min(_file.size(), start + AlignEvent(header.size));
+        return true;
+    }
+
+    bool Player::Open(std::span<const std::byte> file, float speed) {
+        _speed = std::max(speed, 0.0f);
+        _start = Clock::now();
+        _firstUs.reset();
+        _lagMs = 0.0;
+        return _reader.Open(file);
+    }
+
+    bool Player::Next(EventHeader& header, std::span<const std::byte>& payload) {
+        do {
+            if (!_reader.Next(header, payload)) {
+                return false;
+            }
+        } while (header.direction == kSent);
+        if (header.direction == kDefine) {
+            return true;
+        }
+
+        if (!_firstUs) {
+            _firstUs = header.timeUs;
+        }
+        if (_speed > 0.0f) {
+            double offsetUs = static_cast<double>(std::max(header.timeUs, *_firstUs) - *_firstUs) / _speed;
+            auto due = _start + std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double, std::micro>(offsetUs));
+            std::this_thread::sleep_until(due);
+            _lagMs = std::chrono::duration<double, std::milli>(Clock::now() - due).count();
+        }
+        return true;
+    }
+
+    bool Replay(std::span<const std::byte> file, float speed, const ReplayTarget& target, ReplayStats& stats) {
+        Player player;
+        if (!player.Open(file, speed)) {
+            return false;
+        }
+        std::vector<std::uint16_t> rings;  // streams whose ring the target opened
+
+        EventHeader header;
+        std::span<const std::byte> payload;
+        Player::Clock::time_point start = Player::Clock::now();
+        while (player.Next(header, payload)) {
+            if (header.direction == kDefine) {
+                std::string_view name(reinterpret_cast<const char*>(payload.data()), payload.size());
+                if (target.openRing(header.stream, name)) {
+                    rings.push_back(header.stream);
+                }
+                continue;
+            }
+            if (speed > 0.0f) {
+                stats.lagMs.push_back(player.GetLagMs());
+            }
+
+            if (header.stream == kChannelStream) {
+                stats.dispatchMs.push_back(
+                    target.dispatch(std::string_view(reinterpret_cast<const char*>(payload.data()), payload.size())));
+                Metrics::RecordLatency("replay.dispatch", stats.dispatchMs.back());
+                continue;
+            }
+            if (std::find(rings.begin(), rings.end(), header.stream) == rings.end()) {
+                continue;
+            }
+            // The plugin drains the ring on its own thread, wait for room like Mantella would
+            while (!target.writeRecord(header.stream, header.kind, header.flags, payload)) {
+                ++stats.ringStalls;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            ++stats.ringRecords;
+        }
+        stats.totalMs = std::chrono::duration<double, std::milli>(Player::Clock::now() - start).count();
+        return true;
+    }
+
+#ifdef _WIN32
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr auto kFlushInterval = std::chrono::milliseconds(250);
+
+        struct State {
+            std::atomic<bool> recording{false};
+            std::atomic<bool> replaying{false};
+            Clock::time_point start;
+            HANDLE file = INVALID_HANDLE_VALUE;
+            std::uint64_t maxBytes = 0;
+
+            std::mutex lock;
+            std::vector<std::byte> buffer;  // events not written yet
+            std::uint64_t written = 0;
+            std::map<std::wstring, std::uint16_t, std::less<>> streams;
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        // Expects the lock to be held
+        void Append(State& state, const EventHeader& header, const void* data) {
+            std::size_t size = sizeof(EventHeader) + AlignEvent(header.size);
+            if (state.written + state.buffer.size() + size > state.maxBytes) {
+                state.recording = false;
+                Metrics::Increment("recorder.truncated");
+                PrintToConsole("The traffic recording reached [Recorder] iMaxSizeMB and stopped.");
+                return;
+            }
+            std::size_t offset = state.buffer.size();
+            state.buffer.resize(offset + size);
+            std::memcpy(state.buffer.data() + offset, &header, sizeof(header));
+            std::memcpy(state.buffer.data() + offset + sizeof(header), data, header.size);
+            Metrics::Increment("recorder.events");
+        }
+
+        EventHeader MakeHeader(Direction direction, std::uint16_t stream, std::uint32_t size) {
+            EventHeader header = {};
+            header.timeUs = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - GetState().start).count());
+            header.size = size;
+            header.stream = stream;
+            header.direction = direction;
+            return header;
+        }
+
+        // Write what was buffered every few hundred milliseconds, so recording stays off the hot paths' threads
+        void FlushLoop() {
+            State& state = GetState();
+            std::vector<std::byte> pending;
+            for (;;) {
+                std::this_thread::sleep_for(kFlushInterval);
+                {
+                    std::lock_guard guard(state.lock);
+                    pending.swap(state.buffer);
+                    state.written += pending.size();
+                }
+                if (pending.empty()) {
+                    continue;
+                }
+                DWORD written = 0;
+                if (!WriteFile(state.file, pending.data(), static_cast<DWORD>(pending.size()), &written, NULL)) {
+                    std::stringstream ss;
+                    ss << "Failed to write the traffic recording. Error: " << GetLastError();
+                    PrintToConsole(ss.str());
+                    state.recording = false;
+                    return;
+                }
+                Metrics::SetGauge("recorder.bytes", static_cast<std::int64_t>(state.written));
+                pending.clear();
+            }
+        }
+
+        std::vector<std::byte> ReadFileContents(const std::wstring& path) {
+            std::ifstream file(std::filesystem::path(path), std::ios::binary | std::ios::ate);
+            if (!file) {
+                return {};
+            }
+            std::vector<std::byte> data(static_cast<std::size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            return file ? data : std::vector<std::byte>();
+        }
+
+        void ReplayThread(std::vector<std::byte> data, float speed) {
+            State& state = GetState();
+            std::map<std::uint16_t, std::unique_ptr<SharedRing>> rings;
+            ReplayTarget target;
+            target.dispatch = [](std::string_view message) {
+                // Handlers run on the channel thread, the replay only waits for them
+                return Channel::Inject(std::string(message)).get();
+            };
+            target.openRing = [&](std::uint16_t stream, std::string_view name) {
+                // Rings that the plugin didn't create this session stay closed
+                auto ring = std::make_unique<SharedRing>();
+                if (!ring->Open(StringToWideString(std::string(name)))) {
+                    return false;
+                }
+                rings[stream] = std::move(ring);
+                return true;
+            };
+            target.writeRecord = [&](std::uint16_t stream, std::uint16_t kind, std::uint16_t flags,
+                                     std::span<const std::byte> payload) {
+                return rings[stream]->Write(kind, flags, payload.data(), static_cast<std::uint32_t>(payload.size()));
+            };
+
+            ReplayStats stats;
+            Replay(data, speed, target, stats);
+            Benchmark::Summary dispatch = Benchmark::Summarize(std::move(stats.dispatchMs));
+            Benchmark::Summary lag = Benchmark::Summarize(std::move(stats.lagMs));
+            std::stringstream ss;
+            ss << "Replayed " << dispatch.count << " messages and " << stats.ringRecords << " ring records in "
+               << stats.totalMs << " ms. Dispatch p50 " << dispatch.p50 << " ms, p99 " << dispatch.p99 << " ms, max "
+               << dispatch.max << " ms; behind schedule p99 " << lag.p99 << " ms; " << stats.ringStalls
+               << " waits for a full ring.";
+            PrintToConsole(ss.str());
+            state.replaying = false;
+        }
+
+        bool ReplayMantellaRecordingPapyrus(RE::StaticFunctionTag*, RE::BSFixedString path, float speed) {
+            return StartReplay(StringToWideString(path.c_str()), speed);
+        }
+    }
+
+    void Install() {
+        if (!Settings::GetBool(L"Recorder", L"bEnabled", false)) {
+            return;
+        }
+
+        State& state = GetState();
+        std::wstring directory = Settings::GetString(L"Recorder", L"sDirectory", L"");
+        if (directory.empty() && !GetLocalDataDirectory().empty()) {
+            directory = GetLocalDataDirectory() + L"\\Recordings";
+        }
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        FileHeader header = {};
+        header.magic = FileHeader::kMagic;
+        header.version = FileHeader::kVersion;
+        header.startedAt =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        std::wstring path = directory + L"\\session-" + std::to_wstring(header.startedAt) + L".mrec";
+        state.file = CreateFile(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+        DWORD written = 0;
+        if (state.file == INVALID_HANDLE_VALUE || !WriteFile(state.file, &header, sizeof(header), &written, NULL)) {
+            std::stringstream ss;
+            ss << "Failed to create the traffic recording " << WideStringToString(path.c_str())
+               << ". Error: " << GetLastError();
+            PrintToConsole(ss.str());
+            return;
+        }
+
+        state.maxBytes = static_cast<std::uint64_t>(std::max(Settings::GetInt(L"Recorder", L"iMaxSizeMB", 512), 1))
+                         << 20;
+        state.written = sizeof(header);
+        state.start = Clock::now();
+        state.recording = true;
+        std::thread(FlushLoop).detach();
+        PrintToConsole("Recording the traffic with Mantella to " + WideStringToString(path.c_str()) + ".");
+    }
+
+    bool IsRecording() {
+        State& state = GetState();
+        return state.recording && !state.replaying;
+    }
+
+    void RecordMessage(Direction direction, std::string_view message) {
+        if (!IsRecording()) {
+            return;
+        }
+        if (!message.empty() && message.back() == '\n') {
+            message.remove_suffix(1);
+        }
+        State& state = GetState();
+        EventHeader header = MakeHeader(direction, kChannelStream, static_cast<std::uint32_t>(message.size()));
+        std::lock_guard guard(state.lock);
+        Append(state, header, message.data());
+    }
+
+    void RecordRing(Direction direction, const std::wstring& ring, std::uint16_t kind, std::uint16_t flags,
+                    const void* data, std::uint32_t size) {
+        if (!IsRecording()) {
+            return;
+        }
+        State& state = GetState();
+        std::lock_guard guard(state.lock);
+        auto it = state.streams.find(ring);
+        if (it == state.streams.end()) {
+            auto stream = static_cast<std::uint16_t>(state.streams.size() + 1);
+            it = state.streams.emplace(ring, stream).first;
+            std::string name = WideStringToString(ring.c_str());
+            Append(state, MakeHeader(kDefine, stream, static_cast<std::uint32_t>(name.size())), name.data());
+        }
+        EventHeader header = MakeHeader(direction, it->second, size);
+        header.kind = kind;
+        header.flags = flags;
+        Append(state, header, data);
+    }
+
+    bool StartReplay(const std::wstring& path, float speed) {
+        if (Channel::IsConnected()) {
+            PrintToConsole("Close Mantella before replaying a recording, the replay stands in for it.");
+            return false;
+        }
+        State& state = GetState();
+        if (state.replaying.exchange(true)) {
+            PrintToConsole("A recording is already being replayed.");
+            return false;
+        }
+
+        std::vector<std::byte> data = ReadFileContents(path);
+        Reader reader;
+        if (!reader.Open(data)) {
+            PrintToConsole("Failed to read the recording " + WideStringToString(path.c_str()) + ".");
+            state.replaying = false;
+            return false;
+        }
+        std::thread(ReplayThread, std::move(data), std::max(speed, 0.0f)).detach();
+        return true;
+    }
+
+    bool Register(RE::BSScript::IVirtualMachine* vm) {
+        vm->RegisterFunction("ReplayMantellaRecording", "MantellaLauncher", ReplayMantellaRecordingPapyrus);
+        return true;
+    }
+#endif
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+    #include <string>
+#endif
+
+/**
+* Recording and replay of the traffic between the plugin and Mantella
+*
+* With [Recorder] bEnabled, every message on the channel and every record that goes through a shared-memory
+* ring is appended to %LOCALAPPDATA%\Mantella\Recordings\session-<time>.mrec together with the moment it was
+* sent or received. The file is a FileHeader followed by events, each an EventHeader plus its payload padded
+* to 8 bytes; stream 0 is the channel, the rings get a stream number from a kDefine event carrying their name
+* before their first record. Everything is little-endian.
+*
+* ReplayMantellaRecording() feeds what Mantella sent in a recording back through the plugin with the
+* original timing (or faster): messages go to the channel's handlers, ring records into the same rings.
+* That reproduces the load of a real session on the plugin's own processing without Mantella running.
+* Messages are handed to the channel thread, so the handlers run where they always do.
+**/
+namespace Recorder {
+    enum Direction : std::uint8_t {
+        kSent = 0,      // from the plugin to Mantella
+        kReceived = 1,  // from Mantella to the plugin
+        kDefine = 2     // names the stream, the payload is the ring's UTF-8 name
+    };
+
+    constexpr std::uint16_t kChannelStream = 0;
+
+    struct FileHeader {
+        static constexpr std::uint32_t kMagic = 0x4345524D;  // "MREC"
+        static constexpr std::uint32_t kVersion = 1;
+
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::int64_t startedAt;  // Unix time in milliseconds
+    };
+
+    struct EventHeader {
+        std::uint64_t timeUs;  // since the recording started
+        std::uint32_t size;    // payload size in bytes, without the padding
+        std::uint16_t stream;
+        std::uint16_t kind;   // RecordHeader::kind for rings, 0 for channel messages
+        std::uint16_t flags;  // RecordHeader::flags for rings
+        std::uint8_t direction;
+        std::uint8_t reserved;
+        std::uint32_t reserved2;
+    };
+
+    static_assert(sizeof(FileHeader) == 16 && sizeof(EventHeader) == 24);
+
+    // Walks the events of a recording held in memory
+    class Reader {
+    public:
+        // Returns false if the data doesn't start with a valid FileHeader
+        bool Open(std::span<const std::byte> file);
+        // Returns false at the end, or if the rest of the file is truncated
+        bool Next(EventHeader& header, std::span<const std::byte>& payload);
+
+        const FileHeader& GetFileHeader() const { return _header; }
+
+    private:
+        std::span<const std::byte> _file;
+        std::size_t _position = 0;
+        FileHeader _header = {};
+    };
+
+    // Hands out what Mantella sent in a recording with its original timing, for the replay in game and the
+    // replay driver in the tests
+    class Player {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // Speed 2 is twice as fast, 0 as fast as possible. Returns false if the data isn't a recording.
+        bool Open(std::span<const std::byte> file, float speed);
+        // Waits until the next event from Mantella is due and returns it, or false at the end. kDefine events
+        // come right away, the plugin's own traffic is skipped since the replay produces it again.
+        bool Next(EventHeader& header, std::span<const std::byte>& payload);
+        // How far behind schedule the last event was, 0 when replaying as fast as possible
+        double GetLagMs() const { return _lagMs; }
+
+    private:
+        Reader _reader;
+        float _speed = 0.0f;
+        Clock::time_point _start;
+        std::optional<std::uint64_t> _firstUs;  // the replay starts with the first thing Mantella sent
+        double _lagMs = 0.0;
+    };
+
+    // Where a replay delivers what Mantella sent: the plugin's channel and rings in game, a stand-in in the tests
+    struct ReplayTarget {
+        // Hand a message to its handler and wait until it returned. Returns how long that took in ms.
+        std::function<double(std::string_view message)> dispatch;
+        // Open the ring a kDefine event names. Records of streams without a ring are skipped.
+        std::function<bool(std::uint16_t stream, std::string_view name)> openRing;
+        // Write a record into the stream's ring. Returns false while the ring is full.
+        std::function<bool(std::uint16_t stream, std::uint16_t kind, std::uint16_t flags,
+                           std::span<const std::byte> payload)>
+            writeRecord;
+    };
+
+    struct ReplayStats {
+        std::vector<double> dispatchMs;
+        std::vector<double> lagMs;  // how far behind schedule each event was, empty as fast as possible
+        std::size_t ringRecords = 0;
+        std::size_t ringStalls = 0;  // times a full ring made the replay wait
+        double totalMs = 0.0;
+    };
+
+    // Replay what Mantella sent in a recording into target, from the calling thread. A full ring is waited on like
+    // Mantella would. Returns false if the data isn't a recording.
+    bool Replay(std::span<const std::byte> file, float speed, const ReplayTarget& target, ReplayStats& stats);
+
+#ifdef _WIN32
+    // Open the recording if [Recorder] bEnabled is set. Call once at kDataLoaded, before Channel::Start.
+    void Install();
+
+    bool IsRecording();
+    void RecordMessage(Direction direction, std::string_view message);
+    void RecordRing(Direction direction, const std::wstring& ring, std::uint16_t kind, std::uint16_t flags,
+                    const void* data, std::uint32_t size);
+
+    // Replay a recording on a background thread, speed 2 meaning twice as fast and 0 as fast as possible.
+    // Returns false if Mantella is connected, a replay is running or the file can't be read.
+    bool StartReplay(const std::wstring& path, float speed);
+
+    // Register the natives on the MantellaLauncher script
+    bool Register(RE::BSScript::IVirtualMachine* vm);
+#endif
+}
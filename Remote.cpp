@@ -0,0 +1,245 @@
+#include "Remote.h"
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #include <atomic>
+    #include <mutex>
+    #include <sstream>
+    #include <thread>
+
+    #include "Launcher.h"
+    #include "Metrics.h"
+    #include "Settings.h"
+    #include "Status.h"
+    #include "WorkerPool.h"
+#else
+    #include <fcntl.h>
+    #include <netdb.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    #include <cerrno>
+#endif
+
+namespace Remote {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+#ifdef _WIN32
+        using Socket = SOCKET;
+        constexpr Socket kInvalidSocket = INVALID_SOCKET;
+
+        void SetNonBlocking(Socket socket) {
+            u_long nonBlocking = 1;
+            ioctlsocket(socket, FIONBIO, &nonBlocking);
+        }
+
+        bool IsConnecting() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+        void CloseSocket(Socket socket) { closesocket(socket); }
+#else
+        using Socket = int;
+        constexpr Socket kInvalidSocket = -1;
+
+        void SetNonBlocking(Socket socket) { fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK); }
+        bool IsConnecting() { return errno == EINPROGRESS; }
+        void CloseSocket(Socket socket) { close(socket); }
+#endif
+    }
+
+    std::optional<double> Probe(const std::string& host, const std::string& port, std::chrono::milliseconds timeout) {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+            return std::nullopt;
+        }
+
+        std::optional<double> result;
+        for (addrinfo* address = addresses; address && !result; address = address->ai_next) {
+            Socket socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (socket == kInvalidSocket) {
+                continue;
+            }
+            SetNonBlocking(socket);
+
+            Clock::time_point start = Clock::now();
+            if (connect(socket, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0 || IsConnecting()) {
+                fd_set writable;
+                fd_set failed;
+                FD_ZERO(&writable);
+                FD_ZERO(&failed);
+                FD_SET(socket, &writable);
+                FD_SET(socket, &failed);
+                auto limit = std::chrono::duration_cast<std::chrono::microseconds>(timeout);
+                timeval wait = {static_cast<long>(limit.count() / 1000000), static_cast<long>(limit.count() % 1000000)};
+                // Windows reports a refused connect as failed, POSIX as writable with the error set
+                int error = 0;
+                socklen_t length = sizeof(error);
+                if (select(static_cast<int>(socket) + 1, NULL, &writable, &failed, &wait) >= 1 &&
+                    FD_ISSET(socket, &writable) &&
+                    getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) == 0 &&
+                    error == 0) {
+                    result = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                }
+            }
+            CloseSocket(socket);
+        }
+        freeaddrinfo(addresses);
+        return result;
+    }
+
+    void LatencyMonitor::AddSample(std::optional<double> rttMs) {
+        if (!rttMs) {
+            ++_failures;
+            return;
+        }
+        _failures = 0;
+        _samples.push_back(*rttMs);
+        if (_samples.size() > _window) {
+            _samples.pop_front();
+        }
+    }
+
+    bool LatencyMonitor::ShouldFailOver() const {
+        if (_failures >= _maxFailures) {
+            return true;
+        }
+        // Judge only a full window, so a single slow probe doesn't cause a failover
+        std::optional<double> median = GetMedian();
+        return _samples.size() >= _window && median && *median > _budgetMs;
+    }
+
+    std::optional<double> LatencyMonitor::GetMedian() const {
+        if (_samples.empty()) {
+            return std::nullopt;
+        }
+        std::vector<double> sorted(_samples.begin(), _samples.end());
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+
+#ifdef _WIN32
+    namespace {
+        struct State {
+            std::string host;
+            std::string port;
+            std::chrono::milliseconds connectTimeout{1000};
+            std::chrono::milliseconds probeInterval{2000};
+            double budgetMs = 150.0;
+            std::size_t maxFailures = 3;
+
+            std::atomic<bool> active{false};
+            std::mutex lock;
+            std::string endpoint;
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        void MonitorLoop() {
+            State& state = GetState();
+            LatencyMonitor monitor(state.budgetMs, state.maxFailures, 5);
+            for (;;) {
+                std::this_thread::sleep_for(state.probeInterval);
+
+                std::optional<double> rtt = Probe(state.host, state.port, state.connectTimeout);
+                monitor.AddSample(rtt);
+                if (rtt) {
+                    Metrics::RecordLatency("remote.rtt", *rtt);
+                } else {
+                    Metrics::Increment("remote.probe_failures");
+                }
+
+                if (monitor.ShouldFailOver()) {
+                    break;
+                }
+            }
+
+            state.active = false;
+            {
+                std::lock_guard guard(state.lock);
+                state.endpoint.clear();
+            }
+            Metrics::SetGauge("remote.active", 0);
+            Metrics::Increment("remote.failovers");
+            PrintToConsole("The remote Mantella instance is unreachable or too slow, starting Mantella locally.");
+
+            WorkerPool::Submit("launch", WorkerPool::Priority::kHigh, [](WorkerPool::Job&) {
+                if (!LaunchMantellaExe()) {
+                    PrintToConsole("Failed to launch Mantella.exe.");
+                }
+            });
+        }
+
+        RE::BSFixedString GetMantellaEndpointPapyrus(RE::StaticFunctionTag*) { return GetEndpoint().c_str(); }
+    }
+
+    bool Install() {
+        if (!Settings::GetBool(L"Remote", L"bEnabled", false)) {
+            return false;
+        }
+
+        State& state = GetState();
+        state.host = WideStringToString(Settings::GetString(L"Remote", L"sHost", L"").c_str());
+        state.port = std::to_string(Settings::GetInt(L"Remote", L"iPort", 4999));
+        state.budgetMs = Settings::GetFloat(L"Remote", L"fLatencyBudgetMs", 150.0f);
+        state.connectTimeout =
+            std::chrono::milliseconds(std::max(Settings::GetInt(L"Remote", L"iConnectTimeoutMs", 1000), 1));
+        state.probeInterval =
+            std::chrono::milliseconds(std::max(Settings::GetInt(L"Remote", L"iProbeIntervalMs", 2000), 100));
+        state.maxFailures = static_cast<std::size_t>(std::max(Settings::GetInt(L"Remote", L"iMaxFailures", 3), 1));
+        if (state.host.empty()) {
+            return false;
+        }
+
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+            return false;
+        }
+
+        std::optional<double> rtt = Probe(state.host, state.port, state.connectTimeout);
+        std::stringstream ss;
+        if (!rtt || *rtt > state.budgetMs) {
+            ss << "Remote Mantella at " << state.host << ":" << state.port << " is "
+               << (rtt ? "too slow" : "unreachable") << ", starting Mantella locally.";
+            PrintToConsole(ss.str());
+            return false;
+        }
+
+        Metrics::RecordLatency("remote.rtt", *rtt);
+        Metrics::SetGauge("remote.active", 1);
+        {
+            std::lock_guard guard(state.lock);
+            state.endpoint = state.host + ":" + state.port;
+        }
+        state.active = true;
+        Status::SetState(Status::State::kRemote);
+        std::thread(MonitorLoop).detach();
+
+        ss << "Using the remote Mantella at " << state.host << ":" << state.port << " (" << *rtt << " ms).";
+        PrintToConsole(ss.str());
+        return true;
+    }
+
+    bool IsActive() { return GetState().active; }
+
+    std::string GetEndpoint() {
+        State& state = GetState();
+        std::lock_guard guard(state.lock);
+        return state.endpoint;
+    }
+
+    bool Register(RE::BSScript::IVirtualMachine* vm) {
+        vm->RegisterFunction("GetMantellaEndpoint", "MantellaLauncher", GetMantellaEndpointPapyrus);
+        return true;
+    }
+#endif
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <string>
+
+/**
+* Using a Mantella instance on another machine
+*
+* With [Remote] bEnabled the launcher doesn't start MantellaSoftware\Mantella.exe when the configured
+* host answers within the latency budget. The round-trip time is then probed continuously with TCP
+* connects to the remote port. When the remote stops answering or gets too slow, the launcher falls
+* back to starting Mantella locally. Scripts find the endpoint to talk to with GetMantellaEndpoint().
+**/
+namespace Remote {
+    /**
+    * Failover policy, separate from the probing so it can be exercised with any sample source
+    *
+    * Fails over after maxFailures probes in a row got no answer, or when the median of the last
+    * window round-trip times exceeds the budget.
+    **/
+    class LatencyMonitor {
+    public:
+        LatencyMonitor(double budgetMs, std::size_t maxFailures, std::size_t window)
+            : _budgetMs(budgetMs), _maxFailures(maxFailures), _window(window) {}
+
+        // Round-trip time of one probe, or nothing if it failed
+        void AddSample(std::optional<double> rttMs);
+        bool ShouldFailOver() const;
+        std::optional<double> GetMedian() const;
+
+    private:
+        double _budgetMs;
+        std::size_t _maxFailures;
+        std::size_t _window;
+        std::size_t _failures = 0;
+        std::deque<double> _samples;
+    };
+
+    /**
+    * Time a TCP connect to host, which takes one round trip for the handshake
+    *
+    * Returns nothing if no address of host accepted the connection within timeout. The address is
+    * resolved every time, so a remote that changed its address is still found. On Windows, Winsock
+    * must have been started.
+    **/
+    std::optional<double> Probe(const std::string& host, const std::string& port, std::chrono::milliseconds timeout);
+
+#ifdef _WIN32
+    // Read the settings and probe the remote once. Returns true if the remote instance is used,
+    // in which case it is monitored from then on. Call once after kDataLoaded, off the main thread:
+    // the probe waits up to [Remote] iConnectTimeoutMs.
+    bool Install();
+    bool IsActive();
+
+    // "host:port" of the remote instance while it is used, otherwise ""
+    std::string GetEndpoint();
+
+    // Register the natives on the MantellaLauncher script
+    bool Register(RE::BSScript::IVirtualMachine* vm);
+#endif
+}
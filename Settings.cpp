@@ -0,0 +1,38 @@
+#include "Settings.h"
+
+#include <windows.h>
+#include <cwchar>
+
+#include "Launcher.h"
+
+namespace Settings {
+    std::wstring GetPath() {
+        static const std::wstring path = GetCurrentModuleDirectory() + L"\\MantellaLauncher.ini";
+        return path;
+    }
+
+    bool GetBool(const wchar_t* section, const wchar_t* key, bool defaultValue) {
+        return GetPrivateProfileInt(section, key, defaultValue ? 1 : 0, GetPath().c_str()) != 0;
+    }
+
+    int GetInt(const wchar_t* section, const wchar_t* key, int defaultValue) {
+        return static_cast<int>(GetPrivateProfileInt(section, key, defaultValue, GetPath().c_str()));
+    }
+
+    float GetFloat(const wchar_t* section, const wchar_t* key, float defaultValue) {
+        std::wstring value = GetString(section, key, L"");
+        if (value.empty()) {
+            return defaultValue;
+        }
+
+        wchar_t* end = nullptr;
+        float result = std::wcstof(value.c_str(), &end);
+        return end != value.c_str() ? result : defaultValue;
+    }
+
+    std::wstring GetString(const wchar_t* section, const wchar_t* key, const wchar_t* defaultValue) {
+        wchar_t buffer[1024];
+        DWORD length = GetPrivateProfileString(section, key, defaultValue, buffer, 1024, GetPath().c_str());
+        return std::wstring(buffer, length);
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+/**
+* Optional user settings read from Data\SKSE\Plugins\MantellaLauncher.ini
+*
+* Every value has a built-in default, so the file does not need to exist.
+* Values are read on demand; callers cache what they need during their own setup.
+**/
+namespace Settings {
+    std::wstring GetPath();
+
+    bool GetBool(const wchar_t* section, const wchar_t* key, bool defaultValue);
+    int GetInt(const wchar_t* section, const wchar_t* key, int defaultValue);
+    float GetFloat(const wchar_t* section, const wchar_t* key, float defaultValue);
+    std::wstring GetString(const wchar_t* section, const wchar_t* key, const wchar_t* defaultValue);
+}
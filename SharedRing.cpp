@@ -0,0 +1,181 @@
+#include "SharedRing.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "Metrics.h"
+
+#ifdef _WIN32
+    #include "Recorder.h"
+#endif
+
+namespace {
+    constexpr std::uint64_t AlignRecord(std::uint64_t size) { return (size + 7) & ~std::uint64_t{7}; }
+}
+
+void RecordRing::Create(void* memory, std::uint32_t capacity) {
+    _header = new (memory) RingHeader{};
+    _header->magic = RingHeader::kMagic;
+    _header->version = RingHeader::kVersion;
+    _header->capacity = capacity;
+    _header->writePosition.store(0, std::memory_order_relaxed);
+    _header->readPosition.store(0, std::memory_order_release);
+    _data = reinterpret_cast<std::byte*>(_header + 1);
+    _mask = capacity - 1;
+}
+
+bool RecordRing::Attach(void* memory, std::size_t size) {
+    if (size < sizeof(RingHeader)) {
+        return false;
+    }
+    // The other process wrote the header, a capacity past the mapping would make every copy run off its end
+    auto* header = static_cast<RingHeader*>(memory);
+    if (header->magic != RingHeader::kMagic || header->version != RingHeader::kVersion || header->capacity == 0 ||
+        (header->capacity & (header->capacity - 1)) != 0 || GetRequiredSize(header->capacity) > size) {
+        return false;
+    }
+    _header = header;
+    _data = reinterpret_cast<std::byte*>(_header + 1);
+    _mask = header->capacity - 1;
+    return true;
+}
+
+bool RecordRing::Write(std::uint16_t kind, std::uint16_t flags, const void* data, std::uint32_t size) {
+    std::uint64_t total = sizeof(RecordHeader) + AlignRecord(size);
+    std::uint64_t write = _header->writePosition.load(std::memory_order_relaxed);
+    std::uint64_t read = _header->readPosition.load(std::memory_order_acquire);
+    if (total > _header->capacity - (write - read)) {
+        return false;
+    }
+
+    RecordHeader header = {size, kind, flags};
+    CopyIn(write, &header, sizeof(header));
+    CopyIn(write + sizeof(header), data, size);
+    _header->writePosition.store(write + total, std::memory_order_release);
+    return true;
+}
+
+bool RecordRing::Read(RecordHeader& header, std::vector<std::byte>& payload) {
+    std::uint64_t read = _header->readPosition.load(std::memory_order_relaxed);
+    std::uint64_t write = _header->writePosition.load(std::memory_order_acquire);
+    if (read == write) {
+        return false;
+    }
+
+    // The other process writes the headers, so a size that doesn't fit what was written means the ring is
+    // corrupt. Everything written so far is skipped to get back in step with the producer.
+    std::uint64_t available = write - read;
+    if (available <= _header->capacity) {
+        CopyOut(read, &header, sizeof(header));
+    }
+    if (available > _header->capacity || header.size > _header->capacity ||
+        sizeof(RecordHeader) + std::uint64_t{header.size} > available) {
+        Metrics::Increment("ring.corrupt_records");
+        _header->readPosition.store(write, std::memory_order_release);
+        return false;
+    }
+
+    payload.resize(header.size);
+    CopyOut(read + sizeof(header), payload.data(), header.size);
+    _header->readPosition.store(read + sizeof(RecordHeader) + AlignRecord(header.size), std::memory_order_release);
+    return true;
+}
+
+std::uint32_t RecordRing::GetUsedBytes() const {
+    return static_cast<std::uint32_t>(_header->writePosition.load(std::memory_order_acquire) -
+                                      _header->readPosition.load(std::memory_order_acquire));
+}
+
+void RecordRing::CopyIn(std::uint64_t position, const void* data, std::size_t size) {
+    std::size_t offset = static_cast<std::size_t>(position & _mask);
+    std::size_t first = std::min(size, static_cast<std::size_t>(_header->capacity) - offset);
+    std::memcpy(_data + offset, data, first);
+    std::memcpy(_data, static_cast<const std::byte*>(data) + first, size - first);
+}
+
+void RecordRing::CopyOut(std::uint64_t position, void* data, std::size_t size) const {
+    std::size_t offset = static_cast<std::size_t>(position & _mask);
+    std::size_t first = std::min(size, static_cast<std::size_t>(_header->capacity) - offset);
+    std::memcpy(data, _data + offset, first);
+    std::memcpy(static_cast<std::byte*>(data) + first, _data, size - first);
+}
+
+#ifdef _WIN32
+bool SharedRing::Create(const std::wstring& name, std::uint32_t capacity) {
+    Close();
+
+    std::size_t size = RecordRing::GetRequiredSize(capacity);
+    _mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, static_cast<DWORD>(size), name.c_str());
+    if (_mapping == NULL) {
+        return false;
+    }
+
+    _view = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    _dataEvent = CreateEvent(NULL, FALSE, FALSE, (name + L".Data").c_str());
+    if (_view == nullptr || _dataEvent == NULL) {
+        Close();
+        return false;
+    }
+
+    _ring.Create(_view, capacity);
+    _name = name;
+    return true;
+}
+
+bool SharedRing::Open(const std::wstring& name) {
+    Close();
+
+    _mapping = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+    if (_mapping == NULL) {
+        return false;
+    }
+
+    _view = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    _dataEvent = OpenEvent(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, (name + L".Data").c_str());
+    // The view covers the whole mapping, rounded up to whole pages
+    MEMORY_BASIC_INFORMATION view = {};
+    if (_view == nullptr || _dataEvent == NULL || VirtualQuery(_view, &view, sizeof(view)) == 0 ||
+        !_ring.Attach(_view, view.RegionSize)) {
+        Close();
+        return false;
+    }
+
+    _name = name;
+    return true;
+}
+
+void SharedRing::Close() {
+    if (_view != nullptr) {
+        UnmapViewOfFile(_view);
+        _view = nullptr;
+    }
+    if (_mapping != NULL) {
+        CloseHandle(_mapping);
+        _mapping = NULL;
+    }
+    if (_dataEvent != NULL) {
+        CloseHandle(_dataEvent);
+        _dataEvent = NULL;
+    }
+    _ring = RecordRing();
+    _name.clear();
+}
+
+bool SharedRing::Write(std::uint16_t kind, std::uint16_t flags, const void* data, std::uint32_t size) {
+    if (!_ring.Write(kind, flags, data, size)) {
+        return false;
+    }
+    SetEvent(_dataEvent);
+    Recorder::RecordRing(Recorder::kSent, _name, kind, flags, data, size);
+    return true;
+}
+
+bool SharedRing::Read(RecordHeader& header, std::vector<std::byte>& payload) {
+    if (!_ring.Read(header, payload)) {
+        return false;
+    }
+    Recorder::RecordRing(Recorder::kReceived, _name, header.kind, header.flags, payload.data(), header.size);
+    return true;
+}
+#endif
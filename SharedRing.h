@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <string>
+#endif
+
+/**
+* Single-producer, single-consumer record ring for bulk data shared with Mantella
+*
+* The ring lives in a block of memory that both processes map. It starts with a RingHeader followed
+* by a power-of-two sized data area. Each record is an 8-byte RecordHeader plus its payload, padded
+* to 8 bytes; records wrap around the end of the data area. The producer only moves writePosition,
+* the consumer only moves readPosition, so no locks are needed.
+**/
+struct RingHeader {
+    static constexpr std::uint32_t kMagic = 0x474E524D;  // "MRNG"
+    static constexpr std::uint32_t kVersion = 1;
+
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t capacity;  // size of the data area in bytes
+    std::uint32_t reserved;
+    alignas(64) std::atomic<std::uint64_t> writePosition;
+    alignas(64) std::atomic<std::uint64_t> readPosition;
+};
+
+struct RecordHeader {
+    std::uint32_t size;   // payload size in bytes
+    std::uint16_t kind;   // what the payload is, defined by the users of the ring
+    std::uint16_t flags;  // kind-specific flags
+};
+
+class RecordRing {
+public:
+    // Bytes needed for a ring with the given data capacity, which must be a power of two
+    static std::size_t GetRequiredSize(std::uint32_t capacity) { return sizeof(RingHeader) + capacity; }
+
+    // Initialize a fresh ring in memory
+    void Create(void* memory, std::uint32_t capacity);
+    // Attach to a ring that the other side created in size bytes of memory. Returns false if the header doesn't
+    // match, or its capacity is 0, not a power of two or more than the memory holds.
+    bool Attach(void* memory, std::size_t size);
+
+    // Append one record. Returns false without writing anything if there is not enough free space.
+    bool Write(std::uint16_t kind, std::uint16_t flags, const void* data, std::uint32_t size);
+
+    // Pop the next record into payload. Returns false if the ring is empty, or if the next record's size
+    // doesn't fit in what was written; the unread data is then dropped and counted as "ring.corrupt_records".
+    bool Read(RecordHeader& header, std::vector<std::byte>& payload);
+
+    std::uint32_t GetUsedBytes() const;
+    bool IsValid() const { return _header != nullptr; }
+
+private:
+    void CopyIn(std::uint64_t position, const void* data, std::size_t size);
+    void CopyOut(std::uint64_t position, void* data, std::size_t size) const;
+
+    RingHeader* _header = nullptr;
+    std::byte* _data = nullptr;
+    std::uint32_t _mask = 0;
+};
+
+#ifdef _WIN32
+/**
+* A RecordRing in a named file mapping, plus a named auto-reset event that the producer signals
+* after every write so the consumer doesn't have to poll. The names are "<name>" and "<name>.Data".
+**/
+class SharedRing {
+public:
+    SharedRing() = default;
+    SharedRing(const SharedRing&) = delete;
+    SharedRing& operator=(const SharedRing&) = delete;
+    ~SharedRing() { Close(); }
+
+    bool Create(const std::wstring& name, std::uint32_t capacity);
+    // Attach to a ring that was created elsewhere, to write into it as its producer
+    bool Open(const std::wstring& name);
+    void Close();
+
+    // Write a record and wake the consumer
+    bool Write(std::uint16_t kind, std::uint16_t flags, const void* data, std::uint32_t size);
+    bool Read(RecordHeader& header, std::vector<std::byte>& payload);
+
+    HANDLE GetDataEvent() const { return _dataEvent; }
+    const std::wstring& GetName() const { return _name; }
+    bool IsOpen() const { return _ring.IsValid(); }
+
+private:
+    std::wstring _name;
+    HANDLE _mapping = NULL;
+    HANDLE _dataEvent = NULL;
+    void* _view = nullptr;
+    RecordRing _ring;
+};
+#endif
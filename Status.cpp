@@ -0,0 +1,121 @@
+#include "Status.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include "Metrics.h"
+
+namespace Status {
+    namespace {
+        SeqLock<Snapshot>& GetSnapshot() {
+            static SeqLock<Snapshot> snapshot;
+            return snapshot;
+        }
+
+        template <class Function>
+        void Update(Function&& change) {
+            GetSnapshot().Update([&](Snapshot& snapshot) {
+                change(snapshot);
+                ++snapshot.version;
+            });
+        }
+
+        std::int64_t GetUnixTimeMs() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+
+#ifdef _WIN32
+        RE::BSFixedString GetMantellaStatePapyrus(RE::StaticFunctionTag*) { return GetStateName(Get().state); }
+
+        std::int32_t GetMantellaPidPapyrus(RE::StaticFunctionTag*) { return static_cast<std::int32_t>(Get().pid); }
+
+        RE::BSFixedString GetMantellaLastErrorPapyrus(RE::StaticFunctionTag*) {
+            Snapshot snapshot = Get();
+            return snapshot.lastError;
+        }
+#endif
+    }
+
+    Snapshot Get() { return GetSnapshot().Load(); }
+
+    void SetState(State state) {
+        Update([&](Snapshot& snapshot) { snapshot.state = state; });
+        Metrics::SetGauge("launcher.state", static_cast<std::int64_t>(state));
+    }
+
+    void RecordLaunchStart() {
+        std::int64_t now = GetUnixTimeMs();
+        Update([&](Snapshot& snapshot) {
+            snapshot.state = State::kLaunching;
+            snapshot.launchedAt = now;
+            ++snapshot.launches;
+        });
+        Metrics::SetGauge("launcher.state", static_cast<std::int64_t>(State::kLaunching));
+    }
+
+    void RecordLaunchEnd(bool succeeded, std::uint32_t pid, double launchMs, const std::string& error) {
+        State state = succeeded ? State::kRunning : State::kFailed;
+        Update([&](Snapshot& snapshot) {
+            snapshot.state = state;
+            snapshot.pid = pid;
+            snapshot.launchMs = launchMs;
+            // A successful launch clears the error, so it only ever describes the latest attempt
+            std::size_t length = succeeded ? 0 : std::min(error.size(), sizeof(snapshot.lastError) - 1);
+            std::memcpy(snapshot.lastError, error.data(), length);
+            snapshot.lastError[length] = '\0';
+            if (!succeeded) {
+                ++snapshot.failures;
+            }
+        });
+        Metrics::SetGauge("launcher.state", static_cast<std::int64_t>(state));
+        Metrics::RecordLatency("launcher.launch", launchMs);
+        if (!succeeded) {
+            Metrics::Increment("launcher.failures");
+        }
+    }
+
+    void RecordTerminated() {
+        Update([](Snapshot& snapshot) { ++snapshot.terminated; });
+    }
+
+    const char* GetStateName(State state) {
+        switch (state) {
+            case State::kIdle:
+                return "idle";
+            case State::kLaunching:
+                return "launching";
+            case State::kRunning:
+                return "running";
+            case State::kAlreadyRunning:
+                return "already_running";
+            case State::kRemote:
+                return "remote";
+            default:
+                return "failed";
+        }
+    }
+
+    std::string Format() {
+        Snapshot snapshot = Get();
+        std::stringstream ss;
+        ss << "Mantella.exe: " << GetStateName(snapshot.state) << ", pid " << snapshot.pid << ", " << snapshot.launches
+           << " launches (last took " << snapshot.launchMs << " ms), " << snapshot.failures << " failures, "
+           << snapshot.terminated << " stale processes ended";
+        if (snapshot.lastError[0] != '\0') {
+            ss << ", last error: " << snapshot.lastError;
+        }
+        return ss.str();
+    }
+
+#ifdef _WIN32
+    bool Register(RE::BSScript::IVirtualMachine* vm) {
+        vm->RegisterFunction("GetMantellaState", "MantellaLauncher", GetMantellaStatePapyrus);
+        vm->RegisterFunction("GetMantellaPid", "MantellaLauncher", GetMantellaPidPapyrus);
+        vm->RegisterFunction("GetMantellaLastError", "MantellaLauncher", GetMantellaLastErrorPapyrus);
+        return true;
+    }
+#endif
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+/**
+* The launcher's externally visible state
+*
+* Mantella.exe is started in the background, so the game thread, Papyrus and the metrics output
+* read the launcher's state while a launch may be in progress. They must never wait for it, so the
+* state is published as a snapshot behind a seqlock: readers copy it with a few plain loads and
+* retry only in the rare case that a writer was changing it at the same moment.
+**/
+namespace Status {
+    /**
+    * Single-writer-at-a-time, wait-free-for-readers publication of a trivially copyable value
+    *
+    * The value is stored as atomic words, so a reader racing a writer sees a torn copy only as an
+    * odd or changed sequence number and tries again, without any undefined behavior.
+    **/
+    template <class T>
+    class SeqLock {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+    public:
+        SeqLock() { Store(T()); }
+
+        T Load() const {
+            Words words;
+            for (;;) {
+                std::uint64_t before = _sequence.load(std::memory_order_acquire);
+                if (before & 1) {
+                    continue;  // A write is in progress
+                }
+                for (std::size_t i = 0; i < kWordCount; ++i) {
+                    words[i] = _words[i].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_sequence.load(std::memory_order_relaxed) == before) {
+                    break;
+                }
+            }
+            T value;
+            std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+            return value;
+        }
+
+        // Writers are serialized among themselves, readers never wait for them
+        template <class Function>
+        void Update(Function&& change) {
+            std::lock_guard guard(_writerLock);
+            T value = Load();
+            change(value);
+            Store(value);
+        }
+
+    private:
+        static constexpr std::size_t kWordCount = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+        using Words = std::array<std::uint64_t, kWordCount>;
+
+        void Store(const T& value) {
+            Words words{};
+            std::memcpy(words.data(), &value, sizeof(T));
+
+            std::uint64_t sequence = _sequence.load(std::memory_order_relaxed);
+            _sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (std::size_t i = 0; i < kWordCount; ++i) {
+                _words[i].store(words[i], std::memory_order_relaxed);
+            }
+            _sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        std::atomic<std::uint64_t> _sequence{0};
+        std::array<std::atomic<std::uint64_t>, kWordCount> _words{};
+        std::mutex _writerLock;
+    };
+
+    enum class State : std::uint8_t {
+        kIdle,
+        kLaunching,
+        kRunning,         // started by the launcher
+        kAlreadyRunning,  // found running at kDataLoaded
+        kRemote,          // a remote instance is in use
+        kFailed
+    };
+
+    struct Snapshot {
+        std::uint64_t version = 0;  // incremented by every update
+        State state = State::kIdle;
+        std::uint32_t pid = 0;  // 0 when unknown, e.g. Mantella.exe started through Explorer never showed up
+        std::int64_t launchedAt = 0;  // Unix time in milliseconds of the last launch attempt
+        double launchMs = 0.0;        // duration of the last launch attempt
+        std::uint32_t launches = 0;
+        std::uint32_t failures = 0;
+        std::uint32_t terminated = 0;  // stale Mantella.exe processes ended before a launch
+        char lastError[160] = {};
+    };
+
+    // A consistent copy of the latest snapshot, safe on any thread
+    Snapshot Get();
+
+    // Every change publishes the next version
+    void SetState(State state);
+    void RecordLaunchStart();
+    void RecordLaunchEnd(bool succeeded, std::uint32_t pid, double launchMs, const std::string& error = {});
+    void RecordTerminated();
+
+    const char* GetStateName(State state);
+    // One line for the console
+    std::string Format();
+
+#ifdef _WIN32
+    // Register the natives on the MantellaLauncher script
+    bool Register(RE::BSScript::IVirtualMachine* vm);
+#endif
+}
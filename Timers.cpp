@@ -0,0 +1,264 @@
+#include "Timers.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <mutex>
+    #include <thread>
+
+    #include "MainThread.h"
+    #include "Metrics.h"
+#endif
+
+namespace Timers {
+    std::uint64_t Wheel::ToTick(Clock::time_point time) const {
+        if (time <= _start) {
+            return 0;
+        }
+        // Round up so a timer never fires early
+        return static_cast<std::uint64_t>((time - _start + kTick - Clock::duration(1)) / kTick);
+    }
+
+    // Put a timer in the slot of its due time
+    void Wheel::Schedule(std::uint32_t id, Timer& timer) {
+        timer.dueTick = std::max(ToTick(timer.due), _currentTick);
+        _slots[timer.dueTick % kSlotCount].push_back({id, timer.dueTick});
+    }
+
+    std::uint32_t Wheel::Start(std::string eventName, Clock::time_point due, std::chrono::milliseconds interval,
+                               std::string strArg, float numArg) {
+        std::uint32_t id = _nextId++;
+        Timer& timer = _timers[id];
+        timer.eventName = std::move(eventName);
+        timer.strArg = std::move(strArg);
+        timer.numArg = numArg;
+        timer.due = due;
+        timer.interval = interval;
+        Schedule(id, timer);
+        return id;
+    }
+
+    void Wheel::Cancel(std::uint32_t timerId) {
+        auto it = _timers.find(timerId);
+        if (it == _timers.end()) {
+            return;
+        }
+        if (it->second.debounced) {
+            _debounced.erase(it->second.eventName);
+        }
+        _timers.erase(it);  // Its slot entry is dropped when the wheel gets there
+    }
+
+    std::uint32_t Wheel::Debounce(std::string eventName, Clock::time_point due, std::string strArg, float numArg) {
+        auto [entry, inserted] = _debounced.try_emplace(eventName, 0);
+        if (inserted) {
+            entry->second = _nextId++;
+        }
+
+        Timer& timer = _timers[entry->second];
+        timer.eventName = std::move(eventName);
+        timer.strArg = std::move(strArg);
+        timer.numArg = numArg;
+        timer.due = due;
+        timer.debounced = true;
+        Schedule(entry->second, timer);
+        return entry->second;
+    }
+
+    std::optional<Wheel::Clock::time_point> Wheel::Advance(Clock::time_point now, std::vector<Fired>& fired) {
+        std::uint64_t nowTick = now > _start ? static_cast<std::uint64_t>((now - _start) / kTick) : 0;
+
+        // After a stall of more than a revolution every slot is visited once, not once per tick that passed.
+        // A timer restarted for the same tick has an entry per restart, it is still due only once.
+        std::vector<std::uint32_t> due;
+        std::unordered_set<std::uint32_t> seen;
+        std::uint64_t lastTick = std::min(nowTick, _currentTick + kSlotCount - 1);
+        for (std::uint64_t tick = _currentTick; tick <= lastTick; ++tick) {
+            std::erase_if(_slots[tick % kSlotCount], [&](const SlotEntry& entry) {
+                if (entry.tick > nowTick) {
+                    return false;  // Due in a later revolution of the wheel
+                }
+                auto it = _timers.find(entry.id);
+                if (it != _timers.end() && it->second.dueTick == entry.tick && seen.insert(entry.id).second) {
+                    due.push_back(entry.id);
+                }
+                return true;
+            });
+        }
+        _currentTick = std::max(_currentTick, nowTick + 1);
+        // Slots come in wheel order after a stall, fire in the order the timers were due
+        std::sort(due.begin(), due.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return _timers.at(a).dueTick < _timers.at(b).dueTick;
+        });
+
+        for (std::uint32_t id : due) {
+            auto it = _timers.find(id);
+            if (it == _timers.end()) {
+                continue;
+            }
+            Timer& timer = it->second;
+            fired.push_back({timer.eventName, timer.strArg, timer.numArg, timer.due});
+
+            if (timer.interval.count() > 0) {
+                // Keep the cadence, but a timer that missed its next period restarts from now instead of
+                // firing the missed ones back to back
+                timer.due += timer.interval;
+                if (timer.due <= now) {
+                    timer.due = now + timer.interval;
+                }
+                Schedule(id, timer);
+            } else {
+                if (timer.debounced) {
+                    _debounced.erase(timer.eventName);
+                }
+                _timers.erase(it);
+            }
+        }
+
+        if (_timers.empty()) {
+            return std::nullopt;
+        }
+        // The wheel is mostly empty, so look for the next slot with an entry due in this revolution
+        for (std::uint64_t tick = _currentTick; tick < _currentTick + kSlotCount; ++tick) {
+            for (const SlotEntry& entry : _slots[tick % kSlotCount]) {
+                auto it = _timers.find(entry.id);
+                if (entry.tick == tick && it != _timers.end() && it->second.dueTick == tick) {
+                    return _start + kTick * tick;
+                }
+            }
+        }
+        return _start + kTick * (_currentTick + kSlotCount);
+    }
+
+#ifdef _WIN32
+    namespace {
+        using Clock = Wheel::Clock;
+
+        struct State {
+            std::mutex lock;
+            Wheel wheel{Clock::now()};
+
+            HANDLE wakeEvent = NULL;
+            HANDLE waitableTimer = NULL;
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        void Send(const Wheel::Fired& timer, Clock::time_point firedAt) {
+            double late = std::chrono::duration<double, std::milli>(firedAt - timer.due).count();
+            Metrics::RecordLatency("timers.jitter", late);
+            Metrics::Increment("timers.fired");
+
+            MainThread::SendModEvent(timer.eventName, timer.strArg, timer.numArg);
+        }
+
+        // Fire everything that is due and return when the next occupied slot is due, if any
+        std::optional<Clock::time_point> Advance(State& state) {
+            std::vector<Wheel::Fired> fired;
+            std::optional<Clock::time_point> next;
+            Clock::time_point now = Clock::now();
+            {
+                std::lock_guard guard(state.lock);
+                next = state.wheel.Advance(now, fired);
+            }
+            for (const Wheel::Fired& timer : fired) {
+                Send(timer, now);
+            }
+            return next;
+        }
+
+        void TimerLoop() {
+            State& state = GetState();
+            for (;;) {
+                std::optional<Clock::time_point> next = Advance(state);
+                if (!next) {
+                    WaitForSingleObject(state.wakeEvent, INFINITE);
+                    continue;
+                }
+
+                // Relative due time in 100 ns units
+                auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(*next - Clock::now());
+                LARGE_INTEGER dueTime;
+                dueTime.QuadPart = -std::max<long long>(wait.count() / 100, 1);
+                SetWaitableTimer(state.waitableTimer, &dueTime, 0, NULL, NULL, FALSE);
+
+                HANDLE handles[] = {state.waitableTimer, state.wakeEvent};
+                WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+            }
+        }
+
+        std::chrono::milliseconds ToMilliseconds(float seconds) {
+            return std::chrono::milliseconds(static_cast<std::int64_t>(std::max(seconds, 0.0f) * 1000.0f));
+        }
+
+        std::int32_t StartTimerPapyrus(RE::StaticFunctionTag*, RE::BSFixedString eventName, float delaySeconds,
+                                       float intervalSeconds, RE::BSFixedString strArg, float numArg) {
+            return static_cast<std::int32_t>(Start(eventName.c_str(), ToMilliseconds(delaySeconds),
+                                                   ToMilliseconds(intervalSeconds), strArg.c_str(), numArg));
+        }
+
+        void CancelTimerPapyrus(RE::StaticFunctionTag*, std::int32_t timerId) {
+            Cancel(static_cast<std::uint32_t>(timerId));
+        }
+
+        void DebouncePapyrus(RE::StaticFunctionTag*, RE::BSFixedString eventName, float quietSeconds,
+                             RE::BSFixedString strArg, float numArg) {
+            Debounce(eventName.c_str(), ToMilliseconds(quietSeconds), strArg.c_str(), numArg);
+        }
+    }
+
+    void Install() {
+        State& state = GetState();
+        if (state.wakeEvent != NULL) {
+            return;
+        }
+        state.wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        // High resolution timers avoid the 15.6 ms default timer granularity, older Windows versions fall back
+        state.waitableTimer =
+            CreateWaitableTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (state.waitableTimer == NULL) {
+            state.waitableTimer = CreateWaitableTimer(NULL, FALSE, NULL);
+        }
+        std::thread(TimerLoop).detach();
+    }
+
+    std::uint32_t Start(std::string eventName, std::chrono::milliseconds delay, std::chrono::milliseconds interval,
+                        std::string strArg, float numArg) {
+        State& state = GetState();
+        std::uint32_t id;
+        {
+            std::lock_guard guard(state.lock);
+            id = state.wheel.Start(std::move(eventName), Clock::now() + delay, interval, std::move(strArg), numArg);
+        }
+        SetEvent(state.wakeEvent);
+        return id;
+    }
+
+    void Cancel(std::uint32_t timerId) {
+        State& state = GetState();
+        std::lock_guard guard(state.lock);
+        state.wheel.Cancel(timerId);
+    }
+
+    void Debounce(std::string eventName, std::chrono::milliseconds quiet, std::string strArg, float numArg) {
+        State& state = GetState();
+        {
+            std::lock_guard guard(state.lock);
+            state.wheel.Debounce(std::move(eventName), Clock::now() + quiet, std::move(strArg), numArg);
+        }
+        SetEvent(state.wakeEvent);
+    }
+
+    bool Register(RE::BSScript::IVirtualMachine* vm) {
+        vm->RegisterFunction("StartTimer", "MantellaLauncher", StartTimerPapyrus);
+        vm->RegisterFunction("CancelTimer", "MantellaLauncher", CancelTimerPapyrus);
+        vm->RegisterFunction("Debounce", "MantellaLauncher", DebouncePapyrus);
+        return true;
+    }
+#endif
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+* Timers and debounced triggers that fire ModEvents
+*
+* Scripts that wait for Mantella would otherwise poll in Utility.Wait loops, which keeps a VM thread
+* busy and adds up to a polling interval of latency. Instead they can start a timer and react to the
+* ModEvent it sends. Timers live in a hashed timing wheel with 1 ms slots on a background thread that
+* sleeps on a high-resolution waitable timer until the next occupied slot, so starting, restarting and
+* cancelling a timer are O(1). The difference between the due time and the moment the timer
+* fires is recorded as "timers.jitter".
+**/
+namespace Timers {
+    /**
+    * The timing wheel, separate from the timer thread so it can be driven with any clock
+    *
+    * Not thread safe. Restarting or cancelling a timer leaves its old slot entry behind, which is dropped
+    * when the wheel gets there.
+    **/
+    class Wheel {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Fired {
+            std::string eventName;
+            std::string strArg;
+            float numArg = 0.0f;
+            Clock::time_point due;
+        };
+
+        explicit Wheel(Clock::time_point start) : _start(start) {}
+
+        std::uint32_t Start(std::string eventName, Clock::time_point due, std::chrono::milliseconds interval,
+                            std::string strArg, float numArg);
+        void Cancel(std::uint32_t timerId);
+        // Restart the debounced timer of eventName, or start one. Returns its ID.
+        std::uint32_t Debounce(std::string eventName, Clock::time_point due, std::string strArg, float numArg);
+
+        // Append everything due at now to fired, in the order it was due, and return when the next occupied
+        // slot is due, if any
+        std::optional<Clock::time_point> Advance(Clock::time_point now, std::vector<Fired>& fired);
+
+        std::size_t GetSize() const { return _timers.size(); }
+
+    private:
+        static constexpr std::size_t kSlotCount = 1024;  // one revolution of the wheel is about a second
+        static constexpr auto kTick = std::chrono::milliseconds(1);
+
+        struct Timer {
+            std::string eventName;
+            std::string strArg;
+            float numArg = 0.0f;
+            Clock::time_point due;
+            std::uint64_t dueTick = 0;
+            std::chrono::milliseconds interval{0};
+            bool debounced = false;
+        };
+
+        struct SlotEntry {
+            std::uint32_t id;
+            std::uint64_t tick;  // stale when the timer was restarted or cancelled since
+        };
+
+        std::uint64_t ToTick(Clock::time_point time) const;
+        void Schedule(std::uint32_t id, Timer& timer);
+
+        Clock::time_point _start;
+        std::uint64_t _currentTick = 0;  // every slot before this one has been processed
+        std::array<std::vector<SlotEntry>, kSlotCount> _slots;
+        std::unordered_map<std::uint32_t, Timer> _timers;
+        std::unordered_map<std::string, std::uint32_t> _debounced;  // event name to timer ID
+        std::uint32_t _nextId = 1;
+    };
+
+#ifdef _WIN32
+    // Start the timer thread. Call once at kDataLoaded.
+    void Install();
+
+    // Send eventName after delay, and then every interval if it is not zero. Returns the timer's ID.
+    std::uint32_t Start(std::string eventName, std::chrono::milliseconds delay, std::chrono::milliseconds interval,
+                        std::string strArg = {}, float numArg = 0.0f);
+    void Cancel(std::uint32_t timerId);
+    // Send eventName once quiet has passed without another call for the same event name
+    void Debounce(std::string eventName, std::chrono::milliseconds quiet, std::string strArg = {}, float numArg = 0.0f);
+
+    // Register the natives on the MantellaLauncher script
+    bool Register(RE::BSScript::IVirtualMachine* vm);
+#endif
+}
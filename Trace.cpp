@@ -0,0 +1,391 @@
+#include "Trace.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "Benchmark.h"
+#include "Channel.h"
+#include "Json.h"
+#include "Launcher.h"
+#include "Metrics.h"
+#include "Settings.h"
+#include "SharedRing.h"
+#include "WorkerPool.h"
+
+namespace Trace {
+    namespace {
+        constexpr const wchar_t* kRingName = L"Local\\MantellaLauncher.Trace";
+        constexpr std::uint32_t kRingCapacity = 1 << 18;
+        constexpr std::uint16_t kSpanKind = 1;
+        constexpr std::size_t kMaxSpans = 100000;  // per conversation
+        constexpr int kSyncRounds = 8;
+
+        struct State {
+            std::filesystem::path directory;
+            SharedRing ring;
+            HANDLE wakeEvent = NULL;
+
+            std::mutex lock;
+            std::atomic<std::uint32_t> current{0};  // conversation being traced, 0 if none
+            std::map<std::uint32_t, std::vector<Span>> conversations;
+            std::vector<std::uint32_t> finished;  // ended, written once the ring is drained
+
+            // Mantella's clock minus ours, from the handshake round with the shortest round trip
+            std::atomic<std::int64_t> offsetUs{0};
+            std::int64_t bestRttUs = INT64_MAX;
+            std::uint32_t syncedConnection = 0;
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        std::int64_t Now() { return ToMicroseconds(Clock::now()); }
+
+        // Expects the lock to be held
+        void Add(State& state, std::uint32_t conversationId, Span span) {
+            auto it = state.conversations.find(conversationId);
+            if (it == state.conversations.end()) {
+                return;
+            }
+            if (it->second.size() >= kMaxSpans) {
+                Metrics::Increment("trace.dropped_spans");
+                return;
+            }
+            it->second.push_back(std::move(span));
+        }
+
+        void ReadRecord(State& state, const RecordHeader& header, const std::vector<std::byte>& payload) {
+            if (header.kind != kSpanKind || payload.size() < sizeof(SpanRecord)) {
+                return;
+            }
+            SpanRecord record;
+            std::memcpy(&record, payload.data(), sizeof(record));
+
+            Span span;
+            span.stage = static_cast<Stage>(std::min(record.stage, static_cast<std::uint16_t>(Stage::kOther)));
+            span.remote = true;
+            span.name.assign(reinterpret_cast<const char*>(payload.data()) + sizeof(record),
+                             payload.size() - sizeof(record));
+            span.startUs = static_cast<std::int64_t>(record.startUs) - state.offsetUs;
+            span.endUs = span.startUs + static_cast<std::int64_t>(record.durationUs);
+
+            std::lock_guard guard(state.lock);
+            Add(state, record.conversationId, std::move(span));
+        }
+
+        // Calls, inclusive time and latent wait per Papyrus function, from the spans the profiler added
+        void WritePapyrusProfile(Json::Writer& json, const std::vector<Span>& spans) {
+            struct Function {
+                std::vector<double> inclusiveMs;
+                double latentWaitMs = 0.0;
+            };
+            std::map<std::string, Function> functions;
+            for (const Span& span : spans) {
+                if (span.stage == Stage::kPapyrus && !span.remote) {
+                    Function& function = functions[span.name];
+                    function.inclusiveMs.push_back(static_cast<double>(span.endUs - span.startUs) / 1000.0);
+                    function.latentWaitMs += span.latentWaitMs;
+                }
+            }
+
+            json.Key("papyrusProfile").BeginObject();
+            for (auto& [name, function] : functions) {
+                Benchmark::Summary inclusive = Benchmark::Summarize(std::move(function.inclusiveMs));
+                json.Key(name)
+                    .BeginObject()
+                    .Field("calls", static_cast<std::uint64_t>(inclusive.count))
+                    .Field("inclusive_ms", inclusive.mean * static_cast<double>(inclusive.count))
+                    .Field("inclusive_p50_ms", inclusive.p50)
+                    .Field("inclusive_p90_ms", inclusive.p90)
+                    .Field("inclusive_max_ms", inclusive.max)
+                    .Field("latent_wait_ms", function.latentWaitMs)
+                    .EndObject();
+            }
+            json.EndObject();
+        }
+
+        void WriteTrace(const WorkerPool::Job& job, const std::filesystem::path& directory,
+                        std::uint32_t conversationId, std::vector<Span> spans) {
+            std::map<Stage, double> criticalPath = ComputeCriticalPath(spans);
+            for (const auto& [stage, ms] : criticalPath) {
+                Metrics::RecordLatency(std::string("trace.critical.") + GetStageName(stage), ms);
+            }
+            if (spans.empty()) {
+                return;
+            }
+
+            // Timestamps relative to the first span keep the numbers in the viewer readable
+            std::int64_t origin = spans.front().startUs;
+            for (const Span& span : spans) {
+                origin = std::min(origin, span.startUs);
+            }
+
+            Json::Writer json;
+            json.BeginObject().Key("traceEvents").BeginArray();
+            for (int pid = 1; pid <= 2; ++pid) {
+                json.BeginObject()
+                    .Field("name", "process_name")
+                    .Field("ph", "M")
+                    .Field("pid", pid)
+                    .Key("args")
+                    .BeginObject()
+                    .Field("name", pid == 1 ? "Skyrim" : "Mantella")
+                    .EndObject()
+                    .EndObject();
+                for (std::uint16_t stage = 0; stage < static_cast<std::uint16_t>(Stage::kCount); ++stage) {
+                    json.BeginObject()
+                        .Field("name", "thread_name")
+                        .Field("ph", "M")
+                        .Field("pid", pid)
+                        .Field("tid", static_cast<std::int32_t>(stage))
+                        .Key("args")
+                        .BeginObject()
+                        .Field("name", GetStageName(static_cast<Stage>(stage)))
+                        .EndObject()
+                        .EndObject();
+                }
+            }
+            for (const Span& span : spans) {
+                json.BeginObject()
+                    .Field("name", span.name)
+                    .Field("cat", GetStageName(span.stage))
+                    .Field("ph", "X")
+                    .Field("ts", span.startUs - origin)
+                    .Field("dur", std::max<std::int64_t>(span.endUs - span.startUs, 0))
+                    .Field("pid", span.remote ? 2 : 1)
+                    .Field("tid", static_cast<std::int32_t>(span.stage));
+                if (span.latentWaitMs > 0.0) {
+                    json.Key("args").BeginObject().Field("latent_wait_ms", span.latentWaitMs).EndObject();
+                }
+                json.EndObject();
+            }
+            json.EndArray().Field("displayTimeUnit", "ms").Key("criticalPathMs").BeginObject();
+            for (const auto& [stage, ms] : criticalPath) {
+                json.Field(GetStageName(stage), ms);
+            }
+            json.EndObject();
+            WritePapyrusProfile(json, spans);
+            json.EndObject();
+            if (!job.Checkpoint()) {
+                return;
+            }
+
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+            std::filesystem::path path = directory / ("conversation-" + std::to_string(conversationId) + ".json");
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            const std::string& text = json.GetBuffer();
+            file.write(text.data(), static_cast<std::streamsize>(text.size()));
+            if (!file) {
+                PrintToConsole("Failed to write the trace " + WideStringToString(path.c_str()) + ".");
+                return;
+            }
+            Metrics::Increment("trace.written");
+        }
+
+        // Several rounds, the one with the shortest round trip gives the best offset
+        void SyncClock(State& state) {
+            {
+                std::lock_guard guard(state.lock);
+                state.bestRttUs = INT64_MAX;
+            }
+            for (int round = 0; round < kSyncRounds; ++round) {
+                Json::Writer json(Channel::AcquireBuffer());
+                json.BeginObject().Field("type", "clock_sync").Field("t0", Now()).EndObject();
+                Channel::Send(json.Take());
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+
+        void TraceLoop() {
+            State& state = GetState();
+            RecordHeader header;
+            std::vector<std::byte> payload;
+            for (;;) {
+                HANDLE handles[] = {state.ring.GetDataEvent(), state.wakeEvent};
+                WaitForMultipleObjects(2, handles, FALSE, 500);
+
+                std::uint32_t connection = Channel::GetConnectionId();
+                if (Channel::IsConnected() && connection != state.syncedConnection) {
+                    state.syncedConnection = connection;
+                    SyncClock(state);
+                }
+
+                while (state.ring.Read(header, payload)) {
+                    ReadRecord(state, header, payload);
+                }
+
+                std::vector<std::pair<std::uint32_t, std::vector<Span>>> done;
+                {
+                    std::lock_guard guard(state.lock);
+                    for (std::uint32_t id : state.finished) {
+                        auto it = state.conversations.find(id);
+                        if (it != state.conversations.end()) {
+                            done.emplace_back(id, std::move(it->second));
+                            state.conversations.erase(it);
+                        }
+                    }
+                    state.finished.clear();
+                }
+                for (auto& [id, spans] : done) {
+                    auto write = [directory = state.directory, id,
+                                  spans = std::move(spans)](WorkerPool::Job& job) mutable {
+                        WriteTrace(job, directory, id, std::move(spans));
+                    };
+                    WorkerPool::Submit("trace_write", WorkerPool::Priority::kLow, std::move(write));
+                }
+            }
+        }
+
+        void OnClockSync(Json::Value message) {
+            std::int64_t t3 = Now();
+            std::int64_t t0 = message["t0"].GetInt();
+            std::int64_t t1 = message["t1"].GetInt();
+            std::int64_t t2 = message["t2"].GetInt();
+            std::int64_t rtt = (t3 - t0) - (t2 - t1);
+            Metrics::RecordLatency("trace.clock_rtt", static_cast<double>(rtt) / 1000.0);
+
+            State& state = GetState();
+            std::lock_guard guard(state.lock);
+            if (rtt >= 0 && rtt < state.bestRttUs) {
+                state.bestRttUs = rtt;
+                state.offsetUs = ((t1 - t0) + (t2 - t3)) / 2;
+                Metrics::SetGauge("trace.clock_offset_us", state.offsetUs);
+            }
+        }
+
+        void OnTraceBegin(Json::Value message) {
+            auto id = static_cast<std::uint32_t>(message["conversation_id"].GetUInt());
+            if (id == 0) {
+                return;
+            }
+            State& state = GetState();
+            std::lock_guard guard(state.lock);
+            state.conversations.try_emplace(id);
+            state.current = id;
+        }
+
+        void OnTraceEnd(Json::Value message) {
+            auto id = static_cast<std::uint32_t>(message["conversation_id"].GetUInt());
+            State& state = GetState();
+            {
+                std::lock_guard guard(state.lock);
+                if (state.current == id) {
+                    state.current = 0;
+                }
+                state.finished.push_back(id);
+            }
+            SetEvent(state.wakeEvent);
+        }
+    }
+
+    const char* GetStageName(Stage stage) {
+        switch (stage) {
+            case Stage::kPapyrus:
+                return "papyrus";
+            case Stage::kPlugin:
+                return "plugin";
+            case Stage::kCapture:
+                return "capture";
+            case Stage::kStt:
+                return "stt";
+            case Stage::kLlm:
+                return "llm";
+            case Stage::kTts:
+                return "tts";
+            case Stage::kPlayback:
+                return "playback";
+            case Stage::kOther:
+                return "other";
+            default:
+                return "idle";
+        }
+    }
+
+    std::int64_t ToMicroseconds(Clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    }
+
+    std::map<Stage, double> ComputeCriticalPath(const std::vector<Span>& spans) {
+        std::vector<const Span*> sorted;
+        std::vector<std::int64_t> bounds;
+        for (const Span& span : spans) {
+            if (span.endUs > span.startUs) {
+                sorted.push_back(&span);
+                bounds.push_back(span.startUs);
+                bounds.push_back(span.endUs);
+            }
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const Span* a, const Span* b) { return a->startUs < b->startUs; });
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+        // Sweep over the intervals between span boundaries, keeping the running spans ordered by their end
+        std::map<Stage, double> result;
+        std::set<std::pair<std::int64_t, std::size_t>> running;
+        std::size_t next = 0;
+        for (std::size_t i = 0; i + 1 < bounds.size(); ++i) {
+            std::int64_t from = bounds[i];
+            for (; next < sorted.size() && sorted[next]->startUs <= from; ++next) {
+                running.emplace(sorted[next]->endUs, next);
+            }
+            while (!running.empty() && running.begin()->first <= from) {
+                running.erase(running.begin());
+            }
+            Stage stage = running.empty() ? Stage::kCount : sorted[running.rbegin()->second]->stage;
+            result[stage] += static_cast<double>(bounds[i + 1] - from) / 1000.0;
+        }
+        return result;
+    }
+
+    void Install() {
+        if (!Settings::GetBool(L"Trace", L"bEnabled", false)) {
+            return;
+        }
+
+        State& state = GetState();
+        std::wstring directory = Settings::GetString(L"Trace", L"sDirectory", L"");
+        if (directory.empty() && !GetLocalDataDirectory().empty()) {
+            directory = GetLocalDataDirectory() + L"\\Traces";
+        }
+        state.directory = directory;
+
+        if (!state.ring.Create(kRingName, kRingCapacity)) {
+            std::stringstream ss;
+            ss << "Failed to create the trace ring. Error: " << GetLastError();
+            PrintToConsole(ss.str());
+            return;
+        }
+        state.wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+        Channel::RegisterHandler("clock_sync", OnClockSync);
+        Channel::RegisterHandler("trace_begin", OnTraceBegin);
+        Channel::RegisterHandler("trace_end", OnTraceEnd);
+        std::thread(TraceLoop).detach();
+    }
+
+    bool IsRecording() { return GetState().current != 0; }
+
+    void AddSpan(Stage stage, std::string name, Clock::time_point start, Clock::time_point end,
+                 Clock::duration latentWait) {
+        State& state = GetState();
+        std::uint32_t conversationId = state.current;
+        if (conversationId == 0) {
+            return;
+        }
+        std::lock_guard guard(state.lock);
+        Add(state, conversationId,
+            {stage, false, std::move(name), ToMicroseconds(start), ToMicroseconds(end),
+             std::chrono::duration<double, std::milli>(latentWait).count()});
+    }
+}
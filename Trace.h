@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+* Conversation traces that span the plugin and Mantella
+*
+* When Mantella sends trace_begin for a conversation, spans are collected from both sides until
+* trace_end: the plugin's own (Papyrus calls seen by the profiler, microphone capture, voice playback)
+* and Mantella's (speech to text, the LLM call, text to speech), which it writes as binary records
+* into the shared-memory ring "Local\MantellaLauncher.Trace". Mantella's timestamps are moved onto
+* the plugin's clock with the offset measured by a clock_sync handshake every time it connects.
+* The merged spans are written as a Chrome trace (open it in chrome://tracing or ui.perfetto.dev) to
+* %LOCALAPPDATA%\Mantella\Traces, and the conversation's critical path is broken down per stage into
+* "trace.critical.<stage>". The file also holds a Papyrus profile of the conversation: calls, inclusive
+* time and latent wait per function seen by the profiler.
+**/
+namespace Trace {
+    using Clock = std::chrono::steady_clock;
+
+    enum class Stage : std::uint16_t {
+        kPapyrus,
+        kPlugin,
+        kCapture,
+        kStt,
+        kLlm,
+        kTts,
+        kPlayback,
+        kOther,
+        kCount
+    };
+
+    // Payload of a kind 1 record in the trace ring, followed by the UTF-8 name of the span
+    struct SpanRecord {
+        std::uint64_t startUs;  // on Mantella's monotonic clock
+        std::uint64_t durationUs;
+        std::uint32_t conversationId;
+        std::uint16_t stage;  // Stage
+        std::uint16_t reserved;
+    };
+
+    struct Span {
+        Stage stage;
+        bool remote;  // recorded by Mantella
+        std::string name;
+        std::int64_t startUs;  // on the plugin's clock, see ToMicroseconds
+        std::int64_t endUs;
+        double latentWaitMs = 0.0;  // of a Papyrus call, spent waiting on latent functions
+    };
+
+    const char* GetStageName(Stage stage);
+    std::int64_t ToMicroseconds(Clock::time_point time);
+
+    /**
+    * Time on the critical path per stage, in milliseconds
+    *
+    * Every moment is attributed to the running span that ends last, the one everything else waits
+    * for; moments without any span count as idle, reported under Stage::kCount.
+    **/
+    std::map<Stage, double> ComputeCriticalPath(const std::vector<Span>& spans);
+
+    // Create the ring and listen for the trace messages if [Trace] bEnabled is set
+    void Install();
+
+    // Whether a conversation is being traced right now, so callers can skip building span names
+    bool IsRecording();
+    void AddSpan(Stage stage, std::string name, Clock::time_point start, Clock::time_point end,
+                 Clock::duration latentWait = {});
+}
@@ -0,0 +1,437 @@
+#include "VoiceCache.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+#include "Channel.h"
+#include "Fuz.h"
+#include "Json.h"
+#include "Launcher.h"
+#include "Metrics.h"
+#include "Settings.h"
+#include "VoicePlayback.h"
+#include "WorkerPool.h"
+
+namespace VoiceCache {
+    namespace {
+        constexpr std::size_t kMaxPendingLines = 64;
+
+        struct IndexHeader {
+            static constexpr std::uint32_t kMagic = 0x4943564D;  // "MVCI"
+            static constexpr std::uint32_t kVersion = 1;
+
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::uint32_t capacity;  // entries, a power of two
+            std::uint32_t count;
+            std::uint64_t totalBytes;
+            std::uint64_t clock;  // advanced on every use, orders the entries for LRU eviction
+        };
+
+        // Open addressing with linear probing, key 0 marks a free slot
+        struct IndexEntry {
+            std::uint64_t key;
+            std::uint64_t lastUsed;
+            std::uint32_t fileSize;
+            std::uint32_t sampleRate;
+            std::uint16_t channels;
+            std::uint16_t reserved;
+            float synthesisMs;
+        };
+        static_assert(sizeof(IndexEntry) == 32);
+
+        struct State {
+            std::filesystem::path directory;
+            std::uint64_t maxBytes = 0;
+
+            std::mutex lock;
+            HANDLE file = INVALID_HANDLE_VALUE;
+            HANDLE mapping = NULL;
+            IndexHeader* header = nullptr;
+            IndexEntry* entries = nullptr;
+            std::deque<std::pair<std::uint32_t, std::uint64_t>> pending;  // line ID and key of recent misses
+
+            std::uint64_t hits = 0;
+            std::uint64_t misses = 0;
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        std::filesystem::path GetLinePath(const State& state, std::uint64_t key) {
+            wchar_t name[32];
+            swprintf_s(name, L"%016llx.fuz", static_cast<unsigned long long>(key));
+            return state.directory / name;
+        }
+
+        std::size_t GetMask(const State& state) { return state.header->capacity - 1; }
+
+        // The following expect the lock to be held
+
+        IndexEntry* Find(State& state, std::uint64_t key) {
+            for (std::size_t i = key & GetMask(state);; i = (i + 1) & GetMask(state)) {
+                if (state.entries[i].key == key) {
+                    return &state.entries[i];
+                }
+                if (state.entries[i].key == 0) {
+                    return nullptr;
+                }
+            }
+        }
+
+        // Backward-shift deletion keeps every probe sequence unbroken without tombstones
+        void Remove(State& state, std::size_t i) {
+            std::size_t mask = GetMask(state);
+            std::size_t j = i;
+            for (;;) {
+                state.entries[i].key = 0;
+                for (;;) {
+                    j = (j + 1) & mask;
+                    if (state.entries[j].key == 0) {
+                        return;
+                    }
+                    std::size_t home = state.entries[j].key & mask;
+                    bool reachable = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+                    if (!reachable) {
+                        break;
+                    }
+                }
+                state.entries[i] = state.entries[j];
+                i = j;
+            }
+        }
+
+        void Drop(State& state, IndexEntry* entry) {
+            std::error_code error;
+            std::filesystem::remove(GetLinePath(state, entry->key), error);
+            state.header->totalBytes -= entry->fileSize;
+            --state.header->count;
+            Remove(state, static_cast<std::size_t>(entry - state.entries));
+        }
+
+        // Make room for a new line of the given size, least recently used lines go first
+        void Evict(State& state, std::uint64_t incoming) {
+            std::size_t maxCount = state.header->capacity / 4 * 3;
+            while (state.header->count > 0 &&
+                   (state.header->count >= maxCount || state.header->totalBytes + incoming > state.maxBytes)) {
+                IndexEntry* oldest = nullptr;
+                for (std::size_t i = 0; i < state.header->capacity; ++i) {
+                    IndexEntry& entry = state.entries[i];
+                    if (entry.key != 0 && (!oldest || entry.lastUsed < oldest->lastUsed)) {
+                        oldest = &entry;
+                    }
+                }
+                Drop(state, oldest);
+                Metrics::Increment("voice_cache.evictions");
+            }
+        }
+
+        void Insert(State& state, const IndexEntry& line) {
+            // The same line stored again, its file was just replaced
+            if (IndexEntry* existing = Find(state, line.key)) {
+                state.header->totalBytes -= existing->fileSize;
+                --state.header->count;
+                Remove(state, static_cast<std::size_t>(existing - state.entries));
+            }
+            Evict(state, line.fileSize);
+            std::size_t i = line.key & GetMask(state);
+            while (state.entries[i].key != 0) {
+                i = (i + 1) & GetMask(state);
+            }
+            state.entries[i] = line;
+            state.entries[i].lastUsed = ++state.header->clock;
+            state.header->totalBytes += line.fileSize;
+            ++state.header->count;
+            Metrics::SetGauge("voice_cache.bytes", static_cast<std::int64_t>(state.header->totalBytes));
+        }
+
+        bool OpenIndex(State& state, std::uint32_t capacity) {
+            std::uint64_t size = sizeof(IndexHeader) + static_cast<std::uint64_t>(capacity) * sizeof(IndexEntry);
+            std::filesystem::path path = state.directory / L"index.bin";
+            state.file = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                                    FILE_ATTRIBUTE_NORMAL, NULL);
+            if (state.file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+
+            LARGE_INTEGER existingSize;
+            bool fresh = !GetFileSizeEx(state.file, &existingSize) ||
+                         static_cast<std::uint64_t>(existingSize.QuadPart) != size;
+            if (fresh) {
+                // Also shrinks the index of a larger cache, which the mapping alone wouldn't
+                LARGE_INTEGER newSize;
+                newSize.QuadPart = static_cast<LONGLONG>(size);
+                if (!SetFilePointerEx(state.file, newSize, NULL, FILE_BEGIN) || !SetEndOfFile(state.file)) {
+                    return false;
+                }
+            }
+            state.mapping = CreateFileMapping(state.file, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                              static_cast<DWORD>(size), NULL);
+            if (state.mapping == NULL) {
+                return false;
+            }
+            auto* view = static_cast<std::byte*>(MapViewOfFile(state.mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+            if (!view) {
+                return false;
+            }
+            state.header = reinterpret_cast<IndexHeader*>(view);
+            state.entries = reinterpret_cast<IndexEntry*>(view + sizeof(IndexHeader));
+
+            fresh = fresh || state.header->magic != IndexHeader::kMagic ||
+                    state.header->version != IndexHeader::kVersion || state.header->capacity != capacity;
+            if (fresh) {
+                // The lines of an unusable index can't be found anymore
+                std::error_code error;
+                for (const auto& file : std::filesystem::directory_iterator(state.directory, error)) {
+                    if (file.path().extension() == L".fuz") {
+                        std::filesystem::remove(file.path(), error);
+                    }
+                }
+                std::memset(view, 0, size);
+                *state.header = {IndexHeader::kMagic, IndexHeader::kVersion, capacity, 0, 0, 0};
+            }
+            return true;
+        }
+
+        void SendResult(std::uint64_t requestId, std::uint32_t lineId, bool hit) {
+            Json::Writer json(Channel::AcquireBuffer());
+            json.BeginObject()
+                .Field("type", "voice_cached")
+                .Field("request_id", requestId)
+                .Field("line_id", lineId)
+                .Field("hit", hit)
+                .EndObject();
+            Channel::Send(json.Take());
+        }
+
+        void CountLookup(State& state, bool hit) {
+            std::uint64_t total;
+            std::uint64_t hits;
+            {
+                std::lock_guard guard(state.lock);
+                (hit ? state.hits : state.misses)++;
+                total = state.hits + state.misses;
+                hits = state.hits;
+            }
+            Metrics::Increment(hit ? "voice_cache.hits" : "voice_cache.misses");
+            Metrics::SetGauge("voice_cache.hit_rate_pct", static_cast<std::int64_t>(hits * 100 / total));
+        }
+
+        void Miss(State& state, std::uint64_t requestId, std::uint32_t lineId, std::uint64_t key) {
+            {
+                std::lock_guard guard(state.lock);
+                if (state.pending.size() >= kMaxPendingLines) {
+                    state.pending.pop_front();
+                }
+                state.pending.emplace_back(lineId, key);
+            }
+            CountLookup(state, false);
+            SendResult(requestId, lineId, false);
+        }
+
+        // Read the cached line and play it as if Mantella had streamed it
+        void Serve(std::uint64_t requestId, VoicePlayback::LineBegin info, std::string text, std::wstring savePath,
+                   std::optional<VoicePlayback::LineSentence> sentence, IndexEntry entry) {
+            State& state = GetState();
+            std::filesystem::path path = GetLinePath(state, entry.key);
+
+            std::ifstream file(path, std::ios::binary);
+            std::vector<std::byte> fuz(entry.fileSize);
+            file.read(reinterpret_cast<char*>(fuz.data()), static_cast<std::streamsize>(fuz.size()));
+            std::span<const std::byte> lip;
+            std::span<const std::byte> audio;
+            if (!file || !Fuz::Split(fuz, lip, audio) || audio.size() < Fuz::kWavHeaderSize) {
+                {
+                    std::lock_guard guard(state.lock);
+                    if (IndexEntry* stale = Find(state, entry.key)) {
+                        Drop(state, stale);
+                    }
+                }
+                Metrics::Increment("voice_cache.read_errors");
+                Miss(state, requestId, info.lineId, entry.key);
+                return;
+            }
+
+            // Mantella asked for a .fuz file of the line, which is exactly what the cache holds
+            if (!savePath.empty() && !CopyFile(path.c_str(), savePath.c_str(), FALSE)) {
+                DWORD error = GetLastError();
+                std::stringstream ss;
+                ss << "Failed to save cached voice line " << WideStringToString(savePath.c_str())
+                   << ". Error: " << error;
+                PrintToConsole(ss.str());
+            }
+
+            audio = audio.subspan(Fuz::kWavHeaderSize);
+            VoicePlayback::PlayCached(info, std::move(text), std::vector<std::byte>(audio.begin(), audio.end()),
+                                      sentence);
+            CountLookup(state, true);
+            Metrics::RecordLatency("voice_cache.saved", entry.synthesisMs);
+            SendResult(requestId, info.lineId, true);
+        }
+
+        void OnLookup(Json::Value message) {
+            State& state = GetState();
+            std::uint64_t requestId = message["request_id"].GetUInt();
+            auto lineId = static_cast<std::uint32_t>(message["line_id"].GetUInt());
+            std::string text = message["text"].GetString();
+            std::uint64_t key =
+                MakeKey(message["voice"].GetString(), NormalizeText(text), message["settings"].GetText());
+
+            IndexEntry entry = {};
+            {
+                std::lock_guard guard(state.lock);
+                if (IndexEntry* found = Find(state, key)) {
+                    found->lastUsed = ++state.header->clock;
+                    entry = *found;
+                }
+            }
+            if (entry.key == 0) {
+                Miss(state, requestId, lineId, key);
+                return;
+            }
+
+            VoicePlayback::LineBegin info = {};
+            info.lineId = lineId;
+            info.sampleRate = entry.sampleRate;
+            info.channels = entry.channels;
+            info.speakerRefId = static_cast<std::uint32_t>(message["speaker_ref_id"].GetUInt());
+            std::wstring savePath;
+            if (Json::Value save = message["save_path"]; save.IsValid()) {
+                savePath = StringToWideString(save.GetString());
+            }
+            // A cached sentence of a longer reply still plays in its place
+            std::optional<VoicePlayback::LineSentence> sentence;
+            if (Json::Value index = message["sentence"]; index.IsValid()) {
+                auto replyId = static_cast<std::uint32_t>(message["reply_id"].GetUInt());
+                sentence = VoicePlayback::LineSentence{lineId, replyId, static_cast<std::uint32_t>(index.GetUInt())};
+            }
+
+            // Channel handlers must return quickly, the file is read by the pool
+            auto serve = [requestId, info, text = std::move(text), savePath = std::move(savePath), sentence,
+                          entry](WorkerPool::Job&) mutable {
+                Serve(requestId, info, std::move(text), std::move(savePath), sentence, entry);
+            };
+            WorkerPool::Submit("voice_cache_read", WorkerPool::Priority::kHigh, std::move(serve));
+        }
+    }
+
+    std::string NormalizeText(std::string_view text) {
+        std::string normalized;
+        normalized.reserve(text.size());
+        bool space = false;
+        for (char c : text) {
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                space = !normalized.empty();
+                continue;
+            }
+            if (space) {
+                normalized += ' ';
+                space = false;
+            }
+            normalized += c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+        return normalized;
+    }
+
+    // FNV-1a over the three parts, each terminated by a zero byte so their boundaries count
+    std::uint64_t MakeKey(std::string_view voice, std::string_view text, std::string_view settings) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (std::string_view part : {voice, text, settings}) {
+            for (char c : part) {
+                hash = (hash ^ static_cast<std::uint8_t>(c)) * 1099511628211ull;
+            }
+            hash *= 1099511628211ull;
+        }
+        return hash != 0 ? hash : 1;  // 0 marks a free slot in the index
+    }
+
+    void Install() {
+        if (!Settings::GetBool(L"VoiceCache", L"bEnabled", true) ||
+            !Settings::GetBool(L"Playback", L"bEnabled", false)) {
+            return;
+        }
+
+        State& state = GetState();
+        std::wstring directory = Settings::GetString(L"VoiceCache", L"sDirectory", L"");
+        if (directory.empty() && !GetLocalDataDirectory().empty()) {
+            directory = GetLocalDataDirectory() + L"\\VoiceCache";
+        }
+        state.directory = directory;
+        state.maxBytes = static_cast<std::uint64_t>(std::max(Settings::GetInt(L"VoiceCache", L"iMaxSizeMB", 256), 1))
+                         << 20;
+        auto capacity = std::bit_ceil(
+            static_cast<std::uint32_t>(std::max(Settings::GetInt(L"VoiceCache", L"iMaxLines", 4096), 16)) / 3 * 4);
+
+        std::error_code error;
+        std::filesystem::create_directories(state.directory, error);
+        if (state.directory.empty() || error || !OpenIndex(state, capacity)) {
+            std::stringstream ss;
+            ss << "Failed to open the voice cache, lines will always be synthesized. Error: " << GetLastError();
+            PrintToConsole(ss.str());
+            return;
+        }
+        Metrics::SetGauge("voice_cache.bytes", static_cast<std::int64_t>(state.header->totalBytes));
+        Channel::RegisterHandler("voice_lookup", OnLookup);
+    }
+
+    bool WantsLine(std::uint32_t lineId) {
+        State& state = GetState();
+        std::lock_guard guard(state.lock);
+        return std::any_of(state.pending.begin(), state.pending.end(),
+                           [&](const auto& pending) { return pending.first == lineId; });
+    }
+
+    void StoreLine(std::uint32_t lineId, std::uint32_t sampleRate, std::uint16_t channels,
+                   std::span<const std::byte> lip, std::span<const std::byte> pcm, double synthesisMs) {
+        State& state = GetState();
+        IndexEntry entry = {};
+        {
+            std::lock_guard guard(state.lock);
+            auto it = std::find_if(state.pending.begin(), state.pending.end(),
+                                   [&](const auto& pending) { return pending.first == lineId; });
+            if (it == state.pending.end()) {
+                return;
+            }
+            entry.key = it->second;
+            state.pending.erase(it);
+        }
+
+        std::vector<std::byte> fuz;
+        Fuz::BuildFromPcm(lip, sampleRate, channels, pcm, fuz);
+
+        entry.fileSize = static_cast<std::uint32_t>(fuz.size());
+        entry.sampleRate = sampleRate;
+        entry.channels = channels;
+        entry.synthesisMs = static_cast<float>(synthesisMs);
+        if (entry.fileSize > state.maxBytes) {
+            return;
+        }
+
+        auto write = [fuz = std::move(fuz), entry](WorkerPool::Job& job) {
+            State& state = GetState();
+            if (!job.Checkpoint()) {
+                return;
+            }
+            if (!WriteWholeFile(GetLinePath(state, entry.key).wstring(), fuz)) {
+                Metrics::Increment("voice_cache.write_errors");
+                return;
+            }
+            std::lock_guard guard(state.lock);
+            Insert(state, entry);
+            Metrics::Increment("voice_cache.stored");
+        };
+        WorkerPool::Submit("voice_cache_write", WorkerPool::Priority::kLow, std::move(write));
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+/**
+* Persistent cache of synthesized voice lines
+*
+* Greetings, farewells and short acknowledgements repeat across sessions but are synthesized again
+* every time. Before synthesizing a line Mantella sends a voice_lookup message with the voice model,
+* the text and its TTS settings. On a hit the plugin plays the cached line itself and Mantella skips
+* synthesis; on a miss the line streamed afterwards is stored. Lines are kept as .fuz files (lip data
+* plus audio) under %LOCALAPPDATA%\Mantella\VoiceCache, found through a memory-mapped hash table that
+* also tracks their last use, so the least recently used lines are evicted once the cache exceeds
+* [VoiceCache] iMaxSizeMB.
+*
+* Hits, misses and the synthesis time a hit saved are recorded as "voice_cache.*".
+**/
+namespace VoiceCache {
+    // Lower case and single spaces, so lines that differ only in those share an entry
+    std::string NormalizeText(std::string_view text);
+    std::uint64_t MakeKey(std::string_view voice, std::string_view text, std::string_view settings);
+
+    // Open the index and listen for lookups. Needs streamed playback.
+    void Install();
+
+    // Whether a line that is about to be streamed should be kept for StoreLine
+    bool WantsLine(std::uint32_t lineId);
+    // Store a finished line that missed the cache, synthesisMs is how long streaming it took
+    void StoreLine(std::uint32_t lineId, std::uint32_t sampleRate, std::uint16_t channels,
+                   std::span<const std::byte> lip, std::span<const std::byte> pcm, double synthesisMs);
+}
@@ -0,0 +1,575 @@
+#include "VoiceCapture.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <mmreg.h>
+    #include <mmdeviceapi.h>
+    #include <audioclient.h>
+    #include <wrl/client.h>
+    #include <atomic>
+    #include <chrono>
+    #include <mutex>
+    #include <sstream>
+    #include <string>
+    #include <thread>
+
+    #include "Channel.h"
+    #include "Json.h"
+    #include "Launcher.h"
+    #include "Metrics.h"
+    #include "Settings.h"
+    #include "SharedRing.h"
+    #include "Trace.h"
+    #include "VoicePlayback.h"
+
+using Microsoft::WRL::ComPtr;
+#endif
+
+namespace VoiceCapture {
+    void FramePipeline::Configure(std::uint32_t inputRate, float thresholdDb, std::uint32_t hangoverFrames) {
+        _resampler.Configure(inputRate, kSampleRate);
+        _pending.clear();
+        _thresholdDb = thresholdDb;
+        _hangoverFrames = hangoverFrames;
+        _hangover = 0;
+    }
+
+    void FramePipeline::Process(const float* interleaved, std::size_t frames, std::uint32_t channels,
+                                const FrameHandler& onFrame) {
+        _mono.resize(frames);
+        AudioDSP::DownmixToMono(interleaved, frames, channels, _mono.data());
+        _resampler.Process(_mono.data(), frames, _pending);
+
+        std::size_t offset = 0;
+        for (; offset + kFrameSamples <= _pending.size(); offset += kFrameSamples) {
+            Emit(_pending.data() + offset, onFrame);
+        }
+        _pending.erase(_pending.begin(), _pending.begin() + static_cast<std::ptrdiff_t>(offset));
+    }
+
+    void FramePipeline::Flush(const FrameHandler& onFrame) {
+        if (!_pending.empty()) {
+            _pending.resize(kFrameSamples, 0.0f);
+            Emit(_pending.data(), onFrame);
+            _pending.clear();
+        }
+    }
+
+    void FramePipeline::Emit(const float* samples, const FrameHandler& onFrame) {
+        std::int16_t pcm[kFrameSamples];
+        AudioDSP::FloatToInt16(samples, pcm, kFrameSamples);
+        float level = 10.0f * std::log10(AudioDSP::MeanSquare(samples, kFrameSamples) + 1e-10f);
+
+        Frame frame = {samples, pcm, level >= _thresholdDb, false};
+        if (frame.speech) {
+            _hangover = _hangoverFrames;
+            frame.voiced = true;
+        } else if (_hangover > 0) {
+            --_hangover;
+            frame.voiced = true;  // Keep short pauses between words inside the utterance
+        }
+        onFrame(frame);
+    }
+
+    ActivityDetector::Event ActivityDetector::Process(const float* frame, std::size_t count) {
+        float energy = AudioDSP::MeanSquare(frame, count);
+        float levelDb = 10.0f * std::log10(energy + 1e-10f);
+        // Normalized lag-1 autocorrelation, from a dot product of the frame with itself shifted by one sample
+        float correlation = 0.0f;
+        if (count > 1 && energy > 0.0f) {
+            correlation = AudioDSP::DotProduct(frame, frame + 1, count - 1) / (energy * static_cast<float>(count));
+        }
+
+        if (!_hasFloor) {
+            _noiseFloorDb = levelDb;
+            _hasFloor = true;
+        }
+        _voiced = levelDb >= _config.minLevelDb && levelDb >= _noiseFloorDb + _config.marginDb &&
+                  correlation >= _config.minCorrelation;
+
+        // The floor drops to quiet frames quickly but rises slowly, and slower still during speech,
+        // so a steady noise like a fan is learned within seconds while talking barely moves it
+        float rate = levelDb < _noiseFloorDb ? 0.2f : (_voiced ? 0.002f : 0.02f);
+        _noiseFloorDb += rate * (levelDb - _noiseFloorDb);
+
+        if (!_active) {
+            _run = _voiced ? _run + 1 : 0;
+            if (_run < _config.onsetFrames) {
+                return Event::kNone;
+            }
+            _active = true;
+            _run = 0;
+            _hangover = _config.hangoverFrames;
+            return Event::kStart;
+        }
+
+        if (_voiced) {
+            _hangover = _config.hangoverFrames;
+            return Event::kNone;
+        }
+        if (_hangover > 0 && --_hangover > 0) {
+            return Event::kNone;
+        }
+        _active = false;
+        return Event::kEnd;
+    }
+
+    void ActivityDetector::Reset() {
+        _hasFloor = false;
+        _active = false;
+        _voiced = false;
+        _run = 0;
+        _hangover = 0;
+    }
+
+#ifdef _WIN32
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr const wchar_t* kRingName = L"Local\\MantellaLauncher.Mic";
+        constexpr std::uint32_t kRingCapacity = 1 << 18;  // a little over 8 seconds of audio
+
+        // The default communications microphone, opened in shared mode with event-driven buffering
+        struct Device {
+            ComPtr<IAudioClient> client;
+            ComPtr<IAudioCaptureClient> capture;
+            std::uint32_t channels = 0;
+            std::uint32_t sampleRate = 0;
+            bool isFloat = false;
+
+            bool IsOpen() const { return capture != nullptr; }
+
+            // Low latency wakes the thread several times as often, hands-free capture saves that CPU instead
+            bool Open(HANDLE samplesReady, bool lowLatency) {
+                ComPtr<IMMDeviceEnumerator> enumerator;
+                ComPtr<IMMDevice> device;
+                if (FAILED(CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, IID_PPV_ARGS(&enumerator))) ||
+                    FAILED(enumerator->GetDefaultAudioEndpoint(eCapture, eCommunications, &device))) {
+                    return false;
+                }
+
+                WAVEFORMATEX* format = nullptr;
+
+                // Prefer the smallest engine period the device supports (Windows 10 and later)
+                ComPtr<IAudioClient3> client3;
+                if (SUCCEEDED(device->Activate(__uuidof(IAudioClient3), CLSCTX_ALL, NULL,
+                                               reinterpret_cast<void**>(client3.GetAddressOf()))) &&
+                    SUCCEEDED(client3->GetMixFormat(&format))) {
+                    UINT32 defaultPeriod, fundamentalPeriod, minPeriod, maxPeriod;
+                    if (SUCCEEDED(client3->GetSharedModeEnginePeriod(format, &defaultPeriod, &fundamentalPeriod,
+                                                                     &minPeriod, &maxPeriod)) &&
+                        SUCCEEDED(client3->InitializeSharedAudioStream(AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                                                                       lowLatency ? minPeriod : defaultPeriod, format,
+                                                                       NULL))) {
+                        client = client3;
+                    }
+                }
+
+                if (!client) {
+                    if (format != nullptr) {
+                        CoTaskMemFree(format);
+                        format = nullptr;
+                    }
+
+                    ComPtr<IAudioClient> fallback;
+                    if (FAILED(device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, NULL,
+                                                reinterpret_cast<void**>(fallback.GetAddressOf()))) ||
+                        FAILED(fallback->GetMixFormat(&format)) ||
+                        FAILED(fallback->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                                                    100000 /* 10 ms */, 0, format, NULL))) {
+                        CoTaskMemFree(format);
+                        return false;
+                    }
+                    client = fallback;
+                }
+
+                // The format tag of an extensible format is the first field of its sub-format GUID
+                DWORD tag = format->wFormatTag == WAVE_FORMAT_EXTENSIBLE
+                                ? reinterpret_cast<WAVEFORMATEXTENSIBLE*>(format)->SubFormat.Data1
+                                : format->wFormatTag;
+                isFloat = tag == WAVE_FORMAT_IEEE_FLOAT && format->wBitsPerSample == 32;
+                bool isPcm16 = tag == WAVE_FORMAT_PCM && format->wBitsPerSample == 16;
+                channels = format->nChannels;
+                sampleRate = format->nSamplesPerSec;
+                CoTaskMemFree(format);
+
+                if ((!isFloat && !isPcm16) || FAILED(client->SetEventHandle(samplesReady)) ||
+                    FAILED(client->GetService(IID_PPV_ARGS(&capture)))) {
+                    Close();
+                    return false;
+                }
+                return true;
+            }
+
+            void Close() {
+                capture.Reset();
+                client.Reset();
+            }
+        };
+
+        struct State {
+            int pushToTalkKey = 0x2F;  // V
+            float vadThresholdDb = -45.0f;
+            std::uint32_t hangoverFrames = 15;
+            bool handsFree = false;
+            std::size_t preRollFrames = 0;
+
+            std::atomic<bool> talking{false};
+            HANDLE stateEvent = NULL;
+            SharedRing ring;
+
+            // Only touched by the capture thread
+            FramePipeline pipeline;
+            std::vector<float> converted;
+            std::uint32_t framesSent = 0;
+            bool speechSeen = false;
+            Clock::time_point lastVoice;
+            Clock::time_point utteranceStart;
+
+            // Hands-free capture, only touched by the capture thread
+            ActivityDetector detector;
+            bool inUtterance = false;
+            std::vector<std::int16_t> preRoll;  // circular, preRollFrames frames
+            std::vector<std::uint8_t> preRollVoiced;
+            std::size_t preRollNext = 0;
+            std::size_t preRollCount = 0;
+            Clock::time_point cpuSampledAt;
+            std::uint64_t cpuTime = 0;  // of the capture thread, in 100 ns units
+
+            std::mutex lock;
+            bool awaitingToken = false;
+            Clock::time_point endOfSpeech;
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        void WriteFrame(State& state, const std::int16_t* pcm, bool voiced) {
+            if (state.ring.Write(kAudioFrame, voiced ? kVoiced : 0, pcm, kFrameSamples * sizeof(std::int16_t))) {
+                ++state.framesSent;
+            } else {
+                Metrics::Increment("capture.frames_dropped");
+            }
+        }
+
+        void StartStream(State& state, const Device& device) {
+            state.pipeline.Configure(device.sampleRate, state.vadThresholdDb, state.hangoverFrames);
+        }
+
+        void BeginUtterance(State& state) {
+            state.utteranceStart = Clock::now();
+            state.framesSent = 0;
+            state.speechSeen = false;
+
+            {
+                std::lock_guard guard(state.lock);
+                state.awaitingToken = false;
+            }
+
+            Json::Writer json(Channel::AcquireBuffer());
+            json.BeginObject()
+                .Field("type", "mic_start")
+                .Field("ring", "Local\\MantellaLauncher.Mic")
+                .Field("sample_rate", kSampleRate)
+                .Field("frame_samples", kFrameSamples)
+                .Field("hands_free", state.handsFree)
+                .EndObject();
+            Channel::Send(json.Take());
+        }
+
+        void EndUtterance(State& state) {
+            {
+                std::lock_guard guard(state.lock);
+                state.endOfSpeech = state.speechSeen ? state.lastVoice : Clock::now();
+                state.awaitingToken = true;
+            }
+            VoicePlayback::MarkEndOfSpeech(state.endOfSpeech);
+            Trace::AddSpan(Trace::Stage::kCapture, "utterance", state.utteranceStart, Clock::now());
+
+            Metrics::Increment("capture.utterances");
+            Metrics::Increment("capture.frames", state.framesSent);
+            Json::Writer json(Channel::AcquireBuffer());
+            json.BeginObject()
+                .Field("type", "mic_end")
+                .Field("frames", state.framesSent)
+                .Field("speech", state.speechSeen)
+                .EndObject();
+            Channel::Send(json.Take());
+        }
+
+        // Hands-free: keep frames in the pre-roll until the detector hears speech, then send them first
+        void DetectFrame(State& state, const float* frame, const std::int16_t* pcm) {
+            ActivityDetector::Event event = state.detector.Process(frame, kFrameSamples);
+            bool voiced = state.detector.WasFrameVoiced();
+
+            if (!state.inUtterance && event != ActivityDetector::Event::kStart) {
+                std::copy(pcm, pcm + kFrameSamples, state.preRoll.begin() + state.preRollNext * kFrameSamples);
+                state.preRollVoiced[state.preRollNext] = voiced;
+                state.preRollNext = (state.preRollNext + 1) % state.preRollFrames;
+                state.preRollCount = std::min(state.preRollCount + 1, state.preRollFrames);
+                return;
+            }
+
+            if (event == ActivityDetector::Event::kStart) {
+                BeginUtterance(state);
+                state.inUtterance = true;
+                Metrics::Increment("capture.hands_free_onsets");
+                std::size_t first =
+                    (state.preRollNext + state.preRollFrames - state.preRollCount) % state.preRollFrames;
+                for (std::size_t i = 0; i < state.preRollCount; ++i) {
+                    std::size_t index = (first + i) % state.preRollFrames;
+                    WriteFrame(state, state.preRoll.data() + index * kFrameSamples, state.preRollVoiced[index] != 0);
+                }
+                state.preRollCount = 0;
+            }
+
+            if (voiced) {
+                state.speechSeen = true;
+                state.lastVoice = Clock::now();
+            }
+            WriteFrame(state, pcm, state.detector.IsActive());
+
+            if (event == ActivityDetector::Event::kEnd) {
+                state.inUtterance = false;
+                EndUtterance(state);
+            }
+        }
+
+        void ProcessFrame(State& state, const FramePipeline::Frame& frame) {
+            if (state.handsFree) {
+                DetectFrame(state, frame.samples, frame.pcm);
+                return;
+            }
+
+            if (frame.speech) {
+                state.speechSeen = true;
+                state.lastVoice = Clock::now();
+            }
+            WriteFrame(state, frame.pcm, frame.voiced);
+        }
+
+        void ProcessPacket(State& state, const Device& device, const BYTE* data, UINT32 frames, bool silent) {
+            std::size_t samples = static_cast<std::size_t>(frames) * device.channels;
+            const float* interleaved = reinterpret_cast<const float*>(data);
+            if (silent) {
+                state.converted.assign(samples, 0.0f);
+                interleaved = state.converted.data();
+            } else if (!device.isFloat) {
+                state.converted.resize(samples);
+                AudioDSP::Int16ToFloat(reinterpret_cast<const std::int16_t*>(data), state.converted.data(), samples);
+                interleaved = state.converted.data();
+            }
+
+            state.pipeline.Process(interleaved, frames, device.channels,
+                                   [&](const FramePipeline::Frame& frame) { ProcessFrame(state, frame); });
+        }
+
+        // Process every packet the device has ready. Returns false if the device is gone.
+        bool DrainPackets(State& state, Device& device) {
+            UINT32 packetFrames = 0;
+            HRESULT result;
+            while (SUCCEEDED(result = device.capture->GetNextPacketSize(&packetFrames)) && packetFrames > 0) {
+                BYTE* data = nullptr;
+                UINT32 frames = 0;
+                DWORD flags = 0;
+                if (FAILED(result = device.capture->GetBuffer(&data, &frames, &flags, NULL, NULL))) {
+                    break;
+                }
+
+                auto start = Clock::now();
+                ProcessPacket(state, device, data, frames, (flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0);
+                device.capture->ReleaseBuffer(frames);
+                Metrics::RecordLatency("capture.dsp", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+            return SUCCEEDED(result);
+        }
+
+        // Publish how much of a core the capture thread used since the last call, at most every few seconds
+        void SampleCpuUsage(State& state) {
+            Clock::time_point now = Clock::now();
+            if (now - state.cpuSampledAt < std::chrono::seconds(5)) {
+                return;
+            }
+            FILETIME creation, exit, kernel, user;
+            if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+                return;
+            }
+            auto toTicks = [](const FILETIME& time) {
+                return (static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+            };
+            std::uint64_t cpuTime = toTicks(kernel) + toTicks(user);
+            if (state.cpuTime != 0) {
+                double wallTicks = std::chrono::duration<double>(now - state.cpuSampledAt).count() * 1e7;
+                Metrics::SetGauge("capture.cpu_ppm",
+                                  static_cast<std::int64_t>((cpuTime - state.cpuTime) / wallTicks * 1e6));
+            }
+            state.cpuTime = cpuTime;
+            state.cpuSampledAt = now;
+        }
+
+        void CaptureLoop() {
+            State& state = GetState();
+            CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+            HANDLE samplesReady = CreateEvent(NULL, FALSE, FALSE, NULL);
+            Device device;
+            bool streaming = false;
+            bool reportedMissing = false;
+
+            for (;;) {
+                HANDLE handles[] = {state.stateEvent, samplesReady};
+                // Hands-free capture keeps trying to open a missing microphone
+                WaitForMultipleObjects(2, handles, FALSE, state.handsFree && !streaming ? 5000 : INFINITE);
+                bool listening = state.handsFree || state.talking;
+
+                if (listening && !streaming) {
+                    if (!device.IsOpen() && !device.Open(samplesReady, !state.handsFree)) {
+                        if (!state.handsFree) {
+                            PrintToConsole("Failed to open the microphone for push-to-talk.");
+                            state.talking = false;
+                        } else if (!reportedMissing) {
+                            PrintToConsole("Failed to open the microphone for hands-free capture, retrying.");
+                            reportedMissing = true;
+                        }
+                        continue;
+                    }
+                    StartStream(state, device);
+                    if (!state.handsFree) {
+                        BeginUtterance(state);
+                    }
+                    if (FAILED(device.client->Start())) {
+                        device.Close();
+                        if (!state.handsFree) {
+                            EndUtterance(state);
+                        }
+                        continue;
+                    }
+                    streaming = true;
+                    reportedMissing = false;
+                }
+
+                if (!streaming) {
+                    continue;
+                }
+
+                if (!DrainPackets(state, device)) {
+                    // The device was unplugged or changed, it will be reopened on the next key press
+                    // or, hands-free, on the next retry
+                    device.Close();
+                    streaming = false;
+                    if (!state.handsFree || state.inUtterance) {
+                        EndUtterance(state);
+                    }
+                    state.inUtterance = false;
+                    state.detector.Reset();
+                    state.preRollCount = 0;
+                } else if (!listening) {
+                    device.client->Stop();
+                    DrainPackets(state, device);
+                    state.pipeline.Flush([&](const FramePipeline::Frame& frame) { ProcessFrame(state, frame); });
+                    device.client->Reset();
+                    streaming = false;
+                    EndUtterance(state);
+                }
+                SampleCpuUsage(state);
+            }
+        }
+
+        void OnSttToken(Json::Value) {
+            State& state = GetState();
+            std::lock_guard guard(state.lock);
+            if (state.awaitingToken) {
+                state.awaitingToken = false;
+                Metrics::RecordLatency("capture.end_of_speech_to_stt",
+                                       std::chrono::duration<double, std::milli>(Clock::now() - state.endOfSpeech).count());
+            }
+        }
+
+        class InputSink : public RE::BSTEventSink<RE::InputEvent*> {
+        public:
+            static InputSink* GetSingleton() {
+                static InputSink singleton;
+                return &singleton;
+            }
+
+            RE::BSEventNotifyControl ProcessEvent(RE::InputEvent* const* event,
+                                                  RE::BSTEventSource<RE::InputEvent*>*) override {
+                if (!event) {
+                    return RE::BSEventNotifyControl::kContinue;
+                }
+
+                State& state = GetState();
+                for (RE::InputEvent* input = *event; input; input = input->next) {
+                    if (input->GetEventType() != RE::INPUT_EVENT_TYPE::kButton) {
+                        continue;
+                    }
+
+                    RE::ButtonEvent* button = input->AsButtonEvent();
+                    if (button->GetDevice() != RE::INPUT_DEVICE::kKeyboard ||
+                        button->GetIDCode() != static_cast<std::uint32_t>(state.pushToTalkKey)) {
+                        continue;
+                    }
+
+                    if (button->IsDown()) {
+                        state.talking = true;
+                        SetEvent(state.stateEvent);
+                    } else if (button->IsUp()) {
+                        state.talking = false;
+                        SetEvent(state.stateEvent);
+                    }
+                }
+                return RE::BSEventNotifyControl::kContinue;
+            }
+        };
+    }
+
+    void Install() {
+        if (!Settings::GetBool(L"Capture", L"bEnabled", false)) {
+            return;
+        }
+
+        State& state = GetState();
+        state.pushToTalkKey = Settings::GetInt(L"Capture", L"iPushToTalkKey", 0x2F);
+        state.vadThresholdDb = Settings::GetFloat(L"Capture", L"fVadThresholdDb", -45.0f);
+        state.hangoverFrames = static_cast<std::uint32_t>(Settings::GetInt(L"Capture", L"iVadHangoverMs", 300) / 20);
+        state.handsFree = Settings::GetBool(L"Capture", L"bHandsFree", false);
+        if (state.handsFree) {
+            ActivityDetector::Config config;
+            config.minLevelDb = state.vadThresholdDb;
+            config.marginDb = Settings::GetFloat(L"Capture", L"fHandsFreeMarginDb", 12.0f);
+            config.minCorrelation = Settings::GetFloat(L"Capture", L"fHandsFreeMinCorrelation", 0.5f);
+            int onsetMs = Settings::GetInt(L"Capture", L"iHandsFreeOnsetMs", 60);
+            int hangoverMs = Settings::GetInt(L"Capture", L"iHandsFreeHangoverMs", 800);
+            config.onsetFrames = static_cast<std::uint32_t>(std::max(onsetMs / 20, 1));
+            config.hangoverFrames = static_cast<std::uint32_t>(std::max(hangoverMs / 20, 1));
+            state.detector = ActivityDetector(config);
+            // The onset frames themselves are part of the pre-roll
+            state.preRollFrames = static_cast<std::size_t>(
+                std::max(Settings::GetInt(L"Capture", L"iPreRollMs", 300), 0) / 20 + config.onsetFrames);
+            state.preRoll.resize(state.preRollFrames * kFrameSamples);
+            state.preRollVoiced.resize(state.preRollFrames);
+        }
+
+        if (!state.ring.Create(kRingName, kRingCapacity)) {
+            std::stringstream ss;
+            ss << "Failed to create the microphone ring. Error: " << GetLastError();
+            PrintToConsole(ss.str());
+            return;
+        }
+
+        state.stateEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        Channel::RegisterHandler("stt_token", OnSttToken);
+        if (state.handsFree) {
+            SetEvent(state.stateEvent);  // Start listening right away, the push-to-talk key isn't used
+        } else {
+            RE::BSInputDeviceManager::GetSingleton()->AddEventSink(InputSink::GetSingleton());
+        }
+        std::thread(CaptureLoop).detach();
+    }
+#endif
+}
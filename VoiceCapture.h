@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "AudioDSP.h"
+
+/**
+* Optional in-process microphone capture for push-to-talk
+*
+* While the push-to-talk key is held, the default communications microphone is recorded with WASAPI
+* (IAudioClient3 low-latency shared mode when available), downmixed, resampled to 16 kHz and split into
+* 20 ms frames. Each frame is tagged by a simple energy voice activity detector and written as 16-bit
+* PCM to the shared-memory ring "Local\MantellaLauncher.Mic". Mantella is told when talking starts and
+* ends over the channel, and the time from the end of speech to Mantella's first transcription token
+* is recorded in the metrics.
+*
+* With [Capture] bHandsFree the microphone is streamed all the time instead, and ActivityDetector decides
+* when the player talks. Nothing reaches Mantella until it does, so its speech to text only runs for actual
+* speech. The frames just before the onset are kept in a pre-roll buffer and sent first, so the first
+* syllable isn't cut off. The capture thread's CPU use is published as "capture.cpu_ppm".
+**/
+namespace VoiceCapture {
+    enum RecordKind : std::uint16_t {
+        kAudioFrame = 1  // 16 kHz mono int16 PCM
+    };
+
+    enum RecordFlags : std::uint16_t {
+        kVoiced = 1 << 0  // the voice activity detector considers this frame speech
+    };
+
+    constexpr std::uint32_t kSampleRate = 16000;
+    constexpr std::uint32_t kFrameSamples = kSampleRate / 50;
+
+    /**
+    * The DSP half of the capture, from device packets to tagged 16 kHz frames
+    *
+    * Interleaved packets are downmixed, resampled and cut into 20 ms frames, each converted to 16-bit PCM
+    * and tagged by the push-to-talk energy detector. Pauses between words shorter than hangoverFrames stay
+    * voiced. It never touches the device, so the tests run it on WAV files.
+    **/
+    class FramePipeline {
+    public:
+        struct Frame {
+            const float* samples;     // kFrameSamples samples
+            const std::int16_t* pcm;  // the same samples as 16-bit PCM
+            bool speech;              // the level is above the threshold
+            bool voiced;              // speech, or a pause shorter than the hangover
+        };
+
+        using FrameHandler = std::function<void(const Frame& frame)>;
+
+        void Configure(std::uint32_t inputRate, float thresholdDb, std::uint32_t hangoverFrames);
+
+        // Process the next packet of interleaved samples, calling onFrame for every complete frame
+        void Process(const float* interleaved, std::size_t frames, std::uint32_t channels,
+                     const FrameHandler& onFrame);
+        // Pad the last partial frame with silence so no captured audio is lost
+        void Flush(const FrameHandler& onFrame);
+
+    private:
+        void Emit(const float* samples, const FrameHandler& onFrame);
+
+        AudioDSP::Resampler _resampler;
+        std::vector<float> _mono;
+        std::vector<float> _pending;
+        float _thresholdDb = -45.0f;
+        std::uint32_t _hangoverFrames = 0;
+        std::uint32_t _hangover = 0;
+    };
+
+    /**
+    * Voice activity detection for hands-free capture, cheap enough to run on every frame
+    *
+    * A frame counts as speech when its level is a margin above the tracked noise floor and its spectrum
+    * looks like a voice: the normalized lag-1 autocorrelation is high for the low, harmonic energy of voiced
+    * speech and near zero or negative for hiss, fans and other broadband noise. Both take two dot products
+    * with the vector kernels. An utterance starts after onsetFrames speech frames in a row, so clicks and
+    * keyboard noise don't trigger it, and ends after hangoverFrames without speech.
+    **/
+    class ActivityDetector {
+    public:
+        struct Config {
+            float minLevelDb = -45.0f;  // quieter frames are never speech
+            float marginDb = 12.0f;     // above the noise floor
+            float minCorrelation = 0.5f;
+            std::uint32_t onsetFrames = 3;
+            std::uint32_t hangoverFrames = 40;
+        };
+
+        enum class Event {
+            kNone,
+            kStart,  // the last onsetFrames frames were the start of an utterance
+            kEnd     // the utterance ended hangoverFrames ago
+        };
+
+        ActivityDetector() = default;
+        explicit ActivityDetector(const Config& config) : _config(config) {}
+
+        // Classify the next frame
+        Event Process(const float* frame, std::size_t count);
+
+        // Forget the noise floor and any utterance in progress, e.g. after the microphone changed
+        void Reset();
+
+        bool IsActive() const { return _active; }
+        bool WasFrameVoiced() const { return _voiced; }
+        float GetNoiseFloorDb() const { return _noiseFloorDb; }
+
+    private:
+        Config _config;
+        float _noiseFloorDb = 0.0f;
+        bool _hasFloor = false;
+        bool _active = false;
+        bool _voiced = false;
+        std::uint32_t _run = 0;  // speech frames in a row before the onset
+        std::uint32_t _hangover = 0;
+    };
+
+    // Start the capture thread and listen for the push-to-talk key if capture is enabled
+    void Install();
+}
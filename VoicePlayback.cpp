@@ -0,0 +1,648 @@
+#include "VoicePlayback.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <xaudio2.h>
+    #include <algorithm>
+    #include <atomic>
+    #include <cstring>
+    #include <deque>
+    #include <memory>
+    #include <mutex>
+    #include <sstream>
+    #include <thread>
+    #include <utility>
+
+    #include "Channel.h"
+    #include "Fuz.h"
+    #include "Launcher.h"
+    #include "LipSync.h"
+    #include "Metrics.h"
+    #include "Settings.h"
+    #include "SharedRing.h"
+    #include "Trace.h"
+    #include "VoiceCache.h"
+    #include "WorkerPool.h"
+#endif
+
+namespace VoicePlayback {
+    bool SentenceOrder::ShouldHold(const LineSentence& sentence, std::optional<Clock::time_point>& heldSince,
+                                   Clock::time_point now, std::uint32_t& skipped) const {
+        skipped = 0;
+        std::uint32_t next = 0;
+        if (_last && _last->replyId == sentence.replyId) {
+            next = _last->sentence + 1;
+        }
+        if (sentence.sentence <= next) {
+            return false;
+        }
+
+        if (!heldSince) {
+            heldSince = now;
+        }
+        if (now - *heldSince < _reorderWait) {
+            return true;
+        }
+        skipped = sentence.sentence - next;
+        return false;
+    }
+
+    void SentenceOrder::Finish(const std::optional<LineSentence>& sentence, Clock::time_point end) {
+        _last = sentence;
+        if (sentence) {
+            _lastEnd = end;
+        }
+    }
+
+#ifdef _WIN32
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr const wchar_t* kRingName = L"Local\\MantellaLauncher.Voice";
+        constexpr std::uint32_t kRingCapacity = 1 << 20;
+
+        double ElapsedMs(Clock::time_point from, Clock::time_point to) {
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        }
+
+        // Runs on the XAudio2 thread, so it only records what happened and wakes the playback thread
+        class VoiceCallback : public IXAudio2VoiceCallback {
+        public:
+            explicit VoiceCallback(HANDLE wakeEvent) : _wakeEvent(wakeEvent) {}
+
+            void STDMETHODCALLTYPE OnBufferStart(void*) override {
+                if (!_started.exchange(true)) {
+                    _firstAudible = Clock::now().time_since_epoch().count();
+                }
+            }
+            void STDMETHODCALLTYPE OnBufferEnd(void*) override {
+                _lastEnd = Clock::now().time_since_epoch().count();
+                ++_completed;
+                SetEvent(_wakeEvent);
+            }
+            void STDMETHODCALLTYPE OnVoiceProcessingPassStart(UINT32) override {}
+            void STDMETHODCALLTYPE OnVoiceProcessingPassEnd() override {}
+            void STDMETHODCALLTYPE OnStreamEnd() override {}
+            void STDMETHODCALLTYPE OnLoopEnd(void*) override {}
+            void STDMETHODCALLTYPE OnVoiceError(void*, HRESULT) override { SetEvent(_wakeEvent); }
+
+            std::uint32_t TakeCompleted() { return _completed.exchange(0); }
+
+            std::optional<Clock::time_point> GetFirstAudible() const {
+                if (!_started) {
+                    return std::nullopt;
+                }
+                return Clock::time_point(Clock::duration(_firstAudible.load()));
+            }
+
+            // When the last buffer so far finished playing
+            Clock::time_point GetLastEnd() const { return Clock::time_point(Clock::duration(_lastEnd.load())); }
+
+        private:
+            HANDLE _wakeEvent;
+            std::atomic<std::uint32_t> _completed{0};
+            std::atomic<bool> _started{false};
+            std::atomic<Clock::rep> _firstAudible{0};
+            std::atomic<Clock::rep> _lastEnd{0};
+        };
+
+        struct Line {
+            LineBegin info = {};
+            IXAudio2SourceVoice* voice = nullptr;
+            std::unique_ptr<VoiceCallback> callback;
+
+            std::vector<std::byte> buffered;           // received but not yet handed to XAudio2
+            std::deque<std::vector<std::byte>> queued;  // handed to XAudio2, freed when played
+            bool ended = false;
+            bool playing = false;
+            bool reportedFirstAudible = false;
+
+            std::optional<Clock::time_point> endOfSpeech;
+            Clock::time_point beginTime;
+            Clock::time_point lastRecord;  // when the last record of the line arrived
+            std::optional<Clock::time_point> starvedAt;
+            std::uint32_t underruns = 0;
+
+            std::optional<LineSentence> sentence;        // set when the line is a sentence of a longer reply
+            std::optional<Clock::time_point> heldSince;  // when it started waiting for an earlier sentence
+
+            LipSync::Analyzer lipSync;
+            Clock::time_point lipSyncStart;
+
+            std::wstring savePath;         // where to save the line as .fuz, empty if it is only played
+            bool cache = false;            // whether the voice cache wants the line
+            std::vector<std::byte> lip;
+            std::vector<std::byte> saved;  // every audio byte of the line, kept only when saving or caching
+
+            std::uint32_t BytesPerSecond() const { return info.sampleRate * info.channels * 2; }
+            std::size_t BlockAlign() const { return static_cast<std::size_t>(info.channels) * 2; }
+
+            // A line that started playing keeps its place, even while it waits for more audio
+            bool HasStarted() const { return playing || reportedFirstAudible || starvedAt; }
+        };
+
+        struct CachedLine {
+            LineBegin info;
+            std::vector<std::byte> pcm;
+            std::optional<LineSentence> sentence;
+            LipSync::Analyzer lipSync;  // already fed with the whole line
+        };
+
+        // What a finished line needs for the voice cache and its .fuz file, moved out of the line
+        struct Package {
+            LineBegin info = {};
+            std::wstring savePath;
+            bool cache = false;
+            double synthesisMs = 0.0;
+            std::vector<std::byte> lip;
+            std::vector<std::byte> pcm;
+        };
+
+        struct State {
+            std::chrono::milliseconds jitterBuffer{120};
+            std::chrono::milliseconds stallTimeout{5000};  // 0 waits for kLineEnd forever
+            float volume = 1.0f;
+
+            SharedRing ring;
+            HANDLE wakeEvent = NULL;
+            IXAudio2* engine = nullptr;
+            IXAudio2MasteringVoice* master = nullptr;
+            std::deque<std::unique_ptr<Line>> lines;
+            std::vector<std::unique_ptr<Line>> finished;  // voices destroyed at the end of every loop pass
+            SentenceOrder order;
+
+            std::mutex lock;
+            std::optional<Clock::time_point> endOfSpeech;
+            std::vector<CachedLine> cached;  // waiting for the playback thread
+        };
+
+        State& GetState() {
+            static State state;
+            return state;
+        }
+
+        Line* FindLine(State& state, std::uint32_t lineId) {
+            for (auto& line : state.lines) {
+                if (line->info.lineId == lineId) {
+                    return line.get();
+                }
+            }
+            return nullptr;
+        }
+
+        void BeginLine(State& state, const LineBegin& info) {
+            auto line = std::make_unique<Line>();
+            line->info = info;
+            line->beginTime = Clock::now();
+            line->lastRecord = line->beginTime;
+            {
+                std::lock_guard guard(state.lock);
+                line->endOfSpeech = std::exchange(state.endOfSpeech, std::nullopt);
+            }
+
+            WAVEFORMATEX format = {0};
+            format.wFormatTag = WAVE_FORMAT_PCM;
+            format.nChannels = info.channels;
+            format.nSamplesPerSec = info.sampleRate;
+            format.wBitsPerSample = 16;
+            format.nBlockAlign = static_cast<WORD>(info.channels * 2);
+            format.nAvgBytesPerSec = info.sampleRate * format.nBlockAlign;
+
+            line->callback = std::make_unique<VoiceCallback>(state.wakeEvent);
+            if (info.channels == 0 || info.sampleRate == 0 ||
+                FAILED(state.engine->CreateSourceVoice(&line->voice, &format, 0, XAUDIO2_DEFAULT_FREQ_RATIO,
+                                                       line->callback.get()))) {
+                Metrics::Increment("playback.voice_errors");
+                return;
+            }
+            line->voice->SetVolume(state.volume);
+            if (LipSync::IsEnabled() && info.speakerRefId != 0) {
+                line->lipSync.Begin(info.sampleRate, info.channels);
+            }
+            line->cache = VoiceCache::WantsLine(info.lineId);
+            state.lines.push_back(std::move(line));
+        }
+
+        // Mux the finished line into a .fuz file and write it
+        void SaveLine(const Package& package) {
+            Clock::time_point start = Clock::now();
+
+            std::vector<std::byte> fuz;
+            Fuz::BuildFromPcm(package.lip, package.info.sampleRate, package.info.channels, package.pcm, fuz);
+
+            if (WriteWholeFile(package.savePath, fuz)) {
+                Metrics::Increment("fuz.lines_written");
+                Metrics::RecordLatency("fuz.mux", ElapsedMs(start, Clock::now()));
+            } else {
+                DWORD error = GetLastError();
+                Metrics::Increment("fuz.write_errors");
+                std::stringstream ss;
+                ss << "Failed to save voice line " << WideStringToString(package.savePath.c_str())
+                   << ". Error: " << error;
+                PrintToConsole(ss.str());
+            }
+        }
+
+        // Package the finished line in the background, leaving the playback thread free to start the next one
+        void PackageLine(Line& line) {
+            if (!line.cache && line.savePath.empty()) {
+                return;
+            }
+            Package package;
+            package.info = line.info;
+            package.savePath = std::move(line.savePath);
+            package.cache = line.cache;
+            package.synthesisMs = ElapsedMs(line.beginTime, Clock::now());
+            package.lip = std::move(line.lip);
+            package.pcm = std::move(line.saved);
+
+            auto work = [package = std::move(package)](WorkerPool::Job& job) {
+                if (package.cache) {
+                    VoiceCache::StoreLine(package.info.lineId, package.info.sampleRate, package.info.channels,
+                                          package.lip, package.pcm, package.synthesisMs);
+                }
+                if (!package.savePath.empty() && job.Checkpoint()) {
+                    SaveLine(package);
+                }
+            };
+            WorkerPool::Submit("voice_package", WorkerPool::Priority::kNormal, std::move(work));
+        }
+
+        // Move a sentence ahead of the later sentences of its reply that began before it but haven't started yet
+        void PlaceSentence(State& state, Line& line, const LineSentence& sentence) {
+            line.sentence = sentence;
+            std::size_t from = 0;
+            while (state.lines[from].get() != &line) {
+                ++from;
+            }
+            auto place = SentenceOrder::Place(
+                state.lines.begin(), state.lines.begin() + static_cast<std::ptrdiff_t>(from), sentence,
+                [](const std::unique_ptr<Line>& queued) -> const LineSentence* {
+                    return queued->HasStarted() || !queued->sentence ? nullptr : &*queued->sentence;
+                });
+            auto to = static_cast<std::size_t>(place - state.lines.begin());
+            if (to == from) {
+                return;
+            }
+            state.lines[to]->heldSince.reset();  // it waits afresh once it is back at the front
+            std::unique_ptr<Line> moved = std::move(state.lines[from]);
+            state.lines.erase(state.lines.begin() + static_cast<std::ptrdiff_t>(from));
+            state.lines.insert(state.lines.begin() + static_cast<std::ptrdiff_t>(to), std::move(moved));
+            Metrics::Increment("playback.sentences_reordered");
+        }
+
+        void ProcessRecord(State& state, const RecordHeader& header, const std::vector<std::byte>& payload) {
+            if (header.kind == kLineBegin && payload.size() >= sizeof(LineBegin)) {
+                LineBegin info;
+                std::memcpy(&info, payload.data(), sizeof(info));
+                if (info.sampleRate == 0 || info.channels == 0) {
+                    Metrics::Increment("playback.rejected_lines");
+                    return;
+                }
+                BeginLine(state, info);
+                return;
+            }
+
+            if (payload.size() < sizeof(std::uint32_t)) {
+                return;
+            }
+            std::uint32_t lineId;
+            std::memcpy(&lineId, payload.data(), sizeof(lineId));
+            Line* line = FindLine(state, lineId);
+            if (!line) {
+                return;
+            }
+            line->lastRecord = Clock::now();
+
+            if (header.kind == kLineAudio) {
+                if ((payload.size() - sizeof(lineId)) % line->BlockAlign() != 0) {
+                    // Partial frames would shift every sample after them to the wrong channel or byte
+                    Metrics::Increment("playback.misaligned_audio");
+                    return;
+                }
+                line->buffered.insert(line->buffered.end(), payload.begin() + sizeof(lineId), payload.end());
+                if (!line->savePath.empty() || line->cache) {
+                    line->saved.insert(line->saved.end(), payload.begin() + sizeof(lineId), payload.end());
+                }
+                if (line->lipSync.IsActive()) {
+                    std::size_t samples = (payload.size() - sizeof(lineId)) / sizeof(std::int16_t);
+                    line->lipSync.Feed(reinterpret_cast<const std::int16_t*>(payload.data() + sizeof(lineId)),
+                                       samples / line->info.channels);
+                }
+            } else if (header.kind == kLineText) {
+                if (line->lipSync.IsActive()) {
+                    const char* text = reinterpret_cast<const char*>(payload.data()) + sizeof(lineId);
+                    line->lipSync.SetText(std::string_view(text, payload.size() - sizeof(lineId)));
+                }
+            } else if (header.kind == kLineSave) {
+                const char* path = reinterpret_cast<const char*>(payload.data()) + sizeof(lineId);
+                line->savePath = StringToWideString(std::string(path, payload.size() - sizeof(lineId)));
+            } else if (header.kind == kLineLip) {
+                line->lip.assign(payload.begin() + sizeof(lineId), payload.end());
+            } else if (header.kind == kLineSentence && payload.size() >= sizeof(LineSentence)) {
+                LineSentence sentence;
+                std::memcpy(&sentence, payload.data(), sizeof(sentence));
+                PlaceSentence(state, *line, sentence);
+            } else if (header.kind == kLineEnd) {
+                line->ended = true;
+                PackageLine(*line);
+                if (line->endOfSpeech) {
+                    Metrics::RecordLatency("playback.reply_latency.synthesis_complete",
+                                           ElapsedMs(*line->endOfSpeech, Clock::now()));
+                }
+            }
+        }
+
+        // Hand everything received so far to XAudio2 as one buffer, which keeps us far below its queue limit
+        void Submit(Line& line) {
+            if (line.buffered.empty()) {
+                return;
+            }
+
+            line.queued.push_back(std::move(line.buffered));
+            line.buffered.clear();
+
+            XAUDIO2_BUFFER buffer = {0};
+            buffer.AudioBytes = static_cast<UINT32>(line.queued.back().size());
+            buffer.pAudioData = reinterpret_cast<const BYTE*>(line.queued.back().data());
+            if (FAILED(line.voice->SubmitSourceBuffer(&buffer))) {
+                line.queued.pop_back();
+                Metrics::Increment("playback.voice_errors");
+            }
+        }
+
+        // Whether the line has enough audio to start without running dry right away
+        bool IsReady(const State& state, const Line& line) {
+            std::size_t available = line.buffered.size();
+            for (const std::vector<std::byte>& buffer : line.queued) {
+                available += buffer.size();
+            }
+            if (line.ended) {
+                return available > 0;
+            }
+            std::size_t threshold = static_cast<std::size_t>(line.BytesPerSecond()) *
+                                    static_cast<std::size_t>(state.jitterBuffer.count()) / 1000;
+            return available >= threshold;
+        }
+
+        // Whether a sentence should wait because an earlier one of its reply hasn't begun yet
+        bool WaitsForEarlierSentence(const State& state, Line& line) {
+            if (!line.sentence || line.HasStarted()) {
+                return false;
+            }
+            std::uint32_t skipped = 0;
+            if (state.order.ShouldHold(*line.sentence, line.heldSince, Clock::now(), skipped)) {
+                return true;
+            }
+            if (skipped > 0) {
+                Metrics::Increment("playback.sentences_skipped", skipped);
+            }
+            return false;
+        }
+
+        void ReportFirstAudible(State& state, Line& line, Clock::time_point firstAudible) {
+            if (line.lipSync.IsActive()) {
+                line.lipSyncStart = firstAudible;
+                LipSync::Play(line.info.speakerRefId, line.lipSync.GetAnimation(), line.lipSyncStart);
+            }
+            Metrics::RecordLatency("playback.buffering", ElapsedMs(line.beginTime, firstAudible));
+            if (line.endOfSpeech) {
+                Metrics::RecordLatency("playback.reply_latency.first_audio",
+                                       ElapsedMs(*line.endOfSpeech, firstAudible));
+            }
+
+            if (line.sentence && state.order.Follows(*line.sentence)) {
+                Clock::time_point sentenceEnd = state.order.GetLastEnd();
+                Metrics::RecordLatency("playback.sentence_gap", ElapsedMs(sentenceEnd, firstAudible));
+                if (line.beginTime > sentenceEnd) {
+                    // Synthesis didn't keep up with playback, rather than playback being slow to move on
+                    Metrics::Increment("playback.sentences_late");
+                }
+                if (Trace::IsRecording()) {
+                    Trace::AddSpan(Trace::Stage::kPlayback, "sentence_gap", sentenceEnd, firstAudible);
+                }
+            }
+        }
+
+        // Take the front line out of the queue. Its voice is destroyed at the end of the playback loop's pass,
+        // once the next line had its chance to start, since destroying it waits for the audio thread.
+        void FinishLine(State& state) {
+            Line& line = *state.lines.front();
+            if (auto firstAudible = line.callback->GetFirstAudible(); firstAudible && Trace::IsRecording()) {
+                Trace::AddSpan(Trace::Stage::kPlayback, "buffering", line.beginTime, *firstAudible);
+                Trace::AddSpan(Trace::Stage::kPlayback, "line", *firstAudible, Clock::now());
+            }
+            LipSync::Stop(line.info.speakerRefId);
+            Metrics::Increment("playback.lines");
+            if (line.underruns > 0) {
+                Metrics::Increment("playback.lines_with_underruns");
+            }
+            state.order.Finish(line.sentence, line.reportedFirstAudible ? line.callback->GetLastEnd() : Clock::now());
+            state.finished.push_back(std::move(state.lines.front()));
+            state.lines.pop_front();
+        }
+
+        // Advance the line at the front of the queue, the only one that is allowed to play
+        void UpdateActiveLine(State& state) {
+            while (!state.lines.empty()) {
+                Line& line = *state.lines.front();
+
+                for (std::uint32_t completed = line.callback->TakeCompleted(); completed > 0 && !line.queued.empty();
+                     --completed) {
+                    line.queued.pop_front();
+                }
+
+                if (!line.reportedFirstAudible) {
+                    if (auto firstAudible = line.callback->GetFirstAudible()) {
+                        line.reportedFirstAudible = true;
+                        ReportFirstAudible(state, line, *firstAudible);
+                    }
+                }
+
+                if (!line.playing) {
+                    if (!line.ended && state.stallTimeout.count() > 0 &&
+                        Clock::now() - line.lastRecord >= state.stallTimeout) {
+                        // Mantella stopped sending the line without ending it: play what came and move on
+                        line.ended = true;
+                        Metrics::Increment("playback.stalled_lines");
+                    }
+                    if (line.ended && line.buffered.empty() && line.queued.empty()) {
+                        FinishLine(state);
+                        continue;
+                    }
+                    if (!IsReady(state, line) || WaitsForEarlierSentence(state, line)) {
+                        return;  // Still filling the jitter buffer, or held for an earlier sentence
+                    }
+
+                    Submit(line);
+                    line.voice->Start();
+                    line.playing = true;
+                    if (line.starvedAt) {
+                        Clock::time_point now = Clock::now();
+                        Metrics::RecordLatency("playback.underrun_gap", ElapsedMs(*line.starvedAt, now));
+                        if (line.reportedFirstAudible && line.lipSync.IsActive()) {
+                            // The lips pick up where the audio stopped
+                            line.lipSyncStart += now - *line.starvedAt;
+                            LipSync::Play(line.info.speakerRefId, line.lipSync.GetAnimation(), line.lipSyncStart);
+                        }
+                        line.starvedAt.reset();
+                    }
+                    return;
+                }
+
+                Submit(line);
+
+                XAUDIO2_VOICE_STATE voiceState;
+                line.voice->GetState(&voiceState, XAUDIO2_VOICE_NOSAMPLESPLAYED);
+                if (voiceState.BuffersQueued > 0) {
+                    return;
+                }
+
+                if (line.ended) {
+                    FinishLine(state);
+                    continue;
+                }
+
+                // Ran dry before Mantella finished the line: pause and refill the jitter buffer
+                line.voice->Stop();
+                line.playing = false;
+                line.starvedAt = Clock::now();
+                LipSync::Stop(line.info.speakerRefId);
+                ++line.underruns;
+                Metrics::Increment("playback.underruns");
+                return;
+            }
+        }
+
+        // Queue the audio of the line after the active one on its voice, so starting it is all that is left to do
+        // when the active line ends. Done once: its buffers don't complete until it plays.
+        void PrepareNextLine(State& state) {
+            if (state.lines.size() < 2) {
+                return;
+            }
+            Line& next = *state.lines[1];
+            if (next.queued.empty() && IsReady(state, next)) {
+                Submit(next);
+            }
+        }
+
+        void DestroyFinishedVoices(State& state) {
+            for (std::unique_ptr<Line>& line : state.finished) {
+                line->voice->DestroyVoice();
+            }
+            state.finished.clear();
+        }
+
+        // A cached line arrives complete, so it goes through the same steps as a streamed one at once
+        void PlayCachedLines(State& state) {
+            std::vector<CachedLine> cached;
+            {
+                std::lock_guard guard(state.lock);
+                cached.swap(state.cached);
+            }
+            for (CachedLine& entry : cached) {
+                BeginLine(state, entry.info);
+                Line* line = FindLine(state, entry.info.lineId);
+                if (!line) {
+                    continue;
+                }
+                if (line->lipSync.IsActive()) {
+                    line->lipSync = std::move(entry.lipSync);
+                }
+                if (entry.sentence) {
+                    PlaceSentence(state, *line, *entry.sentence);
+                }
+                line->buffered = std::move(entry.pcm);
+                line->ended = true;
+            }
+        }
+
+        void PlaybackLoop() {
+            State& state = GetState();
+            CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+            if (FAILED(XAudio2Create(&state.engine, 0, XAUDIO2_DEFAULT_PROCESSOR)) ||
+                FAILED(state.engine->CreateMasteringVoice(&state.master))) {
+                PrintToConsole("Failed to initialize XAudio2, streamed voice playback is disabled.");
+                return;
+            }
+
+            RecordHeader header;
+            std::vector<std::byte> payload;
+            for (;;) {
+                HANDLE handles[] = {state.ring.GetDataEvent(), state.wakeEvent};
+                WaitForMultipleObjects(2, handles, FALSE, 100);
+
+                while (state.ring.Read(header, payload)) {
+                    ProcessRecord(state, header, payload);
+                }
+                PlayCachedLines(state);
+                UpdateActiveLine(state);
+                PrepareNextLine(state);
+                DestroyFinishedVoices(state);
+            }
+        }
+
+        void OnSpeechEnd(Json::Value) { MarkEndOfSpeech(Clock::now()); }
+    }
+
+    void Install() {
+        if (!Settings::GetBool(L"Playback", L"bEnabled", false)) {
+            return;
+        }
+
+        State& state = GetState();
+        state.jitterBuffer = std::chrono::milliseconds(std::max(Settings::GetInt(L"Playback", L"iJitterBufferMs", 120), 0));
+        state.order.SetReorderWait(
+            std::chrono::milliseconds(std::max(Settings::GetInt(L"Playback", L"iReorderWaitMs", 300), 0)));
+        state.stallTimeout =
+            std::chrono::milliseconds(std::max(Settings::GetInt(L"Playback", L"iStallTimeoutMs", 5000), 0));
+        state.volume = Settings::GetFloat(L"Playback", L"fVolume", 1.0f);
+
+        if (!state.ring.Create(kRingName, kRingCapacity)) {
+            std::stringstream ss;
+            ss << "Failed to create the voice ring. Error: " << GetLastError();
+            PrintToConsole(ss.str());
+            return;
+        }
+
+        state.wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        // Sent by Mantella when it captured the player's speech itself
+        Channel::RegisterHandler("speech_end", OnSpeechEnd);
+        std::thread(PlaybackLoop).detach();
+    }
+
+    void MarkEndOfSpeech(std::chrono::steady_clock::time_point time) {
+        State& state = GetState();
+        std::lock_guard guard(state.lock);
+        state.endOfSpeech = time;
+    }
+
+    void PlayCached(const LineBegin& info, std::string text, std::vector<std::byte> pcm,
+                    std::optional<LineSentence> sentence) {
+        State& state = GetState();
+        if (state.wakeEvent == NULL) {
+            return;
+        }
+        if (info.sampleRate == 0 || info.channels == 0 ||
+            pcm.size() % (static_cast<std::size_t>(info.channels) * 2) != 0) {
+            Metrics::Increment("playback.rejected_lines");
+            return;
+        }
+
+        // Analyzed here rather than on the playback thread, which may be about to start the next line
+        CachedLine entry{info, std::move(pcm), sentence};
+        if (LipSync::IsEnabled() && info.speakerRefId != 0) {
+            entry.lipSync.Begin(info.sampleRate, info.channels);
+            entry.lipSync.SetText(text);
+            entry.lipSync.Feed(reinterpret_cast<const std::int16_t*>(entry.pcm.data()),
+                               entry.pcm.size() / sizeof(std::int16_t) / info.channels);
+        }
+        {
+            std::lock_guard guard(state.lock);
+            state.cached.push_back(std::move(entry));
+        }
+        SetEvent(state.wakeEvent);
+    }
+#endif
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+* Streaming playback of synthesized voice lines
+*
+* Instead of waiting for Mantella to finish writing a whole voice file, Mantella writes each line into
+* the shared-memory ring "Local\MantellaLauncher.Voice" while it is being synthesized: a kLineBegin
+* record, any number of kLineAudio records with 16-bit PCM, then kLineEnd. Playback of a line starts
+* through XAudio2 as soon as the jitter buffer holds [Playback] iJitterBufferMs of audio. If the
+* stream falls behind, the voice is paused until the jitter buffer has refilled and the underrun is
+* counted; a line whose stream stops without kLineEnd is ended after [Playback] iStallTimeoutMs. Lines
+* play one after another in the order they began. While a line plays, the speaker's lips are animated
+* from its text and audio, see LipSync. Lines that the game should be able to play again later are
+* also saved as .fuz files when Mantella asks for it.
+*
+* Mantella synthesizes a long reply sentence by sentence, each sentence being a line of its own. The
+* next sentence streams in and is queued on its voice while the current one plays, so only starting it
+* is left when the current one ends; packaging a finished line for the cache and as .fuz runs on the
+* worker pool. Sentences are played in the order of their index within the reply, whatever order they
+* began in: a sentence that arrives ahead of an earlier one waits up to [Playback] iReorderWaitMs for
+* it. The silence between the end of a sentence and the first sample of the next is recorded as
+* "playback.sentence_gap".
+*
+* Reply latency is measured from the end of the player's speech to the first audible sample, and
+* for comparison to the moment the whole line had been received.
+**/
+namespace VoicePlayback {
+    enum RecordKind : std::uint16_t {
+        kLineBegin = 1,    // LineBegin
+        kLineAudio = 2,    // std::uint32_t line ID followed by interleaved int16 PCM
+        kLineEnd = 3,      // std::uint32_t line ID
+        kLineText = 4,     // std::uint32_t line ID followed by the UTF-8 text of the line, before its audio
+        kLineSave = 5,     // std::uint32_t line ID followed by the UTF-8 path of a .fuz file, before its audio
+        kLineLip = 6,      // std::uint32_t line ID followed by the line's .lip data, before kLineEnd
+        kLineSentence = 7  // LineSentence, right after kLineBegin when the line is a sentence of a longer reply
+    };
+
+    struct LineBegin {
+        std::uint32_t lineId;
+        std::uint32_t sampleRate;
+        std::uint16_t channels;
+        std::uint16_t reserved;
+        std::uint32_t speakerRefId;  // reference form ID of the speaking NPC, 0 if unknown
+    };
+
+    struct LineSentence {
+        std::uint32_t lineId;
+        std::uint32_t replyId;
+        std::uint32_t sentence;  // index within the reply, starting at 0
+    };
+
+    /**
+    * The order the sentences of a reply play in, apart from XAudio2 so the tests can drive it with any timing
+    *
+    * A sentence that begins after a later one of its reply goes ahead of it, as long as that one hasn't
+    * started. A sentence that is ready to play waits while an earlier one hasn't begun, at most for the
+    * reorder wait; the ones it waited for are then skipped.
+    **/
+    class SentenceOrder {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        void SetReorderWait(std::chrono::milliseconds wait) { _reorderWait = wait; }
+
+        // Whether a sentence that just began belongs in front of queued, a line that hasn't started yet
+        static bool GoesBefore(const LineSentence& sentence, const LineSentence& queued) {
+            return queued.replyId == sentence.replyId && queued.sentence >= sentence.sentence;
+        }
+
+        // Where a sentence that just began goes among the queued lines: in front of the first one it GoesBefore,
+        // or at end. queuedSentence(line) returns the line's sentence, or nullptr when the line has started or
+        // isn't a sentence, since those stay where they are.
+        template <class It, class QueuedSentence>
+        static It Place(It begin, It end, const LineSentence& sentence, QueuedSentence queuedSentence) {
+            return std::find_if(begin, end, [&](const auto& line) {
+                const LineSentence* queued = queuedSentence(line);
+                return queued && GoesBefore(sentence, *queued);
+            });
+        }
+
+        // Whether a sentence that could start now should wait for an earlier one. heldSince belongs to the line
+        // and is set when it starts waiting, reset when a sentence is placed ahead of it. When the wait runs out,
+        // skipped is how many sentences were given up.
+        bool ShouldHold(const LineSentence& sentence, std::optional<Clock::time_point>& heldSince,
+                        Clock::time_point now, std::uint32_t& skipped) const;
+
+        // Remember the line that finished, and when its audio ended if it was a sentence
+        void Finish(const std::optional<LineSentence>& sentence, Clock::time_point end);
+
+        // Whether the sentence is of the same reply as the one that finished last, so the silence in between
+        // is a gap within the reply
+        bool Follows(const LineSentence& sentence) const { return _last && _last->replyId == sentence.replyId; }
+
+        // When the last sentence that finished stopped playing
+        Clock::time_point GetLastEnd() const { return _lastEnd; }
+
+    private:
+        std::chrono::milliseconds _reorderWait{300};
+        std::optional<LineSentence> _last;  // of the line that finished last, if it was a sentence
+        Clock::time_point _lastEnd;
+    };
+
+    // Create the ring and start the playback thread if streaming playback is enabled
+    void Install();
+
+    // Remember when the player stopped talking. The next line that starts is measured against it.
+    void MarkEndOfSpeech(std::chrono::steady_clock::time_point time);
+
+    // Play a complete line that didn't come through the ring, e.g. from the voice cache. Its lips are analyzed
+    // on the calling thread.
+    void PlayCached(const LineBegin& info, std::string text, std::vector<std::byte> pcm,
+                    std::optional<LineSentence> sentence = std::nullopt);
+}
@@ -0,0 +1,377 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <exception>
+
+#include "Metrics.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+
+    #include "Launcher.h"
+    #include "Settings.h"
+#endif
+
+namespace WorkerPool {
+    namespace {
+        struct Current {
+            const Pool* pool = nullptr;
+            std::size_t worker = 0;
+        };
+        thread_local Current current;
+
+        std::size_t ToIndex(Priority priority) { return static_cast<std::size_t>(priority); }
+
+        double ToMs(std::chrono::steady_clock::duration duration) {
+            return std::chrono::duration<double, std::milli>(duration).count();
+        }
+    }
+
+    bool Job::Checkpoint() const { return _pool.Checkpoint(*this); }
+
+    Pool::~Pool() {
+        {
+            std::lock_guard guard(_sleepLock);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (std::thread& thread : _threads) {
+            thread.join();
+        }
+    }
+
+    void Pool::Start(std::size_t threadCount, std::function<void()> prepareThread,
+                     std::function<void(const std::string&)> reportError) {
+        if (_started) {
+            return;
+        }
+        _reportError = std::move(reportError);
+        for (std::size_t i = 0; i < std::max<std::size_t>(threadCount, 1); ++i) {
+            _workers.push_back(std::make_unique<Worker>());
+        }
+        {
+            std::lock_guard guard(_sleepLock);
+            for (Task& task : _early) {
+                _workers[0]->queues[ToIndex(task.job->GetPriority())].push_back(std::move(task));
+            }
+            _early.clear();
+            _started = true;
+        }
+        for (std::size_t i = 0; i < _workers.size(); ++i) {
+            _threads.emplace_back(&Pool::WorkerLoop, this, i, prepareThread);
+        }
+    }
+
+    bool Pool::HasRunnableTasks() const {
+        if (_queued[ToIndex(Priority::kHigh)] > 0) {
+            return true;
+        }
+        return !_holdBack && (_queued[ToIndex(Priority::kNormal)] > 0 || _queued[ToIndex(Priority::kLow)] > 0);
+    }
+
+    bool Pool::TakeTask(std::size_t self, std::size_t allowed, Task& task) {
+        std::size_t count = _workers.size();
+        for (std::size_t priority = 0; priority < allowed; ++priority) {
+            if (_queued[priority] == 0) {
+                continue;
+            }
+            for (std::size_t i = 0; i < count; ++i) {
+                Worker& worker = *_workers[(self + i) % count];
+                std::lock_guard guard(worker.lock);
+                std::deque<Task>& queue = worker.queues[priority];
+                if (queue.empty()) {
+                    continue;
+                }
+                if (i == 0) {
+                    task = std::move(queue.back());
+                    queue.pop_back();
+                } else {
+                    task = std::move(queue.front());
+                    queue.pop_front();
+                    Metrics::Increment("pool.steals");
+                }
+                --_queued[priority];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Pool::Run(Task& task) {
+        Clock::time_point start = Clock::now();
+        std::string prefix = "pool." + task.job->GetName();
+        Metrics::RecordLatency(prefix + ".queued", ToMs(start - task.queuedAt));
+        if (task.job->IsCancelled()) {
+            Metrics::Increment("pool.cancelled");
+            return;
+        }
+
+        // An exception escaping a worker would take the game down with it
+        try {
+            task.work(*task.job);
+        } catch (const std::exception& e) {
+            if (_reportError) {
+                _reportError("Background job " + task.job->GetName() + " failed: " + e.what());
+            }
+        }
+        Metrics::RecordLatency(prefix + ".run", ToMs(Clock::now() - start));
+    }
+
+    void Pool::WorkerLoop(std::size_t self, std::function<void()> prepareThread) {
+        if (prepareThread) {
+            prepareThread();
+        }
+        current = {this, self};
+
+        Task task;
+        while (!_stopping) {
+            if (TakeTask(self, _holdBack ? 1 : kPriorityCount, task)) {
+                Run(task);
+                task = Task();
+                continue;
+            }
+            std::unique_lock guard(_sleepLock);
+            _wake.wait(guard, [&]() { return _stopping || HasRunnableTasks(); });
+        }
+    }
+
+    bool Pool::Checkpoint(const Job& job) {
+        if (job.GetPriority() == Priority::kHigh) {
+            return !job.IsCancelled();
+        }
+        constexpr std::size_t kHighOnly = 1;
+        bool onWorker = current.pool == this;
+        Task task;
+        while (_holdBack && !_stopping && !job.IsCancelled()) {
+            // A parked worker would otherwise keep high priority jobs waiting once every worker is parked
+            if (onWorker && TakeTask(current.worker, kHighOnly, task)) {
+                Run(task);
+                task = Task();
+                continue;
+            }
+            std::unique_lock guard(_sleepLock);
+            // Cancel doesn't notify, so look at it every now and then
+            _wake.wait_for(guard, std::chrono::milliseconds(100), [&]() {
+                return !_holdBack || _stopping || (onWorker && _queued[ToIndex(Priority::kHigh)] > 0);
+            });
+        }
+        return !job.IsCancelled();
+    }
+
+    std::shared_ptr<Job> Pool::Submit(std::string name, Priority priority, std::function<void(Job&)> work) {
+        auto job = std::make_shared<Job>(std::move(name), priority, *this);
+        Task task{job, std::move(work), Clock::now()};
+
+        if (!_started) {
+            std::lock_guard guard(_sleepLock);
+            if (!_started) {
+                _early.push_back(std::move(task));
+                ++_queued[ToIndex(priority)];
+                return job;
+            }
+        }
+
+        // Count the task first, so a worker that takes it right away never sees a negative count
+        {
+            std::lock_guard guard(_sleepLock);
+            ++_queued[ToIndex(priority)];
+        }
+        // Workers keep what they spawn, everyone else spreads their jobs around
+        std::size_t target = current.pool == this ? current.worker : _nextWorker++ % _workers.size();
+        {
+            Worker& worker = *_workers[target];
+            std::lock_guard guard(worker.lock);
+            worker.queues[ToIndex(priority)].push_back(std::move(task));
+        }
+        _wake.notify_one();
+        return job;
+    }
+
+    bool Pool::ParallelFor(const std::string& name, std::size_t count, std::function<void(std::size_t)> work,
+                           Job* caller) {
+        struct Shared {
+            std::function<void(std::size_t)> work;
+            std::size_t count;
+            std::atomic<std::size_t> next{0};
+            std::atomic<std::size_t> done{0};
+            std::atomic<bool> dropped{false};
+            std::mutex lock;
+            std::condition_variable finished;
+        };
+        auto shared = std::make_shared<Shared>();
+        shared->work = std::move(work);
+        shared->count = count;
+
+        auto drain = [shared](Job* job) {
+            std::size_t completed = 0;
+            for (std::size_t i = shared->next++; i < shared->count; i = shared->next++) {
+                shared->work(i);
+                ++completed;
+                if (job && !job->Checkpoint()) {
+                    // Claim what nobody took yet, so the caller doesn't wait for it
+                    std::size_t taken = shared->next.exchange(shared->count);
+                    if (taken < shared->count) {
+                        completed += shared->count - taken;
+                        shared->dropped = true;
+                    }
+                    break;
+                }
+            }
+            if (completed > 0 && shared->done.fetch_add(completed) + completed == shared->count) {
+                std::lock_guard guard(shared->lock);
+                shared->finished.notify_all();
+            }
+        };
+
+        std::size_t helpers = _started ? std::min(_workers.size(), count > 0 ? count - 1 : 0) : 0;
+        for (std::size_t i = 0; i < helpers; ++i) {
+            Submit(name, Priority::kNormal, [drain](Job& job) { drain(&job); });
+        }
+        drain(caller);
+
+        std::unique_lock guard(shared->lock);
+        shared->finished.wait(guard, [&]() { return shared->done == shared->count; });
+        return !shared->dropped;
+    }
+
+    void Pool::SetHoldBack(bool holdBack) {
+        {
+            std::lock_guard guard(_sleepLock);
+            _holdBack = holdBack;
+        }
+        Metrics::SetGauge("pool.holding_back", holdBack ? 1 : 0);
+        if (!holdBack) {
+            _wake.notify_all();
+        }
+    }
+
+#ifdef _WIN32
+    namespace {
+        // Never destroyed: joining the workers while the DLL unloads would hang the game on exit
+        Pool& GetPool() {
+            static Pool* pool = new Pool();
+            return *pool;
+        }
+
+        /**
+        * Logical processors for the workers
+        *
+        * On CPUs with performance and efficiency cores, the efficiency cores are used and the game keeps
+        * the fast ones. Otherwise the first reservedCores physical cores are left out. An empty result
+        * means no restriction.
+        **/
+        std::vector<ULONG> SelectCpuSets(std::size_t reservedCores) {
+            ULONG length = 0;
+            GetSystemCpuSetInformation(NULL, 0, &length, GetCurrentProcess(), 0);
+            std::vector<std::byte> buffer(length);
+            auto* first = reinterpret_cast<SYSTEM_CPU_SET_INFORMATION*>(buffer.data());
+            if (length == 0 || !GetSystemCpuSetInformation(first, length, &length, GetCurrentProcess(), 0)) {
+                return {};
+            }
+
+            struct Cpu {
+                ULONG id;
+                BYTE core;
+                BYTE efficiencyClass;
+            };
+            std::vector<Cpu> cpus;
+            for (ULONG offset = 0; offset < length;) {
+                auto* info = reinterpret_cast<SYSTEM_CPU_SET_INFORMATION*>(buffer.data() + offset);
+                if (info->Type == CpuSetInformation) {
+                    cpus.push_back({info->CpuSet.Id, info->CpuSet.CoreIndex, info->CpuSet.EfficiencyClass});
+                }
+                offset += info->Size;
+            }
+            if (cpus.empty()) {
+                return {};
+            }
+
+            auto [slowest, fastest] = std::minmax_element(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b) {
+                return a.efficiencyClass < b.efficiencyClass;
+            });
+            std::vector<ULONG> selected;
+            if (slowest->efficiencyClass != fastest->efficiencyClass) {
+                for (const Cpu& cpu : cpus) {
+                    if (cpu.efficiencyClass == slowest->efficiencyClass) {
+                        selected.push_back(cpu.id);
+                    }
+                }
+                return selected;
+            }
+
+            std::vector<BYTE> cores;
+            for (const Cpu& cpu : cpus) {
+                cores.push_back(cpu.core);
+            }
+            std::sort(cores.begin(), cores.end());
+            cores.erase(std::unique(cores.begin(), cores.end()), cores.end());
+            if (cores.size() <= reservedCores) {
+                return {};
+            }
+            BYTE firstAllowed = cores[reservedCores];
+            for (const Cpu& cpu : cpus) {
+                if (cpu.core >= firstAllowed) {
+                    selected.push_back(cpu.id);
+                }
+            }
+            return selected;
+        }
+
+        class LoadingScreenSink : public RE::BSTEventSink<RE::MenuOpenCloseEvent> {
+        public:
+            static LoadingScreenSink* GetSingleton() {
+                static LoadingScreenSink singleton;
+                return &singleton;
+            }
+
+            RE::BSEventNotifyControl ProcessEvent(const RE::MenuOpenCloseEvent* event,
+                                                  RE::BSTEventSource<RE::MenuOpenCloseEvent>*) override {
+                if (event && event->menuName == RE::LoadingMenu::MENU_NAME) {
+                    SetHoldBack(event->opening);
+                }
+                return RE::BSEventNotifyControl::kContinue;
+            }
+        };
+    }
+
+    }
+
+    void Install() {
+        Pool& pool = GetPool();
+        if (pool.IsStarted()) {
+            return;
+        }
+
+        unsigned int processors = std::max(std::thread::hardware_concurrency(), 2u);
+        int maxThreads = std::clamp(Settings::GetInt(L"Pool", L"iMaxThreads", 2), 1, static_cast<int>(processors - 1));
+        auto reservedCores = static_cast<std::size_t>(std::max(Settings::GetInt(L"Pool", L"iReservedCores", 2), 0));
+        std::vector<ULONG> cpuSets = SelectCpuSets(reservedCores);
+
+        auto prepareThread = [cpuSets]() {
+            SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+            SetThreadDescription(GetCurrentThread(), L"MantellaLauncher worker");
+            if (!cpuSets.empty()) {
+                SetThreadSelectedCpuSets(GetCurrentThread(), cpuSets.data(), static_cast<ULONG>(cpuSets.size()));
+            }
+        };
+        pool.Start(static_cast<std::size_t>(maxThreads), prepareThread,
+                   [](const std::string& error) { PrintToConsole(error); });
+        Metrics::SetGauge("pool.threads", maxThreads);
+        Metrics::SetGauge("pool.cpu_sets", static_cast<std::int64_t>(cpuSets.size()));
+
+        RE::UI::GetSingleton()->AddEventSink<RE::MenuOpenCloseEvent>(LoadingScreenSink::GetSingleton());
+    }
+
+    std::shared_ptr<Job> Submit(std::string name, Priority priority, std::function<void(Job&)> work) {
+        return GetPool().Submit(std::move(name), priority, std::move(work));
+    }
+
+    bool ParallelFor(const std::string& name, std::size_t count, std::function<void(std::size_t)> work, Job* caller) {
+        return GetPool().ParallelFor(name, count, std::move(work), caller);
+    }
+
+    void SetHoldBack(bool holdBack) { GetPool().SetHoldBack(holdBack); }
+
+    bool IsHoldingBack() { return GetPool().IsHoldingBack(); }
+#endif
+}
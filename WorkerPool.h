@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Shared pool of worker threads for the plugin's background jobs
+*
+* Jobs like writing voice files, hashing or measuring file throughput would otherwise each start
+* their own thread inside the game's process. The pool runs them on a small, capped number of
+* threads with below-normal priority, kept off the first cores where the game's main and render
+* threads usually run. Every worker owns a queue per priority and takes work from the others
+* when its own queues are empty.
+*
+* While a loading screen is up the game needs the CPU, so the pool holds back: only high priority
+* jobs are started and running jobs wait in Job::Checkpoint until loading has finished. A worker
+* waiting there still runs high priority jobs, so they are never stuck behind the parked ones.
+* The time a job spent queued and running is recorded as "pool.<name>.queued" and "pool.<name>.run".
+**/
+namespace WorkerPool {
+    enum class Priority : std::uint8_t {
+        kHigh,
+        kNormal,
+        kLow
+    };
+
+    class Pool;
+
+    class Job {
+    public:
+        Job(std::string name, Priority priority, Pool& pool)
+            : _name(std::move(name)), _priority(priority), _pool(pool) {}
+
+        const std::string& GetName() const { return _name; }
+        Priority GetPriority() const { return _priority; }
+
+        // A job that has not started yet is dropped, a running one sees it at its next checkpoint
+        void Cancel() { _cancelled.store(true, std::memory_order_relaxed); }
+        bool IsCancelled() const { return _cancelled.load(std::memory_order_relaxed); }
+
+        /**
+        * Call between units of work
+        *
+        * Waits while the pool holds back for the game, unless the job has high priority,
+        * and returns false once the job was cancelled.
+        **/
+        bool Checkpoint() const;
+
+    private:
+        std::string _name;
+        Priority _priority;
+        Pool& _pool;
+        std::atomic<bool> _cancelled{false};
+    };
+
+    /**
+    * The scheduling policy, separate from the game so it can be exercised with any work
+    *
+    * Thread safe. Destroying the pool stops the workers once their current jobs return and drops
+    * the jobs still queued.
+    **/
+    class Pool {
+    public:
+        Pool() = default;
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+        ~Pool();
+
+        // Start the workers, calling prepareThread on each of them first. Jobs submitted before wait for it.
+        // Exceptions escaping a job are passed to reportError.
+        void Start(std::size_t threadCount, std::function<void()> prepareThread = {},
+                   std::function<void(const std::string&)> reportError = {});
+        bool IsStarted() const { return _started; }
+
+        std::shared_ptr<Job> Submit(std::string name, Priority priority, std::function<void(Job&)> work);
+
+        /**
+        * Call work(i) for every i below count on the workers and the calling thread, and return when all are done
+        *
+        * The caller takes items too, so this finishes even when it runs on a worker or while the pool holds back.
+        * A caller that runs as a job passes it, so it waits at its checkpoints like the helpers do; once it is
+        * cancelled the items nobody took yet are dropped and false is returned.
+        **/
+        bool ParallelFor(const std::string& name, std::size_t count, std::function<void(std::size_t)> work,
+                         Job* caller = nullptr);
+
+        void SetHoldBack(bool holdBack);
+        bool IsHoldingBack() const { return _holdBack; }
+
+    private:
+        friend class Job;
+
+        static constexpr std::size_t kPriorityCount = 3;
+        using Clock = std::chrono::steady_clock;
+
+        struct Task {
+            std::shared_ptr<Job> job;
+            std::function<void(Job&)> work;
+            Clock::time_point queuedAt;
+        };
+
+        // The owner takes its newest task from the back, thieves take the oldest from the front
+        struct Worker {
+            std::mutex lock;
+            std::array<std::deque<Task>, kPriorityCount> queues;
+        };
+
+        bool HasRunnableTasks() const;
+        // Take a task of the first allowed priorities, from the worker self first
+        bool TakeTask(std::size_t self, std::size_t allowed, Task& task);
+        void Run(Task& task);
+        void WorkerLoop(std::size_t self, std::function<void()> prepareThread);
+        bool Checkpoint(const Job& job);
+
+        std::vector<std::unique_ptr<Worker>> _workers;  // not changed once started is set
+        std::vector<std::thread> _threads;
+        std::deque<Task> _early;                        // submitted before Start
+        std::atomic<bool> _started{false};
+        std::atomic<bool> _stopping{false};
+        std::atomic<std::size_t> _nextWorker{0};
+        std::function<void(const std::string&)> _reportError;
+
+        std::mutex _sleepLock;
+        std::condition_variable _wake;  // tasks were queued, the hold back ended or the pool stops
+        std::array<std::atomic<std::size_t>, kPriorityCount> _queued{};
+        std::atomic<bool> _holdBack{false};
+    };
+
+#ifdef _WIN32
+    // Start the workers. Call once at kDataLoaded, jobs submitted before then wait for it.
+    void Install();
+
+    std::shared_ptr<Job> Submit(std::string name, Priority priority, std::function<void(Job&)> work);
+
+    // Pool::ParallelFor on the plugin's pool
+    bool ParallelFor(const std::string& name, std::size_t count, std::function<void(std::size_t)> work,
+                     Job* caller = nullptr);
+
+    // Hold back while the game needs the CPU, the pool does this by itself during loading screens
+    void SetHoldBack(bool holdBack);
+    bool IsHoldingBack();
+#endif
+}
@@ -8,6 +8,33 @@
 #include <cstdio>
 #include <tlhelp32.h>
 #include <comdef.h>
+#include <thread>
+#include <chrono>
+
+#include "Launcher.h"
+#include "AudioDSP.h"
+#include "Benchmark.h"
+#include "Catalog.h"
+#include "Channel.h"
+#include "Commands.h"
+#include "GameEvents.h"
+#include "LipSync.h"
+#include "MainThread.h"
+#include "Metrics.h"
+#include "PapyrusProfiler.h"
+#include "PapyrusStrings.h"
+#include "ModOrganizer.h"
+#include "Prefetch.h"
+#include "Recorder.h"
+#include "Remote.h"
+#include "Settings.h"
+#include "Status.h"
+#include "Timers.h"
+#include "Trace.h"
+#include "VoiceCapture.h"
+#include "VoiceCache.h"
+#include "VoicePlayback.h"
+#include "WorkerPool.h"
 
 /**
 * Set the environment path to store Mantella.exe data
@@ -128,12 +155,57 @@ std::wstring GetTopLevelDirectory() {
 };
 
 
+// Helper function to retrieve the launcher's folder in the local, never roamed, application data
+std::wstring GetLocalDataDirectory() {
+    PWSTR localAppData = nullptr;
+    std::wstring directory;
+    if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, NULL, &localAppData))) {
+        directory = std::wstring(localAppData) + L"\\Mantella";
+    }
+    CoTaskMemFree(localAppData);
+    return directory;
+};
+
+
+// Hand a console message to the main thread, the console is not safe to use from background threads
+void PrintToConsole(std::string message) {
+    MainThread::Post(
+        [message = std::move(message)]() { RE::ConsoleLog::GetSingleton()->Print("%s", message.c_str()); });
+};
+
+
+bool WriteWholeFile(const std::wstring& path, std::span<const std::byte> data) {
+    std::wstring temporary = path + L".tmp";
+    HANDLE file = CreateFile(temporary.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    DWORD written = 0;
+    bool success =
+        WriteFile(file, data.data(), static_cast<DWORD>(data.size()), &written, NULL) && written == data.size();
+    CloseHandle(file);
+
+    if (!success || !MoveFileEx(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFile(temporary.c_str());
+        return false;
+    }
+    return true;
+};
+
+
 // Function to convert wchar_t* to std::string
 std::string WideStringToString(const wchar_t* wideString) {
     std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
     return converter.to_bytes(wideString);
 };
 
+// Function to convert UTF-8 std::string to std::wstring
+std::wstring StringToWideString(const std::string& string) {
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    return converter.from_bytes(string);
+};
+
 // Finds all running processes called 'Mantella.exe'. It should be pretty safe to assume that ours are the only ones running on the system.
 // Acquires HANDLE's with PROCESS_QUERY_INFORMATION and PROCESS_TERMINATE access rights to them.
 std::vector<HANDLE> LocateExistingMantellaProcesses() {
@@ -157,10 +229,43 @@ std::vector<HANDLE> LocateExistingMantellaProcesses() {
     return result;
 };
 
+// Explorer starts Mantella.exe on our behalf, so it only shows up in the process list a moment later.
+// The stale instances were ended before the launch, any Mantella.exe found is the new one. 0 if none appeared.
+std::uint32_t WaitForMantellaPid(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (;;) {
+        std::uint32_t pid = 0;
+        for (const HANDLE& process : LocateExistingMantellaProcesses()) {
+            if (process != NULL) {
+                pid = pid != 0 ? pid : GetProcessId(process);
+                CloseHandle(process);
+            }
+        }
+        if (pid != 0 || std::chrono::steady_clock::now() >= deadline) {
+            return pid;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+};
+
 /**
 * Launch Mantella.exe
+*
+* Safe to call from any thread, the outcome is published through Status.
 **/
 bool LaunchMantellaExe() {
+    auto launchStart = std::chrono::steady_clock::now();
+    Status::RecordLaunchStart();
+    auto finish = [&](bool succeeded, std::uint32_t pid, const std::string& error) {
+        Status::RecordLaunchEnd(
+            succeeded, pid,
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launchStart).count(), error);
+        if (!error.empty()) {
+            PrintToConsole(error);
+        }
+        return succeeded;
+    };
+
     STARTUPINFO si = {0};
     PROCESS_INFORMATION pi = {0};
     si.cb = sizeof(si);
@@ -172,7 +277,7 @@ bool LaunchMantellaExe() {
     std::wstring exePath = moduleDir + L"\\MantellaSoftware\\Mantella.exe";  // Construct the full path to Mantella.exe
 
     if (!SetEnvironmentTempPath()) {
-        return false;  // TODO: Handle error
+        return finish(false, 0, "Failed to set up the temporary folder for Mantella.exe.");
     }
 
     // Convert the full path to a narrow string for printing (optional)
@@ -180,7 +285,7 @@ bool LaunchMantellaExe() {
     std::string exePathStr = converter.to_bytes(exePath.c_str());
     // Convert and print the full path attempting to launch
     std::string exePathStr2 = WideStringToString(exePath.c_str());
-    RE::ConsoleLog::GetSingleton()->Print(("Attempting to launch: " + exePathStr2).c_str());
+    PrintToConsole("Attempting to launch: " + exePathStr2);
 
     const wchar_t* params = L"--integrated";
 
@@ -197,10 +302,11 @@ bool LaunchMantellaExe() {
                     std::stringstream ss;
                     ss << "Failed to terminate existing Mantella.exe process. TerminateProcess error: "
                        << GetLastError();
-                    RE::ConsoleLog::GetSingleton()->Print(ss.str().c_str());
+                    PrintToConsole(ss.str());
                 }
                 WaitForSingleObject(currentMantellaProcess, INFINITE);  // Ensure the process is completely terminated
-                RE::ConsoleLog::GetSingleton()->Print("Existing Mantella.exe process terminated.");
+                Status::RecordTerminated();
+                PrintToConsole("Existing Mantella.exe process terminated.");
             } else {
                 // Process is not active, close the handle
             }
@@ -208,13 +314,25 @@ bool LaunchMantellaExe() {
         }
     }
 
+    // Under MO2, let Explorer start Mantella.exe so it doesn't run inside the virtual file system
+    if (ModOrganizer::IsVirtualized() && Settings::GetBool(L"ModOrganizer", L"bLaunchOutsideVfs", true)) {
+        if (Settings::GetBool(L"ModOrganizer", L"bMeasureFileThroughput", false)) {
+            WorkerPool::Submit("vfs_throughput", WorkerPool::Priority::kLow,
+                               [](WorkerPool::Job&) { ModOrganizer::MeasureFileThroughput(); });
+        }
+        if (ModOrganizer::LaunchOutsideVfs(exePath, params)) {
+            PrintToConsole("Started Mantella.exe outside of MO2's virtual file system.");
+            return finish(true, WaitForMantellaPid(std::chrono::seconds(5)), {});
+        }
+        PrintToConsole("Failed to start Mantella.exe outside of MO2's virtual file system, starting it directly.");
+    }
+
     // Start Mantella.exe
     if (!CreateProcess(NULL, &commandLine[0], NULL, NULL, FALSE, CREATE_NEW_CONSOLE, NULL, moduleDir.c_str(), &si,
                        &pi)) {
         std::stringstream ss;
         ss << "Failed to launch Mantella.exe. CreateProcess error: " << GetLastError();
-        RE::ConsoleLog::GetSingleton()->Print(ss.str().c_str());
-        return false;
+        return finish(false, 0, ss.str());
     } else {
         SetConsoleTitle(L"Mantella");
     }
@@ -222,19 +340,59 @@ bool LaunchMantellaExe() {
     //Close thread handle
     CloseHandle(pi.hThread);
 
-    return true;
+    return finish(true, pi.dwProcessId, {});
 };
 
 
 
-bool LaunchMantellaExePapyrus(RE::StaticFunctionTag*) { 
-    return LaunchMantellaExe(); 
+/**
+* Select the audio kernels for this CPU
+*
+* The vector kernels are checked against the scalar reference once, so a faulty code path
+* only costs speed instead of producing wrong audio.
+**/
+void InitializeAudioKernels() {
+    int level = Settings::GetInt(L"Audio", L"iSimdLevel", -1);
+    if (level >= 0) {
+        AudioDSP::SetLevel(static_cast<AudioDSP::Level>(std::min(level, static_cast<int>(AudioDSP::Level::kAVX2))));
+    }
+
+    if (!AudioDSP::VerifyKernels()) {
+        PrintToConsole(std::string("Audio kernels did not match the reference, falling back to ") +
+                       AudioDSP::GetLevelName(AudioDSP::GetLevel()) + ".");
+    }
+    Metrics::SetGauge("audio.simd_level", static_cast<std::int64_t>(AudioDSP::GetLevel()));
+};
+
+
+// Ending the old Mantella.exe and waiting for the new one takes seconds, so the VM thread only queues the launch.
+// Scripts follow it with GetMantellaState.
+bool LaunchMantellaExePapyrus(RE::StaticFunctionTag*) {
+    if (Remote::IsActive()) {
+        PrintToConsole("Mantella runs on the remote machine, not starting it locally.");
+        return true;
+    }
+    Status::SetState(Status::State::kLaunching);
+    WorkerPool::Submit("launch", WorkerPool::Priority::kHigh, [](WorkerPool::Job&) {
+        if (LaunchMantellaExe()) {
+            PrintToConsole("Mantella.exe restarted successfully!");
+        }
+    });
+    return true;
+};
+
+
+void LogMantellaMetricsPapyrus(RE::StaticFunctionTag*) {
+    PrintToConsole(Status::Format());
+    Metrics::LogToConsole();
 };
 
 
 bool PapyrusFunctions(RE::BSScript::IVirtualMachine* vm) {
     vm->RegisterFunction("LaunchMantellaExe", "MantellaLauncher", LaunchMantellaExePapyrus);
-    return true;
+    vm->RegisterFunction("LogMantellaMetrics", "MantellaLauncher", LogMantellaMetricsPapyrus);
+    return PapyrusStrings::Register(vm) && Timers::Register(vm) && Remote::Register(vm) && Status::Register(vm) &&
+           Benchmark::Register(vm) && Recorder::Register(vm) && Commands::Register(vm);
 };
 
 
@@ -245,19 +403,48 @@ SKSEPluginLoad(const SKSE::LoadInterface* skse) {
 
     SKSE::GetMessagingInterface()->RegisterListener([](SKSE::MessagingInterface::Message* message) {
         if (message->type == SKSE::MessagingInterface::kDataLoaded) {
-            //Get running instances of Mantella.exe here. In case there are any, we don't force spawn the integrated one.
-            std::vector<HANDLE> existingProcesses = LocateExistingMantellaProcesses();
-            if (existingProcesses.size() == 0) {
-                // Attempt to launch Mantella.exe when the game data is loaded
-                if (LaunchMantellaExe()) {
-                    RE::ConsoleLog::GetSingleton()->Print("Mantella.exe launched successfully!");
+            MainThread::Install();
+            WorkerPool::Install();
+            Recorder::Install();
+            // Open the channel before Mantella.exe starts so it can connect right away
+            Channel::Start();
+            Timers::Install();
+            Trace::Install();
+            Benchmark::Install();
+            Catalog::Install();
+            InitializeAudioKernels();
+            Prefetch::Install();
+            GameEvents::Install();
+            PapyrusProfiler::Install();
+            VoiceCapture::Install();
+            LipSync::Install();
+            VoicePlayback::Install();
+            VoiceCache::Install();
+
+            // Probing the remote can take up to its connect timeout, so decide how to start Mantella off the main
+            // thread and without holding up the main menu
+            WorkerPool::Submit("launch", WorkerPool::Priority::kHigh, [](WorkerPool::Job&) {
+                // A reachable remote Mantella replaces the local one
+                if (Remote::Install()) {
+                    return;
+                }
+
+                //Get running instances of Mantella.exe here. In case there are any, we don't force spawn the integrated one.
+                std::vector<HANDLE> existingProcesses = LocateExistingMantellaProcesses();
+                if (existingProcesses.size() == 0) {
+                    if (LaunchMantellaExe()) {
+                        PrintToConsole("Mantella.exe launched successfully!");
+                    } else {
+                        PrintToConsole("Failed to launch Mantella.exe.");
+                    }
                 } else {
-                    RE::ConsoleLog::GetSingleton()->Print("Failed to launch Mantella.exe.");
+                    for (const HANDLE& i : existingProcesses) CloseHandle(i);//close the acquired handles, we will get new ones on a potential restart
+                    Status::SetState(Status::State::kAlreadyRunning);
+                    PrintToConsole("Found running instance of Mantella.exe. Not starting a new one. You can still restart it from the MCM.");
                 }
-            } else {
-                for (const HANDLE& i : existingProcesses) CloseHandle(i);//close the acquired handles, we will get new ones on a potential restart
-                RE::ConsoleLog::GetSingleton()->Print("Found running instance of Mantella.exe. Not starting a new one. You can still restart it from the MCM.");
-            }
+            });
+        } else if (message->type == SKSE::MessagingInterface::kPostLoadGame) {
+            Prefetch::CollectNearbyActors();
         }
     });
 
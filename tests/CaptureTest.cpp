@@ -0,0 +1,269 @@
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "Metrics.h"
+#include "SharedRing.h"
+#include "Test.h"
+#include "VoiceCapture.h"
+#include "Wav.h"
+
+// Push-to-talk capture from WAV input: the frame pipeline writes into a record ring and a reader thread
+// stands in for Mantella, which starts transcribing when the voiced frames end. The clips are pushed as
+// fast as the ring takes them, so the ring transit includes waiting behind a full ring. The same clips, and
+// steady noise, go through the hands-free ActivityDetector for its cost per frame and how long after the
+// labelled speech it starts and ends an utterance.
+
+namespace {
+    using VoiceCapture::FramePipeline;
+    using VoiceCapture::kFrameSamples;
+
+    constexpr std::uint32_t kRingCapacity = 1 << 14;  // smaller than the plugin's, so the test wraps and fills it
+    constexpr float kThresholdDb = -45.0f;
+    constexpr std::uint32_t kHangoverFrames = 15;
+    constexpr double kFrameMs = 20.0;
+
+    struct alignas(64) Block {
+        std::byte bytes[64];
+    };
+
+    struct Ring {
+        std::vector<Block> memory;
+        RecordRing ring;
+
+        explicit Ring(std::uint32_t capacity)
+            : memory((RecordRing::GetRequiredSize(capacity) + sizeof(Block) - 1) / sizeof(Block)) {
+            ring.Create(memory.data(), capacity);
+        }
+    };
+
+    struct Results {
+        std::vector<double> dspMs;
+        std::vector<double> transitUs;
+        std::vector<double> endOfSpeechMs;
+        std::vector<double> vadNs;
+        std::vector<double> onsetMs;
+        std::vector<double> vadEndMs;
+    };
+
+    // Hands-free detection at the ini defaults. Utterances closer than the hangover are one for the detector.
+    // Returns how many utterances were detected.
+    std::size_t RunActivityDetector(const Wav::Clip& clip, Results& results) {
+        VoiceCapture::ActivityDetector::Config config;
+        VoiceCapture::ActivityDetector detector(config);
+        FramePipeline pipeline;
+        pipeline.Configure(clip.sampleRate, kThresholdDb, kHangoverFrames);
+
+        std::vector<double> starts;  // end of the frame that started an utterance, in seconds
+        std::vector<double> ends;
+        std::size_t index = 0;
+        auto onFrame = [&](const FramePipeline::Frame& frame) {
+            Test::Clock::time_point start = Test::Clock::now();
+            VoiceCapture::ActivityDetector::Event event = detector.Process(frame.samples, kFrameSamples);
+            results.vadNs.push_back(Test::ElapsedMs(start) * 1e6);
+            double seconds = static_cast<double>(++index) * kFrameMs / 1000.0;
+            if (event == VoiceCapture::ActivityDetector::Event::kStart) {
+                starts.push_back(seconds);
+            } else if (event == VoiceCapture::ActivityDetector::Event::kEnd) {
+                ends.push_back(seconds);
+            }
+        };
+        pipeline.Process(clip.samples.data(), clip.GetFrames(), clip.channels, onFrame);
+        pipeline.Flush(onFrame);
+        std::printf("%s: hands-free detected %zu utterances\n", clip.name.c_str(), starts.size());
+        if (clip.speech.empty()) {
+            return starts.size();
+        }
+
+        // Merge what the hangover bridges, then every utterance starts after the onset and ends after the hangover.
+        // A pause as long as the hangover ends the utterance on the frame where the next one begins.
+        double hangoverSeconds = (config.hangoverFrames - 1) * kFrameMs / 1000.0;
+        std::vector<std::pair<double, double>> expected;
+        for (const std::pair<double, double>& speech : clip.speech) {
+            if (!expected.empty() && speech.first - expected.back().second < hangoverSeconds) {
+                expected.back().second = speech.second;
+            } else {
+                expected.push_back(speech);
+            }
+        }
+        CHECK(starts.size() == expected.size());
+        for (std::size_t i = 0; i < std::min(starts.size(), expected.size()); ++i) {
+            double onsetMs = (starts[i] - expected[i].first) * 1000.0;
+            results.onsetMs.push_back(onsetMs);
+            CHECK(onsetMs >= config.onsetFrames * kFrameMs - kFrameMs);
+            CHECK(onsetMs <= config.onsetFrames * kFrameMs + 5 * kFrameMs);
+        }
+        for (std::size_t i = 0; i < std::min(ends.size(), expected.size()); ++i) {
+            double endMs = (ends[i] - expected[i].second) * 1000.0;
+            results.vadEndMs.push_back(endMs);
+            CHECK(endMs >= config.hangoverFrames * kFrameMs - 5 * kFrameMs);
+            CHECK(endMs <= config.hangoverFrames * kFrameMs + 3 * kFrameMs);
+        }
+        return starts.size();
+    }
+
+    // Steady noise well above the minimum level, loud enough to pass the energy checks alone
+    void TestActivityDetectorOnNoise(Results& results) {
+        for (float level : {0.003f, 0.03f, 0.1f}) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "noise_rms_%.3f", level);
+            Wav::Clip noise = Wav::Synthesize(name, 16000, 1, 10.0, {}, level, 11);
+            CHECK(RunActivityDetector(noise, results) == 0);
+        }
+    }
+
+    void RunClip(const Wav::Clip& clip, Results& results) {
+        Ring ring(kRingCapacity);
+        std::size_t expectedFrames = clip.GetFrames() * VoiceCapture::kSampleRate / clip.sampleRate + 2;
+        std::vector<std::int16_t> sent;
+        std::vector<Test::Clock::time_point> sentAt(expectedFrames);
+        std::atomic<bool> done{false};
+
+        // Mantella's side: every frame is copied out, the end of an utterance is where it would transcribe
+        std::vector<std::int16_t> received;
+        std::vector<double> transitUs;
+        std::vector<std::size_t> utteranceEnds;  // index of the first unvoiced frame after voiced ones
+        std::thread reader([&] {
+            RecordHeader header;
+            std::vector<std::byte> payload;
+            bool voiced = false;
+            std::size_t index = 0;
+            for (;;) {
+                bool finished = done.load(std::memory_order_acquire);
+                if (!ring.ring.Read(header, payload)) {
+                    if (finished) {
+                        return;
+                    }
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (index < sentAt.size()) {
+                    transitUs.push_back(
+                        std::chrono::duration<double, std::micro>(Test::Clock::now() - sentAt[index]).count());
+                }
+                CHECK(header.kind == VoiceCapture::kAudioFrame);
+                CHECK(header.size == kFrameSamples * sizeof(std::int16_t));
+                auto* pcm = reinterpret_cast<const std::int16_t*>(payload.data());
+                received.insert(received.end(), pcm, pcm + header.size / sizeof(std::int16_t));
+
+                bool frameVoiced = (header.flags & VoiceCapture::kVoiced) != 0;
+                if (voiced && !frameVoiced) {
+                    utteranceEnds.push_back(index);
+                }
+                voiced = frameVoiced;
+                ++index;
+            }
+        });
+
+        FramePipeline pipeline;
+        pipeline.Configure(clip.sampleRate, kThresholdDb, kHangoverFrames);
+        auto onFrame = [&](const FramePipeline::Frame& frame) {
+            std::size_t index = sent.size() / kFrameSamples;
+            sent.insert(sent.end(), frame.pcm, frame.pcm + kFrameSamples);
+            if (index < sentAt.size()) {
+                sentAt[index] = Test::Clock::now();
+            }
+            // Wait for room like the capture thread would if Mantella fell behind
+            while (!ring.ring.Write(VoiceCapture::kAudioFrame, frame.voiced ? VoiceCapture::kVoiced : 0, frame.pcm,
+                                    kFrameSamples * sizeof(std::int16_t))) {
+                std::this_thread::yield();
+            }
+        };
+
+        // 10 ms packets, like a shared-mode device delivers them
+        std::size_t packetFrames = clip.sampleRate / 100;
+        for (std::size_t offset = 0; offset < clip.GetFrames(); offset += packetFrames) {
+            std::size_t frames = std::min(packetFrames, clip.GetFrames() - offset);
+            Test::Clock::time_point start = Test::Clock::now();
+            pipeline.Process(clip.samples.data() + offset * clip.channels, frames, clip.channels, onFrame);
+            results.dspMs.push_back(Test::ElapsedMs(start));
+        }
+        pipeline.Flush(onFrame);
+        done.store(true, std::memory_order_release);
+        reader.join();
+
+        CHECK(sent.size() / kFrameSamples <= expectedFrames);
+        CHECK(received.size() == sent.size());
+        CHECK(std::memcmp(received.data(), sent.data(), std::min(received.size(), sent.size()) * 2) == 0);
+        results.transitUs.insert(results.transitUs.end(), transitUs.begin(), transitUs.end());
+
+        // The end of speech is known once the first unvoiced frame is complete and has crossed the ring
+        std::printf("%s: %.1f s, %zu frames, %zu utterances\n", clip.name.c_str(), clip.GetSeconds(),
+                    sent.size() / kFrameSamples, utteranceEnds.size());
+        CHECK(clip.speech.empty() || utteranceEnds.size() == clip.speech.size());
+        for (std::size_t i = 0; i < std::min(utteranceEnds.size(), clip.speech.size()); ++i) {
+            std::size_t index = utteranceEnds[i];
+            double latencyMs = (static_cast<double>(index) + 1.0) * kFrameMs - clip.speech[i].second * 1000.0 +
+                               (index < transitUs.size() ? transitUs[index] / 1000.0 : 0.0);
+            results.endOfSpeechMs.push_back(latencyMs);
+            // The hangover, give or take a frame of alignment and the resampler's delay
+            CHECK(latencyMs >= kHangoverFrames * kFrameMs - 2 * kFrameMs);
+            CHECK(latencyMs <= kHangoverFrames * kFrameMs + 3 * kFrameMs);
+        }
+    }
+
+    // A record whose size runs past what was written is dropped and the reader catches up with the writer
+    void TestCorruptRecord() {
+        Ring ring(1 << 10);
+        std::uint32_t value = 7;
+        CHECK(ring.ring.Write(1, 0, &value, sizeof(value)));
+        CHECK(ring.ring.Write(1, 0, &value, sizeof(value)));
+        CHECK(ring.ring.Write(1, 0, &value, sizeof(value)));
+
+        // The second record starts after the first header and its payload padded to 8 bytes
+        auto* data = reinterpret_cast<std::byte*>(ring.memory.data()) + sizeof(RingHeader);
+        std::uint32_t corruptSize = 0x00FFFFFF;
+        std::memcpy(data + sizeof(RecordHeader) + 8, &corruptSize, sizeof(corruptSize));
+
+        RecordHeader header;
+        std::vector<std::byte> payload;
+        CHECK(ring.ring.Read(header, payload) && header.size == sizeof(value));
+        CHECK(!ring.ring.Read(header, payload));
+        CHECK(ring.ring.GetUsedBytes() == 0);
+        CHECK(Metrics::Format().find("ring.corrupt_records: 1\n") != std::string::npos);
+
+        CHECK(ring.ring.Write(2, 0, &value, sizeof(value)));
+        CHECK(ring.ring.Read(header, payload) && header.kind == 2);
+    }
+
+    // The producer attaches to the header the other side wrote and must not trust its capacity
+    void TestAttach() {
+        Ring ring(1 << 10);
+        std::size_t size = RecordRing::GetRequiredSize(1 << 10);
+        auto* header = reinterpret_cast<RingHeader*>(ring.memory.data());
+        RecordRing attached;
+        CHECK(attached.Attach(header, size));
+        CHECK(!attached.Attach(header, size - 1));
+        CHECK(!attached.Attach(header, sizeof(RingHeader) - 1));
+
+        for (std::uint32_t capacity : {0u, 1000u, 1u << 11}) {
+            header->capacity = capacity;
+            CHECK(!attached.Attach(header, size));
+        }
+        header->capacity = 1 << 10;
+        header->magic = 0;
+        CHECK(!attached.Attach(header, size));
+    }
+}
+
+int main(int argc, char** argv) {
+    TestCorruptRecord();
+    TestAttach();
+
+    Results results;
+    for (const Wav::Clip& clip : Wav::LoadCorpus(argc, argv)) {
+        RunClip(clip, results);
+        RunActivityDetector(clip, results);
+    }
+    TestActivityDetectorOnNoise(results);
+    std::printf("kernels: %s\n", AudioDSP::GetLevelName(AudioDSP::GetLevel()));
+    Test::Report("dsp per 10 ms packet", std::move(results.dspMs));
+    Test::Report("ring transit", std::move(results.transitUs), "us");
+    Test::Report("end of speech to transcription", std::move(results.endOfSpeechMs));
+    Benchmark::Summary vad = Benchmark::Summarize(results.vadNs);
+    std::printf("hands-free detector: %.1f ppm of a core at the median\n", vad.p50 / (kFrameMs * 1e6) * 1e6);
+    Test::Report("hands-free detector per frame", std::move(results.vadNs), "ns");
+    Test::Report("hands-free onset after speech", std::move(results.onsetMs));
+    Test::Report("hands-free end after speech", std::move(results.vadEndMs));
+    return Test::Finish("capture_test");
+}
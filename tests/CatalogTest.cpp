@@ -0,0 +1,231 @@
+#include <cstring>
+#include <random>
+#include <set>
+
+#include "Catalog.h"
+#include "Test.h"
+
+// A synthetic load order serialized as a catalog and read back the way Mantella maps it: the header and
+// its sections, tables sorted by FormID and found with Catalog::Find in place, names and faction ranks that
+// resolve to what went in. Times building the file and looking up actors.
+
+namespace {
+    constexpr std::int64_t kBuiltAt = 1760000000123;
+
+    struct Source {
+        Catalog::Tables tables;
+        std::vector<std::string> names;  // per actor, in the order they were added
+        std::vector<std::vector<Catalog::FactionRank>> ranks;
+    };
+
+    std::uint32_t AddString(std::string& pool, const std::string& text) {
+        if (text.empty()) {
+            return 0;
+        }
+        auto offset = static_cast<std::uint32_t>(pool.size());
+        pool += text;
+        pool += '\0';
+        return offset;
+    }
+
+    // Actors in load order, so FormIDs of different plugins interleave and the table starts out unsorted
+    Source MakeLoadOrder(std::size_t actorCount, std::uint32_t seed) {
+        Source source;
+        Catalog::Tables& tables = source.tables;
+        std::mt19937 random(seed);
+        std::set<std::uint32_t> used;
+        for (std::size_t i = 0; i < actorCount; ++i) {
+            std::uint32_t formId;
+            do {
+                formId = (random() % 0xFE) << 24 | (random() & 0xFFFFFF);
+            } while (!used.insert(formId).second);
+
+            std::string name = i % 17 == 0 ? std::string() : "Actor " + std::to_string(i) + " \xC3\xA9";
+            Catalog::Actor actor = {};
+            actor.formId = formId;
+            actor.name = AddString(tables.strings, name);
+            actor.race = 0x13740 + static_cast<std::uint32_t>(i % 10);
+            actor.voiceType = i % 5 == 0 ? 0 : 0x13AD0 + static_cast<std::uint32_t>(i % 30);
+            actor.firstFactionRank = static_cast<std::uint32_t>(tables.factionRanks.size());
+            std::vector<Catalog::FactionRank> ranks;
+            for (std::size_t r = 0; r < i % 4; ++r) {
+                auto faction = 0x28000 + static_cast<std::uint32_t>(random() % 500);
+                ranks.push_back({faction, static_cast<std::int32_t>(r) - 1});
+            }
+            tables.factionRanks.insert(tables.factionRanks.end(), ranks.begin(), ranks.end());
+            actor.factionRankCount = static_cast<std::uint16_t>(ranks.size());
+            actor.flags = static_cast<std::uint16_t>(i % 8);
+            tables.actors.push_back(actor);
+            source.names.push_back(name);
+            source.ranks.push_back(std::move(ranks));
+        }
+        for (std::uint32_t i = 0; i < 30; ++i) {
+            tables.voiceTypes.push_back({0x13AD0 + 29 - i, AddString(tables.strings, "MaleVoice" + std::to_string(i))});
+        }
+        for (std::uint32_t i = 0; i < 10; ++i) {
+            tables.races.push_back({0x13749 - i, AddString(tables.strings, "Race " + std::to_string(i))});
+        }
+        for (std::uint32_t i = 0; i < 500; ++i) {
+            tables.factions.push_back({0x28000 + (i * 7919) % 500, AddString(tables.strings, "Faction")});
+        }
+        for (std::uint32_t i = 0; i < 200; ++i) {
+            tables.locations.push_back({0x16000 + (i * 31) % 200, AddString(tables.strings, "Hold"), i ? 0x16000u : 0});
+        }
+        return source;
+    }
+
+    // The file as Mantella sees it after mapping it
+    class View {
+    public:
+        bool Open(std::span<const std::byte> file) {
+            if (file.size() < sizeof(Catalog::Header)) {
+                return false;
+            }
+            std::memcpy(&_header, file.data(), sizeof(_header));
+            _file = file;
+            return _header.magic == Catalog::Header::kMagic && _header.version == Catalog::Header::kVersion &&
+                   IsInside<Catalog::Actor>(_header.actors) && IsInside<Catalog::NamedForm>(_header.voiceTypes) &&
+                   IsInside<Catalog::NamedForm>(_header.races) && IsInside<Catalog::NamedForm>(_header.factions) &&
+                   IsInside<Catalog::Location>(_header.locations) &&
+                   IsInside<Catalog::FactionRank>(_header.factionRanks) && IsInside<char>(_header.strings) &&
+                   _header.strings.count > 0 &&
+                   file[_header.strings.offset + _header.strings.count - 1] == std::byte{0};
+        }
+
+        const Catalog::Header& GetHeader() const { return _header; }
+
+        template <class T>
+        std::span<const T> Get(const Catalog::Section& section) const {
+            return {reinterpret_cast<const T*>(_file.data() + section.offset), section.count};
+        }
+
+        const char* GetString(std::uint32_t offset) const {
+            return reinterpret_cast<const char*>(_file.data() + _header.strings.offset + offset);
+        }
+
+    private:
+        // In bounds and aligned, so the records can be used in place
+        template <class T>
+        bool IsInside(const Catalog::Section& section) const {
+            return section.offset % alignof(T) == 0 && section.offset <= _file.size() &&
+                   std::uint64_t{section.count} * sizeof(T) <= _file.size() - section.offset;
+        }
+
+        Catalog::Header _header = {};
+        std::span<const std::byte> _file;
+    };
+
+    template <class T>
+    bool IsSorted(std::span<const T> table) {
+        return std::adjacent_find(table.begin(), table.end(),
+                                  [](const T& a, const T& b) { return a.formId >= b.formId; }) == table.end();
+    }
+
+    void TestFormat() {
+        Source source = MakeLoadOrder(5000, 7);
+        std::vector<Catalog::Actor> inputActors = source.tables.actors;
+        std::vector<Catalog::FactionRank> inputRanks = source.tables.factionRanks;
+        std::string inputStrings = source.tables.strings;
+        std::vector<std::byte> file = Catalog::Serialize(source.tables, kBuiltAt);
+
+        View view;
+        CHECK(view.Open(file));
+        const Catalog::Header& header = view.GetHeader();
+        CHECK(header.builtAt == kBuiltAt);
+        CHECK(header.actors.offset == sizeof(Catalog::Header));
+        CHECK(header.strings.offset + header.strings.count == file.size());
+        CHECK(header.actors.count == 5000 && header.voiceTypes.count == 30 && header.races.count == 10 &&
+              header.factions.count == 500 && header.locations.count == 200);
+        CHECK(header.factionRanks.count == inputRanks.size() && header.strings.count == inputStrings.size());
+        CHECK(*view.GetString(0) == '\0');
+
+        std::span<const Catalog::Actor> actors = view.Get<Catalog::Actor>(header.actors);
+        std::span<const Catalog::FactionRank> ranks = view.Get<Catalog::FactionRank>(header.factionRanks);
+        CHECK(IsSorted(actors));
+        CHECK(IsSorted(view.Get<Catalog::NamedForm>(header.voiceTypes)));
+        CHECK(IsSorted(view.Get<Catalog::NamedForm>(header.races)));
+        CHECK(IsSorted(view.Get<Catalog::NamedForm>(header.factions)));
+        CHECK(IsSorted(view.Get<Catalog::Location>(header.locations)));
+
+        // Every actor that went in is found with its name and faction ranks
+        int mismatches = 0;
+        for (std::size_t i = 0; i < inputActors.size(); ++i) {
+            const Catalog::Actor* actor = Catalog::Find(actors, inputActors[i].formId);
+            if (!actor || source.names[i] != view.GetString(actor->name) || actor->race != inputActors[i].race ||
+                actor->voiceType != inputActors[i].voiceType || actor->flags != inputActors[i].flags ||
+                actor->factionRankCount != source.ranks[i].size() ||
+                std::uint64_t{actor->firstFactionRank} + actor->factionRankCount > ranks.size()) {
+                ++mismatches;
+                continue;
+            }
+            for (std::size_t r = 0; r < source.ranks[i].size(); ++r) {
+                const Catalog::FactionRank& rank = ranks[actor->firstFactionRank + r];
+                mismatches += rank.faction != source.ranks[i][r].faction || rank.rank != source.ranks[i][r].rank;
+            }
+        }
+        CHECK(mismatches == 0);
+        CHECK(Catalog::Find(actors, 0xFF000000) == nullptr);
+        CHECK(std::string(view.GetString(Catalog::Find(view.Get<Catalog::NamedForm>(header.races), 0x13749)->name)) ==
+              "Race 0");
+        CHECK(Catalog::Find(view.Get<Catalog::Location>(header.locations), 0x16000)->parent == 0);
+
+        // Malformed files are rejected
+        CHECK(!view.Open(std::span(file).first(sizeof(Catalog::Header) - 1)));
+        CHECK(!view.Open(std::span(file).first(file.size() - 1)));
+        std::vector<std::byte> corrupt = file;
+        Catalog::Header bad = header;
+        bad.actors.count = 0x10000000;
+        std::memcpy(corrupt.data(), &bad, sizeof(bad));
+        CHECK(!view.Open(corrupt));
+        bad = header;
+        bad.version = Catalog::Header::kVersion + 1;
+        std::memcpy(corrupt.data(), &bad, sizeof(bad));
+        CHECK(!view.Open(corrupt));
+
+        // An empty load order is still a valid file
+        Catalog::Tables empty;
+        std::vector<std::byte> emptyFile = Catalog::Serialize(empty, kBuiltAt);
+        CHECK(view.Open(emptyFile) && view.GetHeader().actors.count == 0 && view.GetHeader().strings.count == 1);
+    }
+
+    void TimeCatalog() {
+        for (std::size_t actorCount : {5000, 50000}) {
+            std::vector<double> buildMs;
+            std::vector<std::byte> file;
+            for (int run = 0; run < 10; ++run) {
+                Source source = MakeLoadOrder(actorCount, 11);
+                Test::Clock::time_point start = Test::Clock::now();
+                file = Catalog::Serialize(source.tables, kBuiltAt);
+                buildMs.push_back(Test::ElapsedMs(start));
+            }
+            Test::Report("serialize " + std::to_string(actorCount) + " actors", std::move(buildMs));
+
+            View view;
+            CHECK(view.Open(file));
+            std::span<const Catalog::Actor> actors = view.Get<Catalog::Actor>(view.GetHeader().actors);
+            std::mt19937 random(3);
+            std::vector<double> lookupNs;
+            std::size_t found = 0;
+            for (int batch = 0; batch < 200; ++batch) {
+                std::vector<std::uint32_t> ids(1000);
+                for (std::uint32_t& id : ids) {
+                    id = actors[random() % actors.size()].formId;
+                }
+                Test::Clock::time_point start = Test::Clock::now();
+                for (std::uint32_t id : ids) {
+                    found += Catalog::Find(actors, id) != nullptr;
+                }
+                lookupNs.push_back(Test::ElapsedMs(start) * 1e6 / ids.size());
+            }
+            CHECK(found == 200 * 1000);
+            Test::Report("find in " + std::to_string(actorCount) + " actors", std::move(lookupNs), "ns");
+        }
+    }
+}
+
+int main() {
+    std::printf("Catalog format with a synthetic load order\n");
+    TestFormat();
+    TimeCatalog();
+    return Test::Finish("catalog_test");
+}
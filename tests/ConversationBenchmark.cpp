@@ -0,0 +1,212 @@
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+#include "Benchmark.h"
+#include "Test.h"
+
+// The conversation benchmark's loop against a stand-in Mantella on the other end of a local socket. The
+// stand-in takes scripted times for every stage, so the plugin's side can be checked: answers matched to
+// their runs, late answers ignored, errors passed on, overhead and round trip derived from what was measured.
+// With instant stages what is left is the plugin's own cost per run, the number to watch for regressions.
+
+namespace {
+    constexpr const char* kLateVoice = "late";  // the stand-in answers runs with this voice after kLateMs
+    constexpr double kLateMs = 60.0;
+    constexpr double kLateSttMs = 999.0;
+
+    // How long the stand-in takes for each stage, in ms
+    struct Stages {
+        double stt = 0.0;
+        double llmFirstToken = 0.0;
+        double llm = 0.0;  // including the first token
+        double ttsFirstAudio = 0.0;
+        double tts = 0.0;  // including the first audio
+    };
+
+    bool WriteAll(int socket, const std::string& text) {
+        std::size_t written = 0;
+        while (written < text.size()) {
+            ssize_t result = write(socket, text.data() + written, text.size() - written);
+            if (result <= 0) {
+                return false;
+            }
+            written += static_cast<std::size_t>(result);
+        }
+        return true;
+    }
+
+    // Call handle with every '\n'-terminated message until the other end goes away, like the channel does
+    template <class Handle>
+    void ReadMessages(int socket, Handle&& handle) {
+        std::string inbox;
+        char buffer[4096];
+        ssize_t count;
+        while ((count = read(socket, buffer, sizeof(buffer))) > 0) {
+            inbox.append(buffer, static_cast<std::size_t>(count));
+            std::size_t start = 0;
+            std::size_t end;
+            while ((end = inbox.find('\n', start)) != std::string::npos) {
+                handle(Json::Parse(std::string_view(inbox).substr(start, end - start)));
+                start = end + 1;
+            }
+            inbox.erase(0, start);
+        }
+    }
+
+    void Wait(double ms) { std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms)); }
+
+    // Both ends of the channel: Mantella answering benchmark_run, and the plugin's reader handing
+    // benchmark_result to the session
+    class StandIn {
+    public:
+        explicit StandIn(Stages stages)
+            : _session([this](std::string message) { WriteAll(_plugin, message + '\n'); }), _stages(stages) {
+            int sockets[2];
+            socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+            _plugin = sockets[0];
+            _mantella = sockets[1];
+            _mantellaThread = std::thread([this] { ReadMessages(_mantella, [this](Json::Value m) { Answer(m); }); });
+            _pluginThread = std::thread([this] {
+                ReadMessages(_plugin, [this](Json::Value message) {
+                    if (message["type"].GetRawString() == "benchmark_result") {
+                        _session.OnResult(message);
+                    }
+                });
+            });
+        }
+
+        ~StandIn() {
+            shutdown(_plugin, SHUT_RDWR);
+            shutdown(_mantella, SHUT_RDWR);
+            _mantellaThread.join();
+            _pluginThread.join();
+            close(_plugin);
+            close(_mantella);
+        }
+
+        Benchmark::Session& GetSession() { return _session; }
+        int GetWarmupRuns() const { return _warmupRuns; }
+
+    private:
+        void Answer(const Json::Value& run) {
+            _warmupRuns += run["warmup"].GetBool();
+            Json::Writer json;
+            json.BeginObject().Field("type", "benchmark_result").Field("run_id", run["run_id"].GetUInt());
+            if (run["prompt"].GetRawString().empty()) {
+                json.Field("error", "no prompt");
+            } else if (run["voice"].GetRawString() == kLateVoice) {
+                Wait(kLateMs);
+                json.Field("stt_ms", kLateSttMs);
+            } else {
+                Test::Clock::time_point start = Test::Clock::now();
+                Wait(_stages.stt);
+                json.Field("stt_ms", Test::ElapsedMs(start));
+                start = Test::Clock::now();
+                Wait(_stages.llmFirstToken);
+                json.Field("llm_first_token_ms", Test::ElapsedMs(start));
+                Wait(_stages.llm - _stages.llmFirstToken);
+                json.Field("llm_ms", Test::ElapsedMs(start));
+                start = Test::Clock::now();
+                Wait(_stages.ttsFirstAudio);
+                json.Field("tts_first_audio_ms", Test::ElapsedMs(start));
+                Wait(_stages.tts - _stages.ttsFirstAudio);
+                json.Field("tts_ms", Test::ElapsedMs(start));
+            }
+            json.EndObject();
+            WriteAll(_mantella, json.Take() + '\n');
+        }
+
+        Benchmark::Session _session;
+        Stages _stages;
+        int _plugin = -1;
+        int _mantella = -1;
+        std::atomic<int> _warmupRuns{0};
+        std::thread _mantellaThread;
+        std::thread _pluginThread;
+    };
+
+    const Benchmark::Script kScript = {"", "Greetings, traveler. What news do you bring from Whiterun?", "MaleNord"};
+
+    // The loop the in-game benchmark runs. Returns false if a run failed.
+    bool Run(Benchmark::Session& session, int runs, int warmupRuns, Benchmark::Samples& samples) {
+        for (int run = 0; run < warmupRuns + runs; ++run) {
+            double roundTripMs = 0.0;
+            std::optional<Benchmark::Result> result =
+                session.RunOnce(kScript, run < warmupRuns, std::chrono::seconds(5), roundTripMs);
+            if (!result || !result->error.empty()) {
+                return false;
+            }
+            if (run >= warmupRuns) {
+                samples.Add(*result, roundTripMs);
+            }
+        }
+        return true;
+    }
+
+    void TestScriptedStages() {
+        Stages stages = {4.0, 2.0, 8.0, 1.5, 6.0};
+        StandIn standIn(stages);
+        Benchmark::Samples samples;
+        CHECK(Run(standIn.GetSession(), 20, 3, samples));
+        CHECK(standIn.GetWarmupRuns() == 3);
+        CHECK(samples.Get(Benchmark::kRoundTrip).size() == 20);
+
+        // Every stage takes at least its scripted time, and the round trip contains the stages
+        const double scripted[] = {stages.stt, stages.llmFirstToken, stages.llm, stages.ttsFirstAudio, stages.tts};
+        for (std::size_t run = 0; run < 20; ++run) {
+            for (std::size_t stage = 0; stage < Benchmark::kStageCount; ++stage) {
+                CHECK(samples.Get(stage)[run] >= scripted[stage]);
+            }
+            double stagesMs = samples.Get(0)[run] + samples.Get(2)[run] + samples.Get(4)[run];
+            double roundTripMs = samples.Get(Benchmark::kRoundTrip)[run];
+            CHECK(roundTripMs >= stagesMs);
+            CHECK(samples.Get(Benchmark::kOverhead)[run] == roundTripMs - stagesMs);
+        }
+        for (std::size_t column = 0; column < Benchmark::kColumns.size(); ++column) {
+            Test::Report(Benchmark::kColumns[column], samples.Get(column));
+        }
+    }
+
+    void TestFailures() {
+        StandIn standIn({});
+        Benchmark::Session& session = standIn.GetSession();
+        double roundTripMs = 0.0;
+
+        // Mantella's error comes back as the result
+        Benchmark::Script noPrompt = kScript;
+        noPrompt.prompt.clear();
+        std::optional<Benchmark::Result> failed =
+            session.RunOnce(noPrompt, false, std::chrono::seconds(5), roundTripMs);
+        CHECK(failed && failed->error == "no prompt");
+
+        // A run that times out gives nothing, and its answer arriving during the next run isn't taken for that one
+        Benchmark::Script late = kScript;
+        late.voice = kLateVoice;
+        CHECK(!session.RunOnce(late, false, std::chrono::milliseconds(20), roundTripMs).has_value());
+        CHECK(roundTripMs >= 20.0);
+        std::optional<Benchmark::Result> next = session.RunOnce(kScript, false, std::chrono::seconds(5), roundTripMs);
+        CHECK(next && next->error.empty() && next->stageMs[0] != kLateSttMs);
+    }
+
+    // With instant stages the round trip is what the plugin adds: JSON both ways, the socket and waking up
+    void TimeInstantStages() {
+        StandIn standIn({});
+        Benchmark::Samples samples;
+        CHECK(Run(standIn.GetSession(), 2000, 50, samples));
+        std::vector<double> roundTripUs;
+        for (double ms : samples.Get(Benchmark::kRoundTrip)) {
+            roundTripUs.push_back(ms * 1000.0);
+        }
+        Test::Report("round trip, instant stages", std::move(roundTripUs), "us");
+    }
+}
+
+int main() {
+    std::printf("Conversation benchmark against a stand-in Mantella\n");
+    TestScriptedStages();
+    TestFailures();
+    TimeInstantStages();
+    return Test::Finish("conversation_benchmark");
+}
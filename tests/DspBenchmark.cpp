@@ -0,0 +1,141 @@
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "AudioDSP.h"
+#include "Test.h"
+
+// The DSP kernels at every level this CPU supports: bit-exact against the scalar versions on random
+// sizes and offsets, then timed on the buffer sizes the capture, playback and lip-sync paths use.
+
+namespace {
+    using AudioDSP::Level;
+
+    constexpr std::size_t kSizes[] = {160, 480, 960, 4096};  // 10 ms at 16 kHz, 10 and 20 ms at 48 kHz, a block
+    constexpr int kBatches = 200;
+
+    std::vector<float> MakeSignal(std::size_t count, std::uint32_t seed) {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> sample(-1.2f, 1.2f);  // some samples clip in the int16 conversion
+        std::vector<float> signal(count);
+        for (float& value : signal) {
+            value = sample(random);
+        }
+        return signal;
+    }
+
+    bool SameBits(const float* a, const float* b, std::size_t count) {
+        return std::memcmp(a, b, count * sizeof(float)) == 0;
+    }
+
+    void CheckExact(Level level) {
+        AudioDSP::SetLevel(level);
+        CHECK(AudioDSP::GetLevel() == level);
+        CHECK(AudioDSP::VerifyKernels());
+
+        std::mt19937 random(static_cast<std::uint32_t>(level) + 1);
+        std::vector<float> signal = MakeSignal(8192, 7);
+        std::vector<float> other = MakeSignal(8192, 8);
+        for (int round = 0; round < 500; ++round) {
+            std::size_t size = random() % 1500;
+            const float* a = signal.data() + random() % 64;
+            const float* b = other.data() + random() % 64;
+
+            float expected = AudioDSP::Scalar::DotProduct(a, b, size);
+            float actual = AudioDSP::DotProduct(a, b, size);
+            CHECK(SameBits(&expected, &actual, 1));
+            expected = AudioDSP::Scalar::Peak(a, size);
+            actual = AudioDSP::Peak(a, size);
+            CHECK(SameBits(&expected, &actual, 1));
+            CHECK(AudioDSP::Scalar::CountZeroCrossings(a, size) == AudioDSP::CountZeroCrossings(a, size));
+
+            std::size_t blockSize = 1 + random() % 300;
+            std::vector<float> envelope((size + blockSize - 1) / blockSize);
+            AudioDSP::PeakEnvelope(a, size, blockSize, envelope.data());
+            for (std::size_t block = 0; block < envelope.size(); ++block) {
+                std::size_t offset = block * blockSize;
+                float peak = AudioDSP::Scalar::Peak(a + offset, std::min(blockSize, size - offset));
+                CHECK(SameBits(&peak, &envelope[block], 1));
+            }
+
+            std::vector<float> scalar(a, a + size);
+            std::vector<float> vector(a, a + size);
+            float scalarPeak = AudioDSP::Scalar::Peak(scalar.data(), size);
+            float gain = scalarPeak > 0.0f ? std::min(0.9f / scalarPeak, 4.0f) : 1.0f;
+            AudioDSP::Scalar::ApplyGain(scalar.data(), size, gain);
+            CHECK(AudioDSP::Normalize(vector.data(), size, 0.9f, 4.0f) == gain);
+            CHECK(SameBits(scalar.data(), vector.data(), size));
+
+            std::vector<std::int16_t> scalarPcm(size);
+            std::vector<std::int16_t> vectorPcm(size);
+            AudioDSP::Scalar::FloatToInt16(a, scalarPcm.data(), size);
+            AudioDSP::FloatToInt16(a, vectorPcm.data(), size);
+            CHECK(scalarPcm == vectorPcm);
+            AudioDSP::Scalar::Int16ToFloat(scalarPcm.data(), scalar.data(), size);
+            AudioDSP::Int16ToFloat(scalarPcm.data(), vector.data(), size);
+            CHECK(SameBits(scalar.data(), vector.data(), size));
+
+            AudioDSP::Scalar::DownmixToMono(a, size / 2, 2, scalar.data());
+            AudioDSP::DownmixToMono(a, size / 2, 2, vector.data());
+            CHECK(SameBits(scalar.data(), vector.data(), size / 2));
+        }
+    }
+
+    // Nanoseconds per sample of every batch of calls, so the percentiles show the noise between batches
+    template <class Function>
+    void Time(const std::string& name, std::size_t size, Function&& function) {
+        int calls = static_cast<int>(std::max<std::size_t>(65536 / size, 1));
+        std::vector<double> nsPerSample;
+        for (int batch = 0; batch < kBatches; ++batch) {
+            Test::Clock::time_point start = Test::Clock::now();
+            for (int call = 0; call < calls; ++call) {
+                function();
+            }
+            nsPerSample.push_back(Test::ElapsedMs(start) * 1e6 / (static_cast<double>(calls) * size));
+        }
+        Test::Report(name + " " + std::to_string(size), std::move(nsPerSample), "ns/sample");
+    }
+
+    void TimeKernels(Level level) {
+        AudioDSP::SetLevel(level);
+        std::printf("%s\n", AudioDSP::GetLevelName(level));
+
+        std::vector<float> signal = MakeSignal(2 * 4096, 9);
+        std::vector<float> output(2 * 4096);
+        std::vector<std::int16_t> pcm(4096);
+        volatile float sink = 0.0f;
+        for (std::size_t size : kSizes) {
+            Time("downmix_stereo", size, [&] { AudioDSP::DownmixToMono(signal.data(), size, 2, output.data()); });
+            Time("mean_square", size, [&] { sink = AudioDSP::MeanSquare(signal.data(), size); });
+            Time("peak", size, [&] { sink = AudioDSP::Peak(signal.data(), size); });
+            Time("peak_envelope", size, [&] { AudioDSP::PeakEnvelope(signal.data(), size, 80, output.data()); });
+            Time("zero_crossings", size,
+                 [&] { sink = static_cast<float>(AudioDSP::CountZeroCrossings(signal.data(), size)); });
+            Time("normalize", size, [&] {
+                std::memcpy(output.data(), signal.data(), size * sizeof(float));
+                sink = AudioDSP::Normalize(output.data(), size, 0.9f, 4.0f);
+            });
+            Time("float_to_int16", size, [&] { AudioDSP::FloatToInt16(signal.data(), pcm.data(), size); });
+            Time("int16_to_float", size, [&] { AudioDSP::Int16ToFloat(pcm.data(), output.data(), size); });
+        }
+
+        AudioDSP::Resampler resampler;
+        resampler.Configure(48000, 16000);
+        std::vector<float> resampled;
+        Time("resample_48k_to_16k", 480, [&] {
+            resampled.clear();
+            resampler.Process(signal.data(), 480, resampled);
+        });
+    }
+}
+
+int main() {
+    Level highest = AudioDSP::DetectLevel();
+    for (int level = 0; level <= static_cast<int>(highest); ++level) {
+        CheckExact(static_cast<Level>(level));
+    }
+    for (int level = 0; level <= static_cast<int>(highest); ++level) {
+        TimeKernels(static_cast<Level>(level));
+    }
+    return Test::Finish("dsp_benchmark");
+}
@@ -0,0 +1,187 @@
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "GameEvents.h"
+#include "Json.h"
+#include "Test.h"
+
+// Synthetic streams of game events through the record queue and the per-turn summary: what capturing an
+// event costs the thread that sent it, alone and with other threads sending at the same time, and what
+// merging and writing a turn's worth of events costs the channel thread.
+
+namespace {
+    using GameEvents::Kind;
+    using GameEvents::Record;
+    using GameEvents::RecordQueue;
+
+    struct NamedForm {
+        std::uint32_t id;
+        const char* name;
+    };
+
+    constexpr NamedForm kActors[] = {
+        {0x14, "Prisoner"}, {0xA2C94, "Lydia"}, {0x1D4B5, "Bandit Marauder"}, {0x1D4B6, "Bandit Outlaw"},
+        {0x1D4B7, "Bandit Chief"}};
+    constexpr NamedForm kObjects[] = {
+        {0x12EB7, "Iron Sword"}, {0x1359D, "Steel Battleaxe"}, {0x12FD0, "Flames"}, {0x211EE, "Healing"},
+        {0xF, "Gold"}, {0x3EADE, "Potion of Minor Healing"}};
+    constexpr NamedForm kLocations[] = {{0x13163, "Embershard Mine"}, {0x13168, "Riverwood"}};
+
+    // A fight: mostly hits and spells between the same few actors, some loot, now and then a new location
+    Record MakeEvent(std::uint32_t n) {
+        Record record = {Kind::kHit, 1, {}, {}, {}};
+        const NamedForm& a = kActors[n % 3 == 0 ? 0 : n % 5];
+        const NamedForm& b = kActors[(n / 3) % 5];
+        const NamedForm& object = kObjects[n % 4];
+        switch (n % 10) {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+                record.kind = Kind::kHit;
+                break;
+            case 5:
+            case 6:
+                record.kind = Kind::kSpellCast;
+                break;
+            case 7:
+            case 8:
+                record.kind = n % 20 < 10 ? Kind::kItemAdded : Kind::kItemRemoved;
+                record.amount = static_cast<std::int32_t>(n % 7 + 1);
+                record.object.Set(kObjects[4 + n % 2].id, kObjects[4 + n % 2].name);
+                record.source.Set(b.id, b.name);
+                record.target.Set(a.id, a.name);
+                return record;
+            default:
+                record.kind = Kind::kLocationChange;
+                record.source.Set(a.id, a.name);
+                record.target.Set(kLocations[n % 2].id, kLocations[n % 2].name);
+                record.object.Set(kLocations[(n + 1) % 2].id, kLocations[(n + 1) % 2].name);
+                return record;
+        }
+        record.source.Set(a.id, a.name);
+        if (record.kind == Kind::kHit) {
+            record.target.Set(b.id, b.name);
+        }
+        record.object.Set(object.id, object.name);
+        return record;
+    }
+
+    void CheckForms() {
+        GameEvents::Form form;
+        form.Set(7, "The Ebony Warrior of the Long Forgotten Dragon Cult Shrine");
+        CHECK(form.id == 7 && std::strlen(form.name.data()) == form.name.size() - 1);
+        form.Set(8, nullptr);
+        CHECK(form.id == 8 && form.name[0] == '\0');
+    }
+
+    // One turn with events pushed from several threads: every event ends up in exactly one summary entry
+    void CheckTurn() {
+        static RecordQueue queue;
+        constexpr std::uint32_t kThreads = 4;
+        constexpr std::uint32_t kPerThread = 200;
+        std::vector<std::thread> threads;
+        for (std::uint32_t t = 0; t < kThreads; ++t) {
+            threads.emplace_back([t] {
+                for (std::uint32_t i = 0; i < kPerThread; ++i) {
+                    CHECK(queue.Push(MakeEvent(t * kPerThread + i)));
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        Json::Writer json;
+        std::size_t merged = GameEvents::WriteSummary(queue, 3, json);
+        std::string text = json.Take();
+        Json::Value message = Json::Parse(text);
+        CHECK(message["type"].GetString() == "events" && message["dropped"].GetUInt() == 3);
+        std::uint64_t events = 0;
+        std::size_t entries = 0;
+        bool named = true;
+        message["events"].ForEachElement([&](Json::Value event) {
+            events += event["count"].GetUInt();
+            named = named && !event["source"]["name"].GetString().empty();
+            ++entries;
+        });
+        CHECK(events == kThreads * kPerThread);
+        CHECK(entries == merged && merged < kThreads * kPerThread / 4);
+        CHECK(named);
+        std::printf("a turn of %u events merged into %zu entries, %zu bytes\n", kThreads * kPerThread, merged,
+                    text.size());
+
+        Record record;
+        CHECK(!queue.Pop(record));
+    }
+
+    void CheckOverflow() {
+        static RecordQueue queue;
+        std::size_t pushed = 0;
+        for (std::uint32_t i = 0; i < GameEvents::kQueueCapacity + 100; ++i) {
+            pushed += queue.Push(MakeEvent(i));
+        }
+        CHECK(pushed == GameEvents::kQueueCapacity);
+        Json::Writer json;
+        GameEvents::WriteSummary(queue, 100, json);
+        CHECK(queue.Push(MakeEvent(0)));
+    }
+
+    // Capture cost per event with the given number of threads pushing, while a consumer drains every turn
+    void TimeCapture(std::uint32_t threadCount) {
+        static RecordQueue queue;
+        constexpr int kTurns = 200;
+        constexpr std::uint32_t kEventsPerTurn = 512;
+        std::vector<double> nsPerEvent;
+        std::vector<double> summaryMs;
+        std::size_t dropped = 0;
+        for (int turn = 0; turn < kTurns; ++turn) {
+            std::vector<std::thread> threads;
+            std::vector<std::size_t> drops(threadCount);
+            std::vector<double> elapsedMs(threadCount);
+            std::atomic<std::uint32_t> ready{0};
+            for (std::uint32_t t = 0; t < threadCount; ++t) {
+                threads.emplace_back([&, t] {
+                    // Start together, so the threads really contend for the queue
+                    ready.fetch_add(1);
+                    while (ready.load() < threadCount) {
+                    }
+                    Test::Clock::time_point start = Test::Clock::now();
+                    for (std::uint32_t i = t; i < kEventsPerTurn; i += threadCount) {
+                        // Naming the forms is part of the capture, as in the event sinks
+                        Record record = MakeEvent(static_cast<std::uint32_t>(turn) * kEventsPerTurn + i);
+                        drops[t] += !queue.Push(record);
+                    }
+                    elapsedMs[t] = Test::ElapsedMs(start);
+                });
+            }
+            for (std::uint32_t t = 0; t < threadCount; ++t) {
+                threads[t].join();
+                nsPerEvent.push_back(elapsedMs[t] * 1e6 * threadCount / kEventsPerTurn);
+                dropped += drops[t];
+            }
+
+            Test::Clock::time_point start = Test::Clock::now();
+            Json::Writer json;
+            GameEvents::WriteSummary(queue, 0, json);
+            summaryMs.push_back(Test::ElapsedMs(start));
+        }
+        CHECK(dropped == 0);
+        std::string name = std::to_string(threadCount) + (threadCount == 1 ? " thread" : " threads");
+        Test::Report("capture, " + name, std::move(nsPerEvent), "ns/event");
+        Test::Report("summary of 512 events, " + name, std::move(summaryMs));
+    }
+}
+
+int main() {
+    CheckForms();
+    CheckTurn();
+    CheckOverflow();
+    std::printf("record %zu bytes, queue %zu KiB\n", sizeof(Record), sizeof(RecordQueue) / 1024);
+    TimeCapture(1);
+    TimeCapture(4);
+    return Test::Finish("events_benchmark");
+}
@@ -0,0 +1,104 @@
+#include <cstring>
+#include <fstream>
+
+#include "Fuz.h"
+#include "Test.h"
+#include "Wav.h"
+
+// .fuz files muxed in memory by Fuz::BuildFromPcm, as VoicePlayback and VoiceCache do: the header and .lip data,
+// then a .wav header and the streamed PCM appended behind them. Checks that they split and parse back to the
+// same data, and times muxing a line in memory and writing it with one write.
+
+namespace {
+    std::vector<std::byte> Mux(std::span<const std::byte> lip, std::uint32_t sampleRate, std::uint16_t channels,
+                               std::span<const std::byte> pcm) {
+        std::vector<std::byte> fuz;
+        Fuz::BuildFromPcm(lip, sampleRate, channels, pcm, fuz);
+        return fuz;
+    }
+
+    std::vector<std::byte> MakeBytes(std::size_t size, std::uint8_t seed) {
+        std::vector<std::byte> bytes(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            bytes[i] = static_cast<std::byte>((i * 131 + seed) & 0xFF);
+        }
+        return bytes;
+    }
+
+    // WriteWholeFile needs Windows, the timing only covers its single write
+    bool WriteOnce(const std::filesystem::path& path, std::span<const std::byte> data) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(file);
+    }
+
+    void CheckRoundTrip(const std::filesystem::path& directory) {
+        std::vector<std::byte> lip = MakeBytes(1237, 3);  // odd sizes, nothing in the format is padded
+        std::vector<std::int16_t> samples(24000 * 2 + 1);
+        for (std::size_t i = 0; i < samples.size(); ++i) {
+            samples[i] = static_cast<std::int16_t>((i * 7919) % 65536 - 32768);
+        }
+        std::span<const std::byte> pcm = std::as_bytes(std::span(samples));
+        std::vector<std::byte> fuz = Mux(lip, 24000, 1, pcm);
+
+        std::span<const std::byte> lipOut;
+        std::span<const std::byte> audio;
+        CHECK(Fuz::Split(fuz, lipOut, audio));
+        CHECK(lipOut.size() == lip.size() && std::memcmp(lipOut.data(), lip.data(), lip.size()) == 0);
+        CHECK(audio.size() == Fuz::kWavHeaderSize + pcm.size());
+        CHECK(std::memcmp(audio.data() + Fuz::kWavHeaderSize, pcm.data(), pcm.size()) == 0);
+
+        // The .wav inside is a file of its own that a WAV reader accepts
+        std::filesystem::path wavPath = directory / "line.wav";
+        CHECK(WriteOnce(wavPath, audio));
+        Wav::Clip clip;
+        CHECK(Wav::Read(wavPath, clip));
+        CHECK(clip.sampleRate == 24000 && clip.channels == 1 && clip.samples.size() == samples.size());
+        for (std::size_t i = 0; i < std::min(samples.size(), clip.samples.size()); i += 997) {
+            CHECK(clip.samples[i] == samples[i] / 32768.0f);
+        }
+
+        // Lines without lip data, and streamed lines that had no audio yet
+        std::vector<std::byte> empty = Mux({}, 44100, 2, {});
+        CHECK(Fuz::Split(empty, lipOut, audio) && lipOut.empty() && audio.size() == Fuz::kWavHeaderSize);
+
+        // Malformed files
+        CHECK(!Fuz::Split(std::span(fuz).first(sizeof(Fuz::FuzHeader) - 1), lipOut, audio));
+        std::vector<std::byte> corrupt = fuz;
+        std::uint32_t lipSize = static_cast<std::uint32_t>(fuz.size());
+        std::memcpy(corrupt.data() + 8, &lipSize, sizeof(lipSize));
+        CHECK(!Fuz::Split(corrupt, lipOut, audio));
+        corrupt = fuz;
+        corrupt[0] = std::byte{'X'};
+        CHECK(!Fuz::Split(corrupt, lipOut, audio));
+    }
+}
+
+int main() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "mantella_fuz_test";
+    std::filesystem::create_directories(directory);
+    CheckRoundTrip(directory);
+
+    // Lines of a few lengths at the sample rate of typical voice models, with .lip data of a matching size
+    for (double seconds : {1.0, 4.0, 12.0}) {
+        auto pcm = MakeBytes(static_cast<std::size_t>(seconds * 24000) * 2, 1);
+        auto lip = MakeBytes(static_cast<std::size_t>(seconds * 900), 2);
+        std::vector<double> muxMs;
+        std::vector<double> writeMs;
+        for (int run = 0; run < 100; ++run) {
+            Test::Clock::time_point start = Test::Clock::now();
+            std::vector<std::byte> fuz = Mux(lip, 24000, 1, pcm);
+            muxMs.push_back(Test::ElapsedMs(start));
+            CHECK(WriteOnce(directory / "line.fuz", fuz));
+            writeMs.push_back(Test::ElapsedMs(start));
+        }
+        char name[64];
+        std::snprintf(name, sizeof(name), "%.0f s line, mux", seconds);
+        Test::Report(name, std::move(muxMs));
+        std::snprintf(name, sizeof(name), "%.0f s line, mux and write", seconds);
+        Test::Report(name, std::move(writeMs));
+    }
+
+    std::filesystem::remove_all(directory);
+    return Test::Finish("fuz_test");
+}
@@ -0,0 +1,207 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "Json.h"
+#include "Test.h"
+
+// Json::Writer and Json::Value on the messages the plugin exchanges with Mantella most often. Allocations
+// are counted to check the writer really stops allocating once its buffer has grown, and the writer is
+// compared with building the same message with a stringstream, which is what the launcher did before.
+
+namespace {
+    std::atomic<std::size_t> allocations{0};
+}
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+
+namespace {
+    constexpr int kBatches = 200;
+    constexpr int kCallsPerBatch = 200;
+
+    struct Npc {
+        std::uint32_t refId;
+        std::uint32_t baseId;
+        const char* voiceType;
+        const char* name;
+    };
+
+    // A busy tavern: what a prefetch message carries
+    constexpr Npc kNpcs[] = {
+        {0x0001A67C, 0x0001A67B, "FemaleEvenToned", "Hulda"},
+        {0x0001A681, 0x0001A680, "FemaleYoungEager", "Ysolda"},
+        {0x0001A688, 0x0001A687, "FemaleCommander", "Uthgerd the Unbroken"},
+        {0x0001A697, 0x0001A696, "MaleYoungEager", "Mikael"},
+        {0x00013B9B, 0x00013B97, "MaleCommoner", "Jon Battle-Born"},
+        {0x0001A6A0, 0x0001A69F, "FemaleSultry", "Saadia"},
+        {0x000A2C8E, 0x000A2C8D, "MaleGuard", "Whiterun Guard"},
+        {0x000A2C93, 0x000A2C8D, "MaleGuard", "Whiterun Guard"},
+        {0x0001B0A2, 0x0001B0A1, "FemaleNord", "Olfina Gray-Mane"},
+        {0x0001B0AA, 0x0001B0A9, "MaleOldGrumpy", "Brenuin"},
+        {0x0002BF9F, 0x0002BF9D, "MaleYoungEager", "Lars Battle-Born"},
+        {0x0001A6B1, 0x0001A6B0, "MaleCoward", "Sven"},
+    };
+
+    std::string WritePrefetch(Json::Writer& json) {
+        json.BeginObject().Field("type", "prefetch").Key("npcs").BeginArray();
+        for (const Npc& npc : kNpcs) {
+            json.BeginObject()
+                .Field("ref_id", npc.refId)
+                .Field("base_id", npc.baseId)
+                .Field("voice_type", npc.voiceType)
+                .Field("name", npc.name)
+                .EndObject();
+        }
+        json.EndArray().EndObject();
+        return json.Take();
+    }
+
+    std::string StreamPrefetch() {
+        std::stringstream ss;
+        ss << "{\"type\":\"prefetch\",\"npcs\":[";
+        bool first = true;
+        for (const Npc& npc : kNpcs) {
+            ss << (first ? "" : ",") << "{\"ref_id\":" << npc.refId << ",\"base_id\":" << npc.baseId
+               << ",\"voice_type\":\"" << npc.voiceType << "\",\"name\":\"" << npc.name << "\"}";
+            first = false;
+        }
+        ss << "]}";
+        return ss.str();
+    }
+
+    const std::string kVoiceLookup =
+        R"({"type":"voice_lookup","request_id":4211,"line_id":981,"speaker_ref_id":110205,"voice":"MaleNord",)"
+        R"("text":"Aye, the Companions have been around since Ysgramor's time. We take on jobs for coin, \"honor\" )"
+        R"(and glory.\nDon't let the talk in the streets fool you.","settings":{"temperature":0.7,"speed":1.05,)"
+        R"("model":"xtts_v2","speaker_wav":"C:\\Mantella\\voices\\malenord.wav"},"reply_id":77,"sentence":2})";
+
+    const std::string kBenchmarkResult =
+        R"({"type":"benchmark_result","run_id":12,"error":"","stt_ms":182.41,"llm_first_token_ms":402.9,)"
+        R"("llm_ms":1730.25,"tts_first_audio_ms":211.7,"tts_ms":1533.0})";
+
+    std::string MakeEvents() {
+        Json::Writer json;
+        json.BeginObject().Field("type", "events").Key("events").BeginArray();
+        for (int i = 0; i < 24; ++i) {
+            json.BeginObject()
+                .Field("kind", i % 3 == 0 ? "item_added" : (i % 3 == 1 ? "hit" : "spell_cast"))
+                .Field("source", "Player")
+                .Field("target", i % 2 ? "Bandit Marauder" : "Lydia")
+                .Field("object", i % 3 == 0 ? "Gold" : "Iron Sword")
+                .Field("count", static_cast<std::uint32_t>(i + 1))
+                .Field("amount", static_cast<std::int32_t>(i * 25))
+                .EndObject();
+        }
+        json.EndArray().EndObject();
+        return json.Take();
+    }
+
+    void CheckRoundTrip() {
+        Json::Writer json;
+        std::string text = WritePrefetch(json);
+        CHECK(text == StreamPrefetch());
+
+        Json::Value message = Json::Parse(text);
+        CHECK(message["type"].GetString() == "prefetch");
+        std::size_t count = 0;
+        message["npcs"].ForEachElement([&](Json::Value npc) {
+            CHECK(npc["ref_id"].GetUInt() == kNpcs[count].refId);
+            CHECK(npc["name"].GetString() == kNpcs[count].name);
+            ++count;
+        });
+        CHECK(count == std::size(kNpcs));
+
+        Json::Value lookup = Json::Parse(kVoiceLookup);
+        CHECK(lookup.IsValid());
+        CHECK(lookup["settings"]["speaker_wav"].GetString() == "C:\\Mantella\\voices\\malenord.wav");
+        CHECK(lookup["text"].GetString().find("\"honor\" and glory.\nDon't") != std::string::npos);
+        CHECK(lookup["sentence"].GetUInt() == 2);
+        CHECK(lookup["missing"].GetUInt(5) == 5);
+
+        std::string escaped =
+            json.BeginObject().Field("text", "tab\t quote\" snow \xE2\x9D\x84 \x01").EndObject().Take();
+        CHECK(Json::Parse(escaped)["text"].GetString() == "tab\t quote\" snow \xE2\x9D\x84 \x01");
+        CHECK(!Json::Parse(R"({"type":"events","events":[)").IsValid());
+    }
+
+    // Microseconds per call for every batch, and the allocations of the last batch
+    template <class Function>
+    std::size_t Time(const char* name, Function&& function) {
+        std::vector<double> us;
+        std::size_t allocated = 0;
+        for (int batch = 0; batch < kBatches; ++batch) {
+            std::size_t before = allocations.load(std::memory_order_relaxed);
+            Test::Clock::time_point start = Test::Clock::now();
+            for (int call = 0; call < kCallsPerBatch; ++call) {
+                function();
+            }
+            us.push_back(Test::ElapsedMs(start) * 1000.0 / kCallsPerBatch);
+            allocated = allocations.load(std::memory_order_relaxed) - before;
+        }
+        Test::Report(name, std::move(us), "us");
+        return allocated;
+    }
+}
+
+int main() {
+    CheckRoundTrip();
+
+    // The channel hands its buffers back, Reset keeps the capacity the same way
+    Json::Writer json;
+    std::string events = MakeEvents();
+    std::printf("payloads: prefetch %zu, voice_lookup %zu, events %zu, benchmark_result %zu bytes\n",
+                StreamPrefetch().size(), kVoiceLookup.size(), events.size(), kBenchmarkResult.size());
+    std::size_t writerAllocations = Time("write prefetch", [&] {
+        json.Reset();
+        json.BeginObject().Field("type", "prefetch").Key("npcs").BeginArray();
+        for (const Npc& npc : kNpcs) {
+            json.BeginObject()
+                .Field("ref_id", npc.refId)
+                .Field("base_id", npc.baseId)
+                .Field("voice_type", npc.voiceType)
+                .Field("name", npc.name)
+                .EndObject();
+        }
+        json.EndArray().EndObject();
+    });
+    CHECK(writerAllocations == 0);
+    Time("write prefetch, stringstream", [] { StreamPrefetch(); });
+
+    volatile std::uint64_t sink = 0;
+    std::size_t readerAllocations = Time("read voice_lookup fields", [&] {
+        Json::Value message = Json::Parse(kVoiceLookup);
+        sink = message["request_id"].GetUInt() + message["line_id"].GetUInt() + message["reply_id"].GetUInt() +
+               message["voice"].GetRawString().size() + message["text"].GetRawString().size() +
+               message["settings"].GetText().size();
+    });
+    CHECK(readerAllocations == 0);
+    Time("read benchmark_result", [&] {
+        Json::Value message = Json::Parse(kBenchmarkResult);
+        sink = static_cast<std::uint64_t>(message["stt_ms"].GetDouble() + message["llm_ms"].GetDouble() +
+                                          message["tts_ms"].GetDouble());
+    });
+    Time("iterate events", [&] {
+        std::uint64_t total = 0;
+        Json::Parse(events)["events"].ForEachElement([&](Json::Value event) {
+            total += event["count"].GetUInt() + event["kind"].GetRawString().size();
+        });
+        sink = total;
+    });
+    std::string text;
+    Time("unescape voice_lookup text", [&] {
+        Json::Unescape(Json::Parse(kVoiceLookup)["text"].GetRawString(), text);
+        sink = text.size();
+    });
+    return Test::Finish("json_benchmark");
+}
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "AudioDSP.h"
+#include "LipSync.h"
+#include "Test.h"
+#include "Wav.h"
+
+// Lip sync of whole lines: the streamed LipSync::Analyzer, as the plugin runs it while a line arrives,
+// against LipSync::Generate, which sees the whole line and spreads the text exactly over its voiced frames.
+// With a directory of recordings, "<name>.lab" holds the text of a line and an optional "<name>.lip.csv"
+// (one row of 16 phoneme weights per 1/30 s frame, e.g. exported from a FaceFX .lip) is the reference the
+// analyzer is compared with instead.
+
+namespace {
+    using LipSync::Frame;
+
+    constexpr double kChunkSeconds = 0.05;  // audio per ring record while a line streams
+
+    struct Line {
+        Wav::Clip clip;
+        std::string text;
+        std::vector<Frame> reference;
+    };
+
+    struct Comparison {
+        double meanError = 0.0;    // mean absolute weight difference per phoneme target
+        double agreement = 0.0;    // frames where both open the mouth and agree on the strongest target
+        double correlation = 0.0;  // of the mouth opening, the sum of the weights
+    };
+
+    std::vector<std::int16_t> ToPcm(const std::vector<float>& samples) {
+        std::vector<std::int16_t> pcm(samples.size());
+        AudioDSP::FloatToInt16(samples.data(), pcm.data(), samples.size());
+        return pcm;
+    }
+
+    float Opening(const Frame& frame) {
+        float sum = 0.0f;
+        for (float weight : frame) {
+            sum += weight;
+        }
+        return sum;
+    }
+
+    std::size_t Strongest(const Frame& frame) {
+        return static_cast<std::size_t>(std::max_element(frame.begin(), frame.end()) - frame.begin());
+    }
+
+    Comparison Compare(const std::vector<Frame>& actual, const std::vector<Frame>& expected) {
+        Comparison comparison;
+        std::size_t count = std::min(actual.size(), expected.size());
+        if (count == 0) {
+            return comparison;
+        }
+
+        std::size_t open = 0;
+        std::size_t agreed = 0;
+        double sumA = 0.0, sumB = 0.0, sumAA = 0.0, sumBB = 0.0, sumAB = 0.0;
+        for (std::size_t i = 0; i < count; ++i) {
+            for (std::size_t phoneme = 0; phoneme < LipSync::kPhonemeCount; ++phoneme) {
+                comparison.meanError += std::abs(actual[i][phoneme] - expected[i][phoneme]);
+            }
+            double a = Opening(actual[i]);
+            double b = Opening(expected[i]);
+            if (a > 0.1 && b > 0.1) {
+                ++open;
+                agreed += Strongest(actual[i]) == Strongest(expected[i]);
+            }
+            sumA += a;
+            sumB += b;
+            sumAA += a * a;
+            sumBB += b * b;
+            sumAB += a * b;
+        }
+        comparison.meanError /= static_cast<double>(count * LipSync::kPhonemeCount);
+        comparison.agreement = open > 0 ? static_cast<double>(agreed) / static_cast<double>(open) : 0.0;
+        double n = static_cast<double>(count);
+        double variance = (sumAA - sumA * sumA / n) * (sumBB - sumB * sumB / n);
+        comparison.correlation = variance > 0.0 ? (sumAB - sumA * sumB / n) / std::sqrt(variance) : 0.0;
+        return comparison;
+    }
+
+    std::vector<Line> LoadLines(int argc, char** argv) {
+        std::vector<Line> lines;
+        if (argc > 1) {
+            for (Wav::Clip& clip : Wav::LoadCorpus(argc, argv)) {
+                std::filesystem::path path = std::filesystem::path(argv[1]) / clip.name;
+                std::ifstream textFile(std::filesystem::path(path).replace_extension(".lab"));
+                Line line;
+                std::getline(textFile, line.text, '\0');
+
+                std::ifstream reference(std::filesystem::path(path).replace_extension(".lip.csv"));
+                std::string row;
+                while (std::getline(reference, row)) {
+                    std::replace(row.begin(), row.end(), ',', ' ');
+                    std::istringstream values(row);
+                    Frame frame = {};
+                    for (float& weight : frame) {
+                        values >> weight;
+                    }
+                    if (values) {
+                        line.reference.push_back(frame);
+                    }
+                }
+                line.clip = std::move(clip);
+                lines.push_back(std::move(line));
+            }
+            return lines;
+        }
+
+        // Words and the pauses between them roughly where a voice model would put them
+        lines.push_back({Wav::Synthesize("companions_24k", 24000, 1, 4.2, {{0.2, 1.5}, {1.8, 3.9}}, 0.0005f, 11),
+                         "Aye, the Companions have been around since Ysgramor's time. We take on jobs for coin.",
+                         {}});
+        lines.push_back({Wav::Synthesize("greeting_22k_stereo", 22050, 2, 1.6, {{0.1, 0.5}, {0.7, 1.4}}, 0.0005f, 12),
+                         "Greetings, traveler.", {}});
+        lines.push_back({Wav::Synthesize("dragon_44k", 44100, 1, 3.0, {{0.15, 2.8}}, 0.002f, 13),
+                         "Is it true that a dragon was seen near the Western Watchtower?", {}});
+        return lines;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<double> streamMsPerSecond;
+    std::vector<double> generateMsPerSecond;
+    std::vector<double> chunkMs;
+    for (const Line& line : LoadLines(argc, argv)) {
+        const Wav::Clip& clip = line.clip;
+        std::vector<std::int16_t> pcm = ToPcm(clip.samples);
+        auto channels = static_cast<std::uint16_t>(clip.channels);
+
+        LipSync::Analyzer analyzer;
+        Test::Clock::time_point start = Test::Clock::now();
+        analyzer.Begin(clip.sampleRate, channels);
+        analyzer.SetText(line.text);
+        auto chunkFrames = static_cast<std::size_t>(kChunkSeconds * clip.sampleRate);
+        for (std::size_t offset = 0; offset < clip.GetFrames(); offset += chunkFrames) {
+            Test::Clock::time_point chunkStart = Test::Clock::now();
+            analyzer.Feed(pcm.data() + offset * channels, std::min(chunkFrames, clip.GetFrames() - offset));
+            chunkMs.push_back(Test::ElapsedMs(chunkStart));
+        }
+        streamMsPerSecond.push_back(Test::ElapsedMs(start) / clip.GetSeconds());
+        std::vector<Frame> streamed = analyzer.GetAnimation()->frames;
+
+        start = Test::Clock::now();
+        std::vector<Frame> generated =
+            LipSync::Generate(line.text, pcm.data(), clip.GetFrames(), clip.sampleRate, channels);
+        generateMsPerSecond.push_back(Test::ElapsedMs(start) / clip.GetSeconds());
+
+        auto frameSamples = static_cast<std::size_t>(static_cast<float>(clip.sampleRate) / LipSync::kFramesPerSecond);
+        CHECK(generated.size() == clip.GetFrames() / frameSamples);
+        CHECK(streamed.size() == generated.size());
+
+        const std::vector<Frame>& reference = line.reference.empty() ? generated : line.reference;
+        Comparison comparison = Compare(streamed, reference);
+        std::printf("%s: %zu frames against %s, mean error %.3f, strongest target agrees %.0f%%, opening r %.3f\n",
+                    clip.name.c_str(), streamed.size(), line.reference.empty() ? "Generate" : "the reference",
+                    comparison.meanError, comparison.agreement * 100.0, comparison.correlation);
+        if (line.reference.empty()) {
+            // The loudness drives both the same way, only the pacing of the text differs
+            CHECK(comparison.correlation > 0.8);
+        }
+
+        // The mouth stays closed until the first word
+        if (!clip.speech.empty()) {
+            auto silentFrames = static_cast<std::size_t>(clip.speech.front().first * LipSync::kFramesPerSecond);
+            for (std::size_t i = 0; i < std::min(silentFrames, streamed.size()); ++i) {
+                CHECK(Opening(streamed[i]) == 0.0f && Opening(generated[i]) == 0.0f);
+            }
+        }
+    }
+
+    Test::Report("stream, per 50 ms chunk", std::move(chunkMs));
+    Test::Report("stream, per second of audio", std::move(streamMsPerSecond));
+    Test::Report("generate, per second of audio", std::move(generateMsPerSecond));
+    return Test::Finish("lipsync_test");
+}
@@ -0,0 +1,95 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "PapyrusStrings.h"
+#include "Test.h"
+
+// PapyrusStrings::Find against std::string_view::find: random text over a small alphabet, so candidates that
+// share the first and last byte but differ in between are common, searched for needles of 1, 2 and 3 bytes
+// and longer than the 16 bytes one compare covers, taken from anywhere in the text including its very end,
+// from every start position up to past the end. Then both are timed on a reply-sized text.
+
+namespace {
+    std::string MakeText(std::mt19937& random, std::size_t size, char alphabet) {
+        std::string text(size, ' ');
+        for (char& c : text) {
+            c = static_cast<char>('a' + random() % static_cast<unsigned>(alphabet));
+        }
+        return text;
+    }
+
+    void TestAgainstFind() {
+        std::mt19937 random(3);
+        int wrong = 0;
+        int searches = 0;
+        for (int round = 0; round < 300; ++round) {
+            std::string text = MakeText(random, 1 + random() % 200, round % 2 ? 3 : 2);
+            std::string_view view = text;
+            for (std::size_t length : {1, 2, 3, 15, 16, 17, 31, 33, 64}) {
+                std::string needles[] = {
+                    MakeText(random, length, 2),
+                    // Right at the end, and somewhere in the text
+                    length <= text.size() ? text.substr(text.size() - length) : std::string(length, 'a'),
+                    length <= text.size() ? text.substr(random() % (text.size() - length + 1), length)
+                                          : std::string(length, 'b'),
+                };
+                for (const std::string& needle : needles) {
+                    for (std::size_t from = 0; from <= text.size() + 2; ++from) {
+                        wrong += PapyrusStrings::Find(view, needle, from) != view.find(needle, from);
+                        ++searches;
+                    }
+                }
+            }
+        }
+        CHECK(wrong == 0);
+
+        // A match that ends on the last byte, found from just before it and not from one past its start
+        std::string text(40, 'x');
+        text += "needle";
+        CHECK(PapyrusStrings::Find(text, "needle", 39) == 40);
+        CHECK(PapyrusStrings::Find(text, "needle", 40) == 40);
+        CHECK(PapyrusStrings::Find(text, "needle", 41) == std::string_view::npos);
+        CHECK(PapyrusStrings::Find(text, "", text.size()) == text.size());
+        CHECK(PapyrusStrings::Find(text, "", text.size() + 1) == std::string_view::npos);
+        CHECK(PapyrusStrings::Find("", "a") == std::string_view::npos);
+        std::printf("  %d searches compared\n", searches);
+    }
+
+    void TimeFind() {
+        // A long reply split at its sentence ends, what SplitString does
+        std::mt19937 random(7);
+        std::string reply;
+        while (reply.size() < 4000) {
+            reply += MakeText(random, 20 + random() % 120, 26);
+            reply += ". ";
+        }
+        std::vector<double> findUs;
+        std::vector<double> referenceUs;
+        std::size_t parts = 0;
+        for (int run = 0; run < 2000; ++run) {
+            Test::Clock::time_point start = Test::Clock::now();
+            for (std::size_t at = 0; (at = PapyrusStrings::Find(reply, ". ", at)) != std::string_view::npos; at += 2) {
+                ++parts;
+            }
+            findUs.push_back(Test::ElapsedMs(start) * 1000.0);
+
+            start = Test::Clock::now();
+            std::string_view view = reply;
+            for (std::size_t at = 0; (at = view.find(". ", at)) != std::string_view::npos; at += 2) {
+                --parts;
+            }
+            referenceUs.push_back(Test::ElapsedMs(start) * 1000.0);
+        }
+        CHECK(parts == 0);
+        Test::Report("split a 4 KB reply", std::move(findUs), "us");
+        Test::Report("same with std::string_view::find", std::move(referenceUs), "us");
+    }
+}
+
+int main() {
+    std::printf("Substring search of the string natives\n");
+    TestAgainstFind();
+    TimeFind();
+    return Test::Finish("papyrus_strings_test");
+}
@@ -0,0 +1,117 @@
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+#include "Remote.h"
+#include "Test.h"
+
+// A loopback listener stands in for the remote Mantella. Times the connect probe against it, checks that a
+// closed port fails fast instead of waiting for the timeout, and runs the failover policy on live probes.
+
+namespace {
+    // Shorter than the 1 s SYN retransmit: a loopback connect now and then loses its SYN on a busy host, and
+    // such a probe should fail rather than stall the test
+    constexpr auto kTimeout = std::chrono::milliseconds(200);
+
+    class StandInServer {
+    public:
+        StandInServer() {
+            _socket = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            bind(_socket, reinterpret_cast<sockaddr*>(&address), length);
+            listen(_socket, 64);
+            getsockname(_socket, reinterpret_cast<sockaddr*>(&address), &length);
+            _port = std::to_string(ntohs(address.sin_port));
+            // Connections are accepted and closed right away, the probe only times the handshake
+            _thread = std::thread([this] {
+                for (;;) {
+                    int client = accept(_socket, nullptr, nullptr);
+                    if (client < 0) {
+                        return;
+                    }
+                    close(client);
+                }
+            });
+        }
+
+        ~StandInServer() { Stop(); }
+
+        void Stop() {
+            if (_socket < 0) {
+                return;
+            }
+            shutdown(_socket, SHUT_RDWR);
+            close(_socket);
+            _thread.join();
+            _socket = -1;
+        }
+
+        const std::string& GetPort() const { return _port; }
+
+    private:
+        int _socket = -1;
+        std::string _port;
+        std::thread _thread;
+    };
+
+    void TestProbe() {
+        StandInServer server;
+        std::vector<double> rtts;
+        for (int i = 0; i < 500; ++i) {
+            if (std::optional<double> rtt = Remote::Probe("127.0.0.1", server.GetPort(), kTimeout)) {
+                rtts.push_back(*rtt);
+            }
+        }
+        std::printf("  %zu of 500 probes lost\n", 500 - rtts.size());
+        CHECK(rtts.size() >= 490);
+        Test::Report("probe loopback", std::move(rtts));
+
+        // A refused connect must not count as an answer or wait for the timeout
+        std::string port = server.GetPort();
+        server.Stop();
+        Test::Clock::time_point start = Test::Clock::now();
+        CHECK(!Remote::Probe("127.0.0.1", port, kTimeout).has_value());
+        CHECK(Test::ElapsedMs(start) < 500.0);
+    }
+
+    void TestFailover() {
+        StandInServer server;
+        Remote::LatencyMonitor monitor(150.0, 3, 5);
+        for (int i = 0; i < 10; ++i) {
+            monitor.AddSample(Remote::Probe("127.0.0.1", server.GetPort(), kTimeout));
+            CHECK(!monitor.ShouldFailOver());
+        }
+        CHECK(monitor.GetMedian().has_value());
+
+        // The remote goes away: two failures are tolerated, the third one fails over
+        std::string port = server.GetPort();
+        server.Stop();
+        for (int i = 1; i <= 3; ++i) {
+            monitor.AddSample(Remote::Probe("127.0.0.1", port, kTimeout));
+            CHECK(monitor.ShouldFailOver() == (i == 3));
+        }
+
+        // A remote that answers, but slower than the budget, fails over once the window is full
+        StandInServer slow;
+        Remote::LatencyMonitor strict(0.0, 3, 5);
+        std::size_t answered = 0;
+        while (answered < 5) {
+            std::optional<double> rtt = Remote::Probe("127.0.0.1", slow.GetPort(), kTimeout);
+            answered += rtt.has_value();
+            strict.AddSample(rtt);
+            CHECK(strict.ShouldFailOver() == (answered == 5));
+        }
+    }
+}
+
+int main() {
+    std::printf("Remote probe against a stand-in server\n");
+    TestProbe();
+    TestFailover();
+    return Test::Finish("remote_test");
+}
@@ -0,0 +1,433 @@
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "Channel.h"
+#include "GameEvents.h"
+#include "Json.h"
+#include "Recorder.h"
+#include "SharedRing.h"
+#include "Test.h"
+#include "VoicePlayback.h"
+
+// A synthetic recording replayed by Recorder::Replay into a stand-in for the plugin: its channel on a local
+// socket, read on its own thread that dispatches every message to Channel::Handlers and acknowledges it once
+// the handler returned, the way Channel::Inject's future does, and a voice ring whose records a reader thread
+// puts back together into lines. The handlers track the actors Mantella names and answer each turn with
+// GameEvents::WriteSummary. Checks that exactly what Mantella sent arrives, in order and intact, and that a
+// truncated recording replays up to the cut. Times the dispatch round trip, how far behind schedule the replay
+// falls, and a replay as fast as possible.
+
+namespace {
+    using VoicePlayback::LineBegin;
+
+    constexpr std::uint16_t kVoiceStream = 1;    // a ring the stand-in has
+    constexpr std::uint16_t kUnknownStream = 2;  // a ring it doesn't, its records are skipped
+    constexpr std::uint32_t kRingCapacity = 1 << 14;
+    constexpr std::uint64_t kSessionUs = 300000;
+    constexpr std::uint32_t kEventsPerActor = 3;  // hits on an actor between two turns
+
+    struct alignas(64) Block {
+        std::byte bytes[64];
+    };
+
+    // A message as a handler saw it
+    struct Handled {
+        std::string type;
+        std::uint64_t turn;
+
+        bool operator==(const Handled&) const = default;
+    };
+
+    struct VoiceLine {
+        LineBegin info;
+        std::vector<std::byte> pcm;
+
+        bool operator==(const VoiceLine& other) const {
+            return std::memcmp(&info, &other.info, sizeof(info)) == 0 && pcm == other.pcm;
+        }
+    };
+
+    struct Session {
+        std::vector<std::byte> file;
+        std::vector<Handled> handled;  // channel messages from Mantella that have a handler, in order
+        std::size_t unhandled = 0;
+        std::vector<std::size_t> summaries;  // merged events in the answer to each turn
+        std::vector<VoiceLine> lines;        // lines on kVoiceStream, in order
+    };
+
+    void Append(Session& session, Recorder::Direction direction, std::uint16_t stream, std::uint64_t timeUs,
+                const void* data, std::size_t size, std::uint16_t kind = 0) {
+        Recorder::EventHeader header = {};
+        header.timeUs = timeUs;
+        header.size = static_cast<std::uint32_t>(size);
+        header.stream = stream;
+        header.kind = kind;
+        header.direction = direction;
+        std::size_t offset = session.file.size();
+        session.file.resize(offset + sizeof(header) + ((size + 7) & ~std::size_t{7}));
+        std::memcpy(session.file.data() + offset, &header, sizeof(header));
+        std::memcpy(session.file.data() + offset + sizeof(header), data, size);
+    }
+
+    // A voice record on both rings
+    void AppendVoice(Session& session, std::uint64_t timeUs, std::uint16_t kind, const std::vector<std::byte>& data) {
+        Append(session, Recorder::kReceived, kVoiceStream, timeUs, data.data(), data.size(), kind);
+        Append(session, Recorder::kReceived, kUnknownStream, timeUs + 20, data.data(), data.size(), kind);
+    }
+
+    template <class T>
+    std::vector<std::byte> Bytes(const T& value, std::span<const std::byte> tail = {}) {
+        std::vector<std::byte> bytes(sizeof(value) + tail.size());
+        std::memcpy(bytes.data(), &value, sizeof(value));
+        std::copy(tail.begin(), tail.end(), bytes.begin() + sizeof(value));
+        return bytes;
+    }
+
+    // What a conversation looks like on the wire: requests from the plugin, messages and audio from Mantella
+    Session MakeSession(std::uint32_t seed) {
+        Session session;
+        Recorder::FileHeader fileHeader = {Recorder::FileHeader::kMagic, Recorder::FileHeader::kVersion, 0};
+        session.file.resize(sizeof(fileHeader));
+        std::memcpy(session.file.data(), &fileHeader, sizeof(fileHeader));
+
+        std::string voiceName = "Local\\MantellaLauncher.Voice";
+        std::string unknownName = "Local\\MantellaLauncher.Gone";
+        Append(session, Recorder::kDefine, kVoiceStream, 0, voiceName.data(), voiceName.size());
+        Append(session, Recorder::kDefine, kUnknownStream, 0, unknownName.data(), unknownName.size());
+
+        std::mt19937 random(seed);
+        std::size_t actors = 0;
+        for (std::uint64_t i = 0; i < 400; ++i) {
+            std::uint64_t timeUs = 1000 + i * (kSessionUs - 1000) / 400;
+
+            std::string request = "{\"type\":\"prefetch\",\"turn\":" + std::to_string(i) + "}";
+            Append(session, Recorder::kSent, Recorder::kChannelStream, timeUs, request.data(), request.size());
+
+            // Mantella names the actors, some turns later asks what happened to them, and talks in between
+            Json::Writer json;
+            json.BeginObject();
+            switch (i % 4) {
+                case 0:
+                    actors = 1 + random() % 4;
+                    json.Field("type", "event_actors").Key("ref_ids").BeginArray();
+                    for (std::size_t actor = 0; actor < actors; ++actor) {
+                        json.UInt(0x1000 + i + actor);
+                    }
+                    json.EndArray();
+                    session.handled.push_back({"event_actors", i});
+                    break;
+                case 2:
+                    json.Field("type", "turn");
+                    session.handled.push_back({"turn", i});
+                    session.summaries.push_back(actors);
+                    break;
+                default:
+                    json.Field("type", "speaker_changed").Field("text", "Well met.");
+                    ++session.unhandled;
+                    break;
+            }
+            std::string message = json.Field("turn", i).EndObject().Take();
+            Append(session, Recorder::kReceived, Recorder::kChannelStream, timeUs + 50, message.data(),
+                   message.size());
+
+            // A line every other event, its audio in a few records of random size
+            if (i % 2 == 1) {
+                continue;
+            }
+            VoiceLine line = {{static_cast<std::uint32_t>(i), 22050, 1, 0, 0x1A2B}, {}};
+            AppendVoice(session, timeUs + 100, VoicePlayback::kLineBegin, Bytes(line.info));
+            for (std::uint32_t part = 1 + random() % 3; part > 0; --part) {
+                std::vector<std::byte> pcm(2 * (1 + random() % 2000));
+                for (std::byte& byte : pcm) {
+                    byte = static_cast<std::byte>(random());
+                }
+                AppendVoice(session, timeUs + 110, VoicePlayback::kLineAudio, Bytes(line.info.lineId, pcm));
+                line.pcm.insert(line.pcm.end(), pcm.begin(), pcm.end());
+            }
+            AppendVoice(session, timeUs + 150, VoicePlayback::kLineEnd, Bytes(line.info.lineId));
+            session.lines.push_back(std::move(line));
+        }
+        // The plugin has the last word, which the replay doesn't wait for
+        std::string bye = "{\"type\":\"shutdown\"}";
+        Append(session, Recorder::kSent, Recorder::kChannelStream, kSessionUs + 500000, bye.data(), bye.size());
+        return session;
+    }
+
+    // The plugin's side: handlers on one channel thread and a ring drained by a reader thread
+    class StandInPlugin {
+    public:
+        StandInPlugin() : _memory((RecordRing::GetRequiredSize(kRingCapacity) + sizeof(Block) - 1) / sizeof(Block)) {
+            _ring.Create(_memory.data(), kRingCapacity);
+            _handlers.Register("event_actors", [this](Json::Value message) { OnEventActors(message); });
+            _handlers.Register("turn", [this](Json::Value message) { OnTurn(message); });
+
+            int sockets[2];
+            socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+            _driver = sockets[0];
+            _channel = sockets[1];
+            _channelThread = std::thread([this] { Serve(); });
+            _ringThread = std::thread([this] { Drain(); });
+        }
+
+        ~StandInPlugin() {
+            shutdown(_driver, SHUT_RDWR);
+            shutdown(_channel, SHUT_RDWR);
+            _stop = true;
+            _channelThread.join();
+            _ringThread.join();
+            close(_driver);
+            close(_channel);
+        }
+
+        // Where the replay delivers to, as the plugin's channel and rings are in game
+        Recorder::ReplayTarget GetTarget() {
+            Recorder::ReplayTarget target;
+            target.dispatch = [this](std::string_view message) { return Inject(message); };
+            target.openRing = [](std::uint16_t, std::string_view name) {
+                return name == "Local\\MantellaLauncher.Voice";
+            };
+            target.writeRecord = [this](std::uint16_t, std::uint16_t kind, std::uint16_t flags,
+                                        std::span<const std::byte> payload) {
+                return _ring.Write(kind, flags, payload.data(), static_cast<std::uint32_t>(payload.size()));
+            };
+            return target;
+        }
+
+        // Wait until the reader thread took everything out of the ring
+        void WaitForRing() {
+            for (;;) {
+                {
+                    std::lock_guard guard(_lock);
+                    if (_ring.GetUsedBytes() == 0) {
+                        return;
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        std::vector<Handled> TakeHandled() {
+            std::lock_guard guard(_lock);
+            return std::move(_handled);
+        }
+
+        std::size_t GetUnhandled() const { return _unhandled; }
+        std::size_t GetFailedInjects() const { return _failedInjects; }
+
+        std::vector<std::size_t> TakeSummaries() {
+            std::lock_guard guard(_lock);
+            return std::move(_summaries);
+        }
+
+        std::vector<VoiceLine> TakeLines() {
+            std::lock_guard guard(_lock);
+            return std::move(_lines);
+        }
+
+    private:
+        // Send a message and wait until its handler ran. Returns the round trip in ms.
+        double Inject(std::string_view message) {
+            Test::Clock::time_point start = Test::Clock::now();
+            std::string line(message);
+            line += '\n';
+            char ack;
+            if (write(_driver, line.data(), line.size()) != static_cast<ssize_t>(line.size()) ||
+                read(_driver, &ack, 1) != 1) {
+                ++_failedInjects;
+            }
+            return Test::ElapsedMs(start);
+        }
+
+        void Serve() {
+            std::string inbox;
+            char buffer[4096];
+            ssize_t count;
+            while ((count = read(_channel, buffer, sizeof(buffer))) > 0) {
+                inbox.append(buffer, static_cast<std::size_t>(count));
+                std::size_t start = 0;
+                std::size_t end;
+                while ((end = inbox.find('\n', start)) != std::string::npos) {
+                    if (!_handlers.Dispatch(std::string_view(inbox).substr(start, end - start))) {
+                        ++_unhandled;
+                    }
+                    start = end + 1;
+                    if (write(_channel, "+", 1) != 1) {
+                        return;
+                    }
+                }
+                inbox.erase(0, start);
+            }
+        }
+
+        // The game's event sinks would record these for the actors Mantella tracks
+        void OnEventActors(Json::Value message) {
+            message["ref_ids"].ForEachElement([&](Json::Value refId) {
+                for (std::uint32_t hit = 0; hit < kEventsPerActor; ++hit) {
+                    GameEvents::Record record = {GameEvents::Kind::kHit, 1, {}, {}, {}};
+                    record.source.Set(0x14, "Prisoner");
+                    record.target.Set(static_cast<std::uint32_t>(refId.GetUInt()), "Bandit");
+                    record.object.Set(0x12EB7, "Iron Sword");
+                    _events.Push(record);
+                }
+            });
+            Keep(message, "event_actors");
+        }
+
+        void OnTurn(Json::Value message) {
+            Json::Writer json;
+            std::size_t merged = GameEvents::WriteSummary(_events, 0, json);
+            CHECK(Json::Parse(json.GetBuffer())["type"].GetRawString() == "events");
+            {
+                std::lock_guard guard(_lock);
+                _summaries.push_back(merged);
+            }
+            Keep(message, "turn");
+        }
+
+        void Keep(Json::Value message, std::string_view type) {
+            std::lock_guard guard(_lock);
+            _handled.push_back({std::string(type), message["turn"].GetUInt()});
+        }
+
+        // Lines put back together from their records, the way the playback thread reads the ring
+        void Drain() {
+            RecordHeader header;
+            std::vector<std::byte> payload;
+            std::map<std::uint32_t, VoiceLine> open;
+            while (!_stop) {
+                {
+                    // Read and kept in one go, so WaitForRing never sees a record that is in neither place
+                    std::lock_guard guard(_lock);
+                    if (_ring.Read(header, payload)) {
+                        Consume(header, payload, open);
+                        continue;
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        // Expects the lock to be held
+        void Consume(const RecordHeader& header, std::span<const std::byte> payload,
+                     std::map<std::uint32_t, VoiceLine>& open) {
+            std::uint32_t lineId;
+            if (header.kind == VoicePlayback::kLineBegin) {
+                VoiceLine line = {};
+                std::memcpy(&line.info, payload.data(), std::min(payload.size(), sizeof(line.info)));
+                open[line.info.lineId] = std::move(line);
+                return;
+            }
+            std::memcpy(&lineId, payload.data(), sizeof(lineId));
+            auto it = open.find(lineId);
+            if (it == open.end()) {
+                return;
+            }
+            if (header.kind == VoicePlayback::kLineAudio) {
+                it->second.pcm.insert(it->second.pcm.end(), payload.begin() + sizeof(lineId), payload.end());
+            } else if (header.kind == VoicePlayback::kLineEnd) {
+                _lines.push_back(std::move(it->second));
+                open.erase(it);
+            }
+        }
+
+        std::vector<Block> _memory;
+        RecordRing _ring;
+        Channel::Handlers _handlers;
+        GameEvents::RecordQueue _events;
+        int _driver = -1;
+        int _channel = -1;
+        std::atomic<bool> _stop{false};
+        std::atomic<std::size_t> _unhandled{0};
+        std::atomic<std::size_t> _failedInjects{0};
+        std::thread _channelThread;
+        std::thread _ringThread;
+
+        std::mutex _lock;
+        std::vector<Handled> _handled;
+        std::vector<std::size_t> _summaries;
+        std::vector<VoiceLine> _lines;
+    };
+
+    Recorder::ReplayStats Replay(std::span<const std::byte> file, float speed, StandInPlugin& plugin) {
+        Recorder::ReplayStats stats;
+        CHECK(Recorder::Replay(file, speed, plugin.GetTarget(), stats));
+        plugin.WaitForRing();
+        CHECK(plugin.GetFailedInjects() == 0);
+        return stats;
+    }
+
+    void CheckArrived(StandInPlugin& plugin, const Session& session) {
+        CHECK(plugin.TakeHandled() == session.handled);
+        CHECK(plugin.GetUnhandled() == session.unhandled);
+        std::vector<std::size_t> summaries = plugin.TakeSummaries();
+        CHECK(summaries.size() == session.summaries.size());
+        // Hits on the same actor are merged, one event per actor
+        CHECK(std::equal(summaries.begin(), summaries.end(), session.summaries.begin(), session.summaries.end()));
+        CHECK(plugin.TakeLines() == session.lines);
+    }
+
+    void TestReplay() {
+        Session session = MakeSession(5);
+        for (float speed : {1.0f, 4.0f}) {
+            StandInPlugin plugin;
+            Recorder::ReplayStats stats = Replay(session.file, speed, plugin);
+            CheckArrived(plugin, session);
+            // Never ahead of the recording
+            double scheduledMs = static_cast<double>(kSessionUs - 1000) / 1000.0 / speed;
+            CHECK(stats.totalMs >= scheduledMs * 0.99);
+
+            std::string label = " at speed " + std::to_string(static_cast<int>(speed));
+            std::printf("  %.1f ms for %.1f ms of recording%s, %zu ring records, %zu waits for a full ring\n",
+                        stats.totalMs, scheduledMs * speed, label.c_str(), stats.ringRecords, stats.ringStalls);
+            Test::Report("dispatch" + label, std::move(stats.dispatchMs));
+            Test::Report("behind schedule" + label, std::move(stats.lagMs));
+        }
+
+        StandInPlugin plugin;
+        Recorder::ReplayStats stats = Replay(session.file, 0.0f, plugin);
+        CheckArrived(plugin, session);
+        CHECK(stats.lagMs.empty());
+        std::printf("  %.1f ms as fast as possible, %zu waits for a full ring\n", stats.totalMs, stats.ringStalls);
+        Test::Report("dispatch as fast as possible", std::move(stats.dispatchMs));
+    }
+
+    void TestMalformed() {
+        Session session = MakeSession(9);
+        Recorder::ReplayStats stats;
+        Recorder::ReplayTarget target;
+        CHECK(!Recorder::Replay(std::span(session.file).first(sizeof(Recorder::FileHeader) - 1), 0.0f, target, stats));
+        std::vector<std::byte> wrongVersion = session.file;
+        wrongVersion[4] = std::byte{99};
+        CHECK(!Recorder::Replay(wrongVersion, 0.0f, target, stats));
+
+        // Cut in the middle of a message: everything before it is replayed, nothing after
+        std::size_t cut = session.file.size() / 2;
+        Recorder::Reader reader;
+        reader.Open(session.file);
+        Recorder::EventHeader header;
+        std::span<const std::byte> payload;
+        std::size_t complete = 0;
+        while (reader.Next(header, payload) && payload.data() + payload.size() <= session.file.data() + cut) {
+            complete += header.direction == Recorder::kReceived && header.stream == Recorder::kChannelStream;
+        }
+        StandInPlugin plugin;
+        Replay(std::span(session.file).first(cut), 0.0f, plugin);
+        std::vector<Handled> handled = plugin.TakeHandled();
+        CHECK(handled.size() + plugin.GetUnhandled() == complete);
+        CHECK(std::equal(handled.begin(), handled.end(), session.handled.begin()));
+    }
+}
+
+int main() {
+    std::printf("Recording replay against a stand-in plugin\n");
+    TestReplay();
+    TestMalformed();
+    return Test::Finish("replay_test");
+}
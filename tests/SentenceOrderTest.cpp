@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <deque>
+#include <random>
+
+#include "Test.h"
+#include "VoicePlayback.h"
+
+// Where SentenceOrder::Place puts a sentence among queued lines. Then replies whose sentences begin at synthetic
+// times, out of order or not at all, played through VoicePlayback::SentenceOrder by a model of the playback loop
+// on a simulated clock: a line is placed when it begins, and the front line starts once its jitter buffer is full
+// unless it is held for an earlier sentence. Checks the play order, holds and skips, then reports the gaps
+// between sentences and how long holds last for replies synthesized in parallel.
+
+namespace {
+    using VoicePlayback::LineSentence;
+    using VoicePlayback::SentenceOrder;
+    using Clock = SentenceOrder::Clock;
+    using Ms = std::chrono::milliseconds;
+
+    constexpr Ms kJitterBuffer{120};
+    constexpr Ms kReorderWait{300};
+
+    // A sentence as Mantella synthesizes it: it begins, then its audio arrives speed times faster than it plays
+    struct Sentence {
+        LineSentence id;
+        Ms beginAt;
+        Ms duration;
+        double speed = 4.0;
+    };
+
+    struct Played {
+        LineSentence id;
+        Ms startAt;
+        Ms gap{-1};  // silence after the previous sentence of the same reply, -1 for the first one played
+    };
+
+    struct Outcome {
+        std::vector<Played> played;
+        std::vector<Ms> holds;  // how long each hold at the front lasted, until the line started or was displaced
+        std::uint32_t skipped = 0;
+        std::uint32_t reordered = 0;
+    };
+
+    // UpdateActiveLine against a clock that advances 1 ms per pass
+    Outcome Simulate(std::vector<Sentence> sentences) {
+        struct Line {
+            Sentence sentence;
+            bool started = false;
+            Ms endAt{0};
+            std::optional<Ms> readyAt;  // first pass it could have started at the front
+            std::optional<Clock::time_point> heldSince;
+        };
+
+        std::sort(sentences.begin(), sentences.end(),
+                  [](const Sentence& a, const Sentence& b) { return a.beginAt < b.beginAt; });
+        SentenceOrder order;
+        order.SetReorderWait(kReorderWait);
+        Clock::time_point epoch;
+        std::deque<Line> lines;
+        Outcome outcome;
+        std::size_t next = 0;
+
+        for (Ms now{0}; next < sentences.size() || !lines.empty(); now += Ms(1)) {
+            // Lines that began, placed ahead of later sentences of their reply that haven't started
+            for (; next < sentences.size() && sentences[next].beginAt <= now; ++next) {
+                Line line{sentences[next], false, Ms(0), std::nullopt, std::nullopt};
+                auto place = SentenceOrder::Place(lines.begin(), lines.end(), line.sentence.id,
+                                                  [](const Line& queued) -> const LineSentence* {
+                                                      return queued.started ? nullptr : &queued.sentence.id;
+                                                  });
+                if (place != lines.end()) {
+                    if (place->heldSince) {
+                        outcome.holds.push_back(now - *place->readyAt);
+                    }
+                    place->readyAt.reset();
+                    place->heldSince.reset();
+                    ++outcome.reordered;
+                }
+                lines.insert(place, line);
+            }
+            // A line that ended makes way for the next one in the same pass
+            while (!lines.empty() && lines.front().started && now >= lines.front().endAt) {
+                order.Finish(lines.front().sentence.id, epoch + lines.front().endAt);
+                lines.pop_front();
+            }
+            if (lines.empty() || lines.front().started) {
+                continue;
+            }
+
+            // Enough audio for the jitter buffer, or the whole sentence
+            Line& front = lines.front();
+            Ms synthesized(static_cast<Ms::rep>(static_cast<double>((now - front.sentence.beginAt).count()) *
+                                                front.sentence.speed));
+            if (synthesized < std::min(kJitterBuffer, front.sentence.duration)) {
+                continue;
+            }
+            if (!front.readyAt) {
+                front.readyAt = now;
+            }
+            std::uint32_t skipped = 0;
+            if (order.ShouldHold(front.sentence.id, front.heldSince, epoch + now, skipped)) {
+                continue;
+            }
+            outcome.skipped += skipped;
+
+            Played played{front.sentence.id, now};
+            if (order.Follows(front.sentence.id)) {
+                played.gap = std::chrono::duration_cast<Ms>(epoch + now - order.GetLastEnd());
+            }
+            if (front.heldSince) {
+                outcome.holds.push_back(now - *front.readyAt);
+            }
+            outcome.played.push_back(played);
+            front.started = true;
+            // Playback never catches up with a sentence synthesized faster than real time
+            Ms untilSynthesized(static_cast<Ms::rep>(static_cast<double>(front.sentence.duration.count()) /
+                                                     front.sentence.speed));
+            front.endAt = std::max(now + front.sentence.duration, front.sentence.beginAt + untilSynthesized);
+        }
+        return outcome;
+    }
+
+    std::vector<std::uint32_t> PlayOrder(const Outcome& outcome) {
+        std::vector<std::uint32_t> order;
+        for (const Played& played : outcome.played) {
+            order.push_back(played.id.sentence);
+        }
+        return order;
+    }
+
+    LineSentence Id(std::uint32_t reply, std::uint32_t sentence) { return {100 * reply + sentence, reply, sentence}; }
+
+    void TestPlace() {
+        // Queued lines as the playback thread sees them: started or not, and a sentence or a line of its own
+        struct Queued {
+            std::optional<LineSentence> sentence;
+            bool started;
+        };
+        std::vector<Queued> lines = {{Id(1, 3), true}, {std::nullopt, false}, {Id(2, 5), false},
+                                     {Id(1, 4), false}, {Id(1, 6), false}};
+        auto place = [&](const LineSentence& sentence) {
+            auto it = SentenceOrder::Place(lines.begin(), lines.end(), sentence,
+                                           [](const Queued& queued) -> const LineSentence* {
+                                               return queued.started || !queued.sentence ? nullptr : &*queued.sentence;
+                                           });
+            return it - lines.begin();
+        };
+        CHECK(place(Id(1, 2)) == 3);  // not in front of the started sentence 3
+        CHECK(place(Id(1, 4)) == 3);  // the same sentence again goes first
+        CHECK(place(Id(1, 5)) == 4);
+        CHECK(place(Id(1, 7)) == 5);
+        CHECK(place(Id(2, 1)) == 2);
+        CHECK(place(Id(3, 0)) == 5);  // a reply with nothing queued
+    }
+
+    void TestInOrder() {
+        // Each sentence begins while the one before it plays, so the next one starts as soon as it ends
+        Outcome outcome = Simulate({{Id(1, 0), Ms(0), Ms(2000)}, {Id(1, 1), Ms(500), Ms(1500)},
+                                    {Id(1, 2), Ms(900), Ms(1800)}});
+        CHECK((PlayOrder(outcome) == std::vector<std::uint32_t>{0, 1, 2}));
+        CHECK(outcome.played[1].gap == Ms(0) && outcome.played[2].gap == Ms(0));
+        CHECK(outcome.skipped == 0 && outcome.reordered == 0);
+    }
+
+    void TestLateEarlierSentence() {
+        // Sentence 2 begins before sentence 1 and is placed behind it once 1 begins
+        Outcome outcome = Simulate({{Id(1, 0), Ms(0), Ms(2000)}, {Id(1, 2), Ms(300), Ms(1500)},
+                                    {Id(1, 1), Ms(450), Ms(1500)}});
+        CHECK((PlayOrder(outcome) == std::vector<std::uint32_t>{0, 1, 2}));
+        CHECK(outcome.reordered == 1 && outcome.skipped == 0);
+
+        // The front line is held while the sentence before it is still missing, and plays as soon as it begins
+        outcome = Simulate({{Id(1, 0), Ms(0), Ms(300)}, {Id(1, 2), Ms(100), Ms(1500)},
+                            {Id(1, 1), Ms(550), Ms(1500)}});
+        CHECK((PlayOrder(outcome) == std::vector<std::uint32_t>{0, 1, 2}));
+        CHECK(outcome.skipped == 0 && outcome.holds.size() == 1);
+
+        // Sentence 3 is held, then displaced by sentence 1: back at the front it waits afresh for sentence 2
+        outcome = Simulate({{Id(1, 0), Ms(0), Ms(300)}, {Id(1, 3), Ms(50), Ms(1000)},
+                            {Id(1, 1), Ms(400), Ms(1000)}, {Id(1, 2), Ms(1500), Ms(500)}});
+        CHECK((PlayOrder(outcome) == std::vector<std::uint32_t>{0, 1, 2, 3}));
+        CHECK(outcome.skipped == 0 && outcome.holds.size() == 2);
+    }
+
+    void TestMissingSentence() {
+        // Sentence 1 never comes: sentence 2 is held for the reorder wait after sentence 0 ended, then plays
+        Outcome outcome = Simulate({{Id(1, 0), Ms(0), Ms(1000)}, {Id(1, 2), Ms(200), Ms(1000)}});
+        CHECK((PlayOrder(outcome) == std::vector<std::uint32_t>{0, 2}));
+        CHECK(outcome.skipped == 1);
+        CHECK((outcome.holds == std::vector<Ms>{kReorderWait}));
+        CHECK(outcome.played[1].gap == kReorderWait);
+
+        // A sentence that begins after a later one started is played after it instead of being dropped
+        outcome = Simulate({{Id(1, 0), Ms(0), Ms(500)}, {Id(1, 2), Ms(100), Ms(1000)},
+                            {Id(1, 1), Ms(1500), Ms(500)}});
+        CHECK((PlayOrder(outcome) == std::vector<std::uint32_t>{0, 2, 1}));
+        CHECK(outcome.skipped == 1);
+    }
+
+    void TestFirstSentenceOfReply() {
+        // A reply whose first sentence is late holds its second one, the other reply is not affected
+        Outcome outcome = Simulate({{Id(1, 1), Ms(0), Ms(800)}, {Id(1, 0), Ms(100), Ms(800)},
+                                    {Id(2, 0), Ms(200), Ms(500)}, {Id(2, 1), Ms(250), Ms(500)}});
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> order;
+        for (const Played& played : outcome.played) {
+            order.emplace_back(played.id.replyId, played.id.sentence);
+        }
+        CHECK((order == std::vector<std::pair<std::uint32_t, std::uint32_t>>{{1, 0}, {1, 1}, {2, 0}, {2, 1}}));
+        CHECK(outcome.reordered == 1 && outcome.skipped == 0);
+    }
+
+    // Replies of 3 to 8 sentences, from a word to a few seconds long, whose text comes out of the LLM one after
+    // the other and is synthesized by two workers at 1.2 to 4.2 times real time. The message that a sentence
+    // began takes up to 250 ms to arrive, so neighbouring sentences often begin out of order.
+    void TimeParallelSynthesis() {
+        std::mt19937 random(17);
+        std::vector<double> gaps;
+        std::vector<double> held;
+        std::uint32_t reordered = 0;
+        int outOfOrder = 0;
+        for (std::uint32_t reply = 1; reply <= 500; ++reply) {
+            std::uint32_t count = 3 + random() % 6;
+            std::vector<Sentence> sentences;
+            Ms text{0};
+            Ms workers[2] = {Ms(0), Ms(0)};
+            for (std::uint32_t i = 0; i < count; ++i) {
+                text += Ms(50 + random() % 400);
+                Ms& worker = workers[workers[0] <= workers[1] ? 0 : 1];
+                Ms start = std::max(text, worker);
+                // Replies often open with a word or two ("Hm.", "Very well.")
+                Ms duration(i == 0 && random() % 2 ? 150 + random() % 300 : 400 + random() % 2500);
+                Sentence sentence{Id(reply, i), start + Ms(random() % 250), duration, 1.2 + (random() % 31) / 10.0};
+                worker = start + Ms(static_cast<Ms::rep>(static_cast<double>(sentence.duration.count()) /
+                                                         sentence.speed));
+                sentences.push_back(sentence);
+            }
+
+            Outcome outcome = Simulate(sentences);
+            std::vector<std::uint32_t> order = PlayOrder(outcome);
+            outOfOrder += !std::is_sorted(order.begin(), order.end()) || order.size() != count;
+            CHECK(outcome.skipped == 0);
+            reordered += outcome.reordered;
+            for (const Played& played : outcome.played) {
+                if (played.gap >= Ms(0)) {
+                    gaps.push_back(static_cast<double>(played.gap.count()));
+                }
+            }
+            for (Ms hold : outcome.holds) {
+                held.push_back(static_cast<double>(hold.count()));
+            }
+        }
+        CHECK(outOfOrder == 0);
+        std::printf("  %u sentences began ahead of an earlier one of their reply, %zu holds at the front\n",
+                    reordered, held.size());
+        Test::Report("gap between sentences", std::move(gaps));
+        if (!held.empty()) {
+            Test::Report("hold for an earlier sentence", std::move(held));
+        }
+    }
+}
+
+int main() {
+    std::printf("Sentence order with synthetic timings\n");
+    TestPlace();
+    TestInOrder();
+    TestLateEarlierSentence();
+    TestMissingSentence();
+    TestFirstSentenceOfReply();
+    TimeParallelSynthesis();
+    return Test::Finish("sentence_order_test");
+}
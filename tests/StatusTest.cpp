@@ -0,0 +1,162 @@
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "Status.h"
+#include "Test.h"
+
+// Readers copy the seqlock snapshot while two writers keep changing it. Every copy must be one the writers
+// published, never a mix of two. Then times a read alone, next to a writer, and the same copy under a mutex
+// for comparison. Also checks how the launcher status records launches.
+
+namespace {
+    constexpr std::size_t kReaderCount = 3;
+    constexpr std::uint64_t kUpdatesPerWriter = 200000;
+
+    // About the size of Status::Snapshot, every word derived from the first so a torn copy shows
+    struct Payload {
+        std::uint64_t version;
+        std::uint64_t words[23];
+
+        bool IsConsistent() const {
+            for (std::size_t i = 0; i < std::size(words); ++i) {
+                if (words[i] != version * (i + 1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    void Publish(Payload& payload) {
+        ++payload.version;
+        for (std::size_t i = 0; i < std::size(payload.words); ++i) {
+            payload.words[i] = payload.version * (i + 1);
+        }
+    }
+
+    void TestTornReads() {
+        Status::SeqLock<Payload> lock;
+        std::atomic<std::size_t> writersDone{0};
+        std::atomic<std::uint64_t> torn{0};
+        std::atomic<std::uint64_t> reads{0};
+        std::atomic<std::uint64_t> backwards{0};
+
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < kReaderCount; ++i) {
+            threads.emplace_back([&] {
+                std::uint64_t last = 0;
+                std::uint64_t count = 0;
+                while (writersDone.load(std::memory_order_relaxed) < 2) {
+                    Payload payload = lock.Load();
+                    torn += !payload.IsConsistent();
+                    backwards += payload.version < last;  // a reader never sees an older version again
+                    last = payload.version;
+                    ++count;
+                }
+                reads += count;
+            });
+        }
+        for (int writer = 0; writer < 2; ++writer) {
+            threads.emplace_back([&] {
+                for (std::uint64_t i = 0; i < kUpdatesPerWriter; ++i) {
+                    lock.Update(Publish);
+                }
+                ++writersDone;
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        std::printf("  %llu reads during %llu updates\n", static_cast<unsigned long long>(reads.load()),
+                    static_cast<unsigned long long>(2 * kUpdatesPerWriter));
+        CHECK(torn == 0);
+        CHECK(backwards == 0);
+        CHECK(reads > 0);
+        // The writers serialize, no update is lost
+        CHECK(lock.Load().version == 2 * kUpdatesPerWriter);
+        CHECK(lock.Load().IsConsistent());
+    }
+
+    volatile std::uint64_t sink;  // keeps the timed reads from being optimized away
+
+    // ns per read, in batches so the clock doesn't dominate
+    template <class Read>
+    std::vector<double> TimeReads(Read&& read) {
+        constexpr int kBatch = 1000;
+        std::vector<double> samples;
+        std::uint64_t total = 0;
+        for (int batch = 0; batch < 2000; ++batch) {
+            Test::Clock::time_point start = Test::Clock::now();
+            for (int i = 0; i < kBatch; ++i) {
+                total += read().version;
+            }
+            samples.push_back(Test::ElapsedMs(start) * 1e6 / kBatch);
+        }
+        sink = total;
+        return samples;
+    }
+
+    void TimeReaders() {
+        Status::SeqLock<Payload> lock;
+        lock.Update(Publish);
+        Test::Report("seqlock read, no writer", TimeReads([&] { return lock.Load(); }), "ns");
+
+        Payload guarded{};
+        std::mutex mutex;
+        Test::Report("mutex read, no writer", TimeReads([&] {
+                         std::lock_guard guard(mutex);
+                         return guarded;
+                     }),
+                     "ns");
+
+        // A writer updating as fast as it can is far busier than the launcher ever is
+        std::atomic<bool> stop{false};
+        std::thread writer([&] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                lock.Update(Publish);
+                std::lock_guard guard(mutex);
+                Publish(guarded);
+            }
+        });
+        Test::Report("seqlock read, busy writer", TimeReads([&] { return lock.Load(); }), "ns");
+        Test::Report("mutex read, busy writer", TimeReads([&] {
+                         std::lock_guard guard(mutex);
+                         return guarded;
+                     }),
+                     "ns");
+        stop = true;
+        writer.join();
+    }
+
+    void TestLaunchRecords() {
+        Status::RecordLaunchStart();
+        CHECK(Status::Get().state == Status::State::kLaunching);
+        Status::RecordLaunchEnd(false, 0, 12.0, "CreateProcess error: 2");
+        Status::Snapshot failed = Status::Get();
+        CHECK(failed.state == Status::State::kFailed && failed.failures == 1);
+        CHECK(std::string(failed.lastError) == "CreateProcess error: 2");
+
+        // The error of an earlier attempt doesn't outlive a successful launch
+        Status::RecordLaunchStart();
+        Status::RecordLaunchEnd(true, 4242, 30.0);
+        Status::Snapshot running = Status::Get();
+        CHECK(running.state == Status::State::kRunning && running.pid == 4242 && running.launches == 2);
+        CHECK(running.lastError[0] == '\0');
+        CHECK(running.failures == 1);
+        CHECK(running.version > failed.version);
+
+        // Long errors are cut off, not overflowed
+        Status::RecordLaunchEnd(false, 0, 1.0, std::string(1000, 'x'));
+        CHECK(std::string(Status::Get().lastError).size() == sizeof(Status::Snapshot::lastError) - 1);
+    }
+}
+
+int main() {
+    std::printf("Seqlock snapshot under concurrent writers\n");
+    TestTornReads();
+    TimeReaders();
+    TestLaunchRecords();
+    return Test::Finish("status_test");
+}
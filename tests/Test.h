@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+
+/**
+* Checks and timing for the tests
+*
+* The tests build the parts of the plugin that don't need the game on the build host. A failed CHECK
+* prints where it failed and makes the test exit with a failure code at the end, so one run reports every
+* problem. Benchmarks print their percentiles with Report() and check nothing about the timings, since
+* build machines vary too much.
+**/
+namespace Test {
+    using Clock = std::chrono::steady_clock;
+
+    inline int& GetFailures() {
+        static int failures = 0;
+        return failures;
+    }
+
+    inline void Fail(const char* file, int line, const char* condition) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+        ++GetFailures();
+    }
+
+    inline double ElapsedMs(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // One line of percentiles, in the same layout as the in-game benchmark
+    inline void Report(const std::string& name, std::vector<double> samples, const char* unit = "ms") {
+        Benchmark::Summary summary = Benchmark::Summarize(std::move(samples));
+        std::printf("  %-32s n %6zu  p50 %10.3f  p90 %10.3f  p99 %10.3f  max %10.3f %s\n", name.c_str(),
+                    summary.count, summary.p50, summary.p90, summary.p99, summary.max, unit);
+    }
+
+    // Exit code for main
+    inline int Finish(const char* name) {
+        if (GetFailures() > 0) {
+            std::fprintf(stderr, "%s: %d checks failed\n", name, GetFailures());
+            return 1;
+        }
+        std::printf("%s: passed\n", name);
+        return 0;
+    }
+}
+
+#define CHECK(condition)                                \
+    do {                                                \
+        if (!(condition)) {                             \
+            Test::Fail(__FILE__, __LINE__, #condition); \
+        }                                               \
+    } while (false)
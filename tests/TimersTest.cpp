@@ -0,0 +1,192 @@
+#include <map>
+#include <random>
+
+#include "Test.h"
+#include "Timers.h"
+
+// The timing wheel on a synthetic clock: timers fire on the tick they are due and never early, in the order
+// they were due after a stall, repeating timers keep their cadence, restarts and cancels leave stale slot
+// entries that never fire, and a debounced event restarted many times within a tick fires once. Then a burst
+// of debounces and restarts is compared with a plain map of due times, and the cost of the operations timed.
+
+namespace {
+    using Timers::Wheel;
+    using Clock = Wheel::Clock;
+    using Ms = std::chrono::milliseconds;
+
+    const Clock::time_point kStart = Clock::now();
+
+    Clock::time_point At(double ms) {
+        return kStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+    }
+
+    std::vector<std::string> Names(const std::vector<Wheel::Fired>& fired) {
+        std::vector<std::string> names;
+        for (const Wheel::Fired& timer : fired) {
+            names.push_back(timer.eventName);
+        }
+        return names;
+    }
+
+    void TestDueTimes() {
+        Wheel wheel(kStart);
+        std::vector<Wheel::Fired> fired;
+        wheel.Start("b", At(5.5), Ms(0), "arg", 2.0f);
+        wheel.Start("a", At(3.0), Ms(0), {}, 0.0f);
+
+        // The next slot is the first timer's, rounded up to whole ticks
+        CHECK(wheel.Advance(At(0.0), fired) == At(3.0));
+        CHECK(fired.empty());
+        CHECK(wheel.Advance(At(2.9), fired) == At(3.0));
+        CHECK(wheel.Advance(At(3.0), fired) == At(6.0));
+        CHECK((Names(fired) == std::vector<std::string>{"a"}));
+        CHECK(!wheel.Advance(At(6.2), fired).has_value());
+        CHECK((Names(fired) == std::vector<std::string>{"a", "b"}));
+        CHECK(fired[1].strArg == "arg" && fired[1].numArg == 2.0f && fired[1].due == At(5.5));
+        CHECK(wheel.GetSize() == 0);
+
+        // After a stall of several revolutions everything fires once, in the order it was due
+        fired.clear();
+        wheel.Start("late", At(2500.0), Ms(0), {}, 0.0f);
+        wheel.Start("early", At(1200.0), Ms(0), {}, 0.0f);
+        wheel.Start("middle", At(1800.0), Ms(0), {}, 0.0f);
+        CHECK(!wheel.Advance(At(9000.0), fired).has_value());
+        CHECK((Names(fired) == std::vector<std::string>{"early", "middle", "late"}));
+    }
+
+    void TestRepeating() {
+        Wheel wheel(kStart);
+        std::vector<Wheel::Fired> fired;
+        std::uint32_t id = wheel.Start("tick", At(10.0), Ms(10), {}, 0.0f);
+        for (int tick = 10; tick <= 50; ++tick) {
+            wheel.Advance(At(tick), fired);
+        }
+        CHECK(fired.size() == 5 && fired.back().due == At(50.0));
+
+        // Missed periods are not made up for, the cadence restarts from when it fired
+        fired.clear();
+        wheel.Advance(At(95.0), fired);
+        CHECK(fired.size() == 1);
+        CHECK(wheel.Advance(At(96.0), fired) == At(105.0));
+        wheel.Cancel(id);
+        CHECK(!wheel.Advance(At(200.0), fired).has_value() && fired.size() == 1);
+    }
+
+    void TestRestartAndCancel() {
+        Wheel wheel(kStart);
+        std::vector<Wheel::Fired> fired;
+
+        // A debounced event fires once, after the quiet time since the last call, with the last arguments
+        for (int call = 0; call < 5; ++call) {
+            wheel.Debounce("quiet", At(call * 10.0 + 20.0), std::to_string(call), 0.0f);
+            wheel.Advance(At(call * 10.0), fired);
+        }
+        CHECK(fired.empty());
+        CHECK(wheel.Advance(At(59.0), fired) == At(60.0));
+        wheel.Advance(At(60.0), fired);
+        CHECK(fired.size() == 1 && fired[0].strArg == "4");
+
+        // Restarted within the same tick: one entry per call in the same slot, still one event
+        fired.clear();
+        std::uint32_t id = wheel.Debounce("burst", At(80.0), {}, 0.0f);
+        CHECK(wheel.Debounce("burst", At(80.0), {}, 0.0f) == id);
+        CHECK(wheel.Debounce("burst", At(80.0), {}, 0.0f) == id);
+        wheel.Advance(At(80.0), fired);
+        CHECK((Names(fired) == std::vector<std::string>{"burst"}));
+        CHECK(wheel.GetSize() == 0);
+
+        // Debounced again once it fired, under a new ID
+        CHECK(wheel.Debounce("burst", At(90.0), {}, 0.0f) != id);
+        wheel.Advance(At(90.0), fired);
+        CHECK(fired.size() == 2);
+
+        // Cancelled timers never fire, a cancelled debounce starts over and cancelling twice is harmless
+        fired.clear();
+        std::uint32_t cancelled = wheel.Start("cancelled", At(100.0), Ms(0), {}, 0.0f);
+        std::uint32_t debounced = wheel.Debounce("restarted", At(100.0), {}, 0.0f);
+        wheel.Cancel(cancelled);
+        wheel.Cancel(cancelled);
+        wheel.Cancel(debounced);
+        CHECK(wheel.Debounce("restarted", At(110.0), {}, 0.0f) != debounced);
+        CHECK(wheel.Advance(At(105.0), fired) == At(110.0));
+        CHECK(fired.empty());
+        wheel.Advance(At(110.0), fired);
+        CHECK((Names(fired) == std::vector<std::string>{"restarted"}));
+
+        // A debounce pushed a revolution later fires only then
+        fired.clear();
+        wheel.Debounce("far", At(120.0), {}, 0.0f);
+        wheel.Debounce("far", At(120.0 + 1024.0), {}, 0.0f);
+        for (int tick = 111; tick <= 1200; ++tick) {
+            wheel.Advance(At(tick), fired);
+        }
+        CHECK(fired.size() == 1 && fired[0].due == At(1144.0));
+    }
+
+    // Random starts, debounces and cancels against the due times they should fire at
+    void TestAgainstModel() {
+        Wheel wheel(kStart);
+        std::mt19937 random(5);
+        std::map<std::string, double> expected;  // event name to due time, in ms
+        std::map<std::string, std::uint32_t> ids;
+        std::vector<Wheel::Fired> fired;
+        int wrong = 0;
+        for (int tick = 0; tick < 20000; ++tick) {
+            for (int call = random() % 4; call > 0; --call) {
+                std::string name = "event" + std::to_string(random() % 50);
+                double due = tick + static_cast<double>(random() % 1500);
+                if (random() % 8 == 0 && ids.contains(name)) {
+                    wheel.Cancel(ids[name]);
+                    expected.erase(name);
+                    ids.erase(name);
+                } else {
+                    ids[name] = wheel.Debounce(name, At(due), {}, 0.0f);
+                    expected[name] = due;
+                }
+            }
+            fired.clear();
+            wheel.Advance(At(tick), fired);
+            for (const Wheel::Fired& timer : fired) {
+                auto it = expected.find(timer.eventName);
+                wrong += it == expected.end() || At(it->second) != timer.due || it->second > tick;
+                expected.erase(timer.eventName);
+                ids.erase(timer.eventName);
+            }
+            for (const auto& [name, due] : expected) {
+                wrong += due <= tick;  // should have fired by now
+            }
+        }
+        CHECK(wrong == 0);
+    }
+
+    void TimeWheel() {
+        Wheel wheel(kStart);
+        std::mt19937 random(9);
+        std::vector<double> debounceNs;
+        std::vector<double> advanceNs;
+        std::vector<Wheel::Fired> fired;
+        for (int tick = 0; tick < 2000; ++tick) {
+            Test::Clock::time_point start = Test::Clock::now();
+            for (int i = 0; i < 100; ++i) {
+                wheel.Debounce("event" + std::to_string(random() % 500), At(tick + 50.0 + random() % 500), {}, 0.0f);
+            }
+            debounceNs.push_back(Test::ElapsedMs(start) * 1e6 / 100);
+
+            start = Test::Clock::now();
+            wheel.Advance(At(tick), fired);
+            advanceNs.push_back(Test::ElapsedMs(start) * 1e6);
+        }
+        Test::Report("debounce", std::move(debounceNs), "ns");
+        Test::Report("advance one tick", std::move(advanceNs), "ns");
+    }
+}
+
+int main() {
+    std::printf("Timer wheel on a synthetic clock\n");
+    TestDueTimes();
+    TestRepeating();
+    TestRestartAndCancel();
+    TestAgainstModel();
+    TimeWheel();
+    return Test::Finish("timers_test");
+}
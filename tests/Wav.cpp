@@ -0,0 +1,156 @@
+#include "Wav.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numbers>
+#include <sstream>
+
+namespace Wav {
+    namespace {
+        template <class T>
+        T ReadValue(const std::vector<char>& data, std::size_t offset) {
+            T value;
+            std::memcpy(&value, data.data() + offset, sizeof(T));
+            return value;
+        }
+
+        void ReadLabels(const std::filesystem::path& path, Clip& clip) {
+            std::ifstream file(path);
+            std::string line;
+            while (std::getline(file, line)) {
+                std::istringstream fields(line);
+                double start = 0.0;
+                double end = 0.0;
+                if (fields >> start >> end && end > start) {
+                    clip.speech.emplace_back(start, end);
+                }
+            }
+        }
+    }
+
+    bool Read(const std::filesystem::path& path, Clip& clip) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.size() < 12 || std::memcmp(data.data(), "RIFF", 4) != 0 ||
+            std::memcmp(data.data() + 8, "WAVE", 4) != 0) {
+            return false;
+        }
+
+        std::uint16_t format = 0;
+        std::uint16_t bits = 0;
+        clip = {};
+        clip.name = path.filename().string();
+        for (std::size_t offset = 12; offset + 8 <= data.size();) {
+            auto size = static_cast<std::size_t>(ReadValue<std::uint32_t>(data, offset + 4));
+            std::size_t body = offset + 8;
+            size = std::min(size, data.size() - body);
+            if (std::memcmp(data.data() + offset, "fmt ", 4) == 0 && size >= 16) {
+                format = ReadValue<std::uint16_t>(data, body);
+                clip.channels = ReadValue<std::uint16_t>(data, body + 2);
+                clip.sampleRate = ReadValue<std::uint32_t>(data, body + 4);
+                bits = ReadValue<std::uint16_t>(data, body + 14);
+                if (format == 0xFFFE && size >= 26) {
+                    format = ReadValue<std::uint16_t>(data, body + 24);  // first field of the sub-format GUID
+                }
+            } else if (std::memcmp(data.data() + offset, "data", 4) == 0) {
+                if (format == 1 && bits == 16) {
+                    for (std::size_t i = 0; i + 2 <= size; i += 2) {
+                        clip.samples.push_back(ReadValue<std::int16_t>(data, body + i) / 32768.0f);
+                    }
+                } else if (format == 3 && bits == 32) {
+                    for (std::size_t i = 0; i + 4 <= size; i += 4) {
+                        clip.samples.push_back(ReadValue<float>(data, body + i));
+                    }
+                } else {
+                    return false;
+                }
+            }
+            offset = body + size + (size & 1);
+        }
+        if (clip.channels == 0 || clip.sampleRate == 0) {
+            return false;
+        }
+
+        std::filesystem::path labels = path;
+        ReadLabels(labels.replace_extension(".txt"), clip);
+        return true;
+    }
+
+    Clip Synthesize(std::string name, std::uint32_t sampleRate, std::uint32_t channels, double seconds,
+                    std::vector<std::pair<double, double>> speech, float noiseLevel, std::uint32_t seed) {
+        Clip clip;
+        clip.name = std::move(name);
+        clip.sampleRate = sampleRate;
+        clip.channels = channels;
+        clip.speech = std::move(speech);
+
+        auto frames = static_cast<std::size_t>(seconds * sampleRate);
+        clip.samples.resize(frames * channels);
+        std::uint32_t random = seed | 1;
+        double phase = 0.0;
+        for (std::size_t i = 0; i < frames; ++i) {
+            double t = static_cast<double>(i) / sampleRate;
+            double pitch = 120.0 + 30.0 * std::sin(2.0 * std::numbers::pi * 0.7 * t);
+            phase += 2.0 * std::numbers::pi * pitch / sampleRate;
+
+            double envelope = 0.0;
+            for (auto [start, end] : clip.speech) {
+                if (t >= start && t < end) {
+                    // 20 ms ramps at the edges, syllables at 4 Hz in between
+                    double ramp = std::min({1.0, (t - start) / 0.02, (end - t) / 0.02});
+                    envelope = ramp * (0.55 + 0.45 * std::sin(2.0 * std::numbers::pi * 4.0 * (t - start)));
+                }
+            }
+            double voice = 0.0;
+            if (envelope > 0.0) {
+                for (int harmonic = 1; harmonic <= 10 && harmonic * pitch < 0.45 * sampleRate; ++harmonic) {
+                    voice += std::sin(harmonic * phase) / harmonic;
+                }
+            }
+
+            // xorshift32, uniform noise scaled to the requested RMS level
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            double noise = (static_cast<double>(random) / 4294967296.0 * 2.0 - 1.0) * std::sqrt(3.0) * noiseLevel;
+
+            auto sample = static_cast<float>(0.12 * envelope * voice + noise);
+            for (std::uint32_t channel = 0; channel < channels; ++channel) {
+                clip.samples[i * channels + channel] = sample;
+            }
+        }
+        return clip;
+    }
+
+    std::vector<Clip> LoadCorpus(int argc, char** argv) {
+        std::vector<Clip> corpus;
+        if (argc > 1) {
+            std::vector<std::filesystem::path> paths;
+            for (const auto& entry : std::filesystem::directory_iterator(argv[1])) {
+                if (entry.path().extension() == ".wav") {
+                    paths.push_back(entry.path());
+                }
+            }
+            std::sort(paths.begin(), paths.end());
+            for (const auto& path : paths) {
+                Clip clip;
+                if (Read(path, clip)) {
+                    corpus.push_back(std::move(clip));
+                } else {
+                    std::fprintf(stderr, "Skipping %s, only 16-bit PCM and 32-bit float WAV files are read\n",
+                                 path.string().c_str());
+                }
+            }
+            return corpus;
+        }
+
+        corpus.push_back(Synthesize("clean_48k_stereo", 48000, 2, 4.5, {{0.5, 1.7}, {2.4, 3.3}}, 0.0005f, 1));
+        corpus.push_back(Synthesize("noisy_44k_mono", 44100, 1, 4.0, {{0.8, 2.2}}, 0.003f, 2));
+        corpus.push_back(
+            Synthesize("short_words_16k_mono", 16000, 1, 4.5, {{0.3, 0.6}, {1.3, 1.6}, {2.4, 3.2}}, 0.001f, 3));
+        return corpus;
+    }
+}
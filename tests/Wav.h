@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+* WAV input for the audio tests
+*
+* A corpus is either every .wav file in a directory given on the command line, or a few synthetic clips
+* with voice-like bursts over noise when none is given. Synthetic clips know where their speech is. For
+* recorded files, an Audacity label file next to them ("<name>.txt", one "start<TAB>end<TAB>label" line
+* per utterance, in seconds) says where the speech is; without one only what needs no labels is checked.
+**/
+namespace Wav {
+    struct Clip {
+        std::string name;
+        std::uint32_t sampleRate = 0;
+        std::uint32_t channels = 0;
+        std::vector<float> samples;                      // interleaved
+        std::vector<std::pair<double, double>> speech;  // start and end of every utterance, in seconds
+
+        std::size_t GetFrames() const { return channels > 0 ? samples.size() / channels : 0; }
+        double GetSeconds() const { return static_cast<double>(GetFrames()) / sampleRate; }
+    };
+
+    // 16-bit PCM or 32-bit float files
+    bool Read(const std::filesystem::path& path, Clip& clip);
+
+    // Harmonics of a slowly gliding pitch, modulated at a syllable rate, inside each speech interval; white
+    // noise of the given RMS level everywhere
+    Clip Synthesize(std::string name, std::uint32_t sampleRate, std::uint32_t channels, double seconds,
+                    std::vector<std::pair<double, double>> speech, float noiseLevel, std::uint32_t seed);
+
+    // The files in the directory given as the first argument, or the synthetic corpus
+    std::vector<Clip> LoadCorpus(int argc, char** argv);
+}
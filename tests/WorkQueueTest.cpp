@@ -0,0 +1,195 @@
+#include <atomic>
+#include <thread>
+
+#include "MainThread.h"
+#include "Test.h"
+
+// The main thread's scheduling policy on its own: a slice stops once the budget is spent but always runs one
+// item, only runs what was queued when it started, identical keyed work waits only once, and what is left
+// over is reported. Then producers push from several threads while slices drain, and the cost of pushing
+// and draining an item is timed.
+
+namespace {
+    using MainThread::WorkQueue;
+    using namespace std::chrono_literals;
+
+    // Busy, not sleeping, so the item takes at least this long however the host schedules the thread
+    void Spin(WorkQueue::Clock::duration duration) {
+        WorkQueue::Clock::time_point end = WorkQueue::Clock::now() + duration;
+        while (WorkQueue::Clock::now() < end) {
+        }
+    }
+
+    void TestBudget() {
+        WorkQueue queue;
+        int ran = 0;
+        for (int i = 0; i < 100; ++i) {
+            queue.Push([&] {
+                Spin(100us);
+                ++ran;
+            });
+        }
+        // Stops at the first item that ends past the budget
+        WorkQueue::Stats stats = queue.Drain(500us);
+        CHECK(stats.ran >= 1 && stats.ran <= 5);
+        CHECK(stats.ran == static_cast<std::size_t>(ran));
+        CHECK(stats.remaining == 100 - stats.ran);
+        CHECK(stats.remaining == queue.GetSize());
+        CHECK(stats.elapsed >= 500us);
+
+        // A budget larger than the work runs all of it
+        std::size_t first = stats.ran;
+        stats = queue.Drain(10s);
+        CHECK(stats.ran == 100 - first);
+        CHECK(ran == 100 && stats.remaining == 0 && queue.GetSize() == 0);
+
+        // An empty queue runs nothing
+        stats = queue.Drain(500us);
+        CHECK(stats.ran == 0 && stats.remaining == 0);
+    }
+
+    void TestOneItemPerSlice() {
+        WorkQueue queue;
+        for (int i = 0; i < 3; ++i) {
+            queue.Push([] { Spin(2ms); });
+        }
+        // Every item is over the budget, still each slice makes progress
+        for (std::size_t remaining : {2, 1, 0}) {
+            WorkQueue::Stats stats = queue.Drain(500us);
+            CHECK(stats.ran == 1 && stats.remaining == remaining);
+            CHECK(stats.elapsed >= 2ms);
+        }
+        queue.Push([] {});
+        CHECK(queue.Drain(WorkQueue::Clock::duration::zero()).ran == 1);
+    }
+
+    void TestQueuedDuringDrain() {
+        WorkQueue queue;
+        std::vector<int> order;
+        queue.Push([&] {
+            order.push_back(1);
+            queue.Push([&] { order.push_back(3); });  // work that posts more work
+        });
+        queue.Push([&] { order.push_back(2); });
+
+        // What was pushed during the slice waits for the next one
+        WorkQueue::Stats stats = queue.Drain(10s);
+        CHECK(stats.ran == 2 && stats.remaining == 1);
+        stats = queue.Drain(10s);
+        CHECK(stats.ran == 1 && stats.remaining == 0);
+        CHECK((order == std::vector<int>{1, 2, 3}));
+
+        // How long the oldest item waited
+        queue.Push([] {});
+        std::this_thread::sleep_for(5ms);
+        CHECK(queue.Drain(10s).longestWait >= 5ms);
+    }
+
+    void TestCoalescing() {
+        WorkQueue queue;
+        std::vector<std::string> sent;
+        auto send = [&](std::string name) { return [&sent, name] { sent.push_back(name); }; };
+
+        CHECK(queue.Push(send("Mantella_Ready"), "Mantella_Ready"));
+        CHECK(!queue.Push(send("Mantella_Ready"), "Mantella_Ready"));
+        CHECK(queue.Push(send("Mantella_VoiceFile"), "Mantella_VoiceFile"));
+        CHECK(queue.Push(send("unkeyed")));
+        CHECK(queue.Push(send("unkeyed")));  // work without a key is never dropped
+        CHECK(!queue.Push(send("Mantella_VoiceFile"), "Mantella_VoiceFile"));
+        CHECK(queue.GetSize() == 4);
+
+        // Once the first one ran, the same event can be queued again
+        WorkQueue::Stats stats = queue.Drain(WorkQueue::Clock::duration::zero());
+        CHECK(stats.ran == 1 && stats.remaining == 3);
+        CHECK(queue.Push(send("Mantella_Ready"), "Mantella_Ready"));
+        CHECK(!queue.Push(send("Mantella_VoiceFile"), "Mantella_VoiceFile"));
+        queue.Drain(10s);
+        CHECK((sent == std::vector<std::string>{"Mantella_Ready", "Mantella_VoiceFile", "unkeyed", "unkeyed",
+                                                "Mantella_Ready"}));
+    }
+
+    // Producers on other threads while the "main thread" drains a slice per frame
+    void TestConcurrentProducers() {
+        constexpr int kProducers = 4;
+        constexpr int kPerProducer = 20000;
+        WorkQueue queue;
+        std::vector<std::vector<int>> seen(kProducers);
+        std::atomic<int> producersDone{0};
+
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < kProducers; ++producer) {
+            producers.emplace_back([&, producer] {
+                for (int i = 0; i < kPerProducer; ++i) {
+                    queue.Push([&seen, producer, i] { seen[producer].push_back(i); });
+                    if (i % 16 == 0) {
+                        // Keyed duplicates from every producer, most of them coalesced
+                        queue.Push([] {}, "Mantella_Tick");
+                    }
+                }
+                ++producersDone;
+            });
+        }
+
+        std::size_t slices = 0;
+        std::size_t deferredSlices = 0;
+        while (producersDone < kProducers || queue.GetSize() > 0) {
+            WorkQueue::Stats stats = queue.Drain(200us);
+            ++slices;
+            deferredSlices += stats.remaining > 0;
+        }
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+
+        int outOfOrder = 0;
+        for (const std::vector<int>& items : seen) {
+            CHECK(items.size() == kPerProducer);
+            for (std::size_t i = 0; i < items.size(); ++i) {
+                outOfOrder += items[i] != static_cast<int>(i);
+            }
+        }
+        CHECK(outOfOrder == 0);
+        std::printf("  %zu slices, %zu left work for the next one\n", slices, deferredSlices);
+    }
+
+    void TimeQueue() {
+        WorkQueue queue;
+        std::vector<double> pushNs;
+        std::vector<double> drainNs;
+        std::vector<double> coalescedNs;
+        int counter = 0;
+        for (int batch = 0; batch < 200; ++batch) {
+            Test::Clock::time_point start = Test::Clock::now();
+            for (int i = 0; i < 100; ++i) {
+                queue.Push([&counter] { ++counter; });
+            }
+            pushNs.push_back(Test::ElapsedMs(start) * 1e6 / 100);
+
+            queue.Push([] {}, "Mantella_Tick");
+            start = Test::Clock::now();
+            for (int i = 0; i < 100; ++i) {
+                queue.Push([] {}, "Mantella_Tick");
+            }
+            coalescedNs.push_back(Test::ElapsedMs(start) * 1e6 / 100);
+
+            start = Test::Clock::now();
+            WorkQueue::Stats stats = queue.Drain(10s);
+            drainNs.push_back(Test::ElapsedMs(start) * 1e6 / static_cast<double>(stats.ran));
+        }
+        CHECK(counter == 200 * 100);
+        Test::Report("push", std::move(pushNs), "ns");
+        Test::Report("push, coalesced", std::move(coalescedNs), "ns");
+        Test::Report("drain per item", std::move(drainNs), "ns");
+    }
+}
+
+int main() {
+    std::printf("Main thread work queue\n");
+    TestBudget();
+    TestOneItemPerSlice();
+    TestQueuedDuringDrain();
+    TestCoalescing();
+    TestConcurrentProducers();
+    TimeQueue();
+    return Test::Finish("work_queue_test");
+}
@@ -0,0 +1,260 @@
+#include <latch>
+#include <set>
+
+#include "Test.h"
+#include "WorkerPool.h"
+
+// The pool's scheduling policy on its own: queued jobs start by priority, idle workers take jobs another worker
+// spawned, and while the pool holds back only high priority jobs start, running jobs wait at their checkpoints
+// and a worker waiting there still runs high priority jobs. Cancelled jobs are dropped, ParallelFor runs every
+// item once and stops for a cancelled caller. Then the cost of submitting and running a job is timed.
+
+namespace {
+    using WorkerPool::Job;
+    using WorkerPool::Pool;
+    using WorkerPool::Priority;
+    using namespace std::chrono_literals;
+
+    // Set once from one thread and waited for from another
+    class Flag {
+    public:
+        void Set() {
+            std::lock_guard guard(_lock);
+            _set = true;
+            _changed.notify_all();
+        }
+
+        bool WaitFor(std::chrono::milliseconds timeout) {
+            std::unique_lock guard(_lock);
+            return _changed.wait_for(guard, timeout, [&] { return _set; });
+        }
+
+    private:
+        std::mutex _lock;
+        std::condition_variable _changed;
+        bool _set = false;
+    };
+
+    // Hold the only worker until released, so what is submitted meanwhile queues up
+    struct Blocker {
+        Flag started;
+        Flag release;
+
+        void Occupy(Pool& pool) {
+            pool.Submit("blocker", Priority::kHigh, [this](Job&) {
+                started.Set();
+                release.WaitFor(10s);
+            });
+            started.WaitFor(10s);
+        }
+    };
+
+    void TestPriorities() {
+        Pool pool;
+        pool.Start(1);
+        Blocker blocker;
+        blocker.Occupy(pool);
+
+        std::mutex lock;
+        std::vector<std::string> order;
+        Flag done;
+        auto record = [&](std::string name) {
+            return [&, name](Job&) {
+                std::lock_guard guard(lock);
+                order.push_back(name);
+                if (order.size() == 4) {
+                    done.Set();
+                }
+            };
+        };
+        pool.Submit("low", Priority::kLow, record("low"));
+        pool.Submit("normal", Priority::kNormal, record("normal"));
+        pool.Submit("high", Priority::kHigh, record("high"));
+        pool.Submit("normal", Priority::kNormal, record("normal"));
+        blocker.release.Set();
+        CHECK(done.WaitFor(10s));
+        CHECK((order == std::vector<std::string>{"high", "normal", "normal", "low"}));
+    }
+
+    void TestEarlySubmit() {
+        Pool pool;
+        Flag ran;
+        pool.Submit("early", Priority::kNormal, [&](Job&) { ran.Set(); });
+        CHECK(!ran.WaitFor(20ms));
+        pool.Start(2);
+        CHECK(ran.WaitFor(10s));
+    }
+
+    void TestStealing() {
+        Pool pool;
+        pool.Start(2);
+        // Jobs spawned by a worker go to its own queue, and it blocks until they ran: only stealing runs them
+        constexpr int kSpawned = 20;
+        std::latch spawnedDone(kSpawned);
+        std::mutex lock;
+        std::set<std::thread::id> threads;
+        Flag finished;
+        pool.Submit("spawner", Priority::kNormal, [&](Job&) {
+            for (int i = 0; i < kSpawned; ++i) {
+                pool.Submit("spawned", Priority::kNormal, [&](Job&) {
+                    {
+                        std::lock_guard guard(lock);
+                        threads.insert(std::this_thread::get_id());
+                    }
+                    spawnedDone.count_down();
+                });
+            }
+            spawnedDone.wait();
+            finished.Set();
+        });
+        CHECK(finished.WaitFor(10s));
+        CHECK(threads.size() == 1);
+    }
+
+    void TestHoldBack() {
+        Pool pool;
+        pool.Start(1);
+        pool.SetHoldBack(true);
+
+        // Normal and low jobs wait, high ones start
+        Flag normalRan;
+        Flag highRan;
+        pool.Submit("normal", Priority::kNormal, [&](Job&) { normalRan.Set(); });
+        pool.Submit("high", Priority::kHigh, [&](Job&) { highRan.Set(); });
+        CHECK(highRan.WaitFor(10s));
+        CHECK(!normalRan.WaitFor(50ms));
+        pool.SetHoldBack(false);
+        CHECK(normalRan.WaitFor(10s));
+
+        // A running job waits at its checkpoint, and the parked worker still runs high priority jobs
+        Flag started;
+        Flag passed;
+        Flag mayHoldBack;
+        pool.Submit("long", Priority::kLow, [&](Job& job) {
+            started.Set();
+            mayHoldBack.WaitFor(10s);
+            if (job.Checkpoint()) {
+                passed.Set();
+            }
+        });
+        CHECK(started.WaitFor(10s));
+        pool.SetHoldBack(true);
+        mayHoldBack.Set();
+        CHECK(!passed.WaitFor(50ms));
+        Flag urgent;
+        pool.Submit("urgent", Priority::kHigh, [&](Job&) { urgent.Set(); });
+        CHECK(urgent.WaitFor(10s));
+        CHECK(!passed.WaitFor(20ms));
+        pool.SetHoldBack(false);
+        CHECK(passed.WaitFor(10s));
+
+        // High priority jobs never wait at their checkpoints
+        pool.SetHoldBack(true);
+        Flag highPassed;
+        pool.Submit("high", Priority::kHigh, [&](Job& job) {
+            if (job.Checkpoint()) {
+                highPassed.Set();
+            }
+        });
+        CHECK(highPassed.WaitFor(10s));
+        pool.SetHoldBack(false);
+    }
+
+    void TestCancel() {
+        Pool pool;
+        pool.Start(1);
+        Blocker blocker;
+        blocker.Occupy(pool);
+        Flag ran;
+        std::shared_ptr<Job> job = pool.Submit("dropped", Priority::kNormal, [&](Job&) { ran.Set(); });
+        job->Cancel();
+        blocker.release.Set();
+        CHECK(!ran.WaitFor(50ms));
+
+        // A job waiting at its checkpoint is released by cancelling it
+        Flag started;
+        Flag mayHoldBack;
+        Flag stopped;
+        std::atomic<bool> checkpoint{true};
+        std::shared_ptr<Job> waiting = pool.Submit("waiting", Priority::kNormal, [&](Job& self) {
+            started.Set();
+            mayHoldBack.WaitFor(10s);
+            checkpoint = self.Checkpoint();
+            stopped.Set();
+        });
+        CHECK(started.WaitFor(10s));
+        pool.SetHoldBack(true);
+        mayHoldBack.Set();
+        CHECK(!stopped.WaitFor(50ms));
+        waiting->Cancel();
+        CHECK(stopped.WaitFor(10s));
+        CHECK(!checkpoint);
+        pool.SetHoldBack(false);
+    }
+
+    void TestParallelFor() {
+        Pool pool;
+        pool.Start(3);
+        std::vector<std::atomic<int>> runs(1000);
+        CHECK(pool.ParallelFor("items", runs.size(), [&](std::size_t i) { ++runs[i]; }));
+        int wrong = 0;
+        for (const std::atomic<int>& count : runs) {
+            wrong += count != 1;
+        }
+        CHECK(wrong == 0);
+        CHECK(pool.ParallelFor("empty", 0, [](std::size_t) {}));
+
+        // Finishes on the calling thread while the pool holds back
+        pool.SetHoldBack(true);
+        std::atomic<int> held{0};
+        CHECK(pool.ParallelFor("held", 100, [&](std::size_t) { ++held; }));
+        CHECK(held == 100);
+        pool.SetHoldBack(false);
+
+        // A cancelled caller drops the items nobody took yet
+        Flag finished;
+        std::atomic<int> ran{0};
+        bool completed = true;
+        pool.Submit("caller", Priority::kNormal, [&](Job& job) {
+            completed = pool.ParallelFor(
+                "cancelled", 1000,
+                [&](std::size_t) {
+                    if (++ran == 10) {
+                        job.Cancel();
+                    }
+                },
+                &job);
+            finished.Set();
+        });
+        CHECK(finished.WaitFor(10s));
+        CHECK(!completed && ran < 1000);
+    }
+
+    void TimePool() {
+        Pool pool;
+        pool.Start(2);
+        std::vector<double> jobUs;
+        for (int batch = 0; batch < 200; ++batch) {
+            std::latch done(100);
+            Test::Clock::time_point start = Test::Clock::now();
+            for (int i = 0; i < 100; ++i) {
+                pool.Submit("empty", Priority::kNormal, [&](Job&) { done.count_down(); });
+            }
+            done.wait();
+            jobUs.push_back(Test::ElapsedMs(start) * 1000.0 / 100);
+        }
+        Test::Report("submit and run", std::move(jobUs), "us");
+    }
+}
+
+int main() {
+    std::printf("Worker pool scheduling\n");
+    TestPriorities();
+    TestEarlySubmit();
+    TestStealing();
+    TestHoldBack();
+    TestCancel();
+    TestParallelFor();
+    TimePool();
+    return Test::Finish("worker_pool_test");
+}